@@ -0,0 +1,45 @@
+; collatz.asm - steps for memory[0] to reach 1 under n -> n/2 or 3n+1
+; Meant for --batch, which puts each input line into memory[0..]:
+;   seq 1 100000 > seeds.txt && vm --batch seeds.txt collatz.asm
+; memory[0] = n, memory[1] = steps; a seed of 0 prints 0
+loop:
+    PUSH 0
+    LOAD
+    JZ done      ; n == 0
+    PUSH 0
+    LOAD
+    PUSH 1
+    SUB
+    JZ done      ; n == 1
+    PUSH 1
+    LOAD
+    INC
+    PUSH 1
+    STORE        ; steps += 1
+    PUSH 0
+    LOAD
+    PUSH 2
+    MOD
+    JZ even
+    PUSH 0
+    LOAD
+    PUSH 3
+    MUL
+    INC
+    PUSH 0
+    STORE        ; n = 3n + 1
+    JMP loop
+even:
+    PUSH 0
+    LOAD
+    PUSH 2
+    DIV
+    PUSH 0
+    STORE        ; n = n / 2
+    JMP loop
+
+done:
+PUSH 1
+LOAD
+PRINT
+HALT
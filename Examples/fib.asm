@@ -1,17 +1,34 @@
 ; fib.asm - Fibonacci with float (just for fun)
+; a and b live in memory[0..1] and memory[2..3] (STOREF/LOADF)
 main:
     PUSHF 1.0
+    PUSH 0
+    STOREF          ; a = 1
     PUSHF 1.0
+    PUSH 2
+    STOREF          ; b = 1
     PUSH 20
 loop:
     DUP
     JZ done
+    DUP
     PRINT           ; print counter
+    PUSH 0
+    LOADF
+    PUSH 2
+    LOADF
     ADDF            ; a + b
-    ROT             ; c b a → b a c
-    SWAP            ; b c a
+    PUSH 2
+    LOADF
+    PUSH 0
+    STOREF          ; a = b
+    PUSH 2
+    STOREF          ; b = a + b
     DEC
     JMP loop
 done:
+    POP
+    PUSH 2
+    LOADF
     PRINT           ; print last fib
-    HALT
\ No newline at end of file
+    HALT
@@ -1,13 +1,21 @@
-PUSH 3.5
+; float_test.asm - float arithmetic and compare-and-jump
+PUSHF 3.5
 PUSHF 1.2
 SUBF
+DUP
+PRINT        ; 2.3
 PUSHF 2.3
-CMP
-JG yes
+CMP          ; -1, 0 or 1: (3.5 - 1.2) against 2.3
+PRINT
+PUSHF 3.5
+PUSHF 1.2
+SUBF
+PUSHF 2.3
+JG yes       ; jump if (3.5 - 1.2) > 2.3
 PUSH 0
 JMP done
 yes:
 PUSH 1
 done:
 PRINT
-HALT
\ No newline at end of file
+HALT
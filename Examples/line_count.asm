@@ -0,0 +1,48 @@
+; line_count.asm - count the newlines of a data file: vm --data file line_count.asm
+; With the default memory the file is at byte 16384 (cell 4096) and its
+; length in bytes is in memory[4095].
+; memory[0] = byte address, memory[1] = end address, memory[2] = count
+PUSH 4095
+LOAD
+PUSH 16384
+ADD
+PUSH 1
+STORE        ; memory[1] = 16384 + length
+
+PUSH 16384
+PUSH 0
+STORE        ; memory[0] = 16384
+
+loop:
+    PUSH 0
+    LOAD
+    PUSH 1
+    LOAD
+    SUB
+    JZ done      ; address == end
+    PUSH 0
+    LOAD
+    LOADB        ; the byte at the address
+    PUSH 10
+    SUB
+    JZ newline
+next:
+    PUSH 0
+    LOAD
+    INC
+    PUSH 0
+    STORE
+    JMP loop
+newline:
+    PUSH 2
+    LOAD
+    INC
+    PUSH 2
+    STORE
+    JMP next
+
+done:
+PUSH 2
+LOAD
+PRINT
+HALT
@@ -0,0 +1,51 @@
+; sum_numbers.asm - add up the integers in a data file: vm --data file sum_numbers.asm
+; CALLN atoi parses the number at a byte address and also returns the
+; address after it; a byte that starts no number is skipped.
+; memory[0] = byte address, memory[1] = end address, memory[2] = sum
+PUSH 4095
+LOAD
+PUSH 16384
+ADD
+PUSH 1
+STORE        ; memory[1] = 16384 + length
+
+PUSH 16384
+PUSH 0
+STORE        ; memory[0] = 16384
+
+loop:
+    PUSH 0
+    LOAD
+    PUSH 1
+    LOAD
+    JGE done     ; address >= end
+    PUSH 0
+    LOAD
+    CALLN atoi   ; value, address after it
+    DUP
+    PUSH 0
+    LOAD
+    JE skip      ; no number here
+    PUSH 0
+    STORE
+    PUSH 2
+    LOAD
+    ADD
+    PUSH 2
+    STORE
+    JMP loop
+skip:
+    POP
+    POP
+    PUSH 0
+    LOAD
+    INC
+    PUSH 0
+    STORE
+    JMP loop
+
+done:
+PUSH 2
+LOAD
+PRINT
+HALT
@@ -0,0 +1,51 @@
+; typed_memory.asm - doubles in memory (two cells each) and block ops
+; a[i] = i * 0.5 at cells 100, 102, 104, 106; then sum, copy and compare
+PUSHF 0.0
+PUSH 100
+STOREF
+PUSHF 0.5
+PUSH 102
+STOREF
+PUSHF 1.0
+PUSH 104
+STOREF
+PUSHF 1.5
+PUSH 106
+STOREF
+
+PUSH 100
+LOADF
+PUSH 102
+LOADF
+ADDF
+PUSH 104
+LOADF
+ADDF
+PUSH 106
+LOADF
+ADDF
+PRINT        ; 3
+
+PUSH 200     ; dst
+PUSH 100     ; src
+PUSH 8       ; cells
+MEMCPY       ; copy the whole array
+PUSH 200
+PUSH 100
+PUSH 8
+MEMCMP
+PRINT        ; 0: equal
+
+PUSH 202
+PUSH 0
+PUSH 2
+MEMSET       ; zero the copy's second double
+PUSH 202
+LOADF
+PRINT        ; 0
+PUSH 200
+PUSH 100
+PUSH 8
+MEMCMP
+PRINT        ; -1: the copy now sorts first
+HALT
@@ -0,0 +1,26 @@
+; float.asm - float arithmetic: x = x * 0.999999 + 1.0, 5000000 times, with
+; x in memory[0..1]
+; expect: 993262
+PUSHF 0.0
+PUSH 0
+STOREF
+PUSH 5000000
+loop:
+    DUP
+    JZ done
+    PUSH 0
+    LOADF
+    PUSHF 0.999999
+    MULF
+    PUSHF 1.0
+    ADDF
+    PUSH 0
+    STOREF
+    PUSH 1
+    SUB
+    JMP loop
+done:
+    PUSH 0
+    LOADF
+    PRINT
+    HALT
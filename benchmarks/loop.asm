@@ -0,0 +1,23 @@
+; loop.asm - a tight loop: acc = acc * 31 + i for i = 10000000 down to 1,
+; the counter on the stack and acc in memory[0]
+; expect: -1559350080
+PUSH 10000000
+loop:
+    DUP
+    JZ done
+    DUP
+    PUSH 0
+    LOAD
+    PUSH 31
+    MUL
+    ADD
+    PUSH 0
+    STORE        ; acc = acc * 31 + i
+    PUSH 1
+    SUB
+    JMP loop
+done:
+    PUSH 0
+    LOAD
+    PRINT
+    HALT
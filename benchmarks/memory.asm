@@ -0,0 +1,70 @@
+; memory.asm - dynamic LOAD/STORE over a 4000-cell array: each of 500 rounds
+; stores i*i + round at address i, then sums the array back
+; memory[4000] = round, memory[4001] = i, memory[4002] = sum
+; expect: -149498480
+PUSH 500
+PUSH 4000
+STORE
+round:
+    PUSH 4000
+    LOAD
+    JZ done
+    PUSH 4000
+    PUSH 4001
+    STORE        ; i = 4000
+fill:
+    PUSH 4001
+    LOAD
+    JZ sum
+    PUSH 4001
+    LOAD
+    DEC
+    PUSH 4001
+    STORE        ; i -= 1
+    PUSH 4001
+    LOAD
+    DUP
+    MUL
+    PUSH 4000
+    LOAD
+    ADD
+    PUSH 4001
+    LOAD
+    STORE        ; memory[i] = i*i + round
+    JMP fill
+sum:
+    PUSH 0
+    PUSH 4002
+    STORE        ; sum = 0
+    PUSH 4000
+    PUSH 4001
+    STORE        ; i = 4000
+sumloop:
+    PUSH 4001
+    LOAD
+    JZ next
+    PUSH 4001
+    LOAD
+    DEC
+    DUP
+    PUSH 4001
+    STORE        ; i -= 1, keeping i
+    LOAD
+    PUSH 4002
+    LOAD
+    ADD
+    PUSH 4002
+    STORE        ; sum += memory[i]
+    JMP sumloop
+next:
+    PUSH 4000
+    LOAD
+    DEC
+    PUSH 4000
+    STORE
+    JMP round
+done:
+    PUSH 4002
+    LOAD
+    PRINT        ; the last round's sum (int32, wrapped)
+    HALT
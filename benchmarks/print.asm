@@ -0,0 +1,26 @@
+; print.asm - output: 200000 rounds of PRINTing the counter and a float
+; (x += 0.25, in memory[0..1]), 400001 lines in all
+; expect: 1 50000 0
+PUSHF 0.0
+PUSH 0
+STOREF
+PUSH 200000
+loop:
+    DUP
+    JZ done
+    DUP
+    PRINT
+    PUSH 0
+    LOADF
+    PUSHF 0.25
+    ADDF
+    DUP
+    PRINT
+    PUSH 0
+    STOREF
+    PUSH 1
+    SUB
+    JMP loop
+done:
+    PRINT
+    HALT
@@ -0,0 +1,31 @@
+; recursion.asm - deep recursion: sum(n) = n + sum(n - 1), 500 calls deep,
+; 20000 times
+; expect: 125250
+PUSH 20000
+outer:
+    DUP
+    JZ done
+    PUSH 500
+    CALL sum
+    PUSH 0
+    STORE        ; memory[0] = the last result
+    PUSH 1
+    SUB
+    JMP outer
+done:
+    PUSH 0
+    LOAD
+    PRINT
+    HALT
+
+sum:
+    DUP
+    JZ base      ; sum(0) = 0: the 0 is the result
+    DUP
+    PUSH 1
+    SUB
+    CALL sum
+    ADD
+    RET
+base:
+    RET
@@ -0,0 +1,46 @@
+#!/bin/sh
+# run.sh - build each engine and run the benchmark suite on it
+# Usage: benchmarks/run.sh [runs] > results.jsonl
+#   (CC and CFLAGS are honoured; runs defaults to 5)
+# Every line on stdout is one JSON result from vm --bench, so runs before
+# and after a change can be compared with jq or a spreadsheet. Each program
+# is first run normally and its last output lines checked against its
+# "; expect:" comment; a mismatch is reported on stderr and fails the run.
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+runs=${1:-5}
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+
+build() {  # name, extra flags
+    $cc -O2 -std=c11 ${CFLAGS:-} $2 "$here/../source_code/vm.c" -o "$tmp/$1" -lpthread || exit 1
+}
+build threaded ""
+build switch "-DSISA_DISPATCH_SWITCH"
+build nanbox "-DSISA_NAN_BOX"
+
+suite() {  # vm, flags
+    for f in "$here"/*.asm; do
+        want=$(sed -n 's/^; expect: //p' "$f")
+        n=$(echo "$want" | wc -w)
+        got=$("$1" $2 "$f" 2>&1 | tail -n "$n" | tr '\n' ' ' | sed 's/ $//')
+        if [ "$got" != "$want" ]; then
+            echo "FAIL $(basename "$f") ($(basename "$1") $2): got '$got', want '$want'" >&2
+            status=1
+            continue
+        fi
+        "$1" $2 --bench "$runs" "$f" 2>/dev/null || { echo "FAIL $(basename "$f") ($(basename "$1") $2): --bench" >&2; status=1; }
+    done
+}
+suite "$tmp/threaded" ""
+suite "$tmp/threaded" "--no-verify"
+suite "$tmp/threaded" "--jit"
+suite "$tmp/threaded" "--reg"
+suite "$tmp/threaded" "--tier"
+suite "$tmp/switch" ""
+suite "$tmp/nanbox" ""
+suite "$tmp/nanbox" "--jit"
+suite "$tmp/nanbox" "--reg"
+exit $status
@@ -0,0 +1,164 @@
+; vector_loop.asm - 20000 rounds of an int and a float dot product, one
+; interpreted LOAD/MUL/ADD per element (compare vector_ops.asm)
+; expect: 1498500 187125
+
+; ints a[i] = i at cell i, b[i] = 3 at cell 1000 + i, i < 1000
+PUSH 0
+PUSH 4001
+STORE
+init:
+    PUSH 4001
+    LOAD
+    PUSH 4001
+    LOAD
+    STORE               ; a[i] = i
+    PUSH 3
+    PUSH 4001
+    LOAD
+    PUSH 1000
+    ADD
+    STORE               ; b[i] = 3
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 1000
+    SUB
+    JZ init_f
+    JMP init
+; doubles x[j] = j * 0.5 at cell 2000 + 2j, y[j] = 3.0 at cell 3000 + 2j, j < 500
+init_f:
+PUSHF 0.0
+PUSH 4004
+STOREF
+PUSH 0
+PUSH 4001
+STORE
+initf:
+    PUSH 4004
+    LOADF
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 2000
+    ADD
+    STOREF
+    PUSHF 3.0
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 3000
+    ADD
+    STOREF
+    PUSH 4004
+    LOADF
+    PUSHF 0.5
+    ADDF
+    PUSH 4004
+    STOREF
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 500
+    SUB
+    JZ run
+    JMP initf
+run:
+PUSH 20000
+PUSH 4000
+STORE                   ; rounds
+round:
+    PUSH 0
+    PUSH 4002
+    STORE
+    PUSH 0
+    PUSH 4001
+    STORE
+dot:
+    PUSH 4002
+    LOAD
+    PUSH 4001
+    LOAD
+    LOAD
+    PUSH 4001
+    LOAD
+    PUSH 1000
+    ADD
+    LOAD
+    MUL
+    ADD
+    PUSH 4002
+    STORE               ; s += a[i] * b[i]
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 1000
+    SUB
+    JZ dotf0
+    JMP dot
+dotf0:
+    PUSHF 0.0
+    PUSH 4006
+    STOREF
+    PUSH 0
+    PUSH 4001
+    STORE
+dotf:
+    PUSH 4006
+    LOADF
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 2000
+    ADD
+    LOADF
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 3000
+    ADD
+    LOADF
+    MULF
+    ADDF
+    PUSH 4006
+    STOREF              ; sf += x[j] * y[j]
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 500
+    SUB
+    JZ next
+    JMP dotf
+
+next:
+    PUSH 4000
+    LOAD
+    DEC
+    DUP
+    PUSH 4000
+    STORE
+    JZ done
+    JMP round
+done:
+PUSH 4002
+LOAD
+PRINT                   ; 1498500
+PUSH 4006
+LOADF
+PRINT                   ; 187125
+HALT
@@ -0,0 +1,107 @@
+; vector_ops.asm - the rounds of vector_loop.asm with one VDOT and one
+; VDOTF each
+; expect: 1498500 187125
+
+; ints a[i] = i at cell i, b[i] = 3 at cell 1000 + i, i < 1000
+PUSH 0
+PUSH 4001
+STORE
+init:
+    PUSH 4001
+    LOAD
+    PUSH 4001
+    LOAD
+    STORE               ; a[i] = i
+    PUSH 3
+    PUSH 4001
+    LOAD
+    PUSH 1000
+    ADD
+    STORE               ; b[i] = 3
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 1000
+    SUB
+    JZ init_f
+    JMP init
+; doubles x[j] = j * 0.5 at cell 2000 + 2j, y[j] = 3.0 at cell 3000 + 2j, j < 500
+init_f:
+PUSHF 0.0
+PUSH 4004
+STOREF
+PUSH 0
+PUSH 4001
+STORE
+initf:
+    PUSH 4004
+    LOADF
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 2000
+    ADD
+    STOREF
+    PUSHF 3.0
+    PUSH 4001
+    LOAD
+    PUSH 2
+    MUL
+    PUSH 3000
+    ADD
+    STOREF
+    PUSH 4004
+    LOADF
+    PUSHF 0.5
+    ADDF
+    PUSH 4004
+    STOREF
+    PUSH 4001
+    LOAD
+    INC
+    DUP
+    PUSH 4001
+    STORE
+    PUSH 500
+    SUB
+    JZ run
+    JMP initf
+run:
+PUSH 20000
+PUSH 4000
+STORE                   ; rounds
+round:
+    PUSH 0
+    PUSH 1000
+    PUSH 1000
+    VDOT
+    PUSH 4002
+    STORE
+    PUSH 2000
+    PUSH 3000
+    PUSH 500
+    VDOTF
+    PUSH 4006
+    STOREF
+
+next:
+    PUSH 4000
+    LOAD
+    DEC
+    DUP
+    PUSH 4000
+    STORE
+    JZ done
+    JMP round
+done:
+PUSH 4002
+LOAD
+PRINT                   ; 1498500
+PUSH 4006
+LOADF
+PRINT                   ; 187125
+HALT
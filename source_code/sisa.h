@@ -0,0 +1,281 @@
+// sisa.h - embedding API for the SISA VM
+// Implemented in vm.c; build it with -DSISA_NO_MAIN to link it into another
+// program. A SisaProgram is assembled, decoded and verified once and is
+// read-only from then on, so any number of SisaVM contexts, in any threads,
+// can run it at the same time. A SisaVM owns one value stack, call stack and
+// data memory. Every call returns SISA_OK or an error code; nothing exits.
+// Whatever the program does, it cannot crash its host: int arithmetic wraps
+// (INT_MIN / -1 included), and code the verifier passes to the unchecked
+// loop is proven to stay on the stack and use each value at its type;
+// anything else fails the run with an error. Host functions (CALLN) are
+// trusted to do the same.
+#ifndef SISA_H
+#define SISA_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct SisaProgram SisaProgram;
+typedef struct SisaVM SisaVM;
+typedef struct SisaSnapshot SisaSnapshot;
+
+// Error codes
+enum {
+    SISA_OK = 0,
+    SISA_ERR_NOMEM,     // allocation failed
+    SISA_ERR_IO,        // file could not be read or written
+    SISA_ERR_ASM,       // assembler: bad source
+    SISA_ERR_IMAGE,     // malformed binary image
+    SISA_ERR_BYTECODE,  // malformed bytecode
+    SISA_ERR_RUNTIME,   // the program faulted (stack, type, bounds, ...)
+    SISA_YIELD          // not an error: sisa_run used up its fuel and can go on
+};
+
+// Load options
+#define SISA_LOAD_NO_OPT    0x1 // skip the peephole pass (superinstructions)
+#define SISA_LOAD_DUMP_OPT  0x2 // list the superinstructions made on stderr
+#define SISA_LOAD_VERBOSE   0x4 // report the verifier's verdict on stderr
+#define SISA_LOAD_DUMP_REG  0x8 // list the register IR of verified code on stderr
+
+// Run flags
+#define SISA_RUN_TRACE      0x1 // print a TRACE line before every instruction
+#define SISA_RUN_NO_VERIFY  0x2 // keep the checked loop even for verified code
+#define SISA_RUN_JIT        0x4 // compile verified programs to native code
+#define SISA_RUN_BINARY_OUT 0x8 // PRINT writes binary records instead of text lines
+#define SISA_RUN_PROFILE   0x10 // count instructions and clock ticks (sisa_profile_write)
+#define SISA_RUN_REG       0x20 // run verified programs on the register IR instead of the stack loop
+#define SISA_RUN_TIER      0x40 // interpret verified programs, compiling hot code as it warms up
+#define SISA_RUN_SNAPSHOT  0x80 // stop at the first SNAPSHOT instruction (sisa_snapshot_take)
+#define SISA_RUN_STATS    0x100 // record the run's telemetry (sisa_stats)
+#define SISA_RUN_PERF     0x200 // with SISA_RUN_STATS: read the CPU's counters around the run (Linux)
+
+// Assemble source text, or load a file (source or binary image), into a new
+// program. A source file is assembled as it is read, in fixed-size chunks;
+// path "-" reads source from stdin. On failure *out is NULL and err (if not
+// NULL) gets the message.
+int  sisa_program_from_source(const char *src, unsigned opts, SisaProgram **out, char *err, size_t errlen);
+int  sisa_program_from_file(const char *path, unsigned opts, SisaProgram **out, char *err, size_t errlen);
+// Write p's bytecode and labels as a binary image (.sbc).
+int  sisa_program_save(const SisaProgram *p, const char *path, char *err, size_t errlen);
+// Only once no SisaVM runs it any more.
+void sisa_program_free(SisaProgram *p);
+
+// Host functions: CALLN name calls a C function registered under that name
+// in a SisaHost, or one of the built-in ones:
+//   sqrt  f>f   square root
+//   hash  ii>i  FNV-1a of the n bytes (top) at a byte address
+//   atoi  i>ii  the decimal int at a byte address (after blanks, with an
+//               optional '-') and the address after its digits
+// The signature lists the argument types, deepest first, then '>' and the
+// result types: 'i' int, 'f' float, and for arguments 'v' either. A name is
+// looked up, and its signature fixed, when the program is assembled or its
+// image loaded (the image records the name and signature of every native it
+// calls), so the verifier checks every call and a verified CALLN is one call
+// through a pointer. The function gets the arguments in place on the value
+// stack, args[0] the deepest, and leaves its results there, args[0] first;
+// memory is the VM's data memory, cells long (a power of two). It returns 0,
+// or anything else to fault the run. It may run in several VMs at once.
+#ifdef SISA_NAN_BOX
+typedef struct { uint64_t bits; } SisaValue;   // as vm.c's Value (build both with the same flags)
+#define SISA_VALUE_INT_TAG 0xFFF90000u
+static inline int sisa_is_int(const SisaValue *v) { return (uint32_t)(v->bits >> 32) == SISA_VALUE_INT_TAG; }
+static inline int32_t sisa_int(const SisaValue *v) { return (int32_t)(uint32_t)v->bits; }
+static inline double sisa_float(const SisaValue *v) { double d; memcpy(&d, &v->bits, 8); return d; }
+static inline void sisa_set_int(SisaValue *v, int32_t x) { v->bits = (uint64_t)SISA_VALUE_INT_TAG << 32 | (uint32_t)x; }
+static inline void sisa_set_float(SisaValue *v, double d) {
+    memcpy(&v->bits, &d, 8);
+    if (d != d) v->bits = (v->bits & 1ull << 63) | 0x7FF8000000000000ull;   // one NaN per sign, never an int tag
+}
+#else
+typedef struct { int type; union { int32_t i; double f; } v; } SisaValue;
+static inline int sisa_is_int(const SisaValue *v) { return v->type == 1; }
+static inline int32_t sisa_int(const SisaValue *v) { return v->v.i; }
+static inline double sisa_float(const SisaValue *v) { return v->v.f; }
+static inline void sisa_set_int(SisaValue *v, int32_t x) { v->type = 1; v->v.i = x; }
+static inline void sisa_set_float(SisaValue *v, double d) { v->type = 2; v->v.f = d; }
+#endif
+typedef int (*SisaNativeFn)(void *user, SisaValue *args, int32_t *memory, size_t cells);
+typedef struct SisaHost SisaHost;
+SisaHost *sisa_host_create(void);
+// SISA_ERR_ASM for a malformed signature, a name that is empty, longer than
+// 31 characters or already added, or more than 8 arguments or results.
+int  sisa_host_add(SisaHost *h, const char *name, const char *sig, SisaNativeFn fn, void *user);
+// Programs keep their own copy of what they use, so h may go first.
+void sisa_host_free(SisaHost *h);
+// sisa_program_from_source / _from_file with h's functions as well (NULL:
+// the built-in ones only, as there).
+int  sisa_program_from_source_host(const char *src, unsigned opts, const SisaHost *h, SisaProgram **out,
+                                   char *err, size_t errlen);
+int  sisa_program_from_file_host(const char *path, unsigned opts, const SisaHost *h, SisaProgram **out,
+                                 char *err, size_t errlen);
+
+SisaVM *sisa_create(void);
+// Data memory: at least the default 4096 cells, rounded up to a power of
+// two. Above the default it is reserved as a lazily mapped heap, so a large
+// size costs little until the program touches it. Memory reads as zero
+// afterwards. SISA_ERR_NOMEM if the range cannot be reserved; the old
+// memory is kept then. Drops a data segment.
+int  sisa_set_memory(SisaVM *vm, size_t cells);
+// Value and call stack: slots each (at least 1024, at most 2^28; the default
+// is 2^20). The stacks are reserved at that size and their pages are mapped
+// as a run first reaches them, so deep recursion is bounded by memory.
+// SISA_ERR_NOMEM if they cannot be reserved; the old ones are kept then.
+// The stacks start out empty: call it before sisa_load or sisa_restore.
+int  sisa_set_stack(SisaVM *vm, size_t slots);
+// Map the file at path into memory after the current cells (rounded up to a
+// page), growing memory to fit, and store its base cell in *base (if not
+// NULL). The mapping is copy-on-write: STOREs change the VM's copy only, and
+// every sisa_load restores the file contents. memory[base-2] and
+// memory[base-1] hold the length in cells and in bytes (-1 above INT32_MAX);
+// LOADB reads single bytes. Memory below the segment reads as zero.
+int  sisa_map_data(SisaVM *vm, const char *path, size_t *base);
+// Attach p and clear the stacks and memory. p is not copied and must outlive
+// its use by vm.
+int  sisa_load(SisaVM *vm, const SisaProgram *p);
+// Run the attached program from its first instruction up to HALT, or on
+// from where a restored snapshot (or a SISA_RUN_SNAPSHOT run, or one out of
+// fuel) stopped.
+int  sisa_run(SisaVM *vm, unsigned flags);
+// Fuel: a budget of n instructions for the runs that follow (0: none). They
+// are counted as the interpreter runs them, a superinstruction as one, and
+// charged at each taken jump, call and return for the straight line before
+// it, so counting costs nothing between branches. A budgeted run is
+// interpreted (it ignores SISA_RUN_JIT / REG / TIER). Once the fuel is used
+// up sisa_run stops at the next transfer and returns SISA_YIELD, keeping the
+// stacks, memory and place: the next sisa_run goes on from there, after
+// sisa_set_fuel gives it more (or none). sisa_load starts over.
+void sisa_set_fuel(SisaVM *vm, uint64_t n);
+// What is left: down to a little below 0 after a SISA_YIELD (a run stops at
+// the end of a straight line), INT64_MAX without a budget.
+int64_t sisa_fuel(const SisaVM *vm);
+// SISA_RUN_TIER: a loop header or function is compiled to native code (x86-64
+// only; elsewhere the run is interpreted) once the interpreter arrived at it
+// threshold times (0: the default, 1000), on a background thread unless
+// background is 0. The code is kept for later runs of the same program.
+void sisa_set_tier(SisaVM *vm, unsigned threshold, int background);
+// Snapshots: a SISA_RUN_SNAPSHOT run stops at the program's first SNAPSHOT
+// (interpreted: it ignores SISA_RUN_JIT / REG / TIER), and sisa_snapshot_take
+// then copies vm's stacks, the place to go on from and its data memory, less
+// the pages that are all zero. A run restored from it starts after the
+// SNAPSHOT; SNAPSHOT does nothing in other runs. The JIT and the register IR
+// only start at the first instruction, so a restored run ignores SISA_RUN_JIT
+// and SISA_RUN_REG.
+int  sisa_snapshot_take(SisaVM *vm, SisaSnapshot **out);
+int  sisa_snapshot_save(const SisaSnapshot *s, const char *path, char *err, size_t errlen);
+// The file stays mapped; restores map its pages into large memories
+// copy-on-write instead of copying them. SISA_ERR_IMAGE if it is corrupt.
+int  sisa_snapshot_from_file(const char *path, SisaSnapshot **out, char *err, size_t errlen);
+// Attach p, as sisa_load, with s's stacks and memory. s must come from p (the
+// same bytecode); for verified code the stacks are checked against what the
+// verifier proved. The memory takes s's size and drops a data segment (s
+// holds its contents). Restoring the snapshot restored last only resets the
+// memory p can store to, where that is bounded.
+int  sisa_restore(SisaVM *vm, const SisaProgram *p, const SisaSnapshot *s);
+void sisa_snapshot_free(SisaSnapshot *s);
+// Message of the last failed call on vm, "" if none.
+const char *sisa_error(const SisaVM *vm);
+void sisa_destroy(SisaVM *vm);
+
+// PRINT output is buffered per VM and by default written to stdout when the
+// buffer fills and when sisa_run returns. Text is "%d\n" or "%g\n" per value;
+// binary records are a tag byte (1 = int32, 2 = double) and the value in
+// little-endian order.
+typedef void (*SisaSinkFn)(void *user, const char *data, size_t len);
+// Hand each flushed chunk to fn instead (NULL: back to stdout).
+void sisa_output_sink(SisaVM *vm, SisaSinkFn fn, void *user);
+// Keep the output in memory instead; sisa_output returns all of it since the
+// last sisa_load (or the last switch to memory mode).
+void sisa_output_memory(SisaVM *vm);
+const char *sisa_output(const SisaVM *vm, size_t *len);
+
+// A SISA_RUN_PROFILE run goes through the checked interpreter (not the JIT;
+// SISA_RUN_TRACE overrides it) and counts instructions and clock ticks.
+// Afterwards write a table of them per opcode, per function (a CALL target)
+// with and without its callees and per label (the code up to the next one)
+// to summary, and the instruction counts per call path as collapsed stacks
+// ("<main>;f;g 1234" lines, as flame graph tools read them) to stacks.
+// Either may be NULL. SISA_ERR_RUNTIME if nothing was profiled since
+// sisa_load. A run with SISA_RUN_TIER as well is tiered instead; the summary
+// then has the tier's threshold, compiles, native entries and exits, and its
+// regions.
+int  sisa_profile_write(SisaVM *vm, FILE *summary, FILE *stacks);
+
+// Telemetry of a SISA_RUN_STATS run. It is interpreted, as a budgeted run
+// (it ignores SISA_RUN_JIT / REG / TIER, and SISA_RUN_TRACE / PROFILE
+// override it), and counts instructions the way fuel does: exactly, a
+// superinstruction as one, up to the faulting one in a run that fails.
+// With SISA_RUN_PERF as well, and where perf_event_open lets it, the run is
+// bracketed by the CPU's cycle, branch miss and cache miss counters for the
+// calling thread (the interpreter's own work included).
+enum {
+    SISA_CLASS_STACK,       // PUSH, PUSHF, DUP, POP, NOP
+    SISA_CLASS_INT,         // int arithmetic
+    SISA_CLASS_FLOAT,       // float arithmetic and conversions
+    SISA_CLASS_MEMORY,      // LOAD, STORE and their typed forms
+    SISA_CLASS_BLOCK,       // MEMCPY, MEMSET, MEMCMP and the vector ops
+    SISA_CLASS_CONTROL,     // CMP, jumps, calls, returns, HALT, SNAPSHOT
+    SISA_CLASS_HOST,        // CALLN
+    SISA_CLASS_PRINT,       // PRINT
+    SISA_CLASSES
+};
+typedef struct {
+    uint64_t insns;                         // instructions run
+    uint64_t insns_by_class[SISA_CLASSES];
+    uint32_t peak_sp, peak_csp;             // deepest value and call stacks
+    uint64_t mem_cells;                     // cells of the memory pages not all zero after the run
+    uint64_t print_bytes;                   // PRINT output, text or binary
+    double load_s;                          // load: assembling or reading the image, verifying, optimizing
+    double run_s;                           // the run
+    int counters;                           // the three below were read
+    uint64_t cycles, branch_misses, cache_misses;
+} SisaStats;
+// The last SISA_RUN_STATS run's since sisa_load, or NULL.
+const SisaStats *sisa_stats(const SisaVM *vm);
+#define SISA_STATS_JSON 0   // one line, an object
+#define SISA_STATS_PROM 1   // Prometheus text exposition format
+// Write them to f. SISA_ERR_RUNTIME if there are none.
+int  sisa_stats_write(SisaVM *vm, FILE *f, int format);
+
+// Batch mode: run p once per input set on a pool of worker threads, each
+// reusing one SisaVM. Run i starts with inputs[i*stride .. i*stride+stride-1]
+// in memory[0..stride-1] and the rest of memory zero (or the data segment,
+// or from the snapshot: then it also resumes after the SNAPSHOT).
+// fn is called on the calling thread, in run order, with the run's PRINT
+// output and its error message ("" if rc is SISA_OK). The return value is
+// for the batch as a whole, with its message in err.
+typedef void (*SisaBatchFn)(void *user, size_t run, int rc, const char *out, size_t len, const char *err);
+typedef struct {
+    size_t mem_cells;       // as sisa_set_memory; 0: default
+    const char *data_path;  // as sisa_map_data in every worker; NULL: none
+    unsigned flags;         // run flags; trace, profile and stats are ignored
+    int threads;            // <= 0: one per CPU
+    const SisaSnapshot *snapshot;  // every run starts from it (memory size and data are its own); NULL: none
+    size_t stack_slots;     // as sisa_set_stack; 0: default
+    uint64_t fuel;          // as sisa_set_fuel for each run, which fails with SISA_YIELD past it; 0: none
+} SisaBatchOpts;
+int  sisa_run_batch(const SisaProgram *p, const int32_t *inputs, size_t stride, size_t nruns,
+                    const SisaBatchOpts *opts, SisaBatchFn fn, void *user, char *err, size_t errlen);
+
+// Green threads: VMs added to a scheduler share its worker threads round
+// robin, each running for slice instructions of fuel (0: to the end) before
+// it goes to the back of the queue, so a long run does not hold up short ones
+// behind it. A VM is run as sisa_run(vm, flags) would, from its place, and
+// done is called on a worker thread with the result once it returns anything
+// but SISA_YIELD, or SISA_YIELD once budget instructions are used up (0: no
+// budget); vm is then back without fuel and the caller's again. Until then it
+// must not be touched. SISA_RUN_SNAPSHOT is ignored.
+typedef struct SisaSched SisaSched;
+typedef void (*SisaDoneFn)(void *user, SisaVM *vm, int rc);
+// threads <= 0: one per CPU. NULL if out of memory. Without threads (or if
+// none can be started) the VMs are run by sisa_sched_wait.
+SisaSched *sisa_sched_create(int threads, uint64_t slice);
+// SISA_ERR_NOMEM (on vm) if vm cannot be queued. May be called from done.
+int  sisa_sched_add(SisaSched *s, SisaVM *vm, unsigned flags, uint64_t budget, SisaDoneFn done, void *user);
+// Until every VM added is done.
+void sisa_sched_wait(SisaSched *s);
+// Waits, then stops the threads.
+void sisa_sched_free(SisaSched *s);
+
+#endif
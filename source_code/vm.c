@@ -1,63 +1,102 @@
 // vm.c - SoumyaVM extended arithmetic + floating point
 // Build: gcc -O2 -std=c11 vm.c -o vm
-// Usage: ./vm <program.asm>
+//        (-DSISA_NAN_BOX for 8-byte NaN-boxed values, -DSISA_DISPATCH_SWITCH,
+//         -DSISA_NO_JIT, -DSISA_NO_SIMD, -DSISA_NO_THREADS, -DSTACK_SIZE=n,
+//         -DSTACK_MAX=n, -DCODE_CAP=n, -DSISA_NO_MAIN to embed it through sisa.h; add -pthread
+//         on glibc older than 2.34)
+// Usage: ./vm [--trace] [--no-verify] [--jit] [--reg] [--tier] [--tier-threshold N] [--no-opt] [--dump-opt] [--dump-reg] [-v]
+//             [--profile] [--profile-stacks <file>] [--binary-out] [--mem <cells>] [--stack <slots>] [--data <file>]
+//             [--vec <isa>]
+//             [--save <image.sbc>] [--bench-asm] [--bench N] [--snapshot <file>] [--restore <file>]
+//             [--batch <inputs> [-j N]] [--fuel N] [--stats <json | prom>] [--perf]
+//        ./vm --serve <socket | -> [-j N] [--cache N] [--slice N] [run options]
+//             <program.asm | image.sbc | - (source on stdin)>
+
+#define _POSIX_C_SOURCE 200809L // POSIX prototypes (mmap, open, fstat) under -std=c11
+#define _DEFAULT_SOURCE          // MAP_ANONYMOUS
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
-
-#ifdef _WIN32
-// Windows-safe strndup
-static char *strndup(const char *s, size_t n) {
-    char *p = (char *)malloc(n + 1);
-    if (p) {
-        memcpy(p, s, n);
-        p[n] = '\0';
-    }
-    return p;
-}
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
 
-// Windows-safe strtok_r
-static char *strtok_r(char *str, const char *delim, char **saveptr) {
-    char *token;
-    if (str)
-        *saveptr = str;
-    if (!*saveptr)
-        return NULL;
-    token = *saveptr + strspn(*saveptr, delim);
-    if (*token == '\0') {
-        *saveptr = NULL;
-        return NULL;
-    }
-    *saveptr = token + strcspn(token, delim);
-    if (**saveptr != '\0') {
-        **saveptr = '\0';
-        (*saveptr)++;
-    } else {
-        *saveptr = NULL;
-    }
-    return token;
-}
+#include "sisa.h"
+#ifdef _MSC_VER
+    #include <math.h>           // fma
 #endif
+
 #ifdef __linux__
     #include <sys/mman.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>   // SISA_RUN_PERF
 #elif defined(_WIN32)
     #include <windows.h>
+    #include <io.h>
+    #include <fcntl.h>
 #else
     #include <sys/mman.h>
 #endif
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #ifndef SISA_NO_MAIN
+        #include <signal.h>
+        #include <sys/socket.h>     // --serve
+        #include <sys/un.h>
+    #endif
+#endif
+#if defined(__STDC_NO_ATOMICS__) && !defined(SISA_NO_THREADS)
+    #define SISA_NO_THREADS
+#endif
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(SISA_NO_SIMD)
+    #define VEC_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && !defined(SISA_NO_SIMD)
+    #define VEC_ARM 1
+    #include <arm_neon.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+    #define PROF_TSC 1          // the profiler reads the time-stamp counter
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+#ifndef SISA_NO_THREADS
+    #include <stdatomic.h>
+    #ifndef _WIN32
+        #include <pthread.h>
+    #endif
+#endif
 
-#define STACK_SIZE 1024
-#define CODE_CAP   131072
-#define MEM_SIZE   4096
-#define MAX_LABELS 2048
-#define MAX_REFS   2048
-#define LINE_MAX   512
+#ifndef STACK_SIZE
+#define STACK_SIZE 1024   // slots the verifier lets one function's frame take (-DSTACK_SIZE=n)
+#endif
+#ifndef STACK_MAX
+#define STACK_MAX  (1u << 20) // default value and call stack slots, mapped as reached (-DSTACK_MAX=n)
+#endif
+#define STACK_LIMIT (1u << 28) // most slots sisa_set_stack takes
+#ifndef CODE_CAP
+#define CODE_CAP   131072 // initial assembler buffer, doubled as needed (-DCODE_CAP=n)
+#endif
+#define MEM_SIZE   4096   // default and minimum data memory, in cells
+#define MEM_MAX    (1u << 31) // cells: addresses are non-negative int32
+#define MEM_REMAP_MIN (64 * 1024) // bytes: clear a mapped heap by remapping it
+#define LABEL_MAX  255    // longest label name (image symbols store a u8 length)
+#define TOKEN_MAX  512    // longest numeric operand the assembler will parse
+#define CONST_MAX  65536  // constant pool entries (PUSHK has a u16 index)
+#define TIER_THRESHOLD 1000 // default arrivals at a target before --tier compiles it
 
 // Opcodes
 enum {
@@ -83,11 +122,80 @@ enum {
     OP_JZ    = 0x13, // u32 target (pop top; if zero jump) - only checks integers (zero int) or floats with value==0.0
     OP_CALL  = 0x14, // u32 target
     OP_RET   = 0x15,
+    OP_LOADB = 0x16, // dynamic byte addr (pop addr -> push that byte of memory, zero-extended)
+    OP_LOADF = 0x17, // pop addr -> push the double in memory[addr], memory[addr+1]
+    OP_STOREF= 0x18, // pop addr; pop val (float required); store it in memory[addr], memory[addr+1]
+    OP_MEMCPY= 0x19, // pop n, src, dst: copy n cells (overlap allowed)
+    OP_MEMSET= 0x1A, // pop n, val, dst: fill n cells with val
+    OP_MEMCMP= 0x1B, // pop n, b, a: push -1/0/1 comparing n cells as signed ints
+    // vector ops over n int32 cells, F forms over n doubles (two cells each)
+    OP_VADD  = 0x1C, // pop n, b, a, dst: dst[i] = a[i] + b[i]
+    OP_VMUL  = 0x1D, // pop n, b, a, dst: dst[i] = a[i] * b[i]
+    OP_VDOT  = 0x1E, // pop n, b, a: push sum of a[i] * b[i]
+    OP_VSUM  = 0x1F, // pop n, a: push sum of a[i]
+    OP_VADDF = 0x20,
+    OP_VMULF = 0x21,
+    OP_VDOTF = 0x22,
+    OP_VSUMF = 0x23,
+    OP_SNAPSHOT = 0x24, // a SISA_RUN_SNAPSHOT run stops here (see sisa_snapshot_take); otherwise nothing
+    // compact pushes the assembler picks; decoded into PUSH / PUSHF
+    OP_PUSH8 = 0x25, // int8 immediate (1 byte)
+    OP_PUSH16= 0x26, // int16 immediate (2 bytes)
+    OP_PUSHK = 0x27, // u16 index into the program's constant pool (an int32 or a double)
+    // float ops: a is the top, b the value below it, as for the int ops
+    OP_SUBF  = 0x28, // b - a
+    OP_DIVF  = 0x29, // b / a (IEEE: a zero divisor gives an infinity or NaN)
+    OP_NEGF  = 0x2A, // negate top (float)
+    OP_FMAF  = 0x2B, // pop c, b, a: push a * b + c, rounded once
+    OP_ITOF  = 0x2C, // int -> float (exact)
+    OP_FTOI  = 0x2D, // float -> int, truncated; faults outside the int32 range or for a NaN
+    OP_CMP   = 0x2E, // pop a, b: push -1 / 0 / 1 as b < a, b == a (or unordered), b > a
+    // compare-and-jump, u32 target: pop a, b; jump if b op a. Two ints compare
+    // as ints, anything else as doubles, so a NaN makes all but JNE fall through
+    OP_JE    = 0x2F,
+    OP_JNE   = 0x30,
+    OP_JL    = 0x31,
+    OP_JLE   = 0x32,
+    OP_JG    = 0x33,
+    OP_JGE   = 0x34,
+    OP_CALLN = 0x35, // u16 index into the program's natives: call that host function (see sisa.h)
+    // superinstructions: made by optimize_program() and call_pass() from prog[], never in bytecode
+    OP_ADDI  = 0x80, // PUSH k; ADD
+    OP_SUBI  = 0x81, // PUSH k; SUB
+    OP_LOADI = 0x82, // PUSH k; LOAD  (push memory[k])
+    OP_STOREI= 0x83, // PUSH k; STORE (pop value into memory[k])
+    OP_DUPJZ = 0x84, // DUP; JZ t     (jump if top is zero, keep it)
+    OP_TCALL = 0x85, // CALL t; RET   (jump to t, the call stack unchanged)
     OP_HALT  = 0xFF
 };
+#define OP_IS_JCC(op) ((op) >= OP_JE && (op) <= OP_JGE)
 
 // Value type tagging
 typedef enum { TY_INT = 1, TY_FLOAT = 2 } ValType;
+#ifdef SISA_NAN_BOX
+// NaN-boxed, 8 bytes: a double is stored as its own bits, an int32 sits in
+// the low half of a quiet NaN whose upper 32 bits are VAL_INT_TAG. Type tests
+// are one compare on the upper word. Float arithmetic on canonical NaNs only
+// yields 0x7FF8.../0xFFF8..., so only doubles coming from outside the VM
+// (literals, memory, kernels) go through val_from_double() to canonicalise
+// their NaN payload; the sign is kept, as the tagged build keeps it.
+typedef struct { uint64_t bits; } Value;
+#define VAL_INT_TAG   0xFFF90000u
+#define VAL_IS_INT(x) ((uint32_t)((x).bits >> 32) == VAL_INT_TAG)
+#define VAL_I(x)      ((int32_t)(uint32_t)(x).bits)
+static inline double val_f(Value x) { double d; memcpy(&d, &x.bits, 8); return d; }
+static inline Value mk_int(int32_t i) { Value x; x.bits = ((uint64_t)VAL_INT_TAG << 32) | (uint32_t)i; return x; }
+static inline Value mk_float(double d) { Value x; memcpy(&x.bits, &d, 8); return x; }
+static inline double val_from_double(double d) {
+    if (d != d) {  // keep the sign: 0xFFF8... is no int tag either
+        uint64_t q;
+        memcpy(&q, &d, 8);
+        q = (q & 1ull << 63) | 0x7FF8000000000000ull;
+        memcpy(&d, &q, 8);
+    }
+    return d;
+}
+#else
 typedef struct {
     ValType type;
     union {
@@ -95,105 +203,1118 @@ typedef struct {
         double  f;
     } v;
 } Value;
+#define VAL_IS_INT(x) ((x).type == TY_INT)
+#define VAL_I(x)      ((x).v.i)
+static inline double val_f(Value x) { return x.v.f; }
+static inline Value mk_int(int32_t i) { Value x; x.type = TY_INT; x.v.i = i; return x; }
+static inline Value mk_float(double d) { Value x; x.type = TY_FLOAT; x.v.f = d; return x; }
+static inline double val_from_double(double d) { return d; }
+#endif
+#define VAL_F(x) val_f(x)
+_Static_assert(sizeof(Value) == sizeof(SisaValue), "sisa.h's SisaValue must be laid out as Value");
+// an int or a float as a double (exact for every int32)
+static inline double val_num(Value x) { return VAL_IS_INT(x) ? (double)VAL_I(x) : VAL_F(x); }
+
+// Pre-decoded instruction: fixed 16 bytes, operands already decoded and
+// jump targets rewritten from byte offsets to instruction indices.
+typedef struct {
+    uint8_t  op;
+    uint16_t aux;       // set by verify_program: CALL / TCALL: stack slots the callee may use;
+                        // JZ / DUPJZ / PRINT / DUP: static type of the operand (0 = decided at run time);
+                        // CMP / JE..JGE: that of a, and of b in the high byte
+    uint32_t off;       // byte offset in codebuf (TRACE / error messages)
+    union {
+        int32_t  i;     // PUSH, ADDI / SUBI / LOADI / STOREI
+        double   f;     // PUSHF
+        uint32_t t;     // JMP / JZ / DUPJZ / JE..JGE / CALL / TCALL: target instruction index
+    } a;
+} Insn;
+
+// Register IR instruction (see "Register tier"): three register operands,
+// which are slots of the running function's frame, and a constant / target.
+typedef struct {
+    uint8_t  op;        // RG_*
+    uint16_t d, a, b;   // destination and source registers
+    union {
+        struct { int32_t i; uint32_t t; } k;    // int constant; jump / call target
+        double f;                               // float constant
+    } u;
+} RegInsn;
+
+// Labels
+// Label names live NUL-terminated in one growing buffer; lookups go through
+// an open-addressing hash of label indices that doubles at half load. A
+// label that is only referenced so far has offset LABEL_UNDEF, and fwd heads
+// the chain of operands waiting for it: each holds the code position + 1 of
+// the next (0 ends it) until the definition patches them all.
+typedef struct { uint32_t name, len, offset, hash, fwd; } Label; // name: index into label_names
+#define LABEL_UNDEF UINT32_MAX
+// A numeric jump target is a byte offset counted as if PUSH were always 5
+// bytes and PUSHF 9, as before the compact encodings, so programs written
+// against that layout keep their meaning. Each PUSH assembled shorter is
+// recorded (its offset there, old, and in the code, at) and the targets are
+// mapped once the program is in (asm_end).
+typedef struct { uint32_t old, at; uint8_t old_len, len; } AsmShift;
+
+// Constant pool entry: the value's bits (an int32 in the low half) and its
+// tag, 1 = int32 or 2 = double as in binary output. The assembler keeps each
+// distinct value once, found through a hash of pool indices like labels.
+typedef struct { uint64_t bits; uint32_t tag; } Const;
+#define CONST_INT   1
+#define CONST_FLOAT 2
+
+// Host function (CALLN, see sisa.h). A SisaHost holds those registered; a
+// program keeps a copy of each one it calls, numbered in the order of first
+// use, which is what CALLN's operand indexes.
+#define NATIVE_NAME_MAX 31
+#define NATIVE_ARGS_MAX 8
+typedef struct {
+    char name[NATIVE_NAME_MAX + 1];
+    char sig[2 * NATIVE_ARGS_MAX + 2];
+    uint8_t nargs, nres;
+    uint8_t in[NATIVE_ARGS_MAX];    // argument types, deepest first: TY_INT, TY_FLOAT, 0 = either
+    uint8_t out[NATIVE_ARGS_MAX];   // result types
+    uint8_t pure;                   // never stores to memory (the built-in ones)
+    SisaNativeFn fn;
+    void *user;
+} Native;
+struct SisaHost { Native *fn; int count, cap; };
+
+// Bytecode builder: a buffer doubled as it fills
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+} Builder;
+
+// Where a SNAPSHOT or CALL of verified code sits in its function: the stack
+// depth there above the depth at the function's entry, and the entry insn
+// (UINT32_MAX: never reached). sisa_restore checks restored stacks with it.
+typedef struct { int32_t depth; uint32_t fn; } SnapFrame;
+
+// Program: everything load time produces. Read-only once sisa_program_*
+// returns, so VMs in several threads can share one.
+struct SisaProgram {
+    const unsigned char *code;  // assembled buffer or a read-only image mapping
+    size_t code_len;
+    unsigned char *code_owned;  // code when it came from the assembler
+    const unsigned char *map;   // image mapping, if any
+    size_t map_size;
+    Insn *prog;                 // decoded code, prog[prog_len] is a HALT sentinel
+    size_t prog_len;
+    int verified;               // stack depth and types proven at load time
+    RegInsn *reg;               // register IR of verified code, NULL if none
+    uint32_t *reg_off;          // byte offset of the instruction each came from
+    size_t reg_len;             // reg[reg_len] is a HALT sentinel
+    uint32_t mem_written;       // a run can only STORE below this address
+    uint32_t code_hash;         // FNV-1a over code and constants (snapshots name their program by it)
+    SnapFrame *frame;           // per insn if verified code has a SNAPSHOT, else NULL
+    Label *labels;
+    int label_count, label_cap;
+    char *label_names;
+    size_t label_names_len, label_names_cap;
+    int32_t *label_hash;        // label index or -1
+    size_t label_hash_cap;      // power of two
+    Const *consts;              // constant pool, PUSHK operands index it
+    int const_count, const_cap;
+    int32_t *const_hash;        // assembler: pool index or -1
+    size_t const_hash_cap;      // power of two
+    Native *natives;            // host functions CALLN calls
+    int native_count, native_cap;
+    const SisaHost *host;       // loading: where CALLN names are looked up
+    // assembler scratch, kept here so a failed load frees it with the program
+    Builder asm_b;              // the bytecode being assembled
+    AsmShift *asm_shift;        // the PUSHes assembled shorter, in order
+    int asm_shift_count, asm_shift_cap;
+    uint32_t *asm_numeric;      // asm_b positions of numeric targets
+    int asm_numeric_count, asm_numeric_cap;
+    uint32_t asm_delta;         // old layout offset - code offset so far
+    char *asm_src;              // source text, or the streaming read buffer
+    FILE *asm_in;               // source file being streamed
+    double load_sec;            // spent in the load steps (program_step)
+};
+
+// Error channel: a failure anywhere below an API call formats its message
+// into the caller's SisaErr and longjmps back there. The active SisaErr is
+// per thread, so VMs in different threads fail independently.
+typedef struct {
+    jmp_buf jb;
+    int code;
+    char msg[256];
+} SisaErr;
+#if defined(_MSC_VER)
+#define SISA_TLS __declspec(thread)
+#define SISA_NOINLINE __declspec(noinline)
+#else
+#define SISA_TLS _Thread_local
+#define SISA_NOINLINE __attribute__((noinline))
+#endif
+static SISA_TLS SisaErr *sisa_err_ctx = NULL;
+
+// PRINT output buffer. For stdout and sinks it has a fixed size and is
+// flushed when full and when sisa_run returns; in memory mode it grows.
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} OutBuf;
+enum { OUT_STDOUT, OUT_SINK, OUT_MEMORY };
+#define OUT_BUFSIZE 65536
+#define OUT_RECORD_MAX 32       // longest formatted value, newline included
 
-// VM state
-static unsigned char *codebuf = NULL;
-static size_t code_len = 0;
-static Value stack[STACK_SIZE];
-static int sp = 0;
-static uint32_t callstack[STACK_SIZE];
-static int csp = 0;
-static int32_t memory_arr[MEM_SIZE];
-static size_t ip = 0;
-
-// Labels / relocations
-typedef struct { char name[128]; uint32_t offset; } Label;
-typedef struct { char name[128]; size_t patch_pos; } Reloc;
-static Label labels[MAX_LABELS];
-static int label_count = 0;
-static Reloc relocs[MAX_REFS];
-static int reloc_count = 0;
+// VM context: one execution of a program
+struct SisaVM {
+    const SisaProgram *p;
+    Value *stack;               // stack_map + 1: stack[-1] is a guard slot for the TOS-cached loop
+    int sp;
+    uint32_t *callstack;        // after the value stack in stack_map
+    int csp;
+    int stack_max;              // slots in each stack (sisa_set_stack)
+    void *stack_map;            // both stacks: reserved at once, pages fault in as the stacks reach them
+    size_t stack_bytes;
+    uint32_t ip;                // insn the next run starts at: 0, after a SNAPSHOT or where fuel ran out
+    int snap_stop;              // this run is SISA_RUN_SNAPSHOT: stop at a SNAPSHOT
+    int at_snapshot;            // the last run did; ip is the insn after it
+    int64_t fuel;               // instructions left (sisa_set_fuel), <= 0 once used up
+    int fueled;                 // runs are budgeted
+    int yielded;                // the last run used its fuel up; ip is where it goes on
+    int resumed;                // this run goes on from there
+    uint64_t snap_id;           // memory holds this snapshot's pages, changed below mem_written only
+    int snap_mapped;            // heap pages are mapped from a snapshot file
+    int32_t *memory;            // mem_inline, or a lazily mapped heap
+    uint32_t mem_mask;          // cells - 1 (cells a power of two >= MEM_SIZE)
+    int mem_mapped;
+    int32_t mem_inline[MEM_SIZE];
+    // data segment (sisa_map_data): the file at cell data_base of the heap
+    FILE *data_file;
+    size_t data_base, data_cells;
+    uint64_t data_bytes;
+    int data_copy;              // read into the heap rather than mapped
+    SisaErr err;
+    OutBuf out;
+    int out_mode;               // OUT_*
+    int out_binary;             // SISA_RUN_BINARY_OUT: records instead of text
+    int out_sync;               // flush after every PRINT (tracing)
+    SisaSinkFn sink;
+    void *sink_user;
+    // native code for p, compiled on the first SISA_RUN_JIT run
+    const SisaProgram *jit_prog;
+    void *jit_mem;
+    size_t jit_size;
+    struct Tier *tier;          // counters and native regions of SISA_RUN_TIER runs
+    unsigned tier_threshold;    // sisa_set_tier; 0: TIER_THRESHOLD
+    int tier_sync;              // compile on the running thread
+    struct Profile *prof;       // counts of the last SISA_RUN_PROFILE run
+    struct RunStats *stats;     // telemetry of the last SISA_RUN_STATS run
+    uint64_t out_flushed;       // output bytes out_flush has passed on
+};
 
 // Helpers
-static void runtime_err(const char *msg) { fprintf(stderr, "Runtime error: %s\n", msg); exit(1); }
+static void sisa_fail(int code, const char *fmt, ...) {
+    SisaErr *E = sisa_err_ctx;
+    va_list ap;
+    va_start(ap, fmt);
+    if (!E) { vfprintf(stderr, fmt, ap); fputc('\n', stderr); exit(1); }
+    vsnprintf(E->msg, sizeof(E->msg), fmt, ap);
+    va_end(ap);
+    E->code = code;
+    longjmp(E->jb, 1);
+}
+static void runtime_err(const char *msg) { sisa_fail(SISA_ERR_RUNTIME, "Runtime error: %s", msg); }
+static void nomem(void) { sisa_fail(SISA_ERR_NOMEM, "Runtime error: malloc failed"); }
+
+static void push_int(SisaVM *vm, int32_t x) {
+    if (vm->sp >= vm->stack_max) runtime_err("stack overflow");
+    vm->stack[vm->sp++] = mk_int(x);
+}
+static void push_float(SisaVM *vm, double f) {
+    if (vm->sp >= vm->stack_max) runtime_err("stack overflow");
+    vm->stack[vm->sp++] = mk_float(f);
+}
+static Value peek_val(SisaVM *vm) {
+    if (vm->sp <= 0) runtime_err("stack underflow (peek)");
+    return vm->stack[vm->sp-1];
+}
+static void push_from_value(SisaVM *vm, Value v) {
+    if (vm->sp >= vm->stack_max) runtime_err("stack overflow");
+    vm->stack[vm->sp++] = v;
+}
+// Checked access to the value k slots below the top
+static Value val_at_checked(SisaVM *vm, int k) {
+    if (vm->sp <= k) runtime_err("stack underflow");
+    return vm->stack[vm->sp-1-k];
+}
+static int32_t int_at_checked(SisaVM *vm, int k, const char *opname) {
+    Value v = val_at_checked(vm, k);
+    if (!VAL_IS_INT(v)) sisa_fail(SISA_ERR_RUNTIME, "%s expects integer on stack", opname);
+    return VAL_I(v);
+}
+static double float_at_checked(SisaVM *vm, int k, const char *opname) {
+    Value v = val_at_checked(vm, k);
+    if (VAL_IS_INT(v)) sisa_fail(SISA_ERR_RUNTIME, "%s expects float on stack", opname);
+    return VAL_F(v);
+}
+
+static int out_reserve(OutBuf *o, size_t n) {
+    if (o->cap - o->len >= n) return 1;
+    size_t nc = o->cap ? o->cap * 2 : 4096;
+    while (nc - o->len < n) nc *= 2;
+    char *q = realloc(o->buf, nc);
+    if (!q) return 0;
+    o->buf = q; o->cap = nc;
+    return 1;
+}
+static void out_flush(SisaVM *vm) {
+    OutBuf *o = &vm->out;
+    if (vm->out_mode == OUT_MEMORY || !o->len) return;
+    if (vm->out_mode == OUT_SINK) vm->sink(vm->sink_user, o->buf, o->len);
+    else fwrite(o->buf, 1, o->len, stdout);
+    vm->out_flushed += o->len;
+    o->len = 0;
+}
+
+// PRINT formatting without printf: "%d" and "%g" (six significant digits)
+static char *fmt_int(char *p, int32_t x) {
+    uint32_t u = (uint32_t)x;
+    char tmp[10];
+    int n = 0;
+    if (x < 0) { *p++ = '-'; u = 0u - u; }
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static const double pow10_exact[16] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+};
+
+// Scales |f| to six digits with a single rounding, so the result is exact
+// unless it lands within 1e-6 of a rounding tie; those, and magnitudes
+// outside [1e-5, 1e15) (inf and NaN included), go to snprintf.
+static char *fmt_g(char *p, double f) {
+    double a = f < 0 ? -f : f;
+    if (!(a >= 1e-5 && a < 1e15)) return p + snprintf(p, OUT_RECORD_MAX, "%g", f);
+    int e = 0;
+    if (a >= 1) while (a >= pow10_exact[e + 1]) ++e;
+    else for (e = -1; e > -5 && a * pow10_exact[-e] < 1; --e) ;
+    double s = e <= 5 ? a * pow10_exact[5 - e] : a / pow10_exact[e - 5];
+    int64_t m = (int64_t)s;
+    double frac = s - (double)m;
+    m += frac > 0.5;
+    // m < 100000: a sat just under 10^e and lost a digit
+    if (m < 100000 || (frac > 0.5 - 1e-6 && frac < 0.5 + 1e-6)) return p + snprintf(p, OUT_RECORD_MAX, "%g", f);
+    if (m == 1000000) { m = 100000; ++e; }
+    char d[6];
+    for (int i = 5; i >= 0; --i) { d[i] = (char)('0' + m % 10); m /= 10; }
+    int nd = 6;
+    while (nd > 1 && d[nd-1] == '0') --nd;
+    if (f < 0) *p++ = '-';
+    if (e < -4 || e >= 6) {                  // d.ddddde+XX
+        *p++ = d[0];
+        if (nd > 1) { *p++ = '.'; for (int i = 1; i < nd; ++i) *p++ = d[i]; }
+        *p++ = 'e';
+        *p++ = e < 0 ? '-' : '+';
+        int ae = e < 0 ? -e : e;
+        *p++ = (char)('0' + ae / 10);
+        *p++ = (char)('0' + ae % 10);
+    } else if (e >= 0) {                     // ddd.ddd
+        for (int i = 0; i <= e; ++i) *p++ = d[i];
+        if (nd > e + 1) { *p++ = '.'; for (int i = e + 1; i < nd; ++i) *p++ = d[i]; }
+    } else {                                 // 0.000ddd
+        *p++ = '0'; *p++ = '.';
+        for (int i = -1; i > e; --i) *p++ = '0';
+        for (int i = 0; i < nd; ++i) *p++ = d[i];
+    }
+    return p;
+}
+
+// Binary records: a tag byte (1 = int32, 2 = double) and the value, little-endian
+static char *fmt_record(char *p, Value v) {
+    uint64_t bits;
+    int n;
+    if (VAL_IS_INT(v)) { *p++ = 1; bits = (uint32_t)VAL_I(v); n = 4; }
+    else { double f = VAL_F(v); memcpy(&bits, &f, 8); *p++ = 2; n = 8; }
+    for (int i = 0; i < n; ++i) *p++ = (char)(bits >> (8*i));
+    return p;
+}
+
+// kept out of the dispatch loops, where inlining it costs more than the call
+SISA_NOINLINE static void vm_print(SisaVM *vm, Value v) {
+    OutBuf *o = &vm->out;
+    if (o->cap - o->len < OUT_RECORD_MAX) {
+        if (vm->out_mode == OUT_MEMORY || !o->buf) {
+            if (!out_reserve(o, vm->out_mode == OUT_MEMORY ? OUT_RECORD_MAX : OUT_BUFSIZE)) nomem();
+        } else out_flush(vm);
+    }
+    char *q = o->buf + o->len;
+    if (vm->out_binary) q = fmt_record(q, v);
+    else {
+        q = VAL_IS_INT(v) ? fmt_int(q, VAL_I(v)) : fmt_g(q, VAL_F(v));
+        *q++ = '\n';
+    }
+    o->len = (size_t)(q - o->buf);
+    if (vm->out_sync) out_flush(vm);
+}
+
+// Int arithmetic shared by every engine: b op a wraps modulo 2^32 (done
+// unsigned, so it is defined C). Division needs a != 0; INT_MIN / -1 wraps
+// to INT_MIN, remainder 0, instead of trapping.
+static inline int32_t int_add(int32_t b, int32_t a) { return (int32_t)((uint32_t)b + (uint32_t)a); }
+static inline int32_t int_sub(int32_t b, int32_t a) { return (int32_t)((uint32_t)b - (uint32_t)a); }
+static inline int32_t int_mul(int32_t b, int32_t a) { return (int32_t)((uint32_t)b * (uint32_t)a); }
+static inline int32_t int_div(int32_t b, int32_t a) { return a == -1 ? (int32_t)(0u - (uint32_t)b) : b / a; }
+static inline int32_t int_mod(int32_t b, int32_t a) { return a == -1 ? 0 : b % a; }
+
+// Float ops shared by every engine
+// FTOI: f truncates to an int32 (false for a NaN)
+static inline int ftoi_ok(double f) { return f > -2147483649.0 && f < 2147483648.0; }
+// CMP: -1 / 0 / 1 for b < a, b == a (or unordered), b > a; two ints compare
+// as ints, mixed operands as doubles
+static inline int32_t val_cmp(Value b, Value a) {
+    if (VAL_IS_INT(a) && VAL_IS_INT(b)) return (VAL_I(b) > VAL_I(a)) - (VAL_I(b) < VAL_I(a));
+    double x = val_num(b), y = val_num(a);
+    return (x > y) - (x < y);
+}
+// JE..JGE: b op a, compared as CMP does
+static int val_jcc(int op, Value b, Value a) {
+    if (VAL_IS_INT(a) && VAL_IS_INT(b)) {
+        int32_t x = VAL_I(b), y = VAL_I(a);
+        switch (op) {
+            case OP_JE: return x == y;
+            case OP_JNE: return x != y;
+            case OP_JL: return x < y;
+            case OP_JLE: return x <= y;
+            case OP_JG: return x > y;
+            default: return x >= y;
+        }
+    }
+    double x = val_num(b), y = val_num(a);
+    switch (op) {
+        case OP_JE: return x == y;
+        case OP_JNE: return x != y;
+        case OP_JL: return x < y;
+        case OP_JLE: return x <= y;
+        case OP_JG: return x > y;
+        default: return x >= y;
+    }
+}
+
+// FMAF: a * b + c rounded once. A build for FMA3 or AArch64 has it as one
+// instruction and MSVC's CRT has fma(); other x86-64 builds test the CPU and
+// fall back on fma_soft, which needs no libm: both addends as 128-bit
+// integers over a common exponent, the smaller one shifted into place with
+// the bits it loses jammed into bit 0, then one round to nearest even.
+#if !defined(_MSC_VER) && !(defined(__GNUC__) && (defined(__FMA__) || defined(__aarch64__)))
+#define FMA_SOFT 1
+typedef struct { uint64_t hi, lo; } U128;
+static U128 u128_mul(uint64_t a, uint64_t b) {
+    uint64_t a0 = (uint32_t)a, a1 = a >> 32, b0 = (uint32_t)b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+    U128 r;
+    r.lo = mid << 32 | (uint32_t)p00;
+    r.hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    return r;
+}
+static int u128_msb(U128 x) {                      // x != 0
+    int m = x.hi ? 127 : 63;
+    uint64_t w = x.hi ? x.hi : x.lo;
+    while (!(w >> 63)) { w <<= 1; --m; }
+    return m;
+}
+static U128 u128_shl(U128 x, int k) {              // 0 <= k < 128
+    if (k >= 64) { x.hi = x.lo << (k - 64); x.lo = 0; }
+    else if (k) { x.hi = x.hi << k | x.lo >> (64 - k); x.lo <<= k; }
+    return x;
+}
+static U128 u128_shr_jam(U128 x, int k) {          // k >= 0
+    if (k == 0) return x;
+    if (k >= 128) { x.lo = (x.hi | x.lo) != 0; x.hi = 0; return x; }
+    uint64_t lost;
+    if (k >= 64) {
+        lost = x.lo | (k > 64 ? x.hi << (128 - k) : 0);
+        x.lo = x.hi >> (k - 64); x.hi = 0;
+    } else {
+        lost = x.lo << (64 - k);
+        x.lo = x.lo >> k | x.hi << (64 - k); x.hi >>= k;
+    }
+    x.lo |= lost != 0;
+    return x;
+}
+static double fma_soft(double a, double b, double c) {
+    uint64_t ua, ub, uc;
+    memcpy(&ua, &a, 8); memcpy(&ub, &b, 8); memcpy(&uc, &c, 8);
+    int ea = (int)(ua >> 52 & 0x7FF), eb = (int)(ub >> 52 & 0x7FF), ec = (int)(uc >> 52 & 0x7FF);
+    // an infinite, NaN or zero product is exact, so is the plain expression
+    if (ea == 0x7FF || eb == 0x7FF || a == 0 || b == 0) return a * b + c;
+    if (ec == 0x7FF) return c + c;                  // a finite product cannot change it
+    if (c == 0) return a * b;
+    const uint64_t frac = ((uint64_t)1 << 52) - 1;
+    uint64_t ma = (ua & frac) | (uint64_t)(ea != 0) << 52, mb = (ub & frac) | (uint64_t)(eb != 0) << 52;
+    U128 P = u128_mul(ma, mb), C = { 0, (uc & frac) | (uint64_t)(ec != 0) << 52 };
+    // both with the top bit at 125: one bit of headroom for the carry, and
+    // at least 19 zero bits below, so the jam only ever breaks ties
+    int sp = 125 - u128_msb(P), sc = 125 - u128_msb(C);
+    P = u128_shl(P, sp); C = u128_shl(C, sc);
+    int ep = (ea ? ea : 1) + (eb ? eb : 1) - 2150 - sp, ex = (ec ? ec : 1) - 1075 - sc;
+    int neg = (int)((ua ^ ub) >> 63), negc = (int)(uc >> 63);
+    if (ep < ex || (ep == ex && (P.hi < C.hi || (P.hi == C.hi && P.lo < C.lo)))) {
+        U128 T = P; P = C; C = T;
+        int t = ep; ep = ex; ex = t;
+        t = neg; neg = negc; negc = t;
+    }
+    C = u128_shr_jam(C, ep - ex);
+    U128 R;
+    if (neg == negc) { R.lo = P.lo + C.lo; R.hi = P.hi + C.hi + (R.lo < P.lo); }
+    else { R.lo = P.lo - C.lo; R.hi = P.hi - C.hi - (P.lo < C.lo); }
+    if (!R.hi && !R.lo) return 0.0;                 // exact cancellation
+    // R * 2^ep to 53 bits: q is the exponent of the last one kept
+    int m = u128_msb(R), q = ep + m - 52;
+    if (q < -1074) q = -1074;                       // subnormal
+    int shift = q - ep;
+    uint64_t mant;
+    if (shift <= 0) mant = u128_shl(R, -shift).lo;  // exact
+    else {
+        // mant, then the round bit and the sticky bit
+        uint64_t t = shift >= 2 ? u128_shr_jam(R, shift - 2).lo : u128_shl(R, 1).lo;
+        mant = t >> 2;
+        if ((t & 2) && ((t & 1) || (mant & 1))) mant++;
+        if (mant >> 53) { mant >>= 1; q++; }
+    }
+    uint64_t bits = q > 971 ? (uint64_t)0x7FF << 52 : ((uint64_t)(q + 1074) << 52) + mant;
+    bits |= (uint64_t)neg << 63;
+    double r;
+    memcpy(&r, &bits, 8);
+    return r;
+}
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+static inline int cpu_has_fma(void) {
+#if defined(__FMA__)
+    return 1;
+#elif defined(__GNUC__)
+    return __builtin_cpu_supports("fma");
+#else
+    // FMA in CPUID leaf 1, and the OS saving the YMM state (OSXSAVE, XCR0)
+    int r[4];
+    __cpuid(r, 1);
+    return (r[2] & (1 << 12)) && (r[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+#endif
+}
+#endif
+#if defined(_MSC_VER)
+static double vm_fma(double a, double b, double c) { return fma(a, b, c); }
+#elif !defined(FMA_SOFT)
+static inline double vm_fma(double a, double b, double c) { return __builtin_fma(a, b, c); }
+#elif defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("fma"))) static double fma_hw(double a, double b, double c) { return __builtin_fma(a, b, c); }
+static double vm_fma(double a, double b, double c) { return cpu_has_fma() ? fma_hw(a, b, c) : fma_soft(a, b, c); }
+#else
+static double vm_fma(double a, double b, double c) { return fma_soft(a, b, c); }
+#endif
+// ADDF, SUBF, MULF, DIVF and FMAF: a NaN result is always the positive quiet
+// NaN. Which NaN operand the hardware passes on depends on the CPU and on
+// the operand order a compiler or the JIT picks, and 0/0 gives -nan on x86
+// but nan on ARM, so keeping it would make engines print different signs.
+#define FLT_NAN_BITS 0x7FF8000000000000ull
+static inline double flt_result(double x) {
+    if (x == x) return x;
+    uint64_t q = FLT_NAN_BITS;
+    memcpy(&x, &q, 8);
+    return x;
+}
+
+static const char *op_name(unsigned char op);
+
+// Vector kernels for VADD/VMUL/VDOT/VSUM (int32 cells) and their F forms
+// (doubles, two cells each), one set per instruction set: plain C, SSE2,
+// AVX2 and NEON. The best the CPU supports is picked on every call (a
+// cached feature test), or pinned with --vec. Float reductions always
+// run as eight interleaved partial sums, element i into sum i%8, combined
+// pairwise, so every kernel gives the same bits.
+enum { VEC_SCALAR, VEC_SSE2, VEC_AVX2, VEC_NEON, VEC_NISA };
+typedef struct {
+    void (*add)(int32_t *d, const int32_t *a, const int32_t *b, size_t n);
+    void (*mul)(int32_t *d, const int32_t *a, const int32_t *b, size_t n);
+    uint32_t (*dot)(const int32_t *a, const int32_t *b, size_t n);
+    uint32_t (*sum)(const int32_t *a, size_t n);
+    void (*addf)(int32_t *d, const int32_t *a, const int32_t *b, size_t n);
+    void (*mulf)(int32_t *d, const int32_t *a, const int32_t *b, size_t n);
+    double (*dotf)(const int32_t *a, const int32_t *b, size_t n);
+    double (*sumf)(const int32_t *a, size_t n);
+} VecKernels;
+
+static void vs_add(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    for (size_t i = 0; i < n; ++i) d[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+}
+static void vs_mul(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    for (size_t i = 0; i < n; ++i) d[i] = (int32_t)((uint32_t)a[i] * (uint32_t)b[i]);
+}
+static uint32_t vs_dot(const int32_t *a, const int32_t *b, size_t n) {
+    uint32_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += (uint32_t)a[i] * (uint32_t)b[i];
+    return s;
+}
+static uint32_t vs_sum(const int32_t *a, size_t n) {
+    uint32_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += (uint32_t)a[i];
+    return s;
+}
+// double i of a cell array (cells are only 4-byte aligned)
+static double vs_ld(const int32_t *p, size_t i) { double x; memcpy(&x, p + 2*i, 8); return x; }
+static void vs_st(int32_t *p, size_t i, double x) { memcpy(p + 2*i, &x, 8); }
+static void vs_addf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    for (size_t i = 0; i < n; ++i) vs_st(d, i, vs_ld(a, i) + vs_ld(b, i));
+}
+static void vs_mulf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    for (size_t i = 0; i < n; ++i) vs_st(d, i, vs_ld(a, i) * vs_ld(b, i));
+}
+// finish a reduction from element i with the partial sums s (b NULL: plain sum)
+static double vs_reduce(double *s, const int32_t *a, const int32_t *b, size_t i, size_t n) {
+    for (; i < n; ++i) {
+        double x = vs_ld(a, i);
+        if (b) x *= vs_ld(b, i);
+        s[i & 7] += x;
+    }
+    return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+}
+static double vs_dotf(const int32_t *a, const int32_t *b, size_t n) { double s[8] = {0}; return vs_reduce(s, a, b, 0, n); }
+static double vs_sumf(const int32_t *a, size_t n) { double s[8] = {0}; return vs_reduce(s, a, NULL, 0, n); }
+static const VecKernels vec_scalar = { vs_add, vs_mul, vs_dot, vs_sum, vs_addf, vs_mulf, vs_dotf, vs_sumf };
+
+#ifdef VEC_X86
+// SSE2 is part of x86-64, so this set needs no test
+static uint32_t v2_hsum(__m128i v) {
+    uint32_t l[4];
+    _mm_storeu_si128((__m128i *)l, v);
+    return l[0] + l[1] + l[2] + l[3];
+}
+// SSE2 has no 32-bit multiply-low: even and odd lanes through pmuludq
+static __m128i v2_mullo(__m128i x, __m128i y) {
+    __m128i even = _mm_mul_epu32(x, y);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+#define V2_LD(p)    _mm_loadu_si128((const __m128i *)(p))
+#define V2_LDF(p,i) _mm_loadu_pd((const double *)((p) + 2*(i)))
+static void v2_add(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i *)(d + i), _mm_add_epi32(V2_LD(a + i), V2_LD(b + i)));
+    vs_add(d + i, a + i, b + i, n - i);
+}
+static void v2_mul(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i *)(d + i), v2_mullo(V2_LD(a + i), V2_LD(b + i)));
+    vs_mul(d + i, a + i, b + i, n - i);
+}
+static uint32_t v2_dot(const int32_t *a, const int32_t *b, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) s = _mm_add_epi32(s, v2_mullo(V2_LD(a + i), V2_LD(b + i)));
+    return v2_hsum(s) + vs_dot(a + i, b + i, n - i);
+}
+static uint32_t v2_sum(const int32_t *a, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) s = _mm_add_epi32(s, V2_LD(a + i));
+    return v2_hsum(s) + vs_sum(a + i, n - i);
+}
+static void v2_addf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd((double *)(d + 2*i), _mm_add_pd(V2_LDF(a, i), V2_LDF(b, i)));
+    vs_addf(d + 2*i, a + 2*i, b + 2*i, n - i);
+}
+static void v2_mulf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd((double *)(d + 2*i), _mm_mul_pd(V2_LDF(a, i), V2_LDF(b, i)));
+    vs_mulf(d + 2*i, a + 2*i, b + 2*i, n - i);
+}
+// partial sums 0-1 in s0, 2-3 in s1, ...
+static double v2_reduce(const int32_t *a, const int32_t *b, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+#define V2_TERM(i) (b ? _mm_mul_pd(V2_LDF(a, i), V2_LDF(b, i)) : V2_LDF(a, i))
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_pd(s0, V2_TERM(i));
+        s1 = _mm_add_pd(s1, V2_TERM(i + 2));
+        s2 = _mm_add_pd(s2, V2_TERM(i + 4));
+        s3 = _mm_add_pd(s3, V2_TERM(i + 6));
+    }
+#undef V2_TERM
+    double s[8];
+    _mm_storeu_pd(s, s0); _mm_storeu_pd(s + 2, s1); _mm_storeu_pd(s + 4, s2); _mm_storeu_pd(s + 6, s3);
+    return vs_reduce(s, a, b, i, n);
+}
+static double v2_dotf(const int32_t *a, const int32_t *b, size_t n) { return v2_reduce(a, b, n); }
+static double v2_sumf(const int32_t *a, size_t n) { return v2_reduce(a, NULL, n); }
+static const VecKernels vec_sse2 = { v2_add, v2_mul, v2_dot, v2_sum, v2_addf, v2_mulf, v2_dotf, v2_sumf };
+
+#if defined(__GNUC__)
+#define SISA_AVX2 __attribute__((target("avx2")))
+#else
+#define SISA_AVX2
+#endif
+#define V8_LD(p)    _mm256_loadu_si256((const __m256i *)(p))
+#define V8_LDF(p,i) _mm256_loadu_pd((const double *)((p) + 2*(i)))
+SISA_AVX2 static uint32_t v8_hsum(__m256i v) {
+    uint32_t l[8];
+    _mm256_storeu_si256((__m256i *)l, v);
+    _mm256_zeroupper();
+    return l[0] + l[1] + l[2] + l[3] + l[4] + l[5] + l[6] + l[7];
+}
+SISA_AVX2 static void v8_add(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i *)(d + i), _mm256_add_epi32(V8_LD(a + i), V8_LD(b + i)));
+    _mm256_zeroupper();
+    vs_add(d + i, a + i, b + i, n - i);
+}
+SISA_AVX2 static void v8_mul(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i *)(d + i), _mm256_mullo_epi32(V8_LD(a + i), V8_LD(b + i)));
+    _mm256_zeroupper();
+    vs_mul(d + i, a + i, b + i, n - i);
+}
+SISA_AVX2 static uint32_t v8_dot(const int32_t *a, const int32_t *b, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) s = _mm256_add_epi32(s, _mm256_mullo_epi32(V8_LD(a + i), V8_LD(b + i)));
+    return v8_hsum(s) + vs_dot(a + i, b + i, n - i);
+}
+SISA_AVX2 static uint32_t v8_sum(const int32_t *a, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) s = _mm256_add_epi32(s, V8_LD(a + i));
+    return v8_hsum(s) + vs_sum(a + i, n - i);
+}
+SISA_AVX2 static void v8_addf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd((double *)(d + 2*i), _mm256_add_pd(V8_LDF(a, i), V8_LDF(b, i)));
+    _mm256_zeroupper();
+    vs_addf(d + 2*i, a + 2*i, b + 2*i, n - i);
+}
+SISA_AVX2 static void v8_mulf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd((double *)(d + 2*i), _mm256_mul_pd(V8_LDF(a, i), V8_LDF(b, i)));
+    _mm256_zeroupper();
+    vs_mulf(d + 2*i, a + 2*i, b + 2*i, n - i);
+}
+// partial sums 0-3 in lo, 4-7 in hi; mul and add stay separate (no FMA)
+// to round like the other kernels. GCC does not always clear the upper
+// halves before the plain-SSE tail code, so every kernel does.
+SISA_AVX2 static double v8_reduce(const int32_t *a, const int32_t *b, size_t n) {
+    __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x = V8_LDF(a, i), y = V8_LDF(a, i + 4);
+        if (b) { x = _mm256_mul_pd(x, V8_LDF(b, i)); y = _mm256_mul_pd(y, V8_LDF(b, i + 4)); }
+        lo = _mm256_add_pd(lo, x);
+        hi = _mm256_add_pd(hi, y);
+    }
+    double s[8];
+    _mm256_storeu_pd(s, lo);
+    _mm256_storeu_pd(s + 4, hi);
+    _mm256_zeroupper();
+    return vs_reduce(s, a, b, i, n);
+}
+SISA_AVX2 static double v8_dotf(const int32_t *a, const int32_t *b, size_t n) { return v8_reduce(a, b, n); }
+SISA_AVX2 static double v8_sumf(const int32_t *a, size_t n) { return v8_reduce(a, NULL, n); }
+static const VecKernels vec_avx2 = { v8_add, v8_mul, v8_dot, v8_sum, v8_addf, v8_mulf, v8_dotf, v8_sumf };
+
+static int vec_have_avx2(void) {
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("avx2");
+#else
+    // AVX2 in CPUID leaf 7, and the OS saving the YMM state (OSXSAVE, XCR0)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return 0;
+    __cpuid(r, 1);
+    if (!(r[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return 0;
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#endif
+}
+#define VEC_BEST() (vec_have_avx2() ? VEC_AVX2 : VEC_SSE2)
 
-static void push_int(int32_t x) {
-    if (sp >= STACK_SIZE) runtime_err("stack overflow");
-    stack[sp].type = TY_INT;
-    stack[sp].v.i = x;
-    sp++;
+#elif defined(VEC_ARM)
+// NEON is part of AArch64
+#define V4_LDF(p,i) vld1q_f64((const double *)((p) + 2*(i)))
+static void vn_add(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(d + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    vs_add(d + i, a + i, b + i, n - i);
+}
+static void vn_mul(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) vst1q_s32(d + i, vmulq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    vs_mul(d + i, a + i, b + i, n - i);
+}
+static uint32_t vn_dot(const int32_t *a, const int32_t *b, size_t n) {
+    uint32x4_t s = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        s = vmlaq_u32(s, vreinterpretq_u32_s32(vld1q_s32(a + i)), vreinterpretq_u32_s32(vld1q_s32(b + i)));
+    return vaddvq_u32(s) + vs_dot(a + i, b + i, n - i);
+}
+static uint32_t vn_sum(const int32_t *a, size_t n) {
+    uint32x4_t s = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) s = vaddq_u32(s, vreinterpretq_u32_s32(vld1q_s32(a + i)));
+    return vaddvq_u32(s) + vs_sum(a + i, n - i);
 }
-static void push_float(double f) {
-    if (sp >= STACK_SIZE) runtime_err("stack overflow");
-    stack[sp].type = TY_FLOAT;
-    stack[sp].v.f = f;
-    sp++;
+static void vn_addf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) vst1q_f64((double *)(d + 2*i), vaddq_f64(V4_LDF(a, i), V4_LDF(b, i)));
+    vs_addf(d + 2*i, a + 2*i, b + 2*i, n - i);
 }
-static Value pop_val() {
-    if (sp <= 0) runtime_err("stack underflow");
-    return stack[--sp];
+static void vn_mulf(int32_t *d, const int32_t *a, const int32_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) vst1q_f64((double *)(d + 2*i), vmulq_f64(V4_LDF(a, i), V4_LDF(b, i)));
+    vs_mulf(d + 2*i, a + 2*i, b + 2*i, n - i);
 }
-static Value peek_val() {
-    if (sp <= 0) runtime_err("stack underflow (peek)");
-    return stack[sp-1];
+// partial sums 0-1 in s0, 2-3 in s1, ...
+static double vn_reduce(const int32_t *a, const int32_t *b, size_t n) {
+    float64x2_t s0 = vdupq_n_f64(0), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+#define V4_TERM(i) (b ? vmulq_f64(V4_LDF(a, i), V4_LDF(b, i)) : V4_LDF(a, i))
+    for (; i + 8 <= n; i += 8) {
+        s0 = vaddq_f64(s0, V4_TERM(i));
+        s1 = vaddq_f64(s1, V4_TERM(i + 2));
+        s2 = vaddq_f64(s2, V4_TERM(i + 4));
+        s3 = vaddq_f64(s3, V4_TERM(i + 6));
+    }
+#undef V4_TERM
+    double s[8];
+    vst1q_f64(s, s0); vst1q_f64(s + 2, s1); vst1q_f64(s + 4, s2); vst1q_f64(s + 6, s3);
+    return vs_reduce(s, a, b, i, n);
 }
-static int32_t pop_int_checked(const char *opname) {
-    Value v = pop_val();
-    if (v.type != TY_INT) { fprintf(stderr, "%s expects integer on stack\n", opname); exit(1); }
-    return v.v.i;
+static double vn_dotf(const int32_t *a, const int32_t *b, size_t n) { return vn_reduce(a, b, n); }
+static double vn_sumf(const int32_t *a, size_t n) { return vn_reduce(a, NULL, n); }
+static const VecKernels vec_neon = { vn_add, vn_mul, vn_dot, vn_sum, vn_addf, vn_mulf, vn_dotf, vn_sumf };
+#define VEC_BEST() VEC_NEON
+
+#else
+#define VEC_BEST() VEC_SCALAR
+#endif
+
+static int vec_forced = -1;     // --vec: one kernel set for the whole process
+
+// the kernel set used for the next op: the one pinned, else the best the CPU has
+static int vec_isa(void) { return vec_forced >= 0 ? vec_forced : VEC_BEST(); }
+static const VecKernels *vec_kernels(int isa) {
+    switch (isa) {
+#ifdef VEC_X86
+        case VEC_SSE2: return &vec_sse2;
+        case VEC_AVX2: return &vec_avx2;
+#elif defined(VEC_ARM)
+        case VEC_NEON: return &vec_neon;
+#endif
+        default: return &vec_scalar;
+    }
 }
-static double pop_float_checked(const char *opname) {
-    Value v = pop_val();
-    if (v.type != TY_FLOAT) { fprintf(stderr, "%s expects float on stack\n", opname); exit(1); }
-    return v.v.f;
+
+// Block ops: MEMCPY/MEMSET/MEMCMP and the vector ops, each one native call
+// over whole cell ranges instead of an interpreted loop. They take
+// block_arity(op) ints, the length on top, and leave block_results(op).
+static int block_arity(int op) {
+    switch (op) {
+        case OP_VADD: case OP_VMUL: case OP_VADDF: case OP_VMULF: return 4;  // dst a b n
+        case OP_VSUM: case OP_VSUMF: return 2;                               // a n
+        default: return 3;  // MEMCPY dst src n, MEMSET dst value n, MEMCMP a b n, VDOT a b n
+    }
 }
-static void push_from_value(Value v) {
-    if (sp >= STACK_SIZE) runtime_err("stack overflow");
-    stack[sp++] = v;
+static int block_results(int op) { return op == OP_MEMCMP || op == OP_VDOT || op == OP_VSUM || op == OP_VDOTF || op == OP_VSUMF; }
+// [a, a + len) within memory
+static int block_in(uint64_t cells, int32_t a, uint64_t len) { return a >= 0 && (uint64_t)a + len <= cells; }
+
+// Run block op on mem with the operands below top (already type-checked);
+// a result (MEMCMP, VDOT, VSUM) replaces the deepest of them. 0 if n is
+// negative or a range is out of bounds. MEMCPY's ranges may overlap; so
+// may VADD/VMUL's, which then run element by element in order.
+SISA_NOINLINE static int block_op(int32_t *mem, uint32_t mem_mask, int op, Value *top) {
+    uint64_t cells = (uint64_t)mem_mask + 1;
+    int k = block_arity(op);
+    int32_t x[4];
+    for (int j = 0; j < k; ++j) x[j] = VAL_I(top[j-k]);
+    Value *res = &top[-k];
+    int32_t n = x[k-1];
+    if (n < 0) return 0;
+    if (op == OP_MEMCPY || op == OP_MEMSET || op == OP_MEMCMP) {
+        if (!block_in(cells, x[0], (uint32_t)n) || (op != OP_MEMSET && !block_in(cells, x[1], (uint32_t)n))) return 0;
+        int32_t *p = mem + x[0], *q = mem + x[1];
+        switch (op) {
+            case OP_MEMCPY: memmove(p, q, (size_t)n * sizeof(int32_t)); break;
+            case OP_MEMSET:
+                if (x[1] == 0) memset(p, 0, (size_t)n * sizeof(int32_t));
+                else for (int32_t i = 0; i < n; ++i) p[i] = x[1];
+                break;
+            default: {
+                int32_t r = 0;
+                for (int32_t i = 0; i < n; ++i)
+                    if (p[i] != q[i]) { r = p[i] < q[i] ? -1 : 1; break; }
+                *res = mk_int(r);
+            }
+        }
+        return 1;
+    }
+    int fl = op == OP_VADDF || op == OP_VMULF || op == OP_VDOTF || op == OP_VSUMF;
+    uint64_t len = (uint64_t)(uint32_t)n << fl;  // cells per operand
+    for (int j = 0; j < k - 1; ++j) if (!block_in(cells, x[j], len)) return 0;
+    const VecKernels *K = vec_kernels(vec_isa());
+    if (k == 4) {
+        // a destination partly overlapping a source: plain C, in order
+        int32_t d = x[0];
+        for (int j = 1; j < 3; ++j)
+            if (x[j] != d && (uint64_t)x[j] < d + len && (uint64_t)d < x[j] + len) K = &vec_scalar;
+    }
+    int32_t *a = mem + x[k == 4], *b = k > 2 ? mem + x[(k == 4) + 1] : NULL;
+    switch (op) {
+        case OP_VADD:  K->add(mem + x[0], a, b, (size_t)n); break;
+        case OP_VMUL:  K->mul(mem + x[0], a, b, (size_t)n); break;
+        case OP_VADDF: K->addf(mem + x[0], a, b, (size_t)n); break;
+        case OP_VMULF: K->mulf(mem + x[0], a, b, (size_t)n); break;
+        case OP_VDOT:  *res = mk_int((int32_t)K->dot(a, b, (size_t)n)); break;
+        case OP_VSUM:  *res = mk_int((int32_t)K->sum(a, (size_t)n)); break;
+        case OP_VDOTF: *res = mk_float(val_from_double(K->dotf(a, b, (size_t)n))); break;
+        default:       *res = mk_float(val_from_double(K->sumf(a, (size_t)n))); break;
+    }
+    return 1;
 }
+static void block_fail(int op) { sisa_fail(SISA_ERR_RUNTIME, "Runtime error: %s range out of bounds", op_name((unsigned char)op)); }
 
 // Label / reloc helpers
-static void add_label(const char *name, uint32_t offset) {
-    if (label_count >= MAX_LABELS) runtime_err("too many labels");
-    strncpy(labels[label_count].name, name, sizeof(labels[0].name)-1);
-    labels[label_count].offset = offset;
-    label_count++;
-}
-static int find_label(const char *name) {
-    for (int i=0;i<label_count;i++) if (strcmp(labels[i].name, name)==0) return labels[i].offset;
-    return -1;
+static void *grow(void *p, int *cap, size_t elem) {
+    int nc = *cap ? *cap * 2 : 64;
+    void *q = realloc(p, (size_t)nc * elem);
+    if (!q) nomem();
+    *cap = nc;
+    return q;
+}
+static uint32_t name_hash(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) { h ^= (unsigned char)s[i]; h *= 16777619u; }
+    return h;
+}
+static const char *label_name(const SisaProgram *P, int i) { return P->label_names + P->labels[i].name; }
+// slot of name in label_hash: its label, or the empty slot where it would go
+static size_t label_slot(const SisaProgram *P, const char *name, size_t len, uint32_t h) {
+    size_t mask = P->label_hash_cap - 1, k = h & mask;
+    for (;;) {
+        int32_t li = P->label_hash[k];
+        if (li < 0) return k;
+        const Label *L = &P->labels[li];
+        if (L->hash == h && L->len == len && memcmp(P->label_names + L->name, name, len) == 0) return k;
+        k = (k + 1) & mask;
+    }
+}
+static void label_rehash(SisaProgram *P, size_t cap) {
+    free(P->label_hash);
+    P->label_hash = malloc(cap * sizeof(int32_t));
+    if (!P->label_hash) nomem();
+    P->label_hash_cap = cap;
+    memset(P->label_hash, 0xFF, cap * sizeof(int32_t));
+    for (int i = 0; i < P->label_count; ++i)
+        P->label_hash[label_slot(P, label_name(P, i), P->labels[i].len, P->labels[i].hash)] = i;
+}
+// name's index in the symbol table, added undefined if it is new
+static int label_intern(SisaProgram *P, const char *name, size_t len) {
+    if ((size_t)(P->label_count + 1) * 2 > P->label_hash_cap)
+        label_rehash(P, P->label_hash_cap ? P->label_hash_cap * 2 : 256);
+    uint32_t h = name_hash(name, len);
+    size_t k = label_slot(P, name, len, h);
+    if (P->label_hash[k] >= 0) return P->label_hash[k];
+    if (P->label_count == P->label_cap) P->labels = grow(P->labels, &P->label_cap, sizeof(Label));
+    while (P->label_names_len + len + 1 > P->label_names_cap) {
+        P->label_names_cap = P->label_names_cap ? P->label_names_cap * 2 : 4096;
+        char *q = realloc(P->label_names, P->label_names_cap);
+        if (!q) nomem();
+        P->label_names = q;
+    }
+    Label *L = &P->labels[P->label_count];
+    L->name = (uint32_t)P->label_names_len; L->len = (uint32_t)len; L->offset = LABEL_UNDEF; L->hash = h; L->fwd = 0;
+    memcpy(P->label_names + P->label_names_len, name, len);
+    P->label_names[P->label_names_len + len] = 0;
+    P->label_names_len += len + 1;
+    return P->label_hash[k] = P->label_count++;
+}
+// the first definition of a name wins
+static void add_label(SisaProgram *P, const char *name, size_t len, uint32_t offset) {
+    int i = label_intern(P, name, len);  // may move P->labels
+    if (P->labels[i].offset == LABEL_UNDEF) P->labels[i].offset = offset;
+}
+#ifndef SISA_NO_MAIN
+static void reset_labels(SisaProgram *P) {  // --bench-asm reassembles into one program
+    P->label_count = 0; P->label_names_len = 0;
+    if (P->label_hash) memset(P->label_hash, 0xFF, P->label_hash_cap * sizeof(int32_t));
+}
+#endif
+
+// Constant pool
+static size_t const_slot(const SisaProgram *P, uint64_t bits, uint32_t tag) {
+    size_t mask = P->const_hash_cap - 1;
+    size_t k = (size_t)(((bits ^ tag) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    for (;;) {
+        int32_t ci = P->const_hash[k];
+        if (ci < 0 || (P->consts[ci].bits == bits && P->consts[ci].tag == tag)) return k;
+        k = (k + 1) & mask;
+    }
+}
+static void const_rehash(SisaProgram *P, size_t cap) {
+    free(P->const_hash);
+    P->const_hash = malloc(cap * sizeof(int32_t));
+    if (!P->const_hash) nomem();
+    P->const_hash_cap = cap;
+    memset(P->const_hash, 0xFF, cap * sizeof(int32_t));
+    for (int i = 0; i < P->const_count; ++i)
+        P->const_hash[const_slot(P, P->consts[i].bits, P->consts[i].tag)] = i;
+}
+// The value's pool index, added if it is new; -1 once the pool is full
+static int32_t const_intern(SisaProgram *P, uint64_t bits, uint32_t tag) {
+    if ((size_t)(P->const_count + 1) * 2 > P->const_hash_cap)
+        const_rehash(P, P->const_hash_cap ? P->const_hash_cap * 2 : 256);
+    size_t k = const_slot(P, bits, tag);
+    if (P->const_hash[k] >= 0) return P->const_hash[k];
+    if (P->const_count == CONST_MAX) return -1;
+    if (P->const_count == P->const_cap) P->consts = grow(P->consts, &P->const_cap, sizeof(Const));
+    P->consts[P->const_count].bits = bits;
+    P->consts[P->const_count].tag = tag;
+    return P->const_hash[k] = P->const_count++;
+}
+
+// Host functions (CALLN)
+// The built-in ones come after a host's own in lookups, so a host can
+// replace them. All of them check their memory ranges themselves.
+static double vm_sqrt(double x) {
+#if defined(_MSC_VER)
+    return sqrt(x);
+#elif defined(__GNUC__) && defined(__x86_64__)
+    __asm__("sqrtsd %1, %0" : "=x"(x) : "x"(x));    // no libm, no errno
+    return x;
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__("fsqrt %d0, %d1" : "=w"(x) : "w"(x));
+    return x;
+#else
+    return __builtin_sqrt(x);
+#endif
+}
+static int nat_sqrt(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)user; (void)mem; (void)cells;
+    sisa_set_float(&a[0], vm_sqrt(sisa_float(&a[0])));
+    return 0;
+}
+static int nat_hash(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)user;
+    int32_t at = sisa_int(&a[0]), n = sisa_int(&a[1]);
+    if (at < 0 || n < 0 || (uint64_t)at + (uint32_t)n > (uint64_t)cells * 4) return 1;
+    const unsigned char *p = (const unsigned char *)mem + at;
+    uint32_t h = 2166136261u;
+    for (int32_t i = 0; i < n; ++i) { h ^= p[i]; h *= 16777619u; }
+    sisa_set_int(&a[0], (int32_t)h);
+    return 0;
+}
+static int nat_atoi(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)user;
+    int32_t at = sisa_int(&a[0]);
+    uint64_t end = (uint64_t)cells * 4;
+    if (at < 0 || (uint64_t)at > end) return 1;
+    const unsigned char *p = (const unsigned char *)mem;
+    uint64_t i = (uint64_t)at;
+    while (i < end && (p[i] == ' ' || p[i] == '\t')) i++;
+    int neg = i < end && p[i] == '-';
+    uint64_t digits = i + neg;
+    uint32_t v = 0;
+    for (i = digits; i < end && p[i] >= '0' && p[i] <= '9'; ++i) v = v * 10 + (uint32_t)(p[i] - '0');
+    if (i == digits) i = (uint64_t)at;     // no number: the address stays
+    if (i > INT32_MAX) return 1;
+    sisa_set_int(&a[0], (int32_t)(neg ? 0u - v : v));
+    sisa_set_int(&a[1], (int32_t)i);
+    return 0;
+}
+static const Native native_builtin[] = {
+    { "sqrt", "f>f",  1, 1, { TY_FLOAT },       { TY_FLOAT },       1, nat_sqrt, NULL },
+    { "hash", "ii>i", 2, 1, { TY_INT, TY_INT }, { TY_INT },         1, nat_hash, NULL },
+    { "atoi", "i>ii", 1, 2, { TY_INT },         { TY_INT, TY_INT }, 1, nat_atoi, NULL },
+};
+
+// Fill in N's types from sig ("ii>f"); 0 if it is malformed
+static int native_sig(Native *N, const char *sig) {
+    const char *p = sig;
+    int n = 0;
+    for (; *p && *p != '>'; ++p) {
+        if (n == NATIVE_ARGS_MAX || (*p != 'i' && *p != 'f' && *p != 'v')) return 0;
+        N->in[n++] = *p == 'i' ? TY_INT : *p == 'f' ? TY_FLOAT : 0;
+    }
+    if (*p++ != '>') return 0;
+    N->nargs = (uint8_t)n;
+    for (n = 0; *p; ++p) {
+        if (n == NATIVE_ARGS_MAX || (*p != 'i' && *p != 'f')) return 0;
+        N->out[n++] = *p == 'i' ? TY_INT : TY_FLOAT;
+    }
+    N->nres = (uint8_t)n;
+    memcpy(N->sig, sig, (size_t)(p - sig) + 1);
+    return 1;
+}
+static const Native *native_find(const SisaHost *h, const char *name, size_t len) {
+    if (len > NATIVE_NAME_MAX) return NULL;
+    for (int i = 0; h && i < h->count; ++i)
+        if (strlen(h->fn[i].name) == len && memcmp(h->fn[i].name, name, len) == 0) return &h->fn[i];
+    for (size_t i = 0; i < sizeof native_builtin / sizeof native_builtin[0]; ++i)
+        if (strlen(native_builtin[i].name) == len && memcmp(native_builtin[i].name, name, len) == 0)
+            return &native_builtin[i];
+    return NULL;
+}
+// P's index for native N, added if it is new
+static int native_use(SisaProgram *P, const Native *N) {
+    for (int i = 0; i < P->native_count; ++i)
+        if (strcmp(P->natives[i].name, N->name) == 0) return i;
+    if (P->native_count == 0xFFFF) sisa_fail(SISA_ERR_ASM, "More than 65535 natives");
+    if (P->native_count == P->native_cap) P->natives = grow(P->natives, &P->native_cap, sizeof(Native));
+    P->natives[P->native_count] = *N;
+    return P->native_count++;
+}
+// CALLN on the checked loop: the arguments are there, of their types (the
+// top one first), and the results fit
+static void native_check(SisaVM *vm, const Native *N) {
+    for (int k = 0; k < N->nargs; ++k) {
+        int t = N->in[N->nargs - 1 - k];
+        if (t == TY_INT) (void)int_at_checked(vm, k, N->name);
+        else if (t == TY_FLOAT) (void)float_at_checked(vm, k, N->name);
+        else (void)val_at_checked(vm, k);
+    }
+    if (vm->sp - N->nargs + N->nres > vm->stack_max) runtime_err("stack overflow");
 }
-static void add_reloc(const char *name, size_t patch_pos) {
-    if (reloc_count >= MAX_REFS) runtime_err("too many relocations");
-    strncpy(relocs[reloc_count].name, name, sizeof(relocs[0].name)-1);
-    relocs[reloc_count].patch_pos = patch_pos;
-    reloc_count++;
+static void native_fail(const Native *N, int rc) {
+    sisa_fail(SISA_ERR_RUNTIME, "Runtime error: native %s failed (%d)", N->name, rc);
 }
 
 // Bytecode builder
-typedef struct {
-    unsigned char *buf;
-    size_t len;
-    size_t cap;
-} Builder;
 static Builder builder_new(size_t cap) {
-    Builder b; b.cap = cap; b.len = 0; b.buf = malloc(cap);
-    if (!b.buf) { perror("malloc"); exit(1); } return b;
+    Builder b; b.cap = cap ? cap : 64; b.len = 0; b.buf = malloc(b.cap);
+    if (!b.buf) nomem();
+    return b;
+}
+static void b_room(Builder *b, size_t n) {
+    if (b->len + n <= b->cap) return;
+    size_t cap = b->cap;
+    while (cap < b->len + n) cap *= 2;
+    unsigned char *q = realloc(b->buf, cap);
+    if (!q) nomem();
+    b->buf = q;
+    b->cap = cap;
 }
 static void b_emit_u8(Builder *b, uint8_t x) {
-    if (b->len + 1 > b->cap) runtime_err("bytecode overflow");
+    b_room(b, 1);
     b->buf[b->len++] = x;
 }
 static void b_emit_i32_le(Builder *b, int32_t x) {
-    if (b->len + 4 > b->cap) runtime_err("bytecode overflow");
+    b_room(b, 4);
     for (int i=0;i<4;i++) b->buf[b->len++] = (unsigned char)((x >> (8*i)) & 0xFF);
 }
 static void b_emit_u32_le(Builder *b, uint32_t x) {
-    if (b->len + 4 > b->cap) runtime_err("bytecode overflow");
+    b_room(b, 4);
     for (int i=0;i<4;i++) b->buf[b->len++] = (unsigned char)((x >> (8*i)) & 0xFF);
 }
 static void b_emit_double_le(Builder *b, double d) {
-    if (b->len + 8 > b->cap) runtime_err("bytecode overflow");
+    b_room(b, 8);
     union { double f; uint8_t b[8]; } u;
     u.f = d;
     // little-endian
@@ -203,412 +1324,5862 @@ static void b_patch_u32_le(Builder *b, size_t pos, uint32_t x) {
     if (pos + 4 > b->len) runtime_err("patch out of bounds");
     for (int i=0;i<4;i++) b->buf[pos + i] = (unsigned char)((x >> (8*i)) & 0xFF);
 }
+static uint32_t rd_u32_le(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-// Simple trim
-static char *trim(char *s) {
-    while (*s && isspace((unsigned char)*s)) s++;
-    if (*s == 0) return s;
-    char *end = s + strlen(s) - 1;
-    while (end > s && isspace((unsigned char)*end)) end--;
-    end[1] = '\0';
-    return s;
+// Tokens are slices of the source line: no copies, no allocation.
+typedef struct { const char *p; size_t n; } Tok;
+
+// Split [p, end) by whitespace and comma, stopping at a ';' or '#' comment
+static int tokenize_line(const char *p, const char *end, Tok *out, int max_tokens) {
+    int n = 0;
+    while (p < end && n < max_tokens) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end || *p == ';' || *p == '#') break;
+        const char *start = p;
+        while (p < end && !isspace((unsigned char)*p) && *p != ',') p++;
+        out[n].p = start; out[n].n = (size_t)(p - start); n++;
+        if (p < end && *p == ',') p++;
+    }
+    return n;
 }
-static int is_number_token(const char *s) {
-    if (!s || !*s) return 0;
-    // allow - sign and 0x hex and decimal
-    char *p = (char*)s;
-    if (*p == '-' || *p == '+') p++;
-    if (*p == '0' && (p[1]=='x' || p[1]=='X')) {
-        p += 2;
-        if (!isxdigit((unsigned char)*p)) return 0;
-        for (; *p; ++p) if (!isxdigit((unsigned char)*p)) return 0;
-        return 1;
+// NUL-terminated copy of a token for strtod / messages
+static const char *tok_str(Tok t, char *buf) {
+    size_t n = t.n < TOKEN_MAX - 1 ? t.n : TOKEN_MAX - 1;
+    memcpy(buf, t.p, n); buf[n] = 0;
+    return buf;
+}
+
+// Integer literal read from a token as strtol(s, NULL, 0) would: a sign,
+// then 0x hex, 0 octal or decimal digits up to the first other character
+// (none: 0), clamped to the int64 range. Returns the characters used.
+static size_t tok_long(Tok t, int64_t *out) {
+    const char *p = t.p, *e = t.p + t.n;
+    int neg = 0;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    unsigned base = 10;
+    if (p < e && *p == '0') {
+        base = 8;
+        if (e - p > 2 && (p[1] | 0x20) == 'x' && isxdigit((unsigned char)p[2])) { base = 16; p += 2; }
     }
-    int seen_digit = 0;
-    for (; *p; ++p) {
-        if (!isdigit((unsigned char)*p)) return 0;
-        seen_digit = 1;
+    const char *d0 = p;
+    uint64_t v = 0;
+    int over = 0;
+    for (; p < e; ++p) {
+        unsigned c = (unsigned char)*p, d;
+        if (c - '0' < 10) d = c - '0';
+        else if ((c | 0x20) - 'a' < 6) d = (c | 0x20) - 'a' + 10;
+        else break;
+        if (d >= base) break;
+        if (v > (UINT64_MAX - d) / base) over = 1;
+        else v = v * base + d;
     }
-    return seen_digit;
+    *out = 0;
+    if (p == d0) return 0;
+    uint64_t lim = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if (over || v > lim) v = lim;
+    *out = neg ? (v == lim ? INT64_MIN : -(int64_t)v) : (int64_t)v;
+    return (size_t)(p - t.p);
 }
 
-// Tokenize by whitespace and comma; returns malloc'd tokens (caller must free)
-static int tokenize_line(char *line, char **out, int max_tokens) {
-    int n = 0;
-    char *p = line;
-    while (*p && n < max_tokens) {
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (!*p) break;
-        if (*p == ';' || *p == '#') break;
-        char *start = p;
-        while (*p && !isspace((unsigned char)*p) && *p != ',') p++;
-        int len = p - start;
-        char *tok = malloc(len + 1);
-        memcpy(tok, start, len);
-        tok[len] = '\0';
-        out[n++] = tok;
-        if (*p == ',') p++;
+// Float literal read from a token. A decimal mantissa of at most 19 digits
+// that fits 53 bits, scaled by 10^-22..10^22, converts with one exact
+// multiply or divide, which rounds correctly; anything else (more digits,
+// bigger exponents, hex floats, inf, nan, trailing junk) goes to strtod.
+// 0 if the token does not start with a number.
+static int tok_double(Tok t, double *out) {
+    static const double pow10[23] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = t.p, *e = t.p + t.n;
+    int neg = 0, digits = 0, exp10 = 0, any = 0;
+    uint64_t m = 0;
+    if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    for (int frac = 0; p < e; ++p) {
+        if (*p == '.' && !frac) { frac = 1; continue; }
+        unsigned d = (unsigned char)*p - '0';
+        if (d >= 10) break;
+        any = 1;
+        if (m || d) {
+            if (++digits > 19) goto slow;
+            m = m * 10 + d;
+        }
+        exp10 -= frac;
+    }
+    if (!any) goto slow;
+    if (p < e && (*p | 0x20) == 'e') {
+        int eneg = 0, x = 0;
+        if (++p < e && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+        if (p == e || (unsigned char)*p - '0' >= 10) goto slow;
+        for (; p < e && (unsigned char)*p - '0' < 10; ++p) if (x < 10000) x = x * 10 + (*p - '0');
+        exp10 += eneg ? -x : x;
+    }
+    if (p != e || m > (1ull << 53) || exp10 < -22 || exp10 > 22) goto slow;
+    double d = (double)m;
+    if (exp10 < 0) d /= pow10[-exp10];
+    else d *= pow10[exp10];
+    *out = neg ? -d : d;
+    return 1;
+slow: {
+        char buf[TOKEN_MAX], *end;
+        const char *s = tok_str(t, buf);
+        *out = strtod(s, &end);
+        return end != s;
     }
-    return n;
 }
-static void free_tokens(char **toks, int n) { for (int i=0;i<n;i++) free(toks[i]); }
 
-// Assembler (two-pass from string)
-static unsigned char *assemble_from_string(const char *src, size_t *out_len) {
-    Builder b = builder_new(CODE_CAP);
-    // We'll parse line by line:
-    char *copy = strdup(src);
-    char *line = NULL;
-    char *saveptr = NULL;
-    int lineno = 0;
-    line = strtok_r(copy, "\n", &saveptr);
-    while (line) {
-        lineno++;
-        char *ln = trim(line);
-        if (!*ln || ln[0] == ';' || ln[0] == '#') { line = strtok_r(NULL, "\n", &saveptr); continue; }
-        // label?
-        char *colon = strchr(ln, ':');
-        if (colon) {
-            // label name from ln to colon
-            size_t lnlen = colon - ln;
-            char *lbl = strndup(ln, lnlen);
-            char *lt = trim(lbl);
-            if (strlen(lt) == 0) { fprintf(stderr,"Empty label at line %d\n",lineno); exit(1); }
-            add_label(lt, (uint32_t)b.len);
-            free(lbl);
-            // rest after colon
-            char *rest = colon + 1; rest = trim(rest);
-            if (!*rest) { line = strtok_r(NULL, "\n", &saveptr); continue; }
-            ln = rest;
-        }
-        // tokenize (max 3 tokens)
-        char *toks[3] = {0};
-        int tn = tokenize_line(ln, toks, 3);
-        if (tn == 0) { line = strtok_r(NULL, "\n", &saveptr); continue; }
-        // uppercase copy for match
-        char cmdu[64]; strncpy(cmdu, toks[0], sizeof(cmdu)-1); cmdu[sizeof(cmdu)-1]=0;
-        for (char *p = cmdu; *p; ++p) *p = (char)toupper((unsigned char)*p);
-
-        if (strcmp(cmdu, "PUSH") == 0) {
-            if (tn < 2) { fprintf(stderr,"PUSH missing arg at line %d\n",lineno); exit(1); }
-            int32_t v = (int32_t)strtol(toks[1], NULL, 0);
-            b_emit_u8(&b, OP_PUSH);
-            b_emit_i32_le(&b, v);
-        } else if (strcmp(cmdu, "PUSHF") == 0) {
-            if (tn < 2) { fprintf(stderr,"PUSHF missing arg at line %d\n",lineno); exit(1); }
-            char *endptr = NULL;
-            double dv = strtod(toks[1], &endptr);
-            if (endptr == toks[1]) { fprintf(stderr,"Invalid float literal '%s' at line %d\n", toks[1], lineno); exit(1); }
-            b_emit_u8(&b, OP_PUSHF);
-            b_emit_double_le(&b, dv);
-        } else if (strcmp(cmdu, "ADD") == 0) { b_emit_u8(&b, OP_ADD); }
-        else if (strcmp(cmdu, "SUB") == 0) { b_emit_u8(&b, OP_SUB); }
-        else if (strcmp(cmdu, "MUL") == 0) { b_emit_u8(&b, OP_MUL); }
-        else if (strcmp(cmdu, "DIV") == 0) { b_emit_u8(&b, OP_DIV); }
-        else if (strcmp(cmdu, "MOD") == 0) { b_emit_u8(&b, OP_MOD); }
-        else if (strcmp(cmdu, "INC") == 0) { b_emit_u8(&b, OP_INC); }
-        else if (strcmp(cmdu, "DEC") == 0) { b_emit_u8(&b, OP_DEC); }
-        else if (strcmp(cmdu, "NEG") == 0) { b_emit_u8(&b, OP_NEG); }
-        else if (strcmp(cmdu, "ADDF") == 0) { b_emit_u8(&b, OP_ADDF); }
-        else if (strcmp(cmdu, "MULF") == 0) { b_emit_u8(&b, OP_MULF); }
-        else if (strcmp(cmdu, "DUP") == 0) { b_emit_u8(&b, OP_DUP); }
-        else if (strcmp(cmdu, "PRINT") == 0) { b_emit_u8(&b, OP_PRINT); }
-        else if (strcmp(cmdu, "POP") == 0) { b_emit_u8(&b, OP_POP); }
-        else if (strcmp(cmdu, "LOAD") == 0) { b_emit_u8(&b, OP_LOAD); }
-        else if (strcmp(cmdu, "STORE") == 0) { b_emit_u8(&b, OP_STORE); }
-        else if (strcmp(cmdu, "JMP")==0 || strcmp(cmdu, "JZ")==0 || strcmp(cmdu, "CALL")==0) {
-            unsigned char op = (strcmp(cmdu,"JMP")==0)?OP_JMP:(strcmp(cmdu,"JZ")==0?OP_JZ:OP_CALL);
-            b_emit_u8(&b, op);
-            if (tn < 2) { fprintf(stderr,"%s missing target at line %d\n", cmdu, lineno); exit(1); }
-            // if numeric target given, accept it as absolute offset
-            char *targ = toks[1];
-            int isnum = 1;
-            char *p = targ; if (*p=='+'||*p=='-') p++;
-            if (*p=='0' && (p[1]=='x' || p[1]=='X')) {
-                p += 2;
-                if (!isxdigit((unsigned char)*p)) isnum = 0;
-                for (; *p; ++p) if (!isxdigit((unsigned char)*p)) isnum = 0;
+// Mnemonic -> opcode, case-insensitive; -1 if unknown
+static int mnemonic_op(Tok t) {
+    char u[8];
+    if (t.n < 2 || t.n > 8) return -1;
+    for (size_t i = 0; i < t.n; ++i) u[i] = (char)toupper((unsigned char)t.p[i]);
+#define M(s, op) if (memcmp(u, s, t.n) == 0) return op
+    switch (t.n) {
+        case 2: M("JZ", OP_JZ); M("JE", OP_JE); M("JL", OP_JL); M("JG", OP_JG); break;
+        case 3:
+            switch (u[0]) {
+                case 'A': M("ADD", OP_ADD); break;
+                case 'S': M("SUB", OP_SUB); break;
+                case 'M': M("MUL", OP_MUL); M("MOD", OP_MOD); break;
+                case 'D': M("DIV", OP_DIV); M("DEC", OP_DEC); M("DUP", OP_DUP); break;
+                case 'I': M("INC", OP_INC); break;
+                case 'N': M("NEG", OP_NEG); M("NOP", OP_NOP); break;
+                case 'P': M("POP", OP_POP); break;
+                case 'J': M("JMP", OP_JMP); M("JNE", OP_JNE); M("JLE", OP_JLE); M("JGE", OP_JGE); break;
+                case 'C': M("CMP", OP_CMP); break;
+                case 'R': M("RET", OP_RET); break;
+            }
+            break;
+        case 4:
+            switch (u[0]) {
+                case 'P': M("PUSH", OP_PUSH); break;
+                case 'V': M("VADD", OP_VADD); M("VMUL", OP_VMUL); M("VDOT", OP_VDOT); M("VSUM", OP_VSUM); break;
+                case 'A': M("ADDF", OP_ADDF); break;
+                case 'S': M("SUBF", OP_SUBF); break;
+                case 'M': M("MULF", OP_MULF); break;
+                case 'D': M("DIVF", OP_DIVF); break;
+                case 'N': M("NEGF", OP_NEGF); break;
+                case 'F': M("FMAF", OP_FMAF); M("FTOI", OP_FTOI); break;
+                case 'I': M("ITOF", OP_ITOF); break;
+                case 'L': M("LOAD", OP_LOAD); break;
+                case 'C': M("CALL", OP_CALL); break;
+                case 'H': M("HALT", OP_HALT); break;
+            }
+            break;
+        case 5:
+            M("PUSHF", OP_PUSHF); M("PRINT", OP_PRINT); M("STORE", OP_STORE);
+            M("LOADB", OP_LOADB); M("LOADF", OP_LOADF);
+            M("VADDF", OP_VADDF); M("VMULF", OP_VMULF); M("VDOTF", OP_VDOTF); M("VSUMF", OP_VSUMF);
+            M("CALLN", OP_CALLN);
+            break;
+        case 6: M("STOREF", OP_STOREF); M("MEMCPY", OP_MEMCPY); M("MEMSET", OP_MEMSET); M("MEMCMP", OP_MEMCMP); break;
+        case 8: M("SNAPSHOT", OP_SNAPSHOT); break;
+    }
+#undef M
+    return -1;
+}
+
+// Assembler (one pass over the source)
+// Labels are resolved as they are defined: a backward reference gets its
+// offset at once, a forward one joins the label's chain (see Label), so
+// nothing of the source has to outlive its line. Code goes to P->asm_b.
+static void asm_shrunk(SisaProgram *P, uint32_t at, int old_len) {
+    if (P->asm_shift_count == P->asm_shift_cap) P->asm_shift = grow(P->asm_shift, &P->asm_shift_cap, sizeof(AsmShift));
+    AsmShift *S = &P->asm_shift[P->asm_shift_count++];
+    S->old = at + P->asm_delta;
+    S->at = at;
+    S->old_len = (uint8_t)old_len;
+    S->len = (uint8_t)(P->asm_b.len - at);
+    P->asm_delta += (uint32_t)(old_len - S->len);
+}
+// An old layout offset as a code offset. One inside a shortened PUSH maps
+// inside it too, so decoding reports it as the middle of an instruction.
+static uint32_t asm_map_target(const SisaProgram *P, uint32_t t) {
+    int lo = 0, hi = P->asm_shift_count;
+    while (lo < hi) { int m = lo + (hi - lo) / 2; if (P->asm_shift[m].old <= t) lo = m + 1; else hi = m; }
+    if (lo == 0) return t;
+    const AsmShift *S = &P->asm_shift[lo - 1];
+    if (t - S->old < S->old_len) return t == S->old ? S->at : S->at + 1;
+    return t - (S->old + S->old_len) + S->at + S->len;
+}
+
+static void asm_line(SisaProgram *P, const char *ln, const char *end, int lineno) {
+    Builder *b = &P->asm_b;
+    char buf[TOKEN_MAX];
+    while (ln < end && isspace((unsigned char)*ln)) ln++;
+    if (ln == end || *ln == ';' || *ln == '#') return;
+    if (b->len > UINT32_MAX - 16) sisa_fail(SISA_ERR_ASM, "Program larger than 4 GB at line %d", lineno);
+    // label? (a ':' before any comment)
+    const char *colon = ln;
+    while (colon < end && *colon != ':' && *colon != ';' && *colon != '#') colon++;
+    if (colon < end && *colon == ':') {
+        const char *le = colon;
+        while (le > ln && isspace((unsigned char)le[-1])) le--;
+        if (le == ln) sisa_fail(SISA_ERR_ASM, "Empty label at line %d", lineno);
+        if (le - ln > LABEL_MAX) sisa_fail(SISA_ERR_ASM, "Label longer than %d characters at line %d", LABEL_MAX, lineno);
+        int li = label_intern(P, ln, (size_t)(le - ln));  // may move P->labels
+        Label *L = &P->labels[li];
+        if (L->offset == LABEL_UNDEF) {
+            L->offset = (uint32_t)b->len;
+            for (uint32_t at = L->fwd; at; ) {
+                uint32_t next = rd_u32_le(b->buf + at - 1);
+                b_patch_u32_le(b, at - 1, L->offset);
+                at = next;
+            }
+            L->fwd = 0;
+        }
+        ln = colon + 1;
+    }
+    // tokenize (max 3 tokens)
+    Tok toks[3];
+    int tn = tokenize_line(ln, end, toks, 3);
+    if (tn == 0) return;
+    int op = mnemonic_op(toks[0]);
+    switch (op) {
+        // ints that fit go inline in one or two bytes, other values into
+        // the constant pool (inline again once it is full)
+        case OP_PUSH: {
+            if (tn < 2) sisa_fail(SISA_ERR_ASM, "PUSH missing arg at line %d", lineno);
+            int64_t lv;
+            tok_long(toks[1], &lv);
+            int32_t v = (int32_t)lv;
+            int32_t k;
+            uint32_t at = (uint32_t)b->len;
+            if (v >= -128 && v <= 127) {
+                b_emit_u8(b, OP_PUSH8);
+                b_emit_u8(b, (uint8_t)v);
+            } else if (v >= -32768 && v <= 32767) {
+                b_emit_u8(b, OP_PUSH16);
+                b_emit_u8(b, (uint8_t)v); b_emit_u8(b, (uint8_t)(v >> 8));
+            } else if ((k = const_intern(P, (uint32_t)v, CONST_INT)) >= 0) {
+                b_emit_u8(b, OP_PUSHK);
+                b_emit_u8(b, (uint8_t)k); b_emit_u8(b, (uint8_t)(k >> 8));
             } else {
-                for (; *p; ++p) if (!isdigit((unsigned char)*p)) { isnum = 0; break; }
+                b_emit_u8(b, OP_PUSH);
+                b_emit_i32_le(b, v);
             }
-            if (isnum) {
-                uint32_t off = (uint32_t)strtoul(targ, NULL, 0);
-                b_emit_u32_le(&b, off);
+            if (b->len - at < 5) asm_shrunk(P, at, 5);
+            break;
+        }
+        case OP_PUSHF: {
+            if (tn < 2) sisa_fail(SISA_ERR_ASM, "PUSHF missing arg at line %d", lineno);
+            double dv;
+            if (!tok_double(toks[1], &dv))
+                sisa_fail(SISA_ERR_ASM, "Invalid float literal '%s' at line %d", tok_str(toks[1], buf), lineno);
+            uint64_t bits;
+            memcpy(&bits, &dv, 8);
+            int32_t k = const_intern(P, bits, CONST_FLOAT);
+            if (k >= 0) {
+                uint32_t at = (uint32_t)b->len;
+                b_emit_u8(b, OP_PUSHK);
+                b_emit_u8(b, (uint8_t)k); b_emit_u8(b, (uint8_t)(k >> 8));
+                asm_shrunk(P, at, 9);
             } else {
-                size_t patch_pos = b.len;
-                b_emit_u32_le(&b, 0);
-                add_reloc(toks[1], patch_pos);
+                b_emit_u8(b, OP_PUSHF);
+                b_emit_double_le(b, dv);
             }
-        } else if (strcmp(cmdu, "RET") == 0) { b_emit_u8(&b, OP_RET); }
-        else if (strcmp(cmdu, "HALT") == 0) { b_emit_u8(&b, OP_HALT); }
-        else {
-            fprintf(stderr, "Unknown instruction '%s' at line %d\n", toks[0], lineno);
-            exit(1);
+            break;
         }
-
-        free_tokens(toks, tn);
-        line = strtok_r(NULL, "\n", &saveptr);
+        case OP_JMP: case OP_JZ: case OP_CALL:
+        case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE: {
+            b_emit_u8(b, (uint8_t)op);
+            if (tn < 2) sisa_fail(SISA_ERR_ASM, "%s missing target at line %d", op_name((unsigned char)op), lineno);
+            // a numeric target is an absolute offset in the old layout (see AsmShift)
+            int64_t tv;
+            if (tok_long(toks[1], &tv) == toks[1].n) {
+                if (P->asm_numeric_count == P->asm_numeric_cap)
+                    P->asm_numeric = grow(P->asm_numeric, &P->asm_numeric_cap, sizeof(uint32_t));
+                P->asm_numeric[P->asm_numeric_count++] = (uint32_t)b->len;
+                b_emit_u32_le(b, (uint32_t)tv);
+            } else {
+                // no definition can match a name this long
+                if (toks[1].n > LABEL_MAX) sisa_fail(SISA_ERR_ASM, "Undefined label: %.*s", (int)toks[1].n, toks[1].p);
+                int li = label_intern(P, toks[1].p, toks[1].n);
+                Label *L = &P->labels[li];
+                if (L->offset != LABEL_UNDEF) {
+                    b_emit_u32_le(b, L->offset);
+                } else {
+                    uint32_t at = (uint32_t)b->len + 1;
+                    b_emit_u32_le(b, L->fwd);
+                    L->fwd = at;
+                }
+            }
+            break;
+        }
+        // the program's index of the native, whose signature the verifier checks
+        case OP_CALLN: {
+            if (tn < 2) sisa_fail(SISA_ERR_ASM, "CALLN missing name at line %d", lineno);
+            const Native *N = native_find(P->host, toks[1].p, toks[1].n);
+            if (!N) sisa_fail(SISA_ERR_ASM, "Unknown native '%s' at line %d", tok_str(toks[1], buf), lineno);
+            int k = native_use(P, N);
+            b_emit_u8(b, OP_CALLN);
+            b_emit_u8(b, (uint8_t)k); b_emit_u8(b, (uint8_t)(k >> 8));
+            break;
+        }
+        case -1:
+            sisa_fail(SISA_ERR_ASM, "Unknown instruction '%.*s' at line %d", (int)toks[0].n, toks[0].p, lineno);
+            break;
+        default: b_emit_u8(b, (uint8_t)op); break;
     }
+}
 
-    // patch relocations
-    for (int r = 0; r < reloc_count; ++r) {
-        int tgt = find_label(relocs[r].name);
-        if (tgt < 0) { fprintf(stderr, "Undefined label: %s\n", relocs[r].name); exit(1); }
-        b_patch_u32_le(&b, relocs[r].patch_pos, (uint32_t)tgt);
+static void asm_begin(SisaProgram *P) {
+    free(P->asm_b.buf);
+    P->asm_b = builder_new(CODE_CAP);
+    P->const_count = 0;
+    P->native_count = 0;
+    P->asm_shift_count = P->asm_numeric_count = 0;
+    P->asm_delta = 0;
+    if (P->const_hash) memset(P->const_hash, 0xFF, P->const_hash_cap * sizeof(int32_t));
+}
+// All labels defined: hand the builder's buffer, trimmed, to P->code
+static void asm_end(SisaProgram *P) {
+    for (int i = 0; i < P->label_count; ++i)
+        if (P->labels[i].offset == LABEL_UNDEF) sisa_fail(SISA_ERR_ASM, "Undefined label: %s", label_name(P, i));
+    Builder *b = &P->asm_b;
+    for (int i = 0; i < P->asm_numeric_count; ++i) {
+        uint32_t at = P->asm_numeric[i];
+        b_patch_u32_le(b, at, asm_map_target(P, rd_u32_le(b->buf + at)));
     }
+    free(P->asm_shift); P->asm_shift = NULL; P->asm_shift_count = P->asm_shift_cap = 0;
+    free(P->asm_numeric); P->asm_numeric = NULL; P->asm_numeric_count = P->asm_numeric_cap = 0;
+    unsigned char *out = realloc(b->buf, b->len ? b->len : 1);
+    free(P->code_owned);
+    P->code = P->code_owned = out ? out : b->buf;
+    P->code_len = b->len;
+    b->buf = NULL;
+}
 
-    unsigned char *out = malloc(b.len);
-    if (!out) runtime_err("malloc failed");
-    memcpy(out, b.buf, b.len);
-    *out_len = b.len;
-    free(b.buf);
-    free(copy);
-    return out;
+// Assembles src into P->code; labels go to P's symbol table.
+static void assemble_from_string(SisaProgram *P, const char *src) {
+    asm_begin(P);
+    int lineno = 0;
+    for (const char *line = src; *line; ) {
+        const char *nl = strchr(line, '\n');
+        const char *end = nl ? nl : line + strlen(line);
+        asm_line(P, line, end, ++lineno);
+        line = nl ? nl + 1 : end;
+    }
+    asm_end(P);
 }
 
-// Simple TRACE printer
-static const char *op_name(unsigned char op) {
-    switch(op) {
-        case OP_PUSH: return "PUSH";
-        case OP_PUSHF: return "PUSHF";
-        case OP_ADD: return "ADD";
-        case OP_SUB: return "SUB";
-        case OP_MUL: return "MUL";
-        case OP_DIV: return "DIV";
-        case OP_MOD: return "MOD";
-        case OP_INC: return "INC";
-        case OP_DEC: return "DEC";
-        case OP_NEG: return "NEG";
-        case OP_ADDF: return "ADDF";
-        case OP_MULF: return "MULF";
-        case OP_DUP: return "DUP";
-        case OP_PRINT: return "PRINT";
-        case OP_POP: return "POP";
-        case OP_LOAD: return "LOAD";
-        case OP_STORE: return "STORE";
-        case OP_JMP: return "JMP";
-        case OP_JZ: return "JZ";
-        case OP_CALL: return "CALL";
-        case OP_RET: return "RET";
-        case OP_HALT: return "HALT";
-        default: return "UNK";
+// The same, reading f in ASM_CHUNK blocks (pipes included). Only the
+// unfinished line is carried over to the next block, so memory follows the
+// bytecode and the labels rather than the size of the source.
+#define ASM_CHUNK 65536
+static void assemble_from_stream(SisaProgram *P, FILE *f) {
+    size_t cap = ASM_CHUNK, have = 0;
+    char *buf = P->asm_src = malloc(cap);
+    if (!buf) nomem();
+    asm_begin(P);
+    int lineno = 0;
+    for (int eof = 0; !eof; ) {
+        if (have == cap) {  // one line fills the buffer
+            char *q = realloc(buf, cap *= 2);
+            if (!q) nomem();
+            buf = P->asm_src = q;
+        }
+        size_t got = fread(buf + have, 1, cap - have, f);
+        if (got < cap - have) {
+            if (ferror(f)) sisa_fail(SISA_ERR_IO, "Failed to read the source");
+            eof = 1;
+        }
+        const char *p = buf, *end = buf + have + got, *nl;
+        while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+            asm_line(P, p, nl, ++lineno);
+            p = nl + 1;
+        }
+        if (eof && p < end) asm_line(P, p, end, ++lineno);
+        have = (size_t)(end - p);
+        memmove(buf, p, have);
     }
+    free(buf);
+    P->asm_src = NULL;
+    asm_end(P);
 }
 
-static void print_stack_snapshot() {
-    printf(" [stack:");
-    int start = sp - 8; if (start < 0) start = 0;
-    for (int i = start; i < sp; ++i) {
-        if (stack[i].type == TY_INT) printf(" %d", stack[i].v.i);
-        else printf(" %g", stack[i].v.f);
+// Binary image
+// Assembled bytecode plus its labels and constant pool, written once with
+// --save and loaded in place of the source on later runs. Little-endian
+// throughout:
+//   0  "SISA"        magic
+//   4  u16 version   IMAGE_VERSION
+//   6  u16 header    IMAGE_HEADER (offset of the code section)
+//   8  u32 code_len
+//   12 u32 nsyms
+//   16 u32 sym_bytes size of the symbol table
+//   20 u32 checksum  FNV-1a over the code, symbol table and constants
+//   24 u32 nconsts
+//   28 u32 nnatives
+//   32 u32 native_bytes size of the native table
+//   36 code_len bytes of bytecode
+//   .. nsyms x { u32 offset; u8 len; len bytes of name }
+//   .. nconsts x { u8 tag; u64 bits } (see Const)
+//   .. nnatives x { u8 len; name; u8 len; signature } in CALLN index order
+// The loader maps the file read-only and runs the bytecode from the mapping,
+// so processes loading the same image share its pages. Natives are looked up
+// by name again, and must have the signature the image was checked against.
+// Version 1 images (a 24-byte header, no constants) and version 2 ones (28
+// bytes, no natives) still load.
+#define IMAGE_VERSION 3
+#define IMAGE_HEADER  36
+#define IMAGE_HEADER_V1 24
+#define IMAGE_HEADER_V2 28
+
+static uint32_t fnv1a(const unsigned char *p, size_t n, uint32_t h) {
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 16777619u; }
+    return h;
+}
+static int is_image(const unsigned char *p, size_t n) {
+    return n >= 4 && memcmp(p, "SISA", 4) == 0;
+}
+
+static int save_image(const SisaProgram *P, const char *path) {
+    size_t sym_bytes = 0;
+    size_t nat_bytes = 0;
+    for (int i = 0; i < P->label_count; ++i) sym_bytes += 5 + P->labels[i].len;
+    for (int i = 0; i < P->native_count; ++i) nat_bytes += 2 + strlen(P->natives[i].name) + strlen(P->natives[i].sig);
+    Builder b = builder_new(IMAGE_HEADER + P->code_len + sym_bytes + (size_t)P->const_count * 9 + nat_bytes);
+    for (int i = 0; i < 4; ++i) b_emit_u8(&b, (uint8_t)"SISA"[i]);
+    b_emit_u8(&b, IMAGE_VERSION & 0xFF); b_emit_u8(&b, IMAGE_VERSION >> 8);
+    b_emit_u8(&b, IMAGE_HEADER & 0xFF); b_emit_u8(&b, IMAGE_HEADER >> 8);
+    b_emit_u32_le(&b, (uint32_t)P->code_len);
+    b_emit_u32_le(&b, (uint32_t)P->label_count);
+    b_emit_u32_le(&b, (uint32_t)sym_bytes);
+    b_emit_u32_le(&b, 0); // checksum, patched below
+    b_emit_u32_le(&b, (uint32_t)P->const_count);
+    b_emit_u32_le(&b, (uint32_t)P->native_count);
+    b_emit_u32_le(&b, (uint32_t)nat_bytes);
+    for (size_t i = 0; i < P->code_len; ++i) b_emit_u8(&b, P->code[i]);
+    for (int i = 0; i < P->label_count; ++i) {
+        size_t len = P->labels[i].len;
+        const char *name = label_name(P, i);
+        b_emit_u32_le(&b, P->labels[i].offset);
+        b_emit_u8(&b, (uint8_t)len);
+        for (size_t k = 0; k < len; ++k) b_emit_u8(&b, (uint8_t)name[k]);
     }
-    printf(" ]\n");
+    for (int i = 0; i < P->const_count; ++i) {
+        b_emit_u8(&b, (uint8_t)P->consts[i].tag);
+        b_emit_u32_le(&b, (uint32_t)P->consts[i].bits);
+        b_emit_u32_le(&b, (uint32_t)(P->consts[i].bits >> 32));
+    }
+    for (int i = 0; i < P->native_count; ++i) {
+        const char *name = P->natives[i].name, *sig = P->natives[i].sig;
+        size_t nl = strlen(name), sl = strlen(sig);
+        b_emit_u8(&b, (uint8_t)nl);
+        for (size_t k = 0; k < nl; ++k) b_emit_u8(&b, (uint8_t)name[k]);
+        b_emit_u8(&b, (uint8_t)sl);
+        for (size_t k = 0; k < sl; ++k) b_emit_u8(&b, (uint8_t)sig[k]);
+    }
+    b_patch_u32_le(&b, 20, fnv1a(b.buf + IMAGE_HEADER, b.len - IMAGE_HEADER, 2166136261u));
+    FILE *f = fopen(path, "wb");
+    int ok = f && fwrite(b.buf, 1, b.len, f) == b.len;
+    if (f && fclose(f) != 0) ok = 0;
+    free(b.buf);
+    return ok;
 }
 
-// Execution
-static void run_vm() {
-    ip = 0;
-    while (ip < code_len) {
-        size_t cur = ip;
-        unsigned char op = codebuf[ip++];
-        // TRACE
-        printf("TRACE ip=%04zu %-6s", cur, op_name(op));
-        // show immediates for some ops
-        if (op == OP_PUSH) {
-            if (ip + 4 <= code_len) {
-                int32_t imm = 0;
-                memcpy(&imm, &codebuf[ip], 4);
-                printf(" %d", imm);
-            }
-        } else if (op == OP_PUSHF) {
-            if (ip + 8 <= code_len) {
-                union { double f; uint8_t b[8]; } u;
-                for (int i=0;i<8;i++) u.b[i] = codebuf[ip + i];
-                printf(" %g", u.f);
-            }
-        } else if (op==OP_JMP || op==OP_JZ || op==OP_CALL) {
-            if (ip + 4 <= code_len) {
-                uint32_t tgt = 0; memcpy(&tgt, &codebuf[ip], 4);
-                printf(" %u", tgt);
-            }
-        }
-        print_stack_snapshot();
-
-        switch(op) {
-            case OP_NOP: break;
-            case OP_PUSH: {
-                if (ip + 4 > code_len) runtime_err("truncated PUSH");
-                int32_t imm; memcpy(&imm, &codebuf[ip], 4); ip += 4;
-                push_int(imm);
+// Check an image and point P->code into it; P's labels and constant pool
+// get its symbol table and constants.
+static void load_image(SisaProgram *P, const unsigned char *img, size_t size) {
+    if (size < IMAGE_HEADER_V1) sisa_fail(SISA_ERR_IMAGE, "Image error: truncated header");
+    unsigned version = img[4] | (unsigned)img[5] << 8;
+    unsigned header = img[6] | (unsigned)img[7] << 8;
+    uint32_t clen = rd_u32_le(img + 8), nsyms = rd_u32_le(img + 12), sym_bytes = rd_u32_le(img + 16);
+    if (version < 1 || version > IMAGE_VERSION)
+        sisa_fail(SISA_ERR_IMAGE, "Image error: version %u, expected %d", version, IMAGE_VERSION);
+    unsigned want = version == 1 ? IMAGE_HEADER_V1 : version == 2 ? IMAGE_HEADER_V2 : IMAGE_HEADER;
+    if (size < want) sisa_fail(SISA_ERR_IMAGE, "Image error: truncated header");
+    uint32_t nconsts = version == 1 ? 0 : rd_u32_le(img + 24);
+    uint32_t nnat = version < 3 ? 0 : rd_u32_le(img + 28), nat_bytes = version < 3 ? 0 : rd_u32_le(img + 32);
+    if (header != want || nconsts > CONST_MAX || nnat > 0xFFFF ||
+        (uint64_t)header + clen + sym_bytes + (uint64_t)nconsts * 9 + nat_bytes != size) {
+        sisa_fail(SISA_ERR_IMAGE, "Image error: section sizes do not match the file");
+    }
+    if (fnv1a(img + header, size - header, 2166136261u) != rd_u32_le(img + 20)) {
+        sisa_fail(SISA_ERR_IMAGE, "Image error: checksum mismatch");
+    }
+    const unsigned char *sym = img + header + clen, *end = sym + sym_bytes;
+    for (uint32_t i = 0; i < nsyms; ++i) {
+        if (end - sym < 5 || end - sym - 5 < sym[4]) sisa_fail(SISA_ERR_IMAGE, "Image error: bad symbol table");
+        uint32_t off = rd_u32_le(sym);
+        const char *name = (const char *)sym + 5;
+        if (off > clen) sisa_fail(SISA_ERR_IMAGE, "Image error: symbol '%.*s' outside the code", sym[4], name);
+        add_label(P, name, sym[4], off);
+        sym += 5 + sym[4];
+    }
+    if (sym != end) sisa_fail(SISA_ERR_IMAGE, "Image error: bad symbol table");
+    if (nconsts) {
+        P->consts = malloc(nconsts * sizeof(Const));
+        if (!P->consts) nomem();
+        P->const_cap = (int)nconsts;
+    }
+    for (const unsigned char *c = end; (uint32_t)P->const_count < nconsts; c += 9) {
+        if (c[0] != CONST_INT && c[0] != CONST_FLOAT) sisa_fail(SISA_ERR_IMAGE, "Image error: bad constant pool");
+        Const *K = &P->consts[P->const_count++];
+        K->tag = c[0];
+        K->bits = rd_u32_le(c + 1) | (uint64_t)rd_u32_le(c + 5) << 32;
+    }
+    const unsigned char *nat = end + (size_t)nconsts * 9, *nat_end = nat + nat_bytes;
+    for (uint32_t i = 0; i < nnat; ++i) {
+        char name[NATIVE_NAME_MAX + 1], sig[2 * NATIVE_ARGS_MAX + 2];
+        if (nat_end - nat < 1 || nat[0] > NATIVE_NAME_MAX || nat_end - nat - 2 < nat[0]
+            || nat[1 + nat[0]] >= sizeof sig || nat_end - nat - 2 - nat[0] < nat[1 + nat[0]])
+            sisa_fail(SISA_ERR_IMAGE, "Image error: bad native table");
+        memcpy(name, nat + 1, nat[0]); name[nat[0]] = 0;
+        memcpy(sig, nat + 2 + nat[0], nat[1 + nat[0]]); sig[nat[1 + nat[0]]] = 0;
+        nat += 2 + nat[0] + nat[1 + nat[0]];
+        const Native *N = native_find(P->host, name, strlen(name));
+        if (!N) sisa_fail(SISA_ERR_IMAGE, "Image error: native '%s' is not registered", name);
+        if (strcmp(N->sig, sig) != 0)
+            sisa_fail(SISA_ERR_IMAGE, "Image error: native '%s' is %s here, the image expects %s", name, N->sig, sig);
+        if (native_use(P, N) != (int)i) sisa_fail(SISA_ERR_IMAGE, "Image error: bad native table");
+    }
+    if (nat != nat_end) sisa_fail(SISA_ERR_IMAGE, "Image error: bad native table");
+    P->code = img + header;
+    P->code_len = clen;
+}
+
+// Load-time decode: check the bytecode once and expand it into prog[].
+// Immediate size of each opcode, or -1 for an unknown opcode.
+static int op_imm_size(unsigned char op) {
+    switch (op) {
+        case OP_PUSH: return 4;
+        case OP_PUSHF: return 8;
+        case OP_PUSH8: return 1;
+        case OP_PUSH16: case OP_PUSHK: case OP_CALLN: return 2;
+        case OP_JMP: case OP_JZ: case OP_CALL: return 4;
+        case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE: return 4;
+        case OP_NOP: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+        case OP_INC: case OP_DEC: case OP_NEG: case OP_ADDF: case OP_MULF: case OP_DUP:
+        case OP_PRINT: case OP_POP: case OP_LOAD: case OP_STORE: case OP_RET: case OP_HALT:
+        case OP_LOADB: case OP_LOADF: case OP_STOREF: case OP_MEMCPY: case OP_MEMSET: case OP_MEMCMP:
+        case OP_VADD: case OP_VMUL: case OP_VDOT: case OP_VSUM: case OP_VADDF: case OP_VMULF: case OP_VDOTF: case OP_VSUMF:
+        case OP_SNAPSHOT: case OP_SUBF: case OP_DIVF: case OP_NEGF: case OP_FMAF: case OP_ITOF: case OP_FTOI:
+        case OP_CMP:
+            return 0;
+        default: return -1;
+    }
+}
+static double rd_double_le(const unsigned char *p) {
+    union { double f; uint8_t b[8]; } u;
+    for (int i=0;i<8;i++) u.b[i] = p[i];
+    return u.f;
+}
+
+static void decode_program(SisaProgram *P) {
+    const unsigned char *codebuf = P->code;
+    size_t code_len = P->code_len;
+    // pass 1: instruction boundaries; index_of[off] = insn index or -1
+    int32_t *index_of = malloc((code_len + 1) * sizeof(int32_t));
+    if (!index_of) nomem();
+    for (size_t i = 0; i <= code_len; ++i) index_of[i] = -1;
+    size_t n = 0;
+    for (size_t off = 0; off < code_len; ) {
+        int imm = op_imm_size(codebuf[off]);
+        if (imm < 0) {
+            free(index_of);
+            sisa_fail(SISA_ERR_BYTECODE, "Unknown opcode %02X at %zu", codebuf[off], off);
+        }
+        if (off + 1 + (size_t)imm > code_len) {
+            free(index_of);
+            sisa_fail(SISA_ERR_BYTECODE, "Bytecode error: truncated %s at %zu", op_name(codebuf[off]), off);
+        }
+        index_of[off] = (int32_t)n++;
+        off += 1 + (size_t)imm;
+    }
+    index_of[code_len] = (int32_t)n;
+
+    // pass 2: decode operands; targets at or past the end land on the sentinel
+    Insn *prog = P->prog = malloc((n + 1) * sizeof(Insn));
+    if (!prog) { free(index_of); nomem(); }
+    size_t k = 0;
+    for (size_t off = 0; off < code_len; ++k) {
+        Insn *in = &prog[k];
+        memset(in, 0, sizeof(*in));
+        in->op = codebuf[off];
+        in->off = (uint32_t)off;
+        const unsigned char *imm = &codebuf[off + 1];
+        switch (in->op) {
+            case OP_PUSH: in->a.i = (int32_t)rd_u32_le(imm); break;
+            case OP_PUSHF: in->a.f = val_from_double(rd_double_le(imm)); break;
+            case OP_PUSH8: in->op = OP_PUSH; in->a.i = (int8_t)imm[0]; break;
+            case OP_PUSH16: in->op = OP_PUSH; in->a.i = (int16_t)(imm[0] | imm[1] << 8); break;
+            case OP_PUSHK: {
+                unsigned ci = imm[0] | (unsigned)imm[1] << 8;
+                if (ci >= (unsigned)P->const_count) {
+                    free(index_of);
+                    sisa_fail(SISA_ERR_BYTECODE, "Bytecode error: PUSHK at %zu uses constant %u of %d", off, ci, P->const_count);
+                }
+                const Const *K = &P->consts[ci];
+                if (K->tag == CONST_INT) { in->op = OP_PUSH; in->a.i = (int32_t)(uint32_t)K->bits; }
+                else { double d; memcpy(&d, &K->bits, 8); in->op = OP_PUSHF; in->a.f = val_from_double(d); }
                 break;
             }
-            case OP_PUSHF: {
-                if (ip + 8 > code_len) runtime_err("truncated PUSHF");
-                union { double f; uint8_t b[8]; } u;
-                for (int i=0;i<8;i++) u.b[i] = codebuf[ip + i];
-                ip += 8;
-                push_float(u.f);
+            case OP_CALLN: {
+                unsigned ni = imm[0] | (unsigned)imm[1] << 8;
+                if (ni >= (unsigned)P->native_count) {
+                    free(index_of);
+                    sisa_fail(SISA_ERR_BYTECODE, "Bytecode error: CALLN at %zu uses native %u of %d", off, ni, P->native_count);
+                }
+                in->a.i = (int32_t)ni;
                 break;
             }
-            case OP_ADD: {
-                int32_t a = pop_int_checked("ADD"); int32_t b = pop_int_checked("ADD");
-                push_int(b + a);
+            case OP_JMP: case OP_JZ: case OP_CALL:
+            case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE: {
+                uint32_t tgt = rd_u32_le(imm);
+                if (tgt >= code_len) in->a.t = (uint32_t)n;
+                else if (index_of[tgt] < 0) {
+                    free(index_of);
+                    sisa_fail(SISA_ERR_BYTECODE, "Bytecode error: %s at %zu targets the middle of an instruction (%u)",
+                              op_name(in->op), off, tgt);
+                } else in->a.t = (uint32_t)index_of[tgt];
                 break;
             }
-            case OP_SUB: {
-                int32_t a = pop_int_checked("SUB"); int32_t b = pop_int_checked("SUB");
-                push_int(b - a);
+            default: break;
+        }
+        off += 1 + (size_t)op_imm_size(codebuf[off]);
+    }
+    memset(&prog[n], 0, sizeof(Insn));
+    prog[n].op = OP_HALT;
+    prog[n].off = (uint32_t)code_len;
+    P->prog_len = n;
+    free(index_of);
+}
+
+// Load-time verifier
+// Abstract interpretation over the basic blocks of prog[]: every stack slot
+// gets a static type, TY_INT, TY_FLOAT, or VT_PARAM+j ("whatever the caller
+// left j slots below the top at function entry"). Each CALL target is
+// analysed as a function with a summary (how many caller values it consumes,
+// which types it requires of them, what it returns); recursive summaries are
+// found by iterating to a fixed point. Code that passes runs on the unchecked
+// loop. Anything else - stack shape differs between paths, type conflicts,
+// RET outside a function, a block shared by two functions - stays checked.
+#define VT_PARAM   0x80
+#define VT_ANY     0          // bind[]/ptype[]: parameter nothing constrains
+#define VERIFY_MAX_PARAMS 32  // caller slots a function may consume
+#define VERIFY_MAX_DEPTH  (STACK_SIZE + VERIFY_MAX_PARAMS)
+
+typedef struct {
+    int known;                         // a RET was reached; nres and rtype valid
+    int nparam, nres, growth;          // growth: peak depth above entry; nparam (and ptype)
+                                       // are what it takes of the caller, even if it never returns
+    int low;                           // lowest depth reached (register 0 of the IR frame)
+    uint8_t ptype[VERIFY_MAX_PARAMS];  // VT_ANY / TY_INT / TY_FLOAT
+    uint8_t *rtype;                    // nres result types, bottom first
+} VFunc;
+
+typedef struct {
+    Insn *prog;
+    size_t n;
+    const Native *natives;  // CALLN's signatures
+    uint8_t *leader;        // leader[i]: insn i starts a basic block
+    int *func_at;           // function index for a CALL target, else -1
+    int *owner;             // function whose walk reached the block, -1 = none
+    int *depth;             // abstract depth at block entry
+    uint8_t **slots;        // abstract stack at block entry
+    int *work, nwork;
+    VFunc *funcs; int nfuncs;
+    int *entry;             // entry insn of each function (0 = main)
+    int *ifunc;             // function that last annotated insn i, -1 = none
+    SnapFrame *frame;       // SNAPSHOT and CALL insns, if the program has a SNAPSHOT
+    // function being analysed
+    int cur, M, min_d, max_d, ret_d, changed;
+    uint8_t bind[VERIFY_MAX_PARAMS];
+    uint8_t *ret_slots;
+    const char *why; size_t why_at;
+} Verifier;
+
+static int v_fail(Verifier *V, size_t at, const char *why) { V->why = why; V->why_at = at; return 0; }
+
+static uint8_t v_resolve(const Verifier *V, uint8_t t) {
+    if (t & VT_PARAM) { uint8_t b = V->bind[t & 0x7F]; return b ? b : t; }
+    return t;
+}
+// t must be of type want (TY_INT / TY_FLOAT); an unbound parameter gets bound
+static int v_require(Verifier *V, uint8_t t, uint8_t want) {
+    uint8_t r = v_resolve(V, t);
+    if (r == want) return 1;
+    if (r & VT_PARAM) { V->bind[r & 0x7F] = want; return 1; }
+    return 0;
+}
+static int v_same(const Verifier *V, const uint8_t *a, const uint8_t *b, int d) {
+    for (int k = 0; k < d; ++k) if (v_resolve(V, a[k]) != v_resolve(V, b[k])) return 0;
+    return 1;
+}
+
+static int v_merge(Verifier *V, size_t L, const uint8_t *st, int d) {
+    if (L >= V->n) return 1; // sentinel HALT
+    if (V->owner[L] < 0) {
+        V->owner[L] = V->cur;
+        V->depth[L] = d;
+        V->slots[L] = malloc(d ? (size_t)d : 1);
+        if (!V->slots[L]) nomem();
+        memcpy(V->slots[L], st, (size_t)d);
+        V->work[V->nwork++] = (int)L;
+        return 1;
+    }
+    if (V->owner[L] != V->cur) return v_fail(V, L, "block reached from two functions");
+    if (V->depth[L] != d || !v_same(V, V->slots[L], st, d))
+        return v_fail(V, L, "stack shape differs between paths");
+    return 1;
+}
+
+static int v_walk(Verifier *V, size_t L) {
+    const Insn *prog = V->prog;
+    uint8_t st[VERIFY_MAX_DEPTH];
+    int d = V->depth[L];
+    memcpy(st, V->slots[L], (size_t)d);
+#define V_POP(t) do { if (d <= 0) return v_fail(V, i, "stack underflow"); \
+                      (t) = st[--d]; if (d < V->min_d) V->min_d = d; } while (0)
+#define V_POP_AS(want) do { uint8_t t_; V_POP(t_); \
+                      if (!v_require(V, t_, (want))) return v_fail(V, i, "operand type mismatch"); } while (0)
+#define V_PUSH(t) do { if (d >= VERIFY_MAX_DEPTH) return v_fail(V, i, "stack too deep"); \
+                       st[d++] = (t); if (d > V->max_d) V->max_d = d; } while (0)
+// operand types for JZ/PRINT/DUP/CMP/JE..., resolved once the function's bindings are final
+#define V_NOTE(t) do { V->prog[i].aux = (t); V->ifunc[i] = V->cur; } while (0)
+#define V_FRAME() do { if (V->frame) { V->frame[i].depth = d - V->M; V->frame[i].fn = (uint32_t)V->entry[V->cur]; } } while (0)
+    for (size_t i = L; ; ++i) {
+        if (i >= V->n) return 1;
+        if (i != L && V->leader[i]) return v_merge(V, i, st, d);
+        const Insn *in = &prog[i];
+        uint8_t t;
+        switch (in->op) {
+            case OP_NOP: break;
+            case OP_SNAPSHOT: V_FRAME(); break;
+            case OP_PUSH: V_PUSH(TY_INT); break;
+            case OP_PUSHF: V_PUSH(TY_FLOAT); break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+                V_POP_AS(TY_INT); V_POP_AS(TY_INT); V_PUSH(TY_INT); break;
+            case OP_INC: case OP_DEC: case OP_NEG: case OP_LOAD: case OP_LOADB:
+                V_POP_AS(TY_INT); V_PUSH(TY_INT); break;
+            case OP_ADDF: case OP_MULF: case OP_SUBF: case OP_DIVF:
+                V_POP_AS(TY_FLOAT); V_POP_AS(TY_FLOAT); V_PUSH(TY_FLOAT); break;
+            case OP_NEGF: V_POP_AS(TY_FLOAT); V_PUSH(TY_FLOAT); break;
+            case OP_FMAF: V_POP_AS(TY_FLOAT); V_POP_AS(TY_FLOAT); V_POP_AS(TY_FLOAT); V_PUSH(TY_FLOAT); break;
+            case OP_ITOF: V_POP_AS(TY_INT); V_PUSH(TY_FLOAT); break;
+            case OP_FTOI: V_POP_AS(TY_FLOAT); V_PUSH(TY_INT); break;
+            case OP_CMP: { uint8_t u; V_POP(t); V_POP(u); V_NOTE(t | u << 8); V_PUSH(TY_INT); break; }
+            case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE: {
+                uint8_t u;
+                V_POP(t); V_POP(u);
+                V_NOTE(t | u << 8);
+                if (!v_merge(V, in->a.t, st, d)) return 0;
                 break;
             }
-            case OP_MUL: {
-                int32_t a = pop_int_checked("MUL"); int32_t b = pop_int_checked("MUL");
-                push_int(b * a);
+            case OP_DUP: V_POP(t); V_PUSH(t); V_PUSH(t); V_NOTE(t); break;
+            case OP_CALLN: {
+                const Native *N = &V->natives[in->a.i];
+                for (int j = N->nargs; j-- > 0; ) {
+                    if (N->in[j]) V_POP_AS(N->in[j]);
+                    else V_POP(t);
+                }
+                for (int j = 0; j < N->nres; ++j) V_PUSH(N->out[j]);
                 break;
             }
-            case OP_DIV: {
-                int32_t a = pop_int_checked("DIV"); int32_t b = pop_int_checked("DIV");
-                if (a == 0) runtime_err("division by zero");
-                push_int(b / a);
+            case OP_PRINT: V_POP(t); V_NOTE(t); break;
+            case OP_POP: V_POP(t); break;
+            case OP_STORE: V_POP_AS(TY_INT); V_POP_AS(TY_INT); break;
+            case OP_LOADF: V_POP_AS(TY_INT); V_PUSH(TY_FLOAT); break;
+            case OP_STOREF: V_POP_AS(TY_INT); V_POP_AS(TY_FLOAT); break;
+            case OP_MEMCPY: case OP_MEMSET: case OP_MEMCMP:
+            case OP_VADD: case OP_VMUL: case OP_VADDF: case OP_VMULF:
+            case OP_VDOT: case OP_VSUM: case OP_VDOTF: case OP_VSUMF:
+                for (int j = block_arity(in->op); j > 0; --j) V_POP_AS(TY_INT);
+                if (in->op == OP_MEMCMP || in->op == OP_VDOT || in->op == OP_VSUM) V_PUSH(TY_INT);
+                else if (in->op == OP_VDOTF || in->op == OP_VSUMF) V_PUSH(TY_FLOAT);
                 break;
-            }
-            case OP_MOD: {
-                int32_t a = pop_int_checked("MOD"); int32_t b = pop_int_checked("MOD");
-                if (a == 0) runtime_err("modulo by zero");
-                push_int(b % a);
+            case OP_JMP: return v_merge(V, in->a.t, st, d);
+            case OP_JZ:
+                V_POP(t);
+                V_NOTE(t);
+                if (!v_merge(V, in->a.t, st, d)) return 0;
                 break;
-            }
-            case OP_INC: {
-                Value v = pop_val();
-                if (v.type != TY_INT) runtime_err("INC expects integer");
-                v.v.i += 1;
-                push_from_value(v);
+            case OP_CALL: {
+                const VFunc *F = &V->funcs[V->func_at[in->a.t]];
+                V_FRAME();
+                // what the callee takes holds whether it returns or not
+                if (d < F->nparam) return v_fail(V, i, "stack underflow at CALL");
+                uint8_t args[VERIFY_MAX_PARAMS];
+                for (int j = 0; j < F->nparam; ++j) {
+                    args[j] = st[d-1-j];
+                    if (F->ptype[j] != VT_ANY && !v_require(V, args[j], F->ptype[j]))
+                        return v_fail(V, i, "argument type mismatch at CALL");
+                }
+                if (d - F->nparam < V->min_d) V->min_d = d - F->nparam;
+                if (!F->known) return 1; // callee never returns (yet): no successor
+                d -= F->nparam;
+                for (int k = 0; k < F->nres; ++k) {
+                    uint8_t r = F->rtype[k];
+                    if (r & VT_PARAM) {
+                        if ((r & 0x7F) >= F->nparam) return v_fail(V, i, "bad callee summary");
+                        r = args[r & 0x7F];
+                    }
+                    V_PUSH(r);
+                }
                 break;
             }
-            case OP_DEC: {
-                Value v = pop_val();
-                if (v.type != TY_INT) runtime_err("DEC expects integer");
-                v.v.i -= 1;
-                push_from_value(v);
-                break;
+            case OP_RET:
+                if (V->cur == 0) return v_fail(V, i, "RET outside a function");
+                if (!V->ret_slots) {
+                    V->ret_slots = malloc(d ? (size_t)d : 1);
+                    if (!V->ret_slots) nomem();
+                    memcpy(V->ret_slots, st, (size_t)d);
+                    V->ret_d = d;
+                } else if (V->ret_d != d || !v_same(V, V->ret_slots, st, d)) {
+                    return v_fail(V, i, "RETs leave different stacks");
+                }
+                return 1;
+            case OP_HALT: return 1;
+            default: return v_fail(V, i, "unknown opcode");
+        }
+    }
+#undef V_POP
+#undef V_POP_AS
+#undef V_PUSH
+#undef V_NOTE
+#undef V_FRAME
+}
+
+// Analyse function f against the current summaries and refresh its own.
+static int v_function(Verifier *V, int f) {
+    Insn *prog = V->prog;
+    size_t e = (size_t)V->entry[f];
+    if (V->owner[e] >= 0) return v_fail(V, e, "block reached from two functions");
+    V->cur = f;
+    V->M = f == 0 ? 0 : VERIFY_MAX_PARAMS;
+    V->min_d = V->max_d = V->M;
+    V->ret_slots = NULL;
+    memset(V->bind, VT_ANY, sizeof(V->bind));
+    uint8_t init[VERIFY_MAX_PARAMS];
+    for (int k = 0; k < V->M; ++k) init[k] = (uint8_t)(VT_PARAM | (V->M - 1 - k));
+    V->nwork = 0;
+    if (!v_merge(V, e, init, V->M)) return 0;
+    while (V->nwork > 0)
+        if (!v_walk(V, (size_t)V->work[--V->nwork])) { free(V->ret_slots); return 0; }
+
+    for (size_t i = 0; i < V->n; ++i) {
+        if (V->ifunc[i] != f) continue;
+        uint16_t x = prog[i].aux, r = 0;
+        for (int sh = 0; sh < 16; sh += 8) {
+            uint8_t t = v_resolve(V, (uint8_t)(x >> sh));
+            if (!(t & VT_PARAM)) r |= (uint16_t)(t << sh);
+        }
+        prog[i].aux = r;
+        V->ifunc[i] = -1;
+    }
+
+    VFunc *F = &V->funcs[f];
+    VFunc nf; memset(&nf, 0, sizeof(nf));
+    nf.growth = V->max_d - V->M;
+    nf.low = V->min_d;
+    nf.nparam = V->M - V->min_d;
+    for (int j = 0; j < nf.nparam; ++j) nf.ptype[j] = V->bind[j];
+    if (V->ret_slots) {
+        nf.known = 1;
+        nf.nres = V->ret_d - V->min_d;
+        nf.rtype = malloc(nf.nres ? (size_t)nf.nres : 1);
+        if (!nf.rtype) nomem();
+        for (int k = 0; k < nf.nres; ++k) nf.rtype[k] = v_resolve(V, V->ret_slots[V->min_d + k]);
+        free(V->ret_slots);
+        V->ret_slots = NULL;
+    }
+    if (nf.known != F->known || nf.nparam != F->nparam || nf.nres != F->nres ||
+        memcmp(nf.ptype, F->ptype, sizeof(nf.ptype)) != 0 ||
+        (nf.nres && memcmp(nf.rtype, F->rtype, (size_t)nf.nres) != 0))
+        V->changed = 1;
+    free(F->rtype);
+    *F = nf;
+    return 1;
+}
+
+static void reg_build(SisaProgram *P, const Verifier *V, unsigned opts);
+static void call_pass(SisaProgram *P, const Verifier *V, int dump);
+
+static int verify_program(SisaProgram *P, unsigned opts) {
+    int verbose = (opts & SISA_LOAD_VERBOSE) != 0;
+    Verifier V; memset(&V, 0, sizeof(V));
+    Insn *prog = P->prog;
+    size_t n = P->prog_len;
+    V.prog = prog;
+    V.n = n;
+    V.natives = P->natives;
+    V.leader = calloc(n + 1, 1);
+    V.func_at = malloc((n + 1) * sizeof(int));
+    V.owner = malloc((n + 1) * sizeof(int));
+    V.depth = malloc((n + 1) * sizeof(int));
+    V.slots = calloc(n + 1, sizeof(uint8_t *));
+    V.work = malloc((n + 1) * sizeof(int));
+    V.entry = malloc((n + 1) * sizeof(int));
+    V.ifunc = malloc((n + 1) * sizeof(int));
+    if (!V.ifunc || !V.leader || !V.func_at || !V.owner || !V.depth || !V.slots || !V.work || !V.entry)
+        nomem();
+
+    // leaders and functions: main at 0, one function per distinct CALL target
+    for (size_t i = 0; i <= n; ++i) V.func_at[i] = V.ifunc[i] = V.owner[i] = -1;
+    V.leader[0] = 1;
+    V.entry[V.nfuncs++] = 0;
+    V.func_at[0] = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char op = prog[i].op;
+        if (op == OP_JMP || op == OP_JZ || OP_IS_JCC(op) || op == OP_CALL) V.leader[prog[i].a.t] = 1;
+        if (op == OP_JMP || op == OP_JZ || OP_IS_JCC(op) || op == OP_CALL || op == OP_RET || op == OP_HALT)
+            V.leader[i+1] = 1;
+        if (op == OP_CALL && V.func_at[prog[i].a.t] < 0) {
+            if (prog[i].a.t >= n) { V.why = "CALL past the end of the program"; V.why_at = i; goto done; }
+            V.func_at[prog[i].a.t] = V.nfuncs;
+            V.entry[V.nfuncs++] = (int)prog[i].a.t;
+        }
+        if (op == OP_SNAPSHOT && !V.frame && !(V.frame = malloc((n + 1) * sizeof(SnapFrame)))) nomem();
+    }
+    V.funcs = calloc((size_t)V.nfuncs, sizeof(VFunc));
+    if (!V.funcs) nomem();
+
+    // iterate until no summary changes (each round can only refine them)
+    int ok = 0;
+    for (int round = 0; round < 2 * V.nfuncs + 4; ++round) {
+        for (size_t i = 0; i < n; ++i) { V.owner[i] = -1; free(V.slots[i]); V.slots[i] = NULL; }
+        for (size_t i = 0; V.frame && i <= n; ++i) V.frame[i].fn = UINT32_MAX;
+        V.changed = 0;
+        int f;
+        for (f = 0; f < V.nfuncs; ++f) if (!v_function(&V, f)) break;
+        if (f < V.nfuncs) break;
+        if (!V.changed) { ok = 1; break; }
+    }
+    if (!ok && !V.why) V.why = "summaries did not converge";
+    if (ok && V.funcs[0].growth > STACK_SIZE) { ok = 0; V.why = "stack too deep"; }
+    for (int f = 1; ok && f < V.nfuncs; ++f)
+        if (V.funcs[f].growth > 0xFFFF) { ok = 0; V.why = "function frame too deep"; V.why_at = (size_t)V.entry[f]; }
+    for (size_t i = 0; ok && i < n; ++i)
+        if (prog[i].op == OP_CALL) prog[i].aux = (uint16_t)V.funcs[V.func_at[prog[i].a.t]].growth;
+    P->verified = ok;
+    if (ok) {
+        reg_build(P, &V, opts);
+        if (!(opts & SISA_LOAD_NO_OPT)) call_pass(P, &V, (opts & SISA_LOAD_DUMP_OPT) != 0);
+        P->frame = V.frame; V.frame = NULL;
+    }
+
+done:
+    if (verbose) {
+        if (P->verified) fprintf(stderr, "verify: ok (%d function%s), unchecked fast path\n",
+                                   V.nfuncs, V.nfuncs == 1 ? "" : "s");
+        else fprintf(stderr, "verify: rejected at ip=%04u (%s): %s; running checked\n",
+                     V.why_at < n ? prog[V.why_at].off : (uint32_t)P->code_len,
+                     V.why_at < n ? op_name(prog[V.why_at].op) : "END", V.why);
+    }
+    if (verbose && P->reg) fprintf(stderr, "reg: %zu stack insns -> %zu register insns\n", n, P->reg_len);
+    for (size_t i = 0; i < n; ++i) free(V.slots[i]);
+    for (int f = 0; V.funcs && f < V.nfuncs; ++f) free(V.funcs[f].rtype);
+    free(V.funcs); free(V.leader); free(V.func_at); free(V.owner); free(V.depth);
+    free(V.slots); free(V.work); free(V.entry); free(V.ifunc); free(V.frame);
+    return P->verified;
+}
+
+// Peephole pass
+// Runs on prog[] after verification: fuses common pairs into superinstructions
+// and drops NOPs, so each pair costs one dispatch. A pair is fused only when
+// no jump lands on its second instruction; jump targets are remapped to the
+// new indices (a jump to a dropped NOP lands on the next instruction) and
+// every insn keeps the byte offset of its first source instruction.
+static uint8_t fuse_pair(const Insn *a, const Insn *b) {
+    if (a->op == OP_PUSH) {
+        switch (b->op) {
+            case OP_ADD: return OP_ADDI;
+            case OP_SUB: return OP_SUBI;
+            // out-of-range constants keep the PUSH so they fault where they did
+            case OP_LOAD: return a->a.i >= 0 && a->a.i < MEM_SIZE ? OP_LOADI : 0;
+            case OP_STORE: return a->a.i >= 0 && a->a.i < MEM_SIZE ? OP_STOREI : 0;
+            default: return 0;
+        }
+    }
+    if (a->op == OP_DUP && b->op == OP_JZ) return OP_DUPJZ;
+    return 0;
+}
+
+static void optimize_program(SisaProgram *P, int dump) {
+    Insn *prog = P->prog;
+    size_t n = P->prog_len;
+    uint8_t *target = calloc(n + 1, 1);
+    uint32_t *newidx = malloc((n + 1) * sizeof(uint32_t));
+    if (!target || !newidx) nomem();
+    for (size_t i = 0; i < n; ++i)
+        if (prog[i].op == OP_JMP || prog[i].op == OP_JZ || OP_IS_JCC(prog[i].op) || prog[i].op == OP_CALL
+            || prog[i].op == OP_TCALL)
+            target[prog[i].a.t] = 1;
+
+    unsigned fired[256] = {0};
+    size_t k = 0;
+    for (size_t i = 0; i < n; ) {
+        Insn in = prog[i];
+        size_t at = i;
+        newidx[i] = (uint32_t)k;
+        if (in.op == OP_NOP) { fired[OP_NOP]++; ++i; continue; }
+        if (in.op == OP_TCALL) fired[OP_TCALL]++;
+        uint8_t f = i + 1 < n && !target[i+1] ? fuse_pair(&prog[i], &prog[i+1]) : 0;
+        if (f) {
+            const Insn *b = &prog[i+1];
+            newidx[i+1] = (uint32_t)k;
+            if (f == OP_DUPJZ) { in.a.t = b->a.t; in.aux = b->aux; }
+            in.op = f;
+            fired[f]++;
+            i += 2;
+        } else {
+            ++i;
+        }
+        if (P->frame) P->frame[k] = P->frame[at];
+        prog[k++] = in;
+    }
+    newidx[n] = (uint32_t)k;
+    for (size_t i = 0; i < k; ++i)
+        if (prog[i].op == OP_JMP || prog[i].op == OP_JZ || prog[i].op == OP_DUPJZ || OP_IS_JCC(prog[i].op)
+            || prog[i].op == OP_CALL || prog[i].op == OP_TCALL)
+            prog[i].a.t = newidx[prog[i].a.t];
+    for (size_t i = 0; P->frame && i < k; ++i)
+        if (P->frame[i].fn != UINT32_MAX) P->frame[i].fn = newidx[P->frame[i].fn];
+    prog[k] = prog[n];
+    P->prog_len = k;
+
+    if (dump) {
+        for (size_t i = 0; i < k; ++i) {
+            if (prog[i].op < OP_ADDI || prog[i].op == OP_HALT) continue;
+            fprintf(stderr, "opt: ip=%04u %-6s", prog[i].off, op_name(prog[i].op));
+            if (prog[i].op == OP_DUPJZ || prog[i].op == OP_TCALL) fprintf(stderr, " %u\n", prog[prog[i].a.t].off);
+            else fprintf(stderr, " %d\n", prog[i].a.i);
+        }
+        fprintf(stderr, "opt: %zu -> %zu insns;", n, k);
+        for (int op = OP_ADDI; op <= OP_TCALL; ++op) fprintf(stderr, " %s %u", op_name((unsigned char)op), fired[op]);
+        fprintf(stderr, " NOP-removed %u\n", fired[OP_NOP]);
+    }
+    free(target);
+    free(newidx);
+}
+
+// Call pass
+// Runs on verified code before the peephole pass, while the verifier's
+// results are at hand. A CALL of a small leaf function - straight-line code
+// of at most CALL_INLINE_MAX insns up to its RET - becomes a copy of that
+// code, and a CALL just before a RET becomes TCALL, a jump that leaves the
+// call stack as it is, so the callee returns straight to our caller and tail
+// recursion runs in constant call stack. An inlined body adds its growth to
+// that of the function it lands in (main's must still fit STACK_SIZE), since
+// the CALLs of that function test the headroom in its place. Programs with a
+// SNAPSHOT keep their calls: a restored call stack must match the verifier's
+// frames. The register IR is built before this and keeps them too.
+#define CALL_INLINE_MAX 8
+
+static void call_pass(SisaProgram *P, const Verifier *V, int dump) {
+    if (V->frame) return;
+    const Insn *prog = P->prog;
+    size_t n = P->prog_len;
+    int nf = V->nfuncs;
+    uint8_t *target = calloc(n + 1, 1);
+    uint8_t *how = calloc(n + 1, 1);               // 1: inline this CALL, 2: TCALL, 3: RET after a TCALL
+    int *body = malloc((size_t)nf * sizeof(int));   // insns before a leaf's RET, -1: not a leaf
+    int *extra = calloc((size_t)nf, sizeof(int));   // growth the function takes on; -1: inline nothing there
+    uint32_t *newidx = malloc((n + 1) * sizeof(uint32_t));
+    if (!target || !how || !body || !extra || !newidx) nomem();
+    for (size_t i = 0; i < n; ++i)
+        if (prog[i].op == OP_JMP || prog[i].op == OP_JZ || OP_IS_JCC(prog[i].op)) target[prog[i].a.t] = 1;
+
+    body[0] = -1;
+    for (int f = 1; f < nf; ++f) {
+        size_t e = (size_t)V->entry[f], j = e;
+        body[f] = -1;
+        if (!V->funcs[f].known) continue;
+        while (j < n && j - e < CALL_INLINE_MAX && (j == e || !V->leader[j])) {
+            unsigned char op = prog[j].op;
+            if (op == OP_JMP || op == OP_JZ || OP_IS_JCC(op) || op == OP_CALL || op == OP_RET || op == OP_HALT) break;
+            ++j;
+        }
+        if (j < n && prog[j].op == OP_RET && (j == e || !V->leader[j])) body[f] = (int)(j - e);
+    }
+
+    // each insn's function is that of the block it is in (-1: never reached)
+    for (int pass = 0; pass < 2; ++pass) {
+        int g = -1;
+        for (size_t i = 0; i < n; ++i) {
+            if (V->leader[i]) g = V->owner[i];
+            if (prog[i].op != OP_CALL || g < 0) continue;
+            int f = V->func_at[prog[i].a.t];
+            if (body[f] >= 0 && extra[g] >= 0) {
+                if (!pass && extra[g] < V->funcs[f].growth) extra[g] = V->funcs[f].growth;
+                if (pass) how[i] = 1;
+            } else if (pass && g > 0 && prog[i+1].op == OP_RET) {
+                how[i] = 2;
+                if (!target[i+1]) how[i+1] = 3;
             }
-            case OP_NEG: {
-                Value v = pop_val();
-                if (v.type != TY_INT) runtime_err("NEG expects integer");
-                v.v.i = -v.v.i;
-                push_from_value(v);
+        }
+        for (int f = 0; !pass && f < nf; ++f)
+            if (V->funcs[f].growth + extra[f] > (f ? 0xFFFF : STACK_SIZE)) extra[f] = -1;
+    }
+
+    size_t m = 0, inlined = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int b = how[i] == 1 ? body[V->func_at[prog[i].a.t]] : 1;
+        m += b ? (size_t)b : 1;
+    }
+    Insn *out = malloc((m + 1) * sizeof(Insn));
+    if (!out) nomem();
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        Insn in = prog[i];
+        newidx[i] = (uint32_t)k;
+        if (how[i] == 1) {
+            size_t e = prog[i].a.t;
+            int b = body[V->func_at[e]];
+            if (dump) fprintf(stderr, "opt: ip=%04u CALL   %u inlined (%d insns)\n", in.off, prog[e].off, b);
+            for (int j = 0; j < b; ++j) out[k++] = prog[e + (size_t)j];
+            if (!b) { in.op = OP_NOP; out[k++] = in; }   // the peephole pass drops it
+            inlined++;
+            continue;
+        }
+        if (how[i] == 2) in.op = OP_TCALL;
+        if (how[i] == 3) in.op = OP_NOP;
+        out[k++] = in;
+    }
+    newidx[n] = (uint32_t)k;
+    out[k] = prog[n];
+    for (size_t i = 0; i < k; ++i) {
+        Insn *in = &out[i];
+        if (in->op == OP_JMP || in->op == OP_JZ || OP_IS_JCC(in->op) || in->op == OP_CALL || in->op == OP_TCALL) {
+            int f = V->func_at[in->a.t];
+            if (f >= 0 && (in->op == OP_CALL || in->op == OP_TCALL))
+                in->aux = (uint16_t)(V->funcs[f].growth + (extra[f] > 0 ? extra[f] : 0));
+            in->a.t = newidx[in->a.t];
+        }
+    }
+    if (dump) fprintf(stderr, "opt: %zu CALL%s inlined\n", inlined, inlined == 1 ? "" : "s");
+    free(P->prog);
+    P->prog = out;
+    P->prog_len = k;
+    free(target); free(how); free(body); free(extra); free(newidx);
+}
+
+// Register tier
+// Verified code is also translated into a register IR while the verifier's
+// results are at hand. A function's frame slots become its registers,
+// numbered from the lowest slot it reaches, so register r is the value stack
+// slot r above the frame base and CALL just moves the base up to the
+// arguments. Within a basic block PUSH/PUSHF/DUP/POP only change the
+// translator's picture of the stack (each slot is in its own register, is a
+// copy of a lower one or is a constant); constant arithmetic is folded,
+// constants and copies become operands, and SUB; JZ becomes one
+// compare-and-branch. Every slot is in its own register again when a block
+// ends, so blocks and frames meet in the layout the other engines use.
+// Loads and stores are never moved or cached.
+enum {
+    RG_MOV, RG_KI, RG_KF,                       // d = a; d = int k; d = float k
+    RG_ADD, RG_ADDK, RG_SUB, RG_SUBK, RG_KSUB,  // d = a op b; d = a op k; d = k op a
+    RG_MUL, RG_MULK, RG_DIV, RG_DIVK, RG_KDIV, RG_MOD, RG_MODK, RG_KMOD,
+    RG_ADDF, RG_ADDFK, RG_MULF, RG_MULFK, RG_SUBF, RG_DIVF, RG_DIVFK,
+    RG_NEGF, RG_ITOF, RG_FTOI,                  // d = op a
+    RG_FMAF, RG_FMAFK, RG_CMP,                  // d = a * b + c (c: register k); d = a * k + b; d = CMP of a, b
+    RG_LOAD, RG_LOADK, RG_LOADB, RG_LOADF,      // d = memory[a], memory[k], ...
+    RG_STORE, RG_STOREK, RG_KSTORE,             // memory[b] = a; memory[k] = a; memory[b] = k
+    RG_STOREF, RG_STOREFK,
+    RG_PRINT, RG_BLOCK,                         // print a; block op k on the registers below d
+    RG_CALLN,                                   // native k on the registers from d up
+    RG_JMP, RG_JZ, RG_JEQ, RG_JEQK,             // jump to t: always, if a is zero, a == b, a == k
+    RG_JNE, RG_JNEK, RG_JLT, RG_JLTK, RG_JLE, RG_JLEK, RG_JGTK, RG_JGEK,   // ints: a op b, a op k
+    RG_JLTF, RG_JLEF,                           // floats: a op b
+    RG_JCMP,                                    // stack op d (JE..JGE) on a, b of any types
+    RG_CALL, RG_TCALL, RG_RET, RG_HALT,         // CALL: frame base += a, b registers; TCALL: CALL; RET
+                                                // in a frame at base + 0; HALT: d live
+    RG_NOPS
+};
+// operands each op has, for --dump-reg
+enum { RF_D = 1, RF_A = 2, RF_B = 4, RF_KI = 8, RF_KF = 16, RF_T = 32, RF_C = 64 };
+static const struct { const char *name; uint8_t f; } rg_info[RG_NOPS] = {
+    [RG_MOV] = {"MOV", RF_D|RF_A},           [RG_KI] = {"KI", RF_D|RF_KI},          [RG_KF] = {"KF", RF_D|RF_KF},
+    [RG_ADD] = {"ADD", RF_D|RF_A|RF_B},      [RG_ADDK] = {"ADDK", RF_D|RF_A|RF_KI},
+    [RG_SUB] = {"SUB", RF_D|RF_A|RF_B},      [RG_SUBK] = {"SUBK", RF_D|RF_A|RF_KI}, [RG_KSUB] = {"KSUB", RF_D|RF_A|RF_KI},
+    [RG_MUL] = {"MUL", RF_D|RF_A|RF_B},      [RG_MULK] = {"MULK", RF_D|RF_A|RF_KI},
+    [RG_DIV] = {"DIV", RF_D|RF_A|RF_B},      [RG_DIVK] = {"DIVK", RF_D|RF_A|RF_KI}, [RG_KDIV] = {"KDIV", RF_D|RF_A|RF_KI},
+    [RG_MOD] = {"MOD", RF_D|RF_A|RF_B},      [RG_MODK] = {"MODK", RF_D|RF_A|RF_KI}, [RG_KMOD] = {"KMOD", RF_D|RF_A|RF_KI},
+    [RG_ADDF] = {"ADDF", RF_D|RF_A|RF_B},    [RG_ADDFK] = {"ADDFK", RF_D|RF_A|RF_KF},
+    [RG_MULF] = {"MULF", RF_D|RF_A|RF_B},    [RG_MULFK] = {"MULFK", RF_D|RF_A|RF_KF},
+    [RG_SUBF] = {"SUBF", RF_D|RF_A|RF_B},    [RG_DIVF] = {"DIVF", RF_D|RF_A|RF_B},  [RG_DIVFK] = {"DIVFK", RF_D|RF_A|RF_KF},
+    [RG_NEGF] = {"NEGF", RF_D|RF_A},         [RG_ITOF] = {"ITOF", RF_D|RF_A},       [RG_FTOI] = {"FTOI", RF_D|RF_A},
+    [RG_FMAF] = {"FMAF", RF_D|RF_A|RF_B|RF_C}, [RG_FMAFK] = {"FMAFK", RF_D|RF_A|RF_KF|RF_B},
+    [RG_CMP] = {"CMP", RF_D|RF_A|RF_B},
+    [RG_LOAD] = {"LOAD", RF_D|RF_A},         [RG_LOADK] = {"LOADK", RF_D|RF_KI},
+    [RG_LOADB] = {"LOADB", RF_D|RF_A},       [RG_LOADF] = {"LOADF", RF_D|RF_A},
+    [RG_STORE] = {"STORE", RF_A|RF_B},       [RG_STOREK] = {"STOREK", RF_A|RF_KI},  [RG_KSTORE] = {"KSTORE", RF_B|RF_KI},
+    [RG_STOREF] = {"STOREF", RF_A|RF_B},     [RG_STOREFK] = {"STOREFK", RF_A|RF_KI},
+    [RG_PRINT] = {"PRINT", RF_A},            [RG_BLOCK] = {"BLOCK", RF_D},          [RG_CALLN] = {"CALLN", RF_D},
+    [RG_JMP] = {"JMP", RF_T},                [RG_JZ] = {"JZ", RF_A|RF_T},
+    [RG_JEQ] = {"JEQ", RF_A|RF_B|RF_T},      [RG_JEQK] = {"JEQK", RF_A|RF_KI|RF_T},
+    [RG_JNE] = {"JNE", RF_A|RF_B|RF_T},      [RG_JNEK] = {"JNEK", RF_A|RF_KI|RF_T},
+    [RG_JLT] = {"JLT", RF_A|RF_B|RF_T},      [RG_JLTK] = {"JLTK", RF_A|RF_KI|RF_T},
+    [RG_JLE] = {"JLE", RF_A|RF_B|RF_T},      [RG_JLEK] = {"JLEK", RF_A|RF_KI|RF_T},
+    [RG_JGTK] = {"JGTK", RF_A|RF_KI|RF_T},   [RG_JGEK] = {"JGEK", RF_A|RF_KI|RF_T},
+    [RG_JLTF] = {"JLTF", RF_A|RF_B|RF_T},    [RG_JLEF] = {"JLEF", RF_A|RF_B|RF_T},
+    [RG_JCMP] = {"JCMP", RF_A|RF_B|RF_T},
+    [RG_CALL] = {"CALL", RF_T},              [RG_TCALL] = {"TCALL", RF_T},
+    [RG_RET] = {"RET", 0},                   [RG_HALT] = {"HALT", 0},
+};
+#define RG_REG_MAX 0xFFFF   // registers per frame (uint16 operands)
+
+// What the translator knows a stack slot holds
+enum { RS_REG, RS_INT, RS_FLT };
+typedef struct {
+    uint8_t kind;
+    uint16_t r;                 // RS_REG: the register holding the value
+    union { int32_t i; double f; } k;
+} RSlot;
+typedef struct {
+    RegInsn *code; uint32_t *off;
+    size_t n; int cap, off_cap;
+    RSlot *st;                  // slots home.. d-1; a copy only ever names a register at or below its slot
+    int d, home;                // depth; slots below home are in their own registers
+    uint32_t at;                // byte offset of the instruction being translated
+    int dead;                   // no successor: nothing falls through to the next block
+    int fail;                   // frame the IR cannot express
+} RegBuild;
+
+static RegInsn *rg_emit(RegBuild *B, int op, int d, int a, int b) {
+    if (B->n == (size_t)B->cap) {
+        B->code = grow(B->code, &B->cap, sizeof(RegInsn));
+        B->off = grow(B->off, &B->off_cap, sizeof(uint32_t));
+    }
+    RegInsn *in = &B->code[B->n];
+    memset(in, 0, sizeof(*in));
+    in->op = (uint8_t)op; in->d = (uint16_t)d; in->a = (uint16_t)a; in->b = (uint16_t)b;
+    B->off[B->n++] = B->at;
+    return in;
+}
+static RSlot rg_slot(const RegBuild *B, int k) {
+    if (k >= B->home) return B->st[k];
+    RSlot s; s.kind = RS_REG; s.r = (uint16_t)k;
+    return s;
+}
+// slot k becomes the top: the slots above it are dead
+static void rg_set(RegBuild *B, int k, RSlot s) {
+    if (k < B->home) B->home = k;
+    B->st[k] = s;
+}
+static void rg_set_reg(RegBuild *B, int k) { RSlot s; s.kind = RS_REG; s.r = (uint16_t)k; rg_set(B, k, s); }
+static void rg_set_int(RegBuild *B, int k, int32_t x) { RSlot s; s.kind = RS_INT; s.r = 0; s.k.i = x; rg_set(B, k, s); }
+// Put slot k in its own register. Nothing names that register as a copy
+// while the slot is elsewhere, so the write clobbers no live value.
+static void rg_home(RegBuild *B, int k) {
+    RSlot s = rg_slot(B, k);
+    if (s.kind == RS_REG && s.r == k) return;
+    if (s.kind == RS_REG) rg_emit(B, RG_MOV, k, s.r, 0);
+    else if (s.kind == RS_INT) rg_emit(B, RG_KI, k, 0, 0)->u.k.i = s.k.i;
+    else rg_emit(B, RG_KF, k, 0, 0)->u.f = s.k.f;
+    B->st[k].kind = RS_REG;
+    B->st[k].r = (uint16_t)k;
+}
+// the register holding slot k (a constant goes to the slot's own)
+static int rg_reg(RegBuild *B, int k) {
+    RSlot s = rg_slot(B, k);
+    if (s.kind == RS_REG) return s.r;
+    rg_home(B, k);
+    return k;
+}
+static void rg_flush(RegBuild *B) {
+    for (int k = B->home; k < B->d; ++k) rg_home(B, k);
+    B->home = B->d;
+}
+
+// a op b for the two top slots (b on top); ops are those of vm_loop.h
+static void rg_int_op(RegBuild *B, int op) {
+    int t = B->d - 2;
+    RSlot a = rg_slot(B, t), b = rg_slot(B, t + 1);
+    B->d--;
+    if (a.kind == RS_INT && b.kind == RS_INT) {
+        uint32_t x = (uint32_t)a.k.i, y = (uint32_t)b.k.i;
+        // division by zero faults at run time
+        if (op == OP_ADD) { rg_set_int(B, t, (int32_t)(x + y)); return; }
+        if (op == OP_SUB) { rg_set_int(B, t, (int32_t)(x - y)); return; }
+        if (op == OP_MUL) { rg_set_int(B, t, (int32_t)(x * y)); return; }
+        if (b.k.i != 0) { rg_set_int(B, t, op == OP_DIV ? int_div(a.k.i, b.k.i) : int_mod(a.k.i, b.k.i)); return; }
+    }
+    if (b.kind == RS_INT && ((b.k.i == 0 && (op == OP_ADD || op == OP_SUB)) || (b.k.i == 1 && op == OP_MUL))) {
+        rg_set(B, t, a);    // x + 0, x - 0, x * 1
+        return;
+    }
+    int commutes = op == OP_ADD || op == OP_MUL;
+    static const uint8_t rr[] = { RG_ADD, RG_SUB, RG_MUL, RG_DIV, RG_MOD };
+    static const uint8_t rk[] = { RG_ADDK, RG_SUBK, RG_MULK, RG_DIVK, RG_MODK };
+    static const uint8_t kr[] = { RG_ADDK, RG_KSUB, RG_MULK, RG_KDIV, RG_KMOD };
+    int j = op - OP_ADD;
+    if (b.kind == RS_INT && b.k.i != 0 && (b.k.i != -1 || (op != OP_DIV && op != OP_MOD))) {
+        rg_emit(B, rk[j], t, rg_reg(B, t), 0)->u.k.i = b.k.i;   // DIVK / MODK by -1 go through int_div
+    } else if (a.kind == RS_INT && (commutes || b.kind == RS_REG)) {
+        rg_emit(B, kr[j], t, rg_reg(B, t + 1), 0)->u.k.i = a.k.i;
+    } else {
+        int ra = rg_reg(B, t), rb = rg_reg(B, t + 1);
+        rg_emit(B, rr[j], t, ra, rb);
+    }
+    rg_set_reg(B, t);
+}
+static void rg_float_op(RegBuild *B, int op) {
+    int t = B->d - 2;
+    RSlot a = rg_slot(B, t), b = rg_slot(B, t + 1);
+    B->d--;
+    if (a.kind == RS_FLT && b.kind == RS_FLT) {
+        double x = a.k.f, y = b.k.f;
+        RSlot s; s.kind = RS_FLT; s.r = 0;
+        s.k.f = flt_result(op == OP_ADDF ? x + y : op == OP_MULF ? x * y : op == OP_SUBF ? x - y : x / y);
+        rg_set(B, t, s);
+        return;
+    }
+    int commutes = op == OP_ADDF || op == OP_MULF;
+    int k = op == OP_ADDF ? RG_ADDFK : op == OP_MULF ? RG_MULFK : op == OP_DIVF ? RG_DIVFK : -1;
+    if (op == OP_SUBF && b.kind == RS_FLT && b.k.f == b.k.f) { k = RG_ADDFK; b.k.f = -b.k.f; }  // x - k is x + -k
+    if (b.kind == RS_FLT && k >= 0) rg_emit(B, k, t, rg_reg(B, t), 0)->u.f = b.k.f;
+    else if (a.kind == RS_FLT && commutes) rg_emit(B, k, t, rg_reg(B, t + 1), 0)->u.f = a.k.f;
+    else {
+        int ra = rg_reg(B, t), rb = rg_reg(B, t + 1);
+        rg_emit(B, op == OP_ADDF ? RG_ADDF : op == OP_MULF ? RG_MULF : op == OP_SUBF ? RG_SUBF : RG_DIVF, t, ra, rb);
+    }
+    rg_set_reg(B, t);
+}
+// NEGF / ITOF / FTOI on the top slot; a constant folds (FTOI only in range)
+static void rg_unary_op(RegBuild *B, int op) {
+    int t = B->d - 1;
+    RSlot a = rg_slot(B, t), s; s.kind = RS_FLT; s.r = 0;
+    if (op == OP_NEGF && a.kind == RS_FLT) { s.k.f = -a.k.f; rg_set(B, t, s); return; }
+    if (op == OP_ITOF && a.kind == RS_INT) { s.k.f = (double)a.k.i; rg_set(B, t, s); return; }
+    if (op == OP_FTOI && a.kind == RS_FLT && ftoi_ok(a.k.f)) { rg_set_int(B, t, (int32_t)a.k.f); return; }
+    int ra = rg_reg(B, t);
+    rg_emit(B, op == OP_NEGF ? RG_NEGF : op == OP_ITOF ? RG_ITOF : RG_FTOI, t, ra, 0);
+    rg_set_reg(B, t);
+}
+static Value rg_value(RSlot s) { return s.kind == RS_INT ? mk_int(s.k.i) : mk_float(s.k.f); }
+// JE..JGE to target: b op a for the two top slots, ty the verifier's types
+// (a's, b's in the high byte). Ints get a compare of their own, with a
+// constant operand folded in; floats for the orderings; the rest JCMP.
+static void rg_jcc(RegBuild *B, int op, unsigned ty, uint32_t target) {
+    RSlot b = rg_slot(B, B->d - 2), a = rg_slot(B, B->d - 1);
+    B->d -= 2;
+    if (a.kind != RS_REG && b.kind != RS_REG) {     // decided now
+        if (val_jcc(op, rg_value(b), rg_value(a))) {
+            rg_flush(B);
+            rg_emit(B, RG_JMP, 0, 0, 0)->u.k.t = target;
+            B->dead = 1;
+        }
+        return;
+    }
+    int ints = (ty & 0xFF) == TY_INT && ty >> 8 == TY_INT, flts = (ty & 0xFF) == TY_FLOAT && ty >> 8 == TY_FLOAT;
+    // mirrored: k op x as x op' k
+    static const uint8_t rk[] = { RG_JEQK, RG_JNEK, RG_JLTK, RG_JLEK, RG_JGTK, RG_JGEK };
+    static const uint8_t mirror[] = { OP_JE, OP_JNE, OP_JG, OP_JGE, OP_JL, OP_JLE };
+    RegInsn *j;
+    if (ints && (a.kind == RS_INT || b.kind == RS_INT)) {
+        RSlot x = a.kind == RS_INT ? b : a, k = a.kind == RS_INT ? a : b;
+        int o = a.kind == RS_INT ? op : mirror[op - OP_JE];
+        rg_flush(B);
+        j = rg_emit(B, rk[o - OP_JE], 0, x.r, 0);
+        j->u.k.i = k.k.i;
+    } else {
+        int rb = rg_reg(B, B->d), ra = rg_reg(B, B->d + 1);
+        rg_flush(B);
+        if (ints || (flts && op != OP_JE && op != OP_JNE)) {
+            // b < a, b <= a as they are; b > a as a < b, b >= a as a <= b
+            int lt = op == OP_JL || op == OP_JG, swap = op == OP_JG || op == OP_JGE;
+            int rop = op == OP_JE ? RG_JEQ : op == OP_JNE ? RG_JNE
+                    : ints ? (lt ? RG_JLT : RG_JLE) : (lt ? RG_JLTF : RG_JLEF);
+            j = swap ? rg_emit(B, rop, 0, ra, rb) : rg_emit(B, rop, 0, rb, ra);
+        } else {
+            j = rg_emit(B, RG_JCMP, op, rb, ra);
+        }
+    }
+    j->u.k.t = target;
+}
+
+static void reg_dump(const SisaProgram *P) {
+    for (size_t i = 0; i <= P->reg_len; ++i) {
+        const RegInsn *in = &P->reg[i];
+        int f = rg_info[in->op].f;
+        fprintf(stderr, "reg: %4zu ip=%04u %-7s", i, P->reg_off[i], rg_info[in->op].name);
+        const char *sep = " ";
+        if (f & RF_D) { fprintf(stderr, "%sr%u", sep, in->d); sep = ", "; }
+        if (in->op == RG_JCMP) { fprintf(stderr, "%s%s", sep, op_name((unsigned char)in->d)); sep = ", "; }
+        if (f & RF_A) { fprintf(stderr, "%sr%u", sep, in->a); sep = ", "; }
+        if (f & RF_B) { fprintf(stderr, "%sr%u", sep, in->b); sep = ", "; }
+        if (f & RF_C) { fprintf(stderr, "%sr%d", sep, in->u.k.i); sep = ", "; }
+        if (in->op == RG_BLOCK) fprintf(stderr, "%s%s", sep, op_name((unsigned char)in->u.k.i));
+        else if (in->op == RG_CALLN) fprintf(stderr, "%s%s", sep, P->natives[in->u.k.i].name);
+        else if (f & RF_KI) { fprintf(stderr, "%s%d", sep, in->u.k.i); sep = ", "; }
+        if (f & RF_KF) { fprintf(stderr, "%s%g", sep, in->u.f); sep = ", "; }
+        if (in->op == RG_CALL || in->op == RG_TCALL) fprintf(stderr, " base+%u (%u regs),", in->a, in->b);
+        if (f & RF_T) fprintf(stderr, "%s-> %u", sep, in->u.k.t);
+        fputc('\n', stderr);
+    }
+}
+
+// Translate P->prog (verified, not yet optimized) using the verifier's last
+// round: the entry depth of every block its function reached and the callee
+// summaries. Leaves P->reg NULL for a frame wider than RG_REG_MAX.
+static void reg_build(SisaProgram *P, const Verifier *V, unsigned opts) {
+    const Insn *prog = P->prog;
+    size_t n = P->prog_len;
+    for (int f = 0; f < V->nfuncs; ++f)
+        if (V->funcs[f].growth + (f ? VERIFY_MAX_PARAMS : 0) - V->funcs[f].low > RG_REG_MAX) return;
+    RegBuild B; memset(&B, 0, sizeof(B));
+    uint32_t *ir_at = malloc((n + 1) * sizeof(uint32_t));
+    B.st = malloc((VERIFY_MAX_DEPTH + 1) * sizeof(RSlot));
+    if (!ir_at || !B.st) nomem();
+    for (size_t i = 0; i <= n; ++i) ir_at[i] = UINT32_MAX;
+    B.dead = 1;
+    int fn = 0;
+    for (size_t i = 0; i < n && !B.fail; ++i) {
+        const Insn *in = &prog[i];
+        if (V->leader[i]) {
+            if (!B.dead) rg_flush(&B);     // falling through: B.at is still the last insn's
+            B.dead = V->owner[i] < 0;      // never reached
+            if (B.dead) continue;
+            fn = V->owner[i];
+            B.d = B.home = V->depth[i] - V->funcs[V->owner[i]].low;
+            ir_at[i] = (uint32_t)B.n;
+        }
+        if (B.dead) continue;
+        B.at = in->off;
+        int d = B.d;
+        switch (in->op) {
+            case OP_NOP: case OP_SNAPSHOT: break;
+            case OP_PUSH: rg_set_int(&B, d, in->a.i); B.d++; break;
+            case OP_PUSHF: { RSlot s; s.kind = RS_FLT; s.r = 0; s.k.f = in->a.f; rg_set(&B, d, s); B.d++; break; }
+            case OP_DUP: rg_set(&B, d, rg_slot(&B, d - 1)); B.d++; break;
+            case OP_POP: B.d--; break;
+            case OP_SUB:
+                // SUB; JZ t: jump if the operands are equal
+                if (i + 1 < n && prog[i+1].op == OP_JZ && !V->leader[i+1]) {
+                    RSlot a = rg_slot(&B, d - 2), b = rg_slot(&B, d - 1);
+                    if (a.kind != RS_INT || b.kind != RS_INT) {
+                        if (a.kind == RS_INT) { RSlot x = a; a = b; b = x; }
+                        B.d -= 2;
+                        rg_flush(&B);
+                        RegInsn *j = b.kind == RS_INT ? rg_emit(&B, RG_JEQK, 0, a.r, 0) : rg_emit(&B, RG_JEQ, 0, a.r, b.r);
+                        if (b.kind == RS_INT) j->u.k.i = b.k.i;
+                        j->u.k.t = prog[i+1].a.t;
+                        ++i;
+                        break;
+                    }
+                }
+                rg_int_op(&B, OP_SUB);
                 break;
-            }
-            case OP_ADDF: {
-                double a = pop_float_checked("ADDF"); double b = pop_float_checked("ADDF");
-                push_float(b + a);
+            case OP_ADD: case OP_MUL: case OP_DIV: case OP_MOD: rg_int_op(&B, in->op); break;
+            case OP_INC: case OP_DEC: case OP_NEG: {
+                RSlot s = rg_slot(&B, d - 1);
+                int32_t k = in->op == OP_INC ? 1 : in->op == OP_DEC ? -1 : 0;
+                if (s.kind == RS_INT) {
+                    uint32_t x = (uint32_t)s.k.i;
+                    rg_set_int(&B, d - 1, (int32_t)(in->op == OP_NEG ? 0u - x : x + (uint32_t)k));
+                    break;
+                }
+                rg_emit(&B, in->op == OP_NEG ? RG_KSUB : RG_ADDK, d - 1, s.r, 0)->u.k.i = k;
+                rg_set_reg(&B, d - 1);
                 break;
             }
-            case OP_MULF: {
-                double a = pop_float_checked("MULF"); double b = pop_float_checked("MULF");
-                push_float(b * a);
+            case OP_ADDF: case OP_MULF: case OP_SUBF: case OP_DIVF: rg_float_op(&B, in->op); break;
+            case OP_NEGF: case OP_ITOF: case OP_FTOI: rg_unary_op(&B, in->op); break;
+            case OP_FMAF: {
+                RSlot a = rg_slot(&B, d - 3), b = rg_slot(&B, d - 2), c = rg_slot(&B, d - 1);
+                B.d -= 2;
+                if (a.kind == RS_FLT && b.kind == RS_FLT && c.kind == RS_FLT) {
+                    RSlot s; s.kind = RS_FLT; s.r = 0; s.k.f = flt_result(vm_fma(a.k.f, b.k.f, c.k.f));
+                    rg_set(&B, d - 3, s);
+                    break;
+                }
+                if (a.kind == RS_FLT || b.kind == RS_FLT) {
+                    // a constant factor (the product is the same either way round)
+                    double k = a.kind == RS_FLT ? a.k.f : b.k.f;
+                    int rx = rg_reg(&B, a.kind == RS_FLT ? d - 2 : d - 3), rc = rg_reg(&B, d - 1);
+                    rg_emit(&B, RG_FMAFK, d - 3, rx, rc)->u.f = k;
+                    rg_set_reg(&B, d - 3);
+                    break;
+                }
+                int ra = rg_reg(&B, d - 3), rb = rg_reg(&B, d - 2), rc = rg_reg(&B, d - 1);
+                rg_emit(&B, RG_FMAF, d - 3, ra, rb)->u.k.i = rc;
+                rg_set_reg(&B, d - 3);
                 break;
             }
-            case OP_DUP: {
-                Value v = peek_val(); push_from_value(v); break;
-            }
-            case OP_PRINT: {
-                Value v = pop_val();
-                if (v.type == TY_INT) printf("%d\n", v.v.i);
-                else printf("%g\n", v.v.f);
+            case OP_CMP: {
+                RSlot b = rg_slot(&B, d - 2), a = rg_slot(&B, d - 1);
+                B.d--;
+                if (a.kind != RS_REG && b.kind != RS_REG) { rg_set_int(&B, d - 2, val_cmp(rg_value(b), rg_value(a))); break; }
+                int rb = rg_reg(&B, d - 2), ra = rg_reg(&B, d - 1);
+                rg_emit(&B, RG_CMP, d - 2, rb, ra);
+                rg_set_reg(&B, d - 2);
                 break;
             }
-            case OP_POP: { pop_val(); break; }
+            case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE:
+                rg_jcc(&B, in->op, in->aux, in->a.t);
+                break;
             case OP_LOAD: {
-                // pop addr (int) and push memory[addr] as int
-                Value a = pop_val();
-                if (a.type != TY_INT) runtime_err("LOAD expects integer address");
-                int32_t addr = a.v.i;
-                if (addr < 0 || addr >= MEM_SIZE) runtime_err("LOAD address out of bounds");
-                push_int(memory_arr[addr]);
+                RSlot s = rg_slot(&B, d - 1);
+                if (s.kind == RS_INT) rg_emit(&B, RG_LOADK, d - 1, 0, 0)->u.k.i = s.k.i;
+                else rg_emit(&B, RG_LOAD, d - 1, s.r, 0);
+                rg_set_reg(&B, d - 1);
+                break;
+            }
+            case OP_LOADB: case OP_LOADF:
+                rg_emit(&B, in->op == OP_LOADB ? RG_LOADB : RG_LOADF, d - 1, rg_reg(&B, d - 1), 0);
+                rg_set_reg(&B, d - 1);
+                break;
+            case OP_STORE: case OP_STOREF: {
+                RSlot v = rg_slot(&B, d - 2), a = rg_slot(&B, d - 1);
+                int f = in->op == OP_STOREF;
+                if (v.kind == RS_INT && a.kind == RS_REG && !f) rg_emit(&B, RG_KSTORE, 0, 0, a.r)->u.k.i = v.k.i;
+                else if (a.kind == RS_INT) rg_emit(&B, f ? RG_STOREFK : RG_STOREK, 0, rg_reg(&B, d - 2), 0)->u.k.i = a.k.i;
+                else rg_emit(&B, f ? RG_STOREF : RG_STORE, 0, rg_reg(&B, d - 2), a.r);
+                B.d -= 2;
                 break;
             }
-            case OP_STORE: {
-                // pop addr (int), pop value (int required) and store memory[addr]=value
-                Value addrv = pop_val();
-                if (addrv.type != TY_INT) runtime_err("STORE expects integer address");
-                int32_t addr = addrv.v.i;
-                if (addr < 0 || addr >= MEM_SIZE) runtime_err("STORE address out of bounds");
-                Value val = pop_val();
-                if (val.type != TY_INT) runtime_err("STORE currently supports integers only");
-                memory_arr[addr] = val.v.i;
+            case OP_PRINT: rg_emit(&B, RG_PRINT, 0, rg_reg(&B, d - 1), 0); B.d--; break;
+            case OP_MEMCPY: case OP_MEMSET: case OP_MEMCMP:
+            case OP_VADD: case OP_VMUL: case OP_VADDF: case OP_VMULF:
+            case OP_VDOT: case OP_VSUM: case OP_VDOTF: case OP_VSUMF: {
+                int k = block_arity(in->op);
+                for (int j = d - k; j < d; ++j) rg_home(&B, j);   // block_op reads them in place
+                rg_emit(&B, RG_BLOCK, d, 0, 0)->u.k.i = in->op;
+                B.d -= k - block_results(in->op);
+                if (block_results(in->op)) rg_set_reg(&B, B.d - 1);
                 break;
             }
-            case OP_JMP: {
-                if (ip + 4 > code_len) runtime_err("truncated JMP");
-                uint32_t tgt; memcpy(&tgt, &codebuf[ip], 4); ip = (size_t)tgt;
+            case OP_CALLN: {
+                const Native *N = &P->natives[in->a.i];
+                int base = d - N->nargs;
+                for (int j = base; j < d; ++j) rg_home(&B, j);    // the native reads them in place
+                rg_emit(&B, RG_CALLN, base, 0, 0)->u.k.i = in->a.i;
+                B.d = base + N->nres;
+                for (int j = base; j < B.d; ++j) rg_set_reg(&B, j);
                 break;
             }
             case OP_JZ: {
-                if (ip + 4 > code_len) runtime_err("truncated JZ");
-                uint32_t tgt; memcpy(&tgt, &codebuf[ip], 4); ip += 4;
-                {
-                    Value v = pop_val();
-                    int is_zero = 0;
-                    if (v.type == TY_INT) is_zero = (v.v.i == 0);
-                    else is_zero = (v.v.f == 0.0);
-                    if (is_zero) ip = (size_t)tgt;
+                RSlot s = rg_slot(&B, d - 1);
+                B.d--;
+                if (s.kind == RS_REG) {
+                    rg_flush(&B);
+                    rg_emit(&B, RG_JZ, 0, s.r, 0)->u.k.t = in->a.t;
+                } else if (s.kind == RS_INT ? s.k.i == 0 : s.k.f == 0.0) {
+                    rg_flush(&B);
+                    rg_emit(&B, RG_JMP, 0, 0, 0)->u.k.t = in->a.t;
+                    B.dead = 1;
                 }
                 break;
             }
-            case OP_CALL: {
-                if (ip + 4 > code_len) runtime_err("truncated CALL");
-                uint32_t tgt; memcpy(&tgt, &codebuf[ip], 4); ip += 4;
-                if (csp >= STACK_SIZE) runtime_err("call stack overflow");
-                callstack[csp++] = (uint32_t)ip;
-                ip = (size_t)tgt;
+            case OP_JMP:
+                rg_flush(&B);
+                rg_emit(&B, RG_JMP, 0, 0, 0)->u.k.t = in->a.t;
+                B.dead = 1;
                 break;
-            }
-            case OP_RET: {
-                if (csp <= 0) runtime_err("call stack underflow");
-                ip = (size_t)callstack[--csp];
+            case OP_CALL: {
+                // the callee's register 0 is the lowest caller slot it reaches
+                const VFunc *F = &V->funcs[V->func_at[in->a.t]];
+                int below = VERIFY_MAX_PARAMS - F->low;
+                rg_flush(&B);
+                if (d < below) { B.fail = 1; break; }
+                // CALL; RET, as call_pass makes a TCALL of it: only a callee
+                // frame at our own base can skip the call stack, as RET then
+                // restores our caller's (other tail calls grow the stack anyway)
+                int tail = fn > 0 && d == below && prog[i+1].op == OP_RET && !V->frame && !(opts & SISA_LOAD_NO_OPT);
+                rg_emit(&B, tail ? RG_TCALL : RG_CALL, 0, d - below, below + F->growth)->u.k.t = in->a.t;
+                B.dead = 1;     // the return point is a block of its own
                 break;
             }
-            case OP_HALT: return;
-            default:
-                fprintf(stderr, "Unknown opcode %02X at %zu\n", op, cur); exit(1);
+            case OP_RET: rg_flush(&B); rg_emit(&B, RG_RET, 0, 0, 0); B.dead = 1; break;
+            case OP_HALT: rg_flush(&B); rg_emit(&B, RG_HALT, B.d, 0, 0); B.dead = 1; break;
+            default: B.fail = 1; break;
+        }
+    }
+    if (!B.dead) rg_flush(&B);
+    ir_at[n] = (uint32_t)B.n;
+    B.at = (uint32_t)P->code_len;
+    rg_emit(&B, RG_HALT, 0, 0, 0);
+    B.n--;      // the sentinel is not counted
+    for (size_t i = 0; i < B.n && !B.fail; ++i) {
+        RegInsn *in = &B.code[i];
+        if ((in->op >= RG_JMP && in->op <= RG_JCMP) || in->op == RG_CALL || in->op == RG_TCALL) {
+            if (ir_at[in->u.k.t] == UINT32_MAX) B.fail = 1;
+            else in->u.k.t = ir_at[in->u.k.t];
         }
     }
+    free(ir_at);
+    free(B.st);
+    if (B.fail) { free(B.code); free(B.off); return; }
+    P->reg = B.code;
+    P->reg_off = B.off;
+    P->reg_len = B.n;
+    if (opts & SISA_LOAD_DUMP_REG) reg_dump(P);
 }
 
-// Read file into string
-static char *read_file(const char *path) {
-    FILE *f = fopen(path, "rb");
-    if (!f) return NULL;
-    fseek(f, 0, SEEK_END);
-    long sz = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    char *buf = malloc(sz + 1);
-    if (!buf) { fclose(f); return NULL; }
-    if (fread(buf, 1, sz, f) != (size_t)sz) { fclose(f); free(buf); return NULL; }
-    buf[sz] = 0;
-    fclose(f);
-    return buf;
+// Simple TRACE printer
+static const char *op_name(unsigned char op) {
+    switch(op) {
+        case OP_PUSH: return "PUSH";
+        case OP_PUSHF: return "PUSHF";
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_MOD: return "MOD";
+        case OP_INC: return "INC";
+        case OP_DEC: return "DEC";
+        case OP_NEG: return "NEG";
+        case OP_ADDF: return "ADDF";
+        case OP_MULF: return "MULF";
+        case OP_DUP: return "DUP";
+        case OP_PRINT: return "PRINT";
+        case OP_POP: return "POP";
+        case OP_LOAD: return "LOAD";
+        case OP_LOADB: return "LOADB";
+        case OP_STORE: return "STORE";
+        case OP_LOADF: return "LOADF";
+        case OP_STOREF: return "STOREF";
+        case OP_MEMCPY: return "MEMCPY";
+        case OP_MEMSET: return "MEMSET";
+        case OP_MEMCMP: return "MEMCMP";
+        case OP_VADD: return "VADD";
+        case OP_VMUL: return "VMUL";
+        case OP_VDOT: return "VDOT";
+        case OP_VSUM: return "VSUM";
+        case OP_VADDF: return "VADDF";
+        case OP_VMULF: return "VMULF";
+        case OP_VDOTF: return "VDOTF";
+        case OP_VSUMF: return "VSUMF";
+        case OP_JMP: return "JMP";
+        case OP_JZ: return "JZ";
+        case OP_CALL: return "CALL";
+        case OP_RET: return "RET";
+        case OP_ADDI: return "ADDI";
+        case OP_SUBI: return "SUBI";
+        case OP_LOADI: return "LOADI";
+        case OP_STOREI: return "STOREI";
+        case OP_DUPJZ: return "DUPJZ";
+        case OP_TCALL: return "TCALL";
+        case OP_SNAPSHOT: return "SNAPSHOT";
+        case OP_PUSH8: return "PUSH8";
+        case OP_PUSH16: return "PUSH16";
+        case OP_PUSHK: return "PUSHK";
+        case OP_CALLN: return "CALLN";
+        case OP_SUBF: return "SUBF";
+        case OP_DIVF: return "DIVF";
+        case OP_NEGF: return "NEGF";
+        case OP_FMAF: return "FMAF";
+        case OP_ITOF: return "ITOF";
+        case OP_FTOI: return "FTOI";
+        case OP_CMP: return "CMP";
+        case OP_JE: return "JE";
+        case OP_JNE: return "JNE";
+        case OP_JL: return "JL";
+        case OP_JLE: return "JLE";
+        case OP_JG: return "JG";
+        case OP_JGE: return "JGE";
+        case OP_HALT: return "HALT";
+        default: return "UNK";
+    }
 }
 
-// Entrypoint: assemble & run file
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: %s <program.asm>\n\n", argv[0]);
-        printf("Integer sample: sample_int.asm\n");
-        printf("Float sample:   sample_float.asm\n");
-        return 0;
+static void print_stack_snapshot(const SisaVM *vm) {
+    printf(" [stack:");
+    int start = vm->sp - 8; if (start < 0) start = 0;
+    for (int i = start; i < vm->sp; ++i) {
+        if (VAL_IS_INT(vm->stack[i])) printf(" %d", VAL_I(vm->stack[i]));
+        else printf(" %g", VAL_F(vm->stack[i]));
     }
+    printf(" ]\n");
+}
 
-    char *src = read_file(argv[1]);
-    if (!src) { fprintf(stderr, "Failed to open '%s'\n", argv[1]); return 1; }
+// One TRACE line: ip, mnemonic, immediate (if any) and the top of the stack
+static void trace_insn(const SisaVM *vm, const Insn *in) {
+    printf("TRACE ip=%04u %-6s", in->off, op_name(in->op));
+    // show immediates for some ops
+    if (in->op == OP_PUSH) printf(" %d", in->a.i);
+    else if (in->op == OP_PUSHF) printf(" %g", in->a.f);
+    else if (in->op==OP_JMP || in->op==OP_JZ || OP_IS_JCC(in->op) || in->op==OP_CALL) printf(" %u", vm->p->prog[in->a.t].off);
+    else if (in->op == OP_CALLN) printf(" %s", vm->p->natives[in->a.i].name);
+    print_stack_snapshot(vm);
+}
 
-    unsigned char *bc = assemble_from_string(src, &code_len);
-    free(src);
-    codebuf = bc;
+// Profiler (SISA_RUN_PROFILE)
+// The profiling loop calls prof_insn before every instruction. It counts the
+// instruction, charges the clock ticks since the previous call to the
+// previous instruction, and follows CALL/RET through a tree with one node per
+// distinct call path from the entry: a node's own counts are the
+// instructions run with exactly that path on the call stack. Ticks are TSC
+// cycles on x86-64 and nanoseconds elsewhere; they include the profiler's
+// own work: the report takes off the cheapest instruction's ticks (the floor)
+// from every instruction as the profiler's share, so they are estimates.
+typedef struct {
+    int32_t parent;             // -1 for the root (the entry)
+    int32_t fn;                 // callee instruction index, -1 for the root
+    uint64_t calls, insns, ticks;
+} ProfNode;
+typedef struct Profile {
+    const SisaProgram *p;       // NULL: nothing profiled since sisa_load
+    size_t n;                   // p->prog_len + 1 (the HALT sentinel)
+    uint64_t *hits, *ticks;     // per instruction
+    ProfNode *node;
+    int node_count, node_cap;
+    int32_t *child;             // (parent, fn) -> node, open addressing, -1 empty
+    size_t child_cap;           // power of two
+    int32_t cur, last_node;     // call path now, and at the previous instruction
+    size_t last;                // previous instruction
+    uint64_t t;                 // clock at the previous instruction
+    uint64_t floor;             // fewest ticks seen for one instruction
+    int running;                // a run is being counted
+    int timed;                  // read the clock (not for RUN_COUNT)
+} Profile;
+#define RUN_COUNT 0x80000000u   // internal run flag: SISA_RUN_PROFILE's counts only (--bench)
 
-    printf("Assembled %zu bytes.\n", code_len);
-    run_vm();
+#ifdef PROF_TSC
+#define PROF_UNIT "cycles"
+static uint64_t prof_clock(void) { return __rdtsc(); }
+#else
+#define PROF_UNIT "ns"
+static uint64_t prof_clock(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
 
-    free(bc);
-    return 0;
+static size_t prof_slot(const Profile *P, int32_t parent, int32_t fn) {
+    size_t mask = P->child_cap - 1;
+    uint32_t h = ((uint32_t)parent * 0x9E3779B1u ^ (uint32_t)fn) * 0x85EBCA6Bu;
+    for (size_t i = (h ^ h >> 16) & mask; ; i = (i + 1) & mask) {
+        int32_t c = P->child[i];
+        if (c < 0 || (P->node[c].parent == parent && P->node[c].fn == fn)) return i;
+    }
+}
+static void prof_rehash(Profile *P, size_t cap) {
+    int32_t *c = malloc(cap * sizeof(int32_t));
+    if (!c) nomem();
+    memset(c, 0xFF, cap * sizeof(int32_t));
+    free(P->child);
+    P->child = c;
+    P->child_cap = cap;
+    for (int i = 1; i < P->node_count; ++i) P->child[prof_slot(P, P->node[i].parent, P->node[i].fn)] = i;
+}
+// The node for calling fn from path parent
+static int32_t prof_callee(Profile *P, int32_t parent, int32_t fn) {
+    size_t h = prof_slot(P, parent, fn);
+    if (P->child[h] >= 0) return P->child[h];
+    if (2 * (size_t)P->node_count >= P->child_cap) {
+        prof_rehash(P, P->child_cap * 2);
+        h = prof_slot(P, parent, fn);
+    }
+    if (P->node_count == P->node_cap) P->node = grow(P->node, &P->node_cap, sizeof(ProfNode));
+    ProfNode *N = &P->node[P->node_count];
+    N->parent = parent;
+    N->fn = fn;
+    N->calls = N->insns = N->ticks = 0;
+    return P->child[h] = P->node_count++;
+}
+
+SISA_NOINLINE static void prof_insn(Profile *P, const Insn *prog, const Insn *in) {
+    if (P->timed) {
+        uint64_t t = prof_clock(), dt = t - P->t;
+        P->ticks[P->last] += dt;
+        P->node[P->last_node].ticks += dt;
+        if (dt < P->floor) P->floor = dt;
+        P->t = t;
+    }
+    size_t i = (size_t)(in - prog);
+    ++P->hits[i];
+    ++P->node[P->cur].insns;
+    P->last = i;
+    P->last_node = P->cur;
+    if (in->op == OP_CALL) {
+        P->cur = prof_callee(P, P->cur, (int32_t)in->a.t);
+        ++P->node[P->cur].calls;
+    } else if (in->op == OP_RET && P->node[P->cur].parent >= 0) {
+        P->cur = P->node[P->cur].parent;
+    } else if (in->op == OP_TCALL && P->node[P->cur].parent >= 0) {  // the callee replaces us on the path
+        P->cur = prof_callee(P, P->node[P->cur].parent, (int32_t)in->a.t);
+        ++P->node[P->cur].calls;
+    }
+}
+
+// Clear vm's profile (allocating it on first use) for a run of vm->p
+static void prof_start(SisaVM *vm, int timed) {
+    Profile *P = vm->prof;
+    size_t n = vm->p->prog_len + 1;
+    if (!P && !(P = vm->prof = calloc(1, sizeof(Profile)))) nomem();
+    P->p = NULL;
+    if (P->n != n) {
+        free(P->hits); free(P->ticks);
+        P->n = 0;
+        P->hits = calloc(n, sizeof(uint64_t));
+        P->ticks = calloc(n, sizeof(uint64_t));
+        if (!P->hits || !P->ticks) nomem();
+        P->n = n;
+    } else {
+        memset(P->hits, 0, n * sizeof(uint64_t));
+        memset(P->ticks, 0, n * sizeof(uint64_t));
+    }
+    if (!P->node) P->node = grow(NULL, &P->node_cap, sizeof(ProfNode));
+    P->node[0] = (ProfNode){ -1, -1, 1, 0, 0 };
+    P->node_count = 1;
+    prof_rehash(P, 64);
+    P->cur = P->last_node = 0;
+    P->last = 0;
+    P->p = vm->p;
+    P->running = 1;
+    P->timed = timed;
+    P->floor = UINT64_MAX;
+    P->t = prof_clock();
+}
+// The run is over: charge its last instruction
+static void prof_stop(Profile *P) {
+    if (!P->running) return;
+    P->running = 0;
+    if (!P->timed) return;
+    uint64_t t = prof_clock();
+    P->ticks[P->last] += t - P->t;
+    P->node[P->last_node].ticks += t - P->t;
 }
+
+// Run statistics (SISA_RUN_STATS)
+// The stats loops keep a difference array over prog[]: each straight line the
+// fuel pays for adds one at its first insn and takes one off after its last,
+// so a running sum over it gives every insn's count once the run is over.
+// The peak stack depths are kept as the loop goes, the rest is read around
+// the run.
+#define STATS_PAGE 1024         // cells: mem_cells counts 4 KiB pages
+
+typedef struct RunStats {
+    SisaStats s;
+    uint64_t *line;             // p->prog_len + 2 entries
+    size_t n;
+    const SisaProgram *p;       // NULL: no stats since sisa_load
+    const Insn *seg, *at;       // the line being run and its insn so far
+    int running;
+    struct timespec t0;
+    uint64_t out0;              // output bytes before the run
+    int perf[3];                // SISA_RUN_PERF counters, -1 if not open
+} RunStats;
+
+static const unsigned char op_class[256] = {
+    [OP_ADD] = SISA_CLASS_INT, [OP_SUB] = SISA_CLASS_INT, [OP_MUL] = SISA_CLASS_INT,
+    [OP_DIV] = SISA_CLASS_INT, [OP_MOD] = SISA_CLASS_INT, [OP_INC] = SISA_CLASS_INT,
+    [OP_DEC] = SISA_CLASS_INT, [OP_NEG] = SISA_CLASS_INT, [OP_ADDI] = SISA_CLASS_INT,
+    [OP_SUBI] = SISA_CLASS_INT,
+    [OP_ADDF] = SISA_CLASS_FLOAT, [OP_MULF] = SISA_CLASS_FLOAT, [OP_SUBF] = SISA_CLASS_FLOAT,
+    [OP_DIVF] = SISA_CLASS_FLOAT, [OP_NEGF] = SISA_CLASS_FLOAT, [OP_FMAF] = SISA_CLASS_FLOAT,
+    [OP_ITOF] = SISA_CLASS_FLOAT, [OP_FTOI] = SISA_CLASS_FLOAT,
+    [OP_LOAD] = SISA_CLASS_MEMORY, [OP_STORE] = SISA_CLASS_MEMORY, [OP_LOADB] = SISA_CLASS_MEMORY,
+    [OP_LOADF] = SISA_CLASS_MEMORY, [OP_STOREF] = SISA_CLASS_MEMORY, [OP_LOADI] = SISA_CLASS_MEMORY,
+    [OP_STOREI] = SISA_CLASS_MEMORY,
+    [OP_MEMCPY] = SISA_CLASS_BLOCK, [OP_MEMSET] = SISA_CLASS_BLOCK, [OP_MEMCMP] = SISA_CLASS_BLOCK,
+    [OP_VADD] = SISA_CLASS_BLOCK, [OP_VMUL] = SISA_CLASS_BLOCK, [OP_VDOT] = SISA_CLASS_BLOCK,
+    [OP_VSUM] = SISA_CLASS_BLOCK, [OP_VADDF] = SISA_CLASS_BLOCK, [OP_VMULF] = SISA_CLASS_BLOCK,
+    [OP_VDOTF] = SISA_CLASS_BLOCK, [OP_VSUMF] = SISA_CLASS_BLOCK,
+    [OP_CMP] = SISA_CLASS_CONTROL, [OP_JMP] = SISA_CLASS_CONTROL, [OP_JZ] = SISA_CLASS_CONTROL,
+    [OP_JE] = SISA_CLASS_CONTROL, [OP_JNE] = SISA_CLASS_CONTROL, [OP_JL] = SISA_CLASS_CONTROL,
+    [OP_JLE] = SISA_CLASS_CONTROL, [OP_JG] = SISA_CLASS_CONTROL, [OP_JGE] = SISA_CLASS_CONTROL,
+    [OP_DUPJZ] = SISA_CLASS_CONTROL, [OP_CALL] = SISA_CLASS_CONTROL, [OP_TCALL] = SISA_CLASS_CONTROL,
+    [OP_RET] = SISA_CLASS_CONTROL, [OP_HALT] = SISA_CLASS_CONTROL, [OP_SNAPSHOT] = SISA_CLASS_CONTROL,
+    [OP_CALLN] = SISA_CLASS_HOST,
+    [OP_PRINT] = SISA_CLASS_PRINT,
+};   // the rest are SISA_CLASS_STACK (0)
+static const char *const class_name[SISA_CLASSES] = {
+    "stack", "int", "float", "memory", "block", "control", "host", "print",
+};
+
+static void perf_close(RunStats *R) {
+    for (int k = 0; k < 3; ++k) {
+#ifdef __linux__
+        if (R->perf[k] >= 0) close(R->perf[k]);
+#endif
+        R->perf[k] = -1;
+    }
+}
+
+// Cycles, branch misses and cache misses of this thread in user space, as
+// one group so that they cover the same stretch; none if any is refused
+static void perf_start(RunStats *R) {
+#ifdef __linux__
+    static const uint64_t config[3] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES };
+    for (int k = 0; k < 3; ++k) {
+        struct perf_event_attr a;
+        memset(&a, 0, sizeof a);
+        a.size = sizeof a;
+        a.type = PERF_TYPE_HARDWARE;
+        a.config = config[k];
+        a.disabled = k == 0;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        R->perf[k] = (int)syscall(SYS_perf_event_open, &a, 0, -1, k ? R->perf[0] : -1, 0UL);
+        if (R->perf[k] < 0) { perf_close(R); return; }
+    }
+    ioctl(R->perf[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(R->perf[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    (void)R;
+#endif
+}
+
+static void perf_stop(RunStats *R) {
+    if (R->perf[0] < 0) return;
+#ifdef __linux__
+    uint64_t v[3];
+    ioctl(R->perf[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    int ok = 1;
+    for (int k = 0; k < 3; ++k) ok &= read(R->perf[k], &v[k], sizeof v[k]) == (ssize_t)sizeof v[k];
+    if (ok) {
+        R->s.cycles = v[0];
+        R->s.branch_misses = v[1];
+        R->s.cache_misses = v[2];
+        R->s.counters = 1;
+    }
+#endif
+    perf_close(R);
+}
+
+// Cells of the pages of data memory that are not all zero. On Linux the
+// pages of a mapped heap that were never touched are skipped unread.
+static uint64_t mem_used(const SisaVM *vm) {
+    size_t cells = (size_t)vm->mem_mask + 1;
+    uint64_t used = 0;
+#ifdef __linux__
+    size_t os = (size_t)sysconf(_SC_PAGESIZE) / sizeof(int32_t);
+    unsigned char in[256];
+    size_t span = vm->mem_mapped && os >= STATS_PAGE && os % STATS_PAGE == 0 ? os * 256 : 0;
+#endif
+    for (size_t at = 0; at < cells; ) {
+#ifdef __linux__
+        if (span && mincore(vm->memory + at, (cells - at < span ? cells - at : span) * sizeof(int32_t), in) == 0) {
+            size_t end = cells - at < span ? cells : at + span;
+            for (size_t k = 0; at < end; ++k, at += os)
+                if (in[k] & 1)
+                    for (size_t g = at; g < at + os; g += STATS_PAGE) {
+                        int32_t any = 0;
+                        for (size_t i = 0; i < STATS_PAGE; ++i) any |= vm->memory[g + i];
+                        used += any ? STATS_PAGE : 0;
+                    }
+            continue;
+        }
+#endif
+        int32_t any = 0;
+        for (size_t i = 0; i < STATS_PAGE; ++i) any |= vm->memory[at + i];
+        used += any ? STATS_PAGE : 0;
+        at += STATS_PAGE;
+    }
+    return used;
+}
+
+// Clear vm's stats (allocating them on first use) for a run of vm->p
+static void stats_start(SisaVM *vm, unsigned flags) {
+    RunStats *R = vm->stats;
+    size_t n = vm->p->prog_len + 2;
+    if (!R) {
+        if (!(R = vm->stats = calloc(1, sizeof(RunStats)))) nomem();
+        R->perf[0] = R->perf[1] = R->perf[2] = -1;
+    }
+    if (R->n != n) {
+        free(R->line);
+        R->n = 0;
+        if (!(R->line = calloc(n, sizeof(uint64_t)))) nomem();
+        R->n = n;
+    } else memset(R->line, 0, n * sizeof(uint64_t));
+    memset(&R->s, 0, sizeof R->s);
+    R->s.peak_sp = (uint32_t)vm->sp;
+    R->s.peak_csp = (uint32_t)vm->csp;
+    R->p = NULL;
+    R->seg = R->at = NULL;
+    R->running = 1;
+    R->out0 = vm->out_flushed + vm->out.len;
+    if (flags & SISA_RUN_PERF) perf_start(R);
+    timespec_get(&R->t0, TIME_UTC);
+}
+
+// The run is over (or failed): sum the lines up
+static void stats_stop(SisaVM *vm) {
+    RunStats *R = vm->stats;
+    if (!R->running) return;
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    perf_stop(R);
+    R->running = 0;
+    SisaStats *S = &R->s;
+    S->run_s = (double)(t1.tv_sec - R->t0.tv_sec) + (t1.tv_nsec - R->t0.tv_nsec) / 1e9;
+    if (vm->err.code != SISA_OK && vm->err.code != SISA_YIELD && R->at) {
+        ++R->line[R->seg - vm->p->prog];   // the line it faulted in, up to the insn that did
+        --R->line[R->at - vm->p->prog + 1];
+    }
+    uint64_t k = 0;
+    for (size_t i = 0; i + 1 < R->n; ++i) {
+        k += R->line[i];
+        S->insns += k;
+        S->insns_by_class[op_class[vm->p->prog[i].op]] += k;
+    }
+    S->mem_cells = mem_used(vm);
+    S->print_bytes = vm->out_flushed + vm->out.len - R->out0;
+    S->load_s = vm->p->load_sec;
+    R->p = vm->p;
+}
+
+// Execution
+// The loop body lives in vm_loop.h and is stamped out once per variant, so the
+// fast path carries no trace or fuel code at all.
+// Dispatch engine is picked at build time: GCC/Clang get direct threading via
+// labels-as-values, everything else (MSVC) the portable switch. Build with
+// -DSISA_DISPATCH_SWITCH to force the switch loop.
+#if defined(__GNUC__) && !defined(SISA_DISPATCH_SWITCH)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+#define VM_LOOP_NAME    run_loop_fast
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 0
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    0
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+#define VM_LOOP_NAME    run_loop_checked
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 1
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    0
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+#define VM_LOOP_NAME    run_loop_trace
+#define VM_LOOP_TRACE   1
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 1
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+#define VM_LOOP_NAME    run_loop_prof
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    1
+#define VM_LOOP_CHECKED 1
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+// budgeted runs (sisa_set_fuel), verified and not
+#define VM_LOOP_NAME    run_loop_fuel
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 0
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+#define VM_LOOP_NAME    run_loop_fuel_checked
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 1
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+// SISA_RUN_STATS runs, fuel counting included
+#define VM_LOOP_NAME    run_loop_stats
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 0
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   1
+#include "vm_loop.h"
+
+#define VM_LOOP_NAME    run_loop_stats_checked
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 1
+#define VM_LOOP_TIER    0
+#define VM_LOOP_FUEL    1
+#define VM_LOOP_STATS   1
+#include "vm_loop.h"
+
+// Register tier interpreter (SISA_RUN_REG): runs P->reg on the value stack,
+// R at the frame base of the running function. A CALL's return index is on
+// the call stack; the frame base goes back down by the shift of the CALL
+// just before it. Checks and messages are those of run_loop_fast.
+#if VM_THREADED
+#define RG_NEXT() do { pc++; goto *rg_dispatch[pc->op]; } while (0)
+#define RG_JUMP(t) do { pc = code + (t); goto *rg_dispatch[pc->op]; } while (0)
+#define RG_CASE(o) L_##o
+#else
+#define RG_NEXT() { pc++; continue; }
+#define RG_JUMP(t) { pc = code + (t); continue; }
+#define RG_CASE(o) case o
+#endif
+#define RG_I(r) VAL_I(R[r])
+#define RG_F(r) VAL_F(R[r])
+static void run_loop_reg(SisaVM *vm) {
+#if VM_THREADED
+    static const void *const rg_dispatch[RG_NOPS] = {
+        &&L_RG_MOV, &&L_RG_KI, &&L_RG_KF,
+        &&L_RG_ADD, &&L_RG_ADDK, &&L_RG_SUB, &&L_RG_SUBK, &&L_RG_KSUB,
+        &&L_RG_MUL, &&L_RG_MULK, &&L_RG_DIV, &&L_RG_DIVK, &&L_RG_KDIV, &&L_RG_MOD, &&L_RG_MODK, &&L_RG_KMOD,
+        &&L_RG_ADDF, &&L_RG_ADDFK, &&L_RG_MULF, &&L_RG_MULFK, &&L_RG_SUBF, &&L_RG_DIVF, &&L_RG_DIVFK,
+        &&L_RG_NEGF, &&L_RG_ITOF, &&L_RG_FTOI, &&L_RG_FMAF, &&L_RG_FMAFK, &&L_RG_CMP,
+        &&L_RG_LOAD, &&L_RG_LOADK, &&L_RG_LOADB, &&L_RG_LOADF,
+        &&L_RG_STORE, &&L_RG_STOREK, &&L_RG_KSTORE, &&L_RG_STOREF, &&L_RG_STOREFK,
+        &&L_RG_PRINT, &&L_RG_BLOCK, &&L_RG_CALLN,
+        &&L_RG_JMP, &&L_RG_JZ, &&L_RG_JEQ, &&L_RG_JEQK,
+        &&L_RG_JNE, &&L_RG_JNEK, &&L_RG_JLT, &&L_RG_JLTK, &&L_RG_JLE, &&L_RG_JLEK, &&L_RG_JGTK, &&L_RG_JGEK,
+        &&L_RG_JLTF, &&L_RG_JLEF, &&L_RG_JCMP,
+        &&L_RG_CALL, &&L_RG_TCALL, &&L_RG_RET, &&L_RG_HALT,
+    };
+#endif
+    const RegInsn *const code = vm->p->reg;
+    Value *const stack = vm->stack;
+    uint32_t *const callstack = vm->callstack;
+    int32_t *const memory_arr = vm->memory;
+    const uint32_t mem_mask = vm->mem_mask;
+    const Native *const natives = vm->p->natives;
+    const int stack_max = vm->stack_max;
+    int csp = vm->csp;
+    Value *R = stack;
+    const RegInsn *pc = code;
+#if VM_THREADED
+    goto *rg_dispatch[pc->op];
+#else
+    for (;;) {
+        switch (pc->op) {
+#endif
+            RG_CASE(RG_MOV): R[pc->d] = R[pc->a]; RG_NEXT();
+            RG_CASE(RG_KI): R[pc->d] = mk_int(pc->u.k.i); RG_NEXT();
+            RG_CASE(RG_KF): R[pc->d] = mk_float(pc->u.f); RG_NEXT();
+            RG_CASE(RG_ADD): R[pc->d] = mk_int(int_add(RG_I(pc->a), RG_I(pc->b))); RG_NEXT();
+            RG_CASE(RG_ADDK): R[pc->d] = mk_int(int_add(RG_I(pc->a), pc->u.k.i)); RG_NEXT();
+            RG_CASE(RG_SUB): R[pc->d] = mk_int(int_sub(RG_I(pc->a), RG_I(pc->b))); RG_NEXT();
+            RG_CASE(RG_SUBK): R[pc->d] = mk_int(int_sub(RG_I(pc->a), pc->u.k.i)); RG_NEXT();
+            RG_CASE(RG_KSUB): R[pc->d] = mk_int(int_sub(pc->u.k.i, RG_I(pc->a))); RG_NEXT();
+            RG_CASE(RG_MUL): R[pc->d] = mk_int(int_mul(RG_I(pc->a), RG_I(pc->b))); RG_NEXT();
+            RG_CASE(RG_MULK): R[pc->d] = mk_int(int_mul(RG_I(pc->a), pc->u.k.i)); RG_NEXT();
+            RG_CASE(RG_DIV): {
+                int32_t b = RG_I(pc->b);
+                if (b == 0) runtime_err("division by zero");
+                R[pc->d] = mk_int(int_div(RG_I(pc->a), b));
+                RG_NEXT();
+            }
+            RG_CASE(RG_DIVK): R[pc->d] = mk_int(RG_I(pc->a) / pc->u.k.i); RG_NEXT();   // k != 0, -1
+            RG_CASE(RG_KDIV): {
+                int32_t b = RG_I(pc->a);
+                if (b == 0) runtime_err("division by zero");
+                R[pc->d] = mk_int(int_div(pc->u.k.i, b));
+                RG_NEXT();
+            }
+            RG_CASE(RG_MOD): {
+                int32_t b = RG_I(pc->b);
+                if (b == 0) runtime_err("modulo by zero");
+                R[pc->d] = mk_int(int_mod(RG_I(pc->a), b));
+                RG_NEXT();
+            }
+            RG_CASE(RG_MODK): R[pc->d] = mk_int(RG_I(pc->a) % pc->u.k.i); RG_NEXT();
+            RG_CASE(RG_KMOD): {
+                int32_t b = RG_I(pc->a);
+                if (b == 0) runtime_err("modulo by zero");
+                R[pc->d] = mk_int(int_mod(pc->u.k.i, b));
+                RG_NEXT();
+            }
+            RG_CASE(RG_ADDF): R[pc->d] = mk_float(flt_result(RG_F(pc->a) + RG_F(pc->b))); RG_NEXT();
+            RG_CASE(RG_ADDFK): R[pc->d] = mk_float(flt_result(RG_F(pc->a) + pc->u.f)); RG_NEXT();
+            RG_CASE(RG_MULF): R[pc->d] = mk_float(flt_result(RG_F(pc->a) * RG_F(pc->b))); RG_NEXT();
+            RG_CASE(RG_MULFK): R[pc->d] = mk_float(flt_result(RG_F(pc->a) * pc->u.f)); RG_NEXT();
+            RG_CASE(RG_SUBF): R[pc->d] = mk_float(flt_result(RG_F(pc->a) - RG_F(pc->b))); RG_NEXT();
+            RG_CASE(RG_DIVF): R[pc->d] = mk_float(flt_result(RG_F(pc->a) / RG_F(pc->b))); RG_NEXT();
+            RG_CASE(RG_DIVFK): R[pc->d] = mk_float(flt_result(RG_F(pc->a) / pc->u.f)); RG_NEXT();
+            RG_CASE(RG_NEGF): R[pc->d] = mk_float(-RG_F(pc->a)); RG_NEXT();
+            RG_CASE(RG_ITOF): R[pc->d] = mk_float((double)RG_I(pc->a)); RG_NEXT();
+            RG_CASE(RG_FTOI): {
+                double f = RG_F(pc->a);
+                if (!ftoi_ok(f)) runtime_err("FTOI out of range");
+                R[pc->d] = mk_int((int32_t)f);
+                RG_NEXT();
+            }
+            RG_CASE(RG_FMAF): R[pc->d] = mk_float(flt_result(vm_fma(RG_F(pc->a), RG_F(pc->b), RG_F(pc->u.k.i)))); RG_NEXT();
+            RG_CASE(RG_FMAFK): R[pc->d] = mk_float(flt_result(vm_fma(RG_F(pc->a), pc->u.f, RG_F(pc->b)))); RG_NEXT();
+            RG_CASE(RG_CMP): R[pc->d] = mk_int(val_cmp(R[pc->a], R[pc->b])); RG_NEXT();
+            RG_CASE(RG_LOAD): {
+                int32_t addr = RG_I(pc->a);
+                if ((uint32_t)addr > mem_mask) runtime_err("LOAD address out of bounds");
+                R[pc->d] = mk_int(memory_arr[addr]);
+                RG_NEXT();
+            }
+            RG_CASE(RG_LOADK): {
+                int32_t addr = pc->u.k.i;
+                if ((uint32_t)addr > mem_mask) runtime_err("LOAD address out of bounds");
+                R[pc->d] = mk_int(memory_arr[addr]);
+                RG_NEXT();
+            }
+            RG_CASE(RG_LOADB): {
+                int32_t addr = RG_I(pc->a);
+                if (addr < 0 || (uint32_t)addr >> 2 > mem_mask) runtime_err("LOADB address out of bounds");
+                R[pc->d] = mk_int(((const uint8_t *)memory_arr)[addr]);
+                RG_NEXT();
+            }
+            RG_CASE(RG_LOADF): {
+                int32_t addr = RG_I(pc->a);
+                if ((uint32_t)addr >= mem_mask) runtime_err("LOADF address out of bounds");
+                double f;
+                memcpy(&f, memory_arr + addr, sizeof(f));
+                R[pc->d] = mk_float(val_from_double(f));
+                RG_NEXT();
+            }
+            RG_CASE(RG_STORE): {
+                int32_t addr = RG_I(pc->b);
+                if ((uint32_t)addr > mem_mask) runtime_err("STORE address out of bounds");
+                memory_arr[addr] = RG_I(pc->a);
+                RG_NEXT();
+            }
+            RG_CASE(RG_STOREK): {
+                int32_t addr = pc->u.k.i;
+                if ((uint32_t)addr > mem_mask) runtime_err("STORE address out of bounds");
+                memory_arr[addr] = RG_I(pc->a);
+                RG_NEXT();
+            }
+            RG_CASE(RG_KSTORE): {
+                int32_t addr = RG_I(pc->b);
+                if ((uint32_t)addr > mem_mask) runtime_err("STORE address out of bounds");
+                memory_arr[addr] = pc->u.k.i;
+                RG_NEXT();
+            }
+            RG_CASE(RG_STOREF): {
+                int32_t addr = RG_I(pc->b);
+                if ((uint32_t)addr >= mem_mask) runtime_err("STOREF address out of bounds");
+                double f = RG_F(pc->a);
+                memcpy(memory_arr + addr, &f, sizeof(f));
+                RG_NEXT();
+            }
+            RG_CASE(RG_STOREFK): {
+                int32_t addr = pc->u.k.i;
+                if ((uint32_t)addr >= mem_mask) runtime_err("STOREF address out of bounds");
+                double f = RG_F(pc->a);
+                memcpy(memory_arr + addr, &f, sizeof(f));
+                RG_NEXT();
+            }
+            RG_CASE(RG_PRINT): vm_print(vm, R[pc->a]); RG_NEXT();
+            RG_CASE(RG_BLOCK):
+                if (!block_op(memory_arr, mem_mask, pc->u.k.i, R + pc->d)) block_fail(pc->u.k.i);
+                RG_NEXT();
+            RG_CASE(RG_CALLN): {
+                const Native *N = &natives[pc->u.k.i];
+                int rc = N->fn(N->user, (SisaValue *)(R + pc->d), memory_arr, (size_t)mem_mask + 1);
+                if (rc) native_fail(N, rc);
+                RG_NEXT();
+            }
+            RG_CASE(RG_JMP): RG_JUMP(pc->u.k.t);
+            RG_CASE(RG_JZ): {
+                Value v = R[pc->a];
+                if (VAL_IS_INT(v) ? VAL_I(v) == 0 : VAL_F(v) == 0.0) RG_JUMP(pc->u.k.t);
+                RG_NEXT();
+            }
+            RG_CASE(RG_JEQ): if (RG_I(pc->a) == RG_I(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JEQK): if (RG_I(pc->a) == pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JNE): if (RG_I(pc->a) != RG_I(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JNEK): if (RG_I(pc->a) != pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLT): if (RG_I(pc->a) < RG_I(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLTK): if (RG_I(pc->a) < pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLE): if (RG_I(pc->a) <= RG_I(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLEK): if (RG_I(pc->a) <= pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JGTK): if (RG_I(pc->a) > pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JGEK): if (RG_I(pc->a) >= pc->u.k.i) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLTF): if (RG_F(pc->a) < RG_F(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JLEF): if (RG_F(pc->a) <= RG_F(pc->b)) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_JCMP): if (val_jcc(pc->d, R[pc->a], R[pc->b])) RG_JUMP(pc->u.k.t); RG_NEXT();
+            RG_CASE(RG_CALL): {
+                if (csp >= stack_max) runtime_err("call stack overflow");
+                if ((R - stack) + pc->a + pc->b > stack_max) runtime_err("stack overflow");
+                callstack[csp++] = (uint32_t)(pc - code) + 1;
+                R += pc->a;
+                RG_JUMP(pc->u.k.t);
+            }
+            RG_CASE(RG_TCALL):
+                if ((R - stack) + pc->b > stack_max) runtime_err("stack overflow");
+                RG_JUMP(pc->u.k.t);
+            RG_CASE(RG_RET): {
+                if (csp <= 0) runtime_err("call stack underflow");
+                pc = code + callstack[--csp];
+                R -= pc[-1].a;
+#if VM_THREADED
+                goto *rg_dispatch[pc->op];
+#else
+                continue;
+#endif
+            }
+            RG_CASE(RG_HALT):
+                vm->sp = (int)(R - stack) + pc->d;
+                vm->csp = csp;
+                return;
+#if !VM_THREADED
+            default:
+                sisa_fail(SISA_ERR_BYTECODE, "Unknown register op %u", pc->op);
+        }
+    }
+#endif
+}
+#undef RG_NEXT
+#undef RG_JUMP
+#undef RG_CASE
+#undef RG_I
+#undef RG_F
+
+// x86-64 template JIT
+// Verified programs only: every opcode becomes a fixed machine-code template
+// over the same Value stack the interpreter uses (rbx points at stack[sp]),
+// jump targets are resolved from prog[] indices, SISA CALL/RET become native
+// call/ret. Code is written into a read-write mapping which is then flipped
+// to read-execute (W^X). Build with -DSISA_NO_JIT to leave it out.
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(SISA_NO_JIT)
+#define VM_HAVE_JIT 1
+
+// Handed to the generated code in the first argument register, kept in rbp.
+typedef struct {
+    Value   *top;     // +0:  &stack[sp]; written back on exit
+    int32_t *mem;     // +8:  memory_arr, kept in r12
+    Value   *limit;   // +16: &stack[stack_max], kept in r13
+    int32_t  depth;   // +24: call frames left before overflow, kept in r14d
+    uint32_t mem_mask; // +28: LOAD/STORE bound
+    // tiered code (jit_build with a region) only
+    uint32_t *callstack; // +32: &vm->callstack[csp], rebuilt from the native frames on an exit
+    const void *entry;   // +40: where to start
+    uint32_t resume;     // +48: the insn a JIT_EXIT / JIT_GUARD leaves for
+    int32_t status;      // +52: that exit's status
+    const uint64_t *base; // +56: rsp with no native frames (r15)
+    const struct JitCode *code; // for jit_unwind
+} JitCtx;
+typedef int (*JitFn)(JitCtx *);
+
+// Exit statuses of generated code (0 = HALT)
+enum { JIT_OK, JIT_DIV0, JIT_MOD0, JIT_LOAD_OOB, JIT_STORE_OOB, JIT_STACK_OVF, JIT_CALL_OVF, JIT_LOADB_OOB,
+       JIT_LOADF_OOB, JIT_STOREF_OOB, JIT_BLOCK_OOB, JIT_FTOI_RANGE, JIT_NATIVE_FAIL, JIT_NSTATUS };
+static const char *const jit_status_msg[JIT_NSTATUS] = {
+    NULL, "division by zero", "modulo by zero", "LOAD address out of bounds",
+    "STORE address out of bounds", "stack overflow", "call stack overflow", "LOADB address out of bounds",
+    "LOADF address out of bounds", "STOREF address out of bounds", NULL /* block_fail */, "FTOI out of range",
+    NULL /* native_fail */,
+};
+// Exits of tiered code: back to the interpreter at ctx.resume, at a region
+// exit, a fault or a RET into an interpreted frame (JIT_EXIT) or where a
+// type guard failed (JIT_GUARD). The interpreter then runs that insn itself.
+enum { JIT_EXIT = JIT_NSTATUS, JIT_GUARD };
+
+typedef struct {
+    Builder b;
+    size_t *at;                        // native offset of each insn (n + 1)
+    struct { size_t pos; uint32_t insn; } *fix; size_t nfix;  // rel32 -> insn
+    struct { size_t pos; int status; } *efix; size_t nefix;   // rel32 -> error stub
+    // tiered code: only insns in region are compiled; jumps out of it, and
+    // faults, go to exit stubs instead
+    const uint8_t *region;             // NULL: the whole program
+    const uint8_t *poly;               // insns whose guard failed: compile them generic
+    uint32_t cur;                      // the insn being compiled
+    struct { size_t pos; uint32_t insn; int status; } *dfix; size_t ndfix;  // rel32 -> exit stub
+    uint32_t *ret_at, *ret_to; size_t nret;                    // see JitCode
+} Jit;
+
+static void j_bytes(Jit *J, const unsigned char *bytes, size_t n) {
+    for (size_t i = 0; i < n; ++i) b_emit_u8(&J->b, (uint8_t)bytes[i]);
+}
+#define J(...) do { static const unsigned char j_[] = { __VA_ARGS__ }; j_bytes(J, j_, sizeof(j_)); } while (0)
+static void j_i32(Jit *J, int32_t x) { b_emit_i32_le(&J->b, x); }
+static void j_jump(Jit *J, uint32_t insn) {        // after an E8/E9/0F 8x opcode
+    J->fix[J->nfix].pos = J->b.len; J->fix[J->nfix++].insn = insn; j_i32(J, 0);
+}
+static void j_exit(Jit *J, uint32_t insn, int status) {  // after an E9/0F 8x opcode
+    J->dfix[J->ndfix].pos = J->b.len; J->dfix[J->ndfix].insn = insn; J->dfix[J->ndfix++].status = status; j_i32(J, 0);
+}
+static void j_err(Jit *J, int status) {            // after a 0F 8x opcode
+    if (J->region) { j_exit(J, J->cur, JIT_EXIT); return; }  // the interpreter reports it
+    J->efix[J->nefix].pos = J->b.len; J->efix[J->nefix++].status = status; j_i32(J, 0);
+}
+
+// Value layout as seen by generated code. Slots are addressed off rbx, which
+// points one past the top: the payload of the value k below the top is at
+// JV_AT(k). An int is tagged by one dword store at JV_TAG of its slot; the
+// NaN-boxed layout has no float tag to write.
+#ifdef SISA_NAN_BOX
+#define JV_PAY      0
+#define JV_TAG      4
+#define JV_INT_TAG  ((int32_t)VAL_INT_TAG)
+#else
+#define JV_PAY      8
+#define JV_TAG      0
+#define JV_INT_TAG  TY_INT
+#endif
+#define JV_SIZE     ((int)sizeof(Value))
+#define JV_AT(k)    (JV_PAY - ((k) + 1) * JV_SIZE)
+
+// op bytes then ModRM for [rbx+disp8]; reg is a register or /digit
+static void j_rbx(Jit *J, const unsigned char *op, size_t n, int reg, int disp) {
+    j_bytes(J, op, n);
+    b_emit_u8(&J->b, (uint8_t)(0x43 | (reg << 3)));
+    b_emit_u8(&J->b, (uint8_t)(int8_t)disp);
+}
+#define JM(reg, disp, ...) do { static const unsigned char j_[] = { __VA_ARGS__ }; j_rbx(J, j_, sizeof(j_), reg, disp); } while (0)
+enum { R_EAX = 0, R_ECX = 1, R_EDX = 2, R_EDI = 7 };
+
+static void j_adj(Jit *J, int slots) {             // add rbx, slots*JV_SIZE
+    J(0x48,0x83,0xC3); b_emit_u8(&J->b, (uint8_t)(int8_t)(slots * JV_SIZE));
+}
+static void j_lea_adj(Jit *J, int slots) {         // same, flags preserved
+    JM(3, slots * JV_SIZE, 0x48,0x8D);             // lea rbx, [rbx+d]
+}
+static void j_tag_int(Jit *J, int disp) {          // disp: slot start
+    JM(0, disp + JV_TAG, 0xC7); j_i32(J, JV_INT_TAG);        // mov dword [rbx+d], tag
+}
+static void j_tag_float(Jit *J, int disp) {
+#ifdef SISA_NAN_BOX
+    (void)J; (void)disp;
+#else
+    JM(0, disp + JV_TAG, 0xC7); j_i32(J, TY_FLOAT);
+#endif
+}
+
+#ifdef _WIN32
+#define J_ARG1_FROM_RBX()   J(0x48,0x89,0xD9)        // mov rcx, rbx
+#define J_ARG1              R_ECX
+#define J_RBP_FROM_ARG1()   J(0x48,0x89,0xCD)        // mov rbp, rcx
+#define J_ARG2_IMM()        J(0xBA)                  // mov edx, imm32
+#define J_ARG1_FROM_RBP()   J(0x48,0x89,0xE9)        // mov rcx, rbp
+#define J_ARG2_FROM_RSP()   J(0x48,0x89,0xE2)        // mov rdx, rsp
+#else
+#define J_ARG1_FROM_RBX()   J(0x48,0x89,0xDF)        // mov rdi, rbx
+#define J_ARG1              R_EDI
+#define J_RBP_FROM_ARG1()   J(0x48,0x89,0xFD)        // mov rbp, rdi
+#define J_ARG2_IMM()        J(0xBE)                  // mov esi, imm32
+#define J_ARG1_FROM_RBP()   J(0x48,0x89,0xEF)        // mov rdi, rbp
+#define J_ARG2_FROM_RSP()   J(0x48,0x89,0xE6)        // mov rsi, rsp
+#endif
+
+#define JIT_NO_ENTRY UINT32_MAX
+typedef struct JitCode {
+    void *mem;
+    size_t size;
+    uint32_t *entry;   // region code: native offset of each branch target in it, else JIT_NO_ENTRY
+    uint32_t *ret_at;  // region code: native offset after each CALL, ascending
+    uint32_t *ret_to;  // the insn that CALL returns to
+    size_t nret;
+} JitCode;
+static void jit_code_free(JitCode *c) {
+    free(c->entry); free(c->ret_at); free(c->ret_to);
+    c->entry = c->ret_at = c->ret_to = NULL;
+}
+// Region code leaving with native frames: each is one return address between
+// sp and ctx->base, so the interpreter's call stack above the csp it entered
+// with is the insns they return to, outermost first
+static void jit_unwind(JitCtx *ctx, const uint64_t *sp) {
+    const JitCode *c = ctx->code;
+    uint32_t *cs = ctx->callstack;
+    for (const uint64_t *f = ctx->base; f-- > sp; ) {
+        uint32_t off = (uint32_t)(*f - (uint64_t)(uintptr_t)c->mem);
+        size_t lo = 0, hi = c->nret - 1;
+        while (lo < hi) { size_t m = (lo + hi) / 2; if (c->ret_at[m] < off) lo = m + 1; else hi = m; }
+        *cs++ = c->ret_to[lo];
+    }
+}
+
+// the VM running generated code on this thread, for the PRINT helpers
+static SISA_TLS SisaVM *jit_vm = NULL;
+static void jit_print_int(int32_t x) { vm_print(jit_vm, mk_int(x)); }
+static void jit_print_float(double f) { vm_print(jit_vm, mk_float(f)); }
+static void jit_print_val(const Value *v) { vm_print(jit_vm, *v); }
+// block_op on the JIT stack. On failure the op is left in jit_block_op for
+// the error message.
+static SISA_TLS int jit_block_op;
+static int jit_block(Value *top, int op) {
+    if (!block_op(jit_vm->memory, jit_vm->mem_mask, op, top)) { jit_block_op = op; return 0; }
+    return 1;
+}
+
+// CALLN on the JIT stack; a failure is left in jit_native for the message
+static SISA_TLS const Native *jit_native;
+static SISA_TLS int jit_native_rc;
+static int jit_calln(Value *top, int k) {
+    const Native *N = &jit_vm->p->natives[k];
+    int rc = N->fn(N->user, (SisaValue *)(top - N->nargs), jit_vm->memory, (size_t)jit_vm->mem_mask + 1);
+    if (rc) { jit_native = N; jit_native_rc = rc; return 0; }
+    return 1;
+}
+
+// CMP and JE..JGE on the top two values when their types are not static
+static void jit_cmp(Value *top) { top[-2] = mk_int(val_cmp(top[-2], top[-1])); }
+static int jit_jcc(Value *top, int op) { return val_jcc(op, top[-2], top[-1]); }
+
+// xmm0 = the positive quiet NaN if it holds a NaN (flt_result)
+static void j_nan_result(Jit *J) {
+    J(0x66,0x0F,0x2E,0xC0);                              // ucomisd xmm0, xmm0
+    J(0x7B,0x0F);                                        // jnp done (+15)
+    J(0x48,0xB8);                                        // mov rax, imm64
+    for (int i = 0; i < 8; ++i) b_emit_u8(&J->b, (uint8_t)(FLT_NAN_BITS >> (8*i)));
+    J(0x66,0x48,0x0F,0x6E,0xC0);                         // movq xmm0, rax
+}
+
+// call a C helper with rsp realigned to 16 (native SISA calls move it by 8)
+// plus the Win64 shadow area; argument registers are loaded by the caller.
+static void j_call_helper(Jit *J, void *fn) {
+    J(0x48,0x89,0xE0);                                   // mov rax, rsp
+    J(0x48,0x83,0xE4,0xF0);                              // and rsp, -16
+    J(0x48,0x83,0xEC,0x30);                              // sub rsp, 48
+    J(0x48,0x89,0x44,0x24,0x20);                         // mov [rsp+32], rax
+    J(0x48,0xB8);                                  // mov rax, imm64
+    uint64_t a = (uint64_t)(uintptr_t)fn;
+    for (int i = 0; i < 8; ++i) b_emit_u8(&J->b, (uint8_t)(a >> (8*i)));
+    J(0xFF,0xD0);                            // call rax
+    J(0x48,0x8B,0x64,0x24,0x20);                   // mov rsp, [rsp+32]
+}
+
+static void j_push_int_eax(Jit *J) {
+    j_tag_int(J, 0);
+    JM(R_EAX, JV_PAY, 0x89);                       // mov [rbx+pay], eax
+    j_adj(J, 1);
+}
+
+// JZ (pop = 1) or DUPJZ (pop = 0) on a top of static type ty (0 = tagged)
+static void j_jz(Jit *J, uint16_t ty, uint32_t target, int pop) {
+    if (ty == TY_INT) {
+        JM(7, JV_AT(0), 0x83); J(0x00);    // cmp dword [top], 0
+        if (pop) j_lea_adj(J, -1);
+        J(0x0F,0x84); j_jump(J, target);   // jz target
+    } else if (ty == TY_FLOAT) {
+        JM(0, JV_AT(0), 0xF2,0x0F,0x10);   // movsd xmm0, [top]
+        if (pop) j_adj(J, -1);
+        J(0x66,0x0F,0x57,0xC9);            // xorpd xmm1, xmm1
+        J(0x66,0x0F,0x2E,0xC1);            // ucomisd xmm0, xmm1
+        J(0x7A,0x06);                            // jp +6 (NaN is not zero)
+        J(0x0F,0x84); j_jump(J, target);   // jz target
+    } else {
+        int slot = -JV_SIZE;               // the tested value's slot
+        if (pop) { j_lea_adj(J, -1); slot = 0; }
+        if (JV_INT_TAG > 127 || JV_INT_TAG < -128) {
+            JM(7, slot + JV_TAG, 0x81); j_i32(J, JV_INT_TAG);  // cmp dword [tag], int tag
+        } else {
+            JM(7, slot + JV_TAG, 0x83); J((unsigned char)JV_INT_TAG);
+        }
+        J(0x75,0x0C);                            // jne float (+12)
+        JM(7, slot + JV_PAY, 0x83); J(0x00);     // cmp dword [payload], 0
+        J(0x0F,0x84); j_jump(J, target);   // jz target
+        J(0xEB,0x15);                      // jmp done (+21)
+        JM(0, slot + JV_PAY, 0xF2,0x0F,0x10);    // float: movsd xmm0, [payload]
+        J(0x66,0x0F,0x57,0xC9);            // xorpd xmm1, xmm1
+        J(0x66,0x0F,0x2E,0xC1);            // ucomisd xmm0, xmm1
+        J(0x7A,0x06);                            // jp done
+        J(0x0F,0x84); j_jump(J, target);   // jz target
+    }                                            // done:
+}
+
+static void j_jcc(Jit *J, uint8_t cc, uint32_t target) {    // 0F cc rel32
+    b_emit_u8(&J->b, 0x0F); b_emit_u8(&J->b, cc); j_jump(J, target);
+}
+// JE..JGE: pop a and b, jump if b op a. ty: the static types of a and of b
+// (high byte); ints compare as ints, floats with ucomisd, where unordered
+// sets ZF, PF and CF: each ordering is computed as an "above" so a NaN falls
+// through. Anything else goes through jit_jcc.
+static void j_cmp_jump(Jit *J, int op, uint16_t ty, uint32_t target) {
+    static const uint8_t icc[] = { 0x84, 0x85, 0x8C, 0x8E, 0x8F, 0x8D };   // je jne jl jle jg jge
+    int k = op - OP_JE;
+    if (ty == (TY_INT | TY_INT << 8)) {
+        JM(R_EAX, JV_AT(0), 0x8B);               // mov eax, [a]
+        JM(R_EAX, JV_AT(1), 0x39);               // cmp [b], eax
+        j_lea_adj(J, -2);
+        j_jcc(J, icc[k], target);
+    } else if (ty == (TY_FLOAT | TY_FLOAT << 8)) {
+        int swap = op == OP_JL || op == OP_JLE;  // b < a as a > b
+        JM(0, JV_AT(swap ? 0 : 1), 0xF2,0x0F,0x10);  // movsd xmm0, [b] (or [a])
+        JM(0, JV_AT(swap ? 1 : 0), 0x66,0x0F,0x2E);  // ucomisd xmm0, [a] (or [b])
+        j_lea_adj(J, -2);
+        if (op == OP_JE) {
+            J(0x7A,0x06);                        // jp +6 (unordered)
+            j_jcc(J, 0x84, target);              // je target
+        } else if (op == OP_JNE) {
+            j_jcc(J, 0x8A, target);              // jp target
+            j_jcc(J, 0x85, target);              // jne target
+        } else {
+            j_jcc(J, op == OP_JL || op == OP_JG ? 0x87 : 0x83, target);  // ja / jae
+        }
+    } else {
+        J_ARG1_FROM_RBX();
+        J_ARG2_IMM(); j_i32(J, op);
+        j_call_helper(J, (void *)jit_jcc);
+        J(0x85,0xC0);                            // test eax, eax
+        j_lea_adj(J, -2);
+        j_jcc(J, 0x85, target);                  // jnz target
+    }
+}
+
+// Tiered code speculates that a value of no static type (a function
+// parameter) is an int: a guard on its tag, leaving with JIT_GUARD. Returns
+// the type to compile the insn for.
+static uint16_t j_speculate(Jit *J, uint16_t ty) {
+    if (ty || !J->region || J->poly[J->cur]) return ty;
+    if (JV_INT_TAG > 127 || JV_INT_TAG < -128) {
+        JM(7, -JV_SIZE + JV_TAG, 0x81); j_i32(J, JV_INT_TAG);  // cmp dword [tag], int tag
+    } else {
+        JM(7, -JV_SIZE + JV_TAG, 0x83); J((unsigned char)JV_INT_TAG);
+    }
+    J(0x0F,0x85); j_exit(J, J->cur, JIT_GUARD);                // jne exit
+    return TY_INT;
+}
+// tiered code: where nothing in the region follows insn i, jump to i + 1
+static void j_fall(Jit *J, size_t i) {
+    if (J->region && !J->region[i+1]) { J(0xE9); j_jump(J, (uint32_t)(i + 1)); }
+}
+static void jit_unmap(void *mem, size_t sz) {
+#ifdef _WIN32
+    (void)sz;
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, sz);
+#endif
+}
+
+// Compile P into executable memory; 0 if the code could not be mapped. With
+// a region (flags per insn) only those insns are compiled, as tiered code:
+// it starts at ctx.entry and leaves for the interpreter wherever control
+// goes outside the region (see JIT_EXIT).
+static int jit_build(const SisaProgram *P, const uint8_t *region, const uint8_t *poly, JitCode *out) {
+    const Insn *prog = P->prog;
+    size_t n = P->prog_len;
+    Jit Jb; memset(&Jb, 0, sizeof(Jb));
+    Jit *J = &Jb;
+    J->b = builder_new(64 * (n + 1) + 256);
+    J->at = malloc((n + 1) * sizeof(size_t));
+    J->fix = malloc(3 * (n + 1) * sizeof(*J->fix));   // a tagged JZ has two exits, region code a fall-through
+    J->efix = malloc(4 * (n + 1) * sizeof(*J->efix));
+    J->dfix = malloc(4 * (n + 1) * sizeof(*J->dfix));
+    J->region = region; J->poly = poly;
+    J->ret_at = malloc((n + 1) * sizeof(uint32_t));
+    J->ret_to = malloc((n + 1) * sizeof(uint32_t));
+    uint8_t *target = calloc(n + 1, 1);
+    if (!J->at || !J->fix || !J->efix || !J->dfix || !J->ret_at || !J->ret_to || !target) nomem();
+    for (size_t i = 0; i <= n; ++i) J->at[i] = SIZE_MAX;
+    for (size_t i = 0; i < n; ++i)
+        if (prog[i].op == OP_JMP || prog[i].op == OP_JZ || prog[i].op == OP_DUPJZ || OP_IS_JCC(prog[i].op)
+            || prog[i].op == OP_CALL || prog[i].op == OP_TCALL)
+            target[prog[i].a.t] = 1;
+
+    // prologue: save callee-saved registers, load the context
+    J(0x55, 0x53, 0x41,0x54, 0x41,0x55, 0x41,0x56, 0x41,0x57); // push rbp rbx r12-r15
+    J_RBP_FROM_ARG1();
+    J(0x48,0x8B,0x5D,0x00);                        // mov rbx, [rbp]
+    J(0x4C,0x8B,0x65,0x08);                        // mov r12, [rbp+8]
+    J(0x4C,0x8B,0x6D,0x10);                        // mov r13, [rbp+16]
+    J(0x44,0x8B,0x75,0x18);                        // mov r14d, [rbp+24]
+    J(0x49,0x89,0xE7);                       // mov r15, rsp
+    if (region) {
+        J(0x4C,0x89,0x7D,0x38);              // mov [rbp+56], r15 (base)
+        J(0xFF,0x65,0x28);                   // jmp [rbp+40] (entry)
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const Insn *in = &prog[i];
+        if (region && !region[i]) continue;
+        J->at[i] = J->b.len;
+        J->cur = (uint32_t)i;
+        // PUSH k feeding the next instruction: fold the constant into it
+        if (in->op == OP_PUSH && i + 1 < n && !target[i+1] && (!region || region[i+1])) {
+            int32_t k = in->a.i;
+            const Insn *nx = &prog[i+1];
+            int fused = 1;
+            switch (nx->op) {
+                case OP_ADD: JM(0, JV_AT(0), 0x81); j_i32(J, k); break;   // add dword [top], k
+                case OP_SUB: JM(5, JV_AT(0), 0x81); j_i32(J, k); break;   // sub dword [top], k
+                case OP_MUL: JM(R_EAX, JV_AT(0), 0x69); j_i32(J, k);      // imul eax, [top], k
+                             JM(R_EAX, JV_AT(0), 0x89); break;            // mov [top], eax
+                case OP_JZ:  if (k == 0) { J(0xE9); j_jump(J, nx->a.t); } break;
+                case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE: {
+                    static const uint8_t icc[] = { 0x84, 0x85, 0x8C, 0x8E, 0x8F, 0x8D };
+                    if (nx->aux >> 8 != TY_INT) { fused = 0; break; }
+                    JM(7, JV_AT(0), 0x81); j_i32(J, k);                  // cmp dword [top], k
+                    j_lea_adj(J, -1);
+                    j_jcc(J, icc[nx->op - OP_JE], nx->a.t);
+                    break;
+                }
+                case OP_LOAD:
+                    if (k < 0 || k >= MEM_SIZE) { fused = 0; break; }
+                    J(0x41,0x8B,0x84,0x24); j_i32(J, k * 4);             // mov eax, [r12+k*4]
+                    j_push_int_eax(J);
+                    break;
+                case OP_STORE:
+                    if (k < 0 || k >= MEM_SIZE) { fused = 0; break; }
+                    JM(R_ECX, JV_AT(0), 0x8B);                           // mov ecx, [top]
+                    J(0x41,0x89,0x8C,0x24); j_i32(J, k * 4);             // mov [r12+k*4], ecx
+                    j_adj(J, -1);
+                    break;
+                default: fused = 0;
+            }
+            if (fused) { J->at[++i] = J->b.len; j_fall(J, i); continue; }
+        }
+        uint16_t ty = in->aux;
+        if (in->op == OP_DUP || in->op == OP_PRINT || in->op == OP_JZ || in->op == OP_DUPJZ) ty = j_speculate(J, ty);
+        switch (in->op) {
+            case OP_NOP: case OP_SNAPSHOT: break;
+            case OP_PUSH:
+                j_tag_int(J, 0);
+                JM(0, JV_PAY, 0xC7); j_i32(J, in->a.i);  // mov dword [rbx+pay], imm
+                j_adj(J, 1);
+                break;
+            case OP_PUSHF: {
+                uint64_t bits; memcpy(&bits, &in->a.f, 8);
+                j_tag_float(J, 0);
+                J(0x48,0xB8);                          // mov rax, imm64
+                for (int k = 0; k < 8; ++k) b_emit_u8(&J->b, (uint8_t)(bits >> (8*k)));
+                JM(R_EAX, JV_PAY, 0x48,0x89);          // mov [rbx+pay], rax
+                j_adj(J, 1);
+                break;
+            }
+            // int binary ops: b op a into b's slot; its tag is already an int's
+            case OP_ADD:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [a]
+                JM(R_EAX, JV_AT(1), 0x01);       // add [b], eax
+                j_adj(J, -1);
+                break;
+            case OP_SUB:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [a]
+                JM(R_EAX, JV_AT(1), 0x29);       // sub [b], eax
+                j_adj(J, -1);
+                break;
+            case OP_MUL:
+                JM(R_EAX, JV_AT(1), 0x8B);       // mov eax, [b]
+                JM(R_EAX, JV_AT(0), 0x0F,0xAF);  // imul eax, [a]
+                JM(R_EAX, JV_AT(1), 0x89);       // mov [b], eax
+                j_adj(J, -1);
+                break;
+            case OP_DIV: case OP_MOD:
+                JM(R_ECX, JV_AT(0), 0x8B);       // mov ecx, [a]
+                J(0x85,0xC9);                    // test ecx, ecx
+                J(0x0F,0x84); j_err(J, in->op == OP_DIV ? JIT_DIV0 : JIT_MOD0); // jz err
+                JM(R_EAX, JV_AT(1), 0x8B);       // mov eax, [b]
+                J(0x83,0xF9,0xFF);               // cmp ecx, -1 (idiv would trap on INT_MIN)
+                J(0x75,0x06);                    // jne div (+6)
+                J(0xF7,0xD8);                    // neg eax: b / -1
+                J(0x31,0xD2);                    // xor edx, edx: b % -1
+                J(0xEB,0x03);                    // jmp done (+3)
+                J(0x99);                         // div: cdq
+                J(0xF7,0xF9);                    // idiv ecx
+                if (in->op == OP_DIV) JM(R_EAX, JV_AT(1), 0x89);  // mov [b], eax
+                else JM(R_EDX, JV_AT(1), 0x89);                   // mov [b], edx
+                j_adj(J, -1);
+                break;
+            case OP_INC: JM(0, JV_AT(0), 0x83); J(0x01); break;  // add dword [top], 1
+            case OP_DEC: JM(5, JV_AT(0), 0x83); J(0x01); break;  // sub dword [top], 1
+            case OP_NEG: JM(3, JV_AT(0), 0xF7); break;           // neg dword [top]
+            case OP_ADDF: case OP_MULF: case OP_SUBF: case OP_DIVF:
+                JM(0, JV_AT(1), 0xF2,0x0F,0x10);                  // movsd xmm0, [b]
+                if (in->op == OP_ADDF) JM(0, JV_AT(0), 0xF2,0x0F,0x58); // addsd xmm0, [a]
+                else if (in->op == OP_MULF) JM(0, JV_AT(0), 0xF2,0x0F,0x59); // mulsd xmm0, [a]
+                else if (in->op == OP_SUBF) JM(0, JV_AT(0), 0xF2,0x0F,0x5C); // subsd xmm0, [a]
+                else JM(0, JV_AT(0), 0xF2,0x0F,0x5E);                  // divsd xmm0, [a]
+                j_nan_result(J);
+                JM(0, JV_AT(1), 0xF2,0x0F,0x11);                  // movsd [b], xmm0
+                j_adj(J, -1);
+                break;
+            case OP_NEGF:                                          // flip the sign bit
+                JM(R_EAX, JV_AT(0), 0x48,0x8B);                   // mov rax, [top]
+                J(0x48,0x0F,0xBA,0xF8,0x3F);                      // btc rax, 63
+                JM(R_EAX, JV_AT(0), 0x48,0x89);                   // mov [top], rax
+                break;
+            case OP_FMAF:
+                JM(0, JV_AT(2), 0xF2,0x0F,0x10);                  // movsd xmm0, [a]
+                JM(1, JV_AT(1), 0xF2,0x0F,0x10);                  // movsd xmm1, [b]
+                if (cpu_has_fma()) JM(0, JV_AT(0), 0xC4,0xE2,0xF1,0xA9);  // vfmadd213sd xmm0, xmm1, [c]
+                else {
+                    JM(2, JV_AT(0), 0xF2,0x0F,0x10);              // movsd xmm2, [c]
+                    j_call_helper(J, (void *)vm_fma);
+                }
+                j_nan_result(J);
+                JM(0, JV_AT(2), 0xF2,0x0F,0x11);                  // movsd [a], xmm0
+                j_adj(J, -2);
+                break;
+            case OP_ITOF:
+                JM(0, JV_AT(0), 0xF2,0x0F,0x2A);                  // cvtsi2sd xmm0, dword [top]
+                j_tag_float(J, -JV_SIZE);
+                JM(0, JV_AT(0), 0xF2,0x0F,0x11);                  // movsd [top], xmm0
+                break;
+            case OP_FTOI: {
+                static const double lim[2] = { 2147483648.0, -2147483649.0 };
+                uint64_t bits[2]; memcpy(bits, lim, sizeof(bits));
+                JM(0, JV_AT(0), 0xF2,0x0F,0x10);                  // movsd xmm0, [top]
+                for (int e = 0; e < 2; ++e) {
+                    J(0x48,0xB8);                                  // mov rax, limit
+                    for (int k = 0; k < 8; ++k) b_emit_u8(&J->b, (uint8_t)(bits[e] >> (8*k)));
+                    J(0x66,0x48,0x0F,0x6E,0xC8);                  // movq xmm1, rax
+                    if (e == 0) J(0x66,0x0F,0x2E,0xC8);           // ucomisd xmm1, xmm0: 2^31 > f
+                    else J(0x66,0x0F,0x2E,0xC1);                  // ucomisd xmm0, xmm1: f > -2^31-1
+                    J(0x0F,0x86); j_err(J, JIT_FTOI_RANGE);        // jbe err (NaN too)
+                }
+                J(0xF2,0x0F,0x2C,0xC0);                           // cvttsd2si eax, xmm0
+                j_tag_int(J, -JV_SIZE);
+                JM(R_EAX, JV_AT(0), 0x89);                        // mov [top], eax
+                break;
+            }
+            case OP_CMP:
+                if (ty == (TY_INT | TY_INT << 8)) {
+                    J(0x31,0xC9, 0x31,0xD2);                      // xor ecx, ecx; xor edx, edx
+                    JM(R_EAX, JV_AT(0), 0x8B);                    // mov eax, [a]
+                    JM(R_EAX, JV_AT(1), 0x39);                    // cmp [b], eax
+                    J(0x0F,0x9F,0xC1, 0x0F,0x9C,0xC2);            // setg cl; setl dl
+                } else if (ty == (TY_FLOAT | TY_FLOAT << 8)) {
+                    J(0x31,0xC9, 0x31,0xD2);                      // xor ecx, ecx; xor edx, edx
+                    JM(0, JV_AT(1), 0xF2,0x0F,0x10);              // movsd xmm0, [b]
+                    JM(1, JV_AT(0), 0xF2,0x0F,0x10);              // movsd xmm1, [a]
+                    J(0x66,0x0F,0x2E,0xC1, 0x0F,0x97,0xC1);       // ucomisd xmm0, xmm1; seta cl
+                    J(0x66,0x0F,0x2E,0xC8, 0x0F,0x97,0xC2);       // ucomisd xmm1, xmm0; seta dl
+                    j_tag_int(J, -2 * JV_SIZE);
+                } else {
+                    J_ARG1_FROM_RBX();
+                    j_call_helper(J, (void *)jit_cmp);
+                    j_adj(J, -1);
+                    break;
+                }
+                J(0x29,0xD1);                                     // sub ecx, edx
+                JM(R_ECX, JV_AT(1), 0x89);                        // mov [b], ecx
+                j_adj(J, -1);
+                break;
+            case OP_DUP:
+                // copy at the width the value was written with: a wide load
+                // straight after a 4-byte int store would miss store forwarding
+                if (ty == TY_INT) {
+                    JM(R_EAX, JV_AT(0), 0x8B);               // mov eax, [top]
+                    j_push_int_eax(J);
+                } else if (ty == TY_FLOAT || JV_SIZE == 8) {
+                    j_tag_float(J, 0);
+                    JM(R_EAX, JV_AT(0), 0x48,0x8B);          // mov rax, [top]
+                    JM(R_EAX, JV_PAY, 0x48,0x89);            // mov [rbx+pay], rax
+                    j_adj(J, 1);
+                } else {
+                    JM(0, -JV_SIZE, 0x0F,0x10);              // movups xmm0, [rbx-16]
+                    JM(0, 0, 0x0F,0x11);                     // movups [rbx], xmm0
+                    j_adj(J, 1);
+                }
+                break;
+            case OP_POP: j_adj(J, -1); break;
+            case OP_PRINT:
+                j_adj(J, -1);
+                if (ty == TY_INT) { JM(J_ARG1, JV_PAY, 0x8B); j_call_helper(J, (void *)jit_print_int); }
+                else if (ty == TY_FLOAT) {
+                    JM(0, JV_PAY, 0xF2,0x0F,0x10);     // movsd xmm0, [rbx+pay]
+                    j_call_helper(J, (void *)jit_print_float);
+                } else { J_ARG1_FROM_RBX(); j_call_helper(J, (void *)jit_print_val); }
+                break;
+            case OP_LOAD:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [top]
+                J(0x3B,0x45,0x1C);                           // cmp eax, [rbp+28] (mem_mask)
+                J(0x0F,0x87); j_err(J, JIT_LOAD_OOB);  // ja err (negative too)
+                J(0x41,0x8B,0x04,0x84);          // mov eax, [r12+rax*4]
+                JM(R_EAX, JV_AT(0), 0x89);       // mov [top], eax
+                break;
+            case OP_LOADB:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [top]
+                J(0x85,0xC0);                    // test eax, eax
+                J(0x0F,0x88); j_err(J, JIT_LOADB_OOB); // js err
+                J(0x89,0xC1, 0xC1,0xE9,0x02);    // mov ecx, eax; shr ecx, 2
+                J(0x3B,0x4D,0x1C);               // cmp ecx, [rbp+28] (mem_mask)
+                J(0x0F,0x87); j_err(J, JIT_LOADB_OOB); // ja err
+                J(0x41,0x0F,0xB6,0x04,0x04);     // movzx eax, byte [r12+rax]
+                JM(R_EAX, JV_AT(0), 0x89);       // mov [top], eax
+                break;
+            case OP_STORE:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [top]
+                J(0x3B,0x45,0x1C);                           // cmp eax, [rbp+28] (mem_mask)
+                J(0x0F,0x87); j_err(J, JIT_STORE_OOB); // ja err
+                JM(R_ECX, JV_AT(1), 0x8B);       // mov ecx, [value]
+                J(0x41,0x89,0x0C,0x84);          // mov [r12+rax*4], ecx
+                j_adj(J, -2);
+                break;
+            case OP_LOADF:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [top]
+                J(0x3B,0x45,0x1C);               // cmp eax, [rbp+28] (mem_mask)
+                J(0x0F,0x83); j_err(J, JIT_LOADF_OOB); // jae err (addr+1 must fit too)
+                J(0xF2,0x41,0x0F,0x10,0x04,0x84);      // movsd xmm0, [r12+rax*4]
+#ifdef SISA_NAN_BOX
+                J(0x66,0x0F,0x2E,0xC0);          // ucomisd xmm0, xmm0
+                J(0x7B,0x1C);                    // jnp +28: not a NaN
+                J(0x66,0x48,0x0F,0x7E,0xC0);     // movq rax, xmm0
+                J(0x48,0xC1,0xE8,0x3F);          // shr rax, 63: the sign
+                J(0x48,0xC1,0xE0,0x0F);          // shl rax, 15
+                J(0x48,0x0D,0xF8,0x7F,0,0);      // or rax, 0x7FF8
+                J(0x48,0xC1,0xE0,0x30);          // shl rax, 48: the canonical NaN of that sign
+                J(0x66,0x48,0x0F,0x6E,0xC0);     // movq xmm0, rax
+#endif
+                j_tag_float(J, -JV_SIZE);
+                JM(0, JV_AT(0), 0xF2,0x0F,0x11); // movsd [top], xmm0
+                break;
+            case OP_STOREF:
+                JM(R_EAX, JV_AT(0), 0x8B);       // mov eax, [top]
+                J(0x3B,0x45,0x1C);               // cmp eax, [rbp+28] (mem_mask)
+                J(0x0F,0x83); j_err(J, JIT_STOREF_OOB); // jae err
+                JM(0, JV_AT(1), 0xF2,0x0F,0x10); // movsd xmm0, [value]
+                J(0xF2,0x41,0x0F,0x11,0x04,0x84);      // movsd [r12+rax*4], xmm0
+                j_adj(J, -2);
+                break;
+            case OP_MEMCPY: case OP_MEMSET: case OP_MEMCMP:
+            case OP_VADD: case OP_VMUL: case OP_VADDF: case OP_VMULF:
+            case OP_VDOT: case OP_VSUM: case OP_VDOTF: case OP_VSUMF: {
+                J_ARG1_FROM_RBX();
+                J_ARG2_IMM(); j_i32(J, in->op);
+                j_call_helper(J, (void *)jit_block);
+                J(0x85,0xC0);                    // test eax, eax
+                J(0x0F,0x84); j_err(J, JIT_BLOCK_OOB); // jz err
+                j_adj(J, block_results(in->op) - block_arity(in->op));
+                break;
+            }
+            case OP_CALLN: {
+                const Native *N = &P->natives[in->a.i];
+                J_ARG1_FROM_RBX();
+                J_ARG2_IMM(); j_i32(J, in->a.i);
+                j_call_helper(J, (void *)jit_calln);
+                J(0x85,0xC0);                    // test eax, eax
+                J(0x0F,0x84); j_err(J, JIT_NATIVE_FAIL); // jz err
+                j_adj(J, N->nres - N->nargs);
+                break;
+            }
+            case OP_JMP: J(0xE9); j_jump(J, in->a.t); break;
+            case OP_JZ: j_jz(J, ty, in->a.t, 1); break;
+            case OP_DUPJZ: j_jz(J, ty, in->a.t, 0); break;
+            case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE:
+                j_cmp_jump(J, in->op, ty, in->a.t);
+                break;
+            case OP_ADDI: JM(0, JV_AT(0), 0x81); j_i32(J, in->a.i); break;   // add dword [top], k
+            case OP_SUBI: JM(5, JV_AT(0), 0x81); j_i32(J, in->a.i); break;   // sub dword [top], k
+            case OP_LOADI:
+                J(0x41,0x8B,0x84,0x24); j_i32(J, in->a.i * 4);   // mov eax, [r12+k*4]
+                j_push_int_eax(J);
+                break;
+            case OP_STOREI:
+                JM(R_ECX, JV_AT(0), 0x8B);                       // mov ecx, [top]
+                J(0x41,0x89,0x8C,0x24); j_i32(J, in->a.i * 4);   // mov [r12+k*4], ecx
+                j_adj(J, -1);
+                break;
+            case OP_CALL:
+                if (region) {        // checks first, so an exit leaves the state the CALL found
+                    if (!region[in->a.t]) { J(0xE9); j_exit(J, J->cur, JIT_EXIT); break; }
+                    J(0x45,0x85,0xF6);                     // test r14d, r14d
+                    J(0x0F,0x84); j_exit(J, J->cur, JIT_EXIT);  // jz exit
+                    J(0x48,0x8D,0x83); j_i32(J, (int32_t)in->aux * JV_SIZE); // lea rax, [rbx+aux*size]
+                    J(0x4C,0x39,0xE8);                     // cmp rax, r13
+                    J(0x0F,0x87); j_exit(J, J->cur, JIT_EXIT);  // ja exit
+                    J(0x41,0xFF,0xCE);                     // dec r14d
+                    J(0xE8); j_jump(J, in->a.t);           // call target
+                    J->ret_at[J->nret] = (uint32_t)J->b.len; J->ret_to[J->nret++] = (uint32_t)i + 1;
+                    break;
+                }
+                J(0x41,0xFF,0xCE);               // dec r14d
+                J(0x0F,0x88); j_err(J, JIT_CALL_OVF);  // js err
+                J(0x48,0x8D,0x83); j_i32(J, (int32_t)in->aux * JV_SIZE); // lea rax, [rbx+aux*size]
+                J(0x4C,0x39,0xE8);                     // cmp rax, r13
+                J(0x0F,0x87); j_err(J, JIT_STACK_OVF); // ja err
+                J(0xE8); j_jump(J, in->a.t);           // call target
+                break;
+            case OP_TCALL:                             // the headroom test of CALL, then a jump
+                if (region && !region[in->a.t]) { J(0xE9); j_exit(J, J->cur, JIT_EXIT); break; }
+                J(0x48,0x8D,0x83); j_i32(J, (int32_t)in->aux * JV_SIZE); // lea rax, [rbx+aux*size]
+                J(0x4C,0x39,0xE8);                     // cmp rax, r13
+                J(0x0F,0x87); j_err(J, JIT_STACK_OVF); // ja err
+                J(0xE9); j_jump(J, in->a.t);           // jmp target
+                break;
+            case OP_RET:
+                if (region) {                          // no native frame: the caller is interpreted
+                    J(0x4C,0x39,0xFC);                 // cmp rsp, r15
+                    J(0x0F,0x84); j_exit(J, J->cur, JIT_EXIT);  // je exit
+                }
+                J(0x41,0xFF,0xC6);               // inc r14d
+                J(0xC3);                               // ret
+                break;
+            case OP_HALT:
+                J(0xE9); j_jump(J, (uint32_t)n);       // jmp sentinel
+                break;
+            default: runtime_err("JIT: unknown opcode");
+        }
+        if (in->op != OP_JMP && in->op != OP_TCALL && in->op != OP_RET && in->op != OP_HALT) j_fall(J, i);
+    }
+
+    // sentinel HALT / common exit (eax = status): unwind any native frames
+    J->at[n] = J->b.len;
+    J(0x31,0xC0);                                   // xor eax, eax
+    size_t exit_at = J->b.len;
+    J(0x48,0x89,0x5D,0x00);                         // mov [rbp], rbx
+    J(0x44,0x89,0x75,0x18);                         // mov [rbp+24], r14d
+    J(0x4C,0x89,0xFC);                        // mov rsp, r15
+    J(0x41,0x5F, 0x41,0x5E, 0x41,0x5D, 0x41,0x5C, 0x5B, 0x5D, 0xC3); // pop r15-r12 rbx rbp; ret
+    size_t stub_at[JIT_NSTATUS];
+    for (int st = 1; st < JIT_NSTATUS; ++st) {
+        stub_at[st] = J->b.len;
+        J(0xB8); j_i32(J, st);                      // mov eax, status
+        J(0xE9); j_i32(J, (int32_t)(exit_at - (J->b.len + 4))); // jmp exit
+    }
+    // region code: an exit stub per jump out of the region and per j_exit,
+    // all going through jit_unwind
+    size_t unwind_at = J->b.len;
+    if (region) {
+        J_ARG1_FROM_RBP(); J_ARG2_FROM_RSP();
+        j_call_helper(J, (void *)jit_unwind);
+        J(0x8B,0x45,0x34);                          // mov eax, [rbp+52] (status)
+        J(0xE9); j_i32(J, (int32_t)(exit_at - (J->b.len + 4))); // jmp exit
+    }
+    for (size_t k = 0; k < J->nfix + J->ndfix; ++k) {
+        uint32_t insn = k < J->nfix ? J->fix[k].insn : J->dfix[k - J->nfix].insn;
+        if (k < J->nfix && J->at[insn] != SIZE_MAX) continue;
+        size_t at = J->b.len;
+        J(0xC7,0x45,0x30); j_i32(J, (int32_t)insn); // mov dword [rbp+48], insn
+        J(0xC7,0x45,0x34); j_i32(J, k < J->nfix ? JIT_EXIT : J->dfix[k - J->nfix].status); // mov dword [rbp+52], status
+        J(0xE9); j_i32(J, (int32_t)(unwind_at - (J->b.len + 4))); // jmp unwind
+        if (k < J->nfix) J->at[insn] = at;
+        else { int32_t rel = (int32_t)(at - (J->dfix[k - J->nfix].pos + 4)); memcpy(&J->b.buf[J->dfix[k - J->nfix].pos], &rel, 4); }
+    }
+    // patch rel32s
+    for (size_t k = 0; k < J->nfix; ++k) {
+        size_t pos = J->fix[k].pos;
+        int32_t rel = (int32_t)(J->at[J->fix[k].insn] - (pos + 4));
+        memcpy(&J->b.buf[pos], &rel, 4);
+    }
+    for (size_t k = 0; k < J->nefix; ++k) {
+        size_t pos = J->efix[k].pos;
+        int32_t rel = (int32_t)(stub_at[J->efix[k].status] - (pos + 4));
+        memcpy(&J->b.buf[pos], &rel, 4);
+    }
+
+    // W^X: map writable, copy, then flip to executable
+    size_t sz = J->b.len;
+#ifdef _WIN32
+    void *mem = VirtualAlloc(NULL, sz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    int ok = mem != NULL;
+    if (ok) {
+        DWORD old;
+        memcpy(mem, J->b.buf, sz);
+        ok = VirtualProtect(mem, sz, PAGE_EXECUTE_READ, &old) != 0;
+        if (ok) FlushInstructionCache(GetCurrentProcess(), mem, sz);
+    }
+#else
+    void *mem = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    int ok = mem != MAP_FAILED;
+    if (ok) {
+        memcpy(mem, J->b.buf, sz);
+        ok = mprotect(mem, sz, PROT_READ | PROT_EXEC) == 0;
+    }
+    if (!ok && mem == MAP_FAILED) mem = NULL;
+#endif
+    out->entry = NULL; out->ret_at = out->ret_to = NULL; out->nret = 0;
+    if (ok && region) {
+        if (!(out->entry = malloc((n + 1) * sizeof(uint32_t)))) ok = 0;
+        for (size_t i = 0; ok && i <= n; ++i)
+            out->entry[i] = i < n && region[i] && target[i] ? (uint32_t)J->at[i] : JIT_NO_ENTRY;
+        out->ret_at = J->ret_at; out->ret_to = J->ret_to; out->nret = J->nret;
+        J->ret_at = J->ret_to = NULL;
+    }
+    free(J->b.buf); free(J->at); free(J->fix); free(J->efix); free(J->dfix); free(J->ret_at); free(J->ret_to); free(target);
+    if (!ok) { if (mem) jit_unmap(mem, sz); jit_code_free(out); return 0; }
+    out->mem = mem;
+    out->size = sz;
+    return 1;
+}
+
+// Compile vm->p into vm->jit_mem; 0 if the code could not be mapped.
+static int jit_compile(SisaVM *vm) {
+    JitCode c;
+    if (!jit_build(vm->p, NULL, NULL, &c)) return 0;
+    vm->jit_mem = c.mem;
+    vm->jit_size = c.size;
+    vm->jit_prog = vm->p;
+    return 1;
+}
+
+static void jit_release(SisaVM *vm) {
+    if (!vm->jit_mem) return;
+    jit_unmap(vm->jit_mem, vm->jit_size);
+    vm->jit_mem = NULL; vm->jit_prog = NULL;
+}
+
+// Native CALLs nest on the C stack, 8 bytes a frame: calls from generated
+// code stop at this depth even where the VM's call stack has room
+#define JIT_CALL_MAX 32768
+static int32_t jit_depth(const SisaVM *vm) {
+    int left = vm->stack_max - vm->csp;
+    return left < JIT_CALL_MAX ? left : JIT_CALL_MAX;
+}
+
+static void run_jit(SisaVM *vm) {
+    JitCtx ctx;
+    ctx.top = &vm->stack[vm->sp];
+    ctx.mem = vm->memory;
+    ctx.limit = &vm->stack[vm->stack_max];
+    ctx.depth = jit_depth(vm);
+    ctx.mem_mask = vm->mem_mask;
+    jit_vm = vm;
+    int status = ((JitFn)vm->jit_mem)(&ctx);
+    vm->sp = (int)(ctx.top - vm->stack);
+    fflush(stdout);
+    if (status == JIT_BLOCK_OOB) block_fail(jit_block_op);
+    if (status == JIT_NATIVE_FAIL) native_fail(jit_native, jit_native_rc);
+    if (status != JIT_OK) runtime_err(jit_status_msg[status]);
+}
+
+// Tiered execution (SISA_RUN_TIER)
+// Verified programs start in the interpreter, in a copy of the fast loop that
+// counts arrivals at backward-branch targets (loop headers) and CALL targets
+// down from a threshold. A target whose count runs out gets its region - the
+// loop around a header, the body of a called function - compiled by the JIT
+// above, on a background thread, while the interpreter carries on; the
+// count is then polled every TIER_POLL arrivals and the interpreter switches
+// to the native code at the first arrival once it is installed. Regions are
+// compiled together, so hot loops call hot functions natively. The code
+// leaves for the interpreter (JIT_EXIT) wherever control leaves the regions,
+// at a fault, and at a RET into an interpreted caller; native CALLs keep the
+// interpreter's call stack current so it can take over at any depth. Values
+// of no static type are speculated to be ints, behind a tag guard: when one
+// fails the interpreter resumes at that insn and the regions are compiled
+// again with that insn generic.
+enum { TIER_LOOP = 1, TIER_CALL = 2 };
+#define TIER_POLL      64    // arrivals between looks at a compile in flight
+
+typedef struct {
+    uint32_t ip;                // insn the region grows from
+    int kind;                   // TIER_LOOP / TIER_CALL
+    size_t insns;               // in its region; 0 until compiled
+    uint64_t entries;           // native entries through ip, this run
+} TierRoot;
+
+// One compile: a snapshot of the roots and guards, and the code made from it
+typedef struct {
+    const SisaProgram *p;
+    TierRoot *roots; size_t nroots;
+    uint8_t *poly;
+    JitCode code;
+    int ok;
+    size_t insns;               // in all regions
+    double sec;
+#ifndef SISA_NO_THREADS
+    atomic_int done;
+    int threaded;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+#endif
+} TierJob;
+
+typedef struct Tier {
+    const SisaProgram *p;       // what everything below is for
+    int32_t *hot;               // per insn: arrivals left before the next event
+    uint8_t *poly;              // per insn: a guard failed there
+    uint8_t *seen;              // per insn: a root already
+    TierRoot *roots; size_t nroots, roots_cap;  // in the order they got hot
+    uint32_t ip;                // where the tier loop starts
+    int event;                  // why it stopped at ip: TIER_LOOP / TIER_CALL, 0 at HALT
+    int failed;                 // a compile failed: stay in the interpreter
+    JitCode code;               // installed native code (mem NULL: none)
+    size_t code_insns;
+    TierJob *job;               // compile in flight
+    int again;                  // roots or guards changed since job was started
+    uint32_t threshold;
+    int background;
+    // statistics for sisa_profile_write: compiles since p was first run,
+    // events, entries and exits of the last run
+    int ran;                    // a tiered run since sisa_load
+    unsigned compiles;
+    double compile_sec;
+    uint64_t events, entries, exits, guards;
+} Tier;
+
+#define VM_LOOP_NAME    run_loop_tier
+#define VM_LOOP_TRACE   0
+#define VM_LOOP_PROF    0
+#define VM_LOOP_CHECKED 0
+#define VM_LOOP_TIER    1
+#define VM_LOOP_FUEL    0
+#define VM_LOOP_STATS   0
+#include "vm_loop.h"
+
+// Mark root's region in region[]: the insns reachable from it without
+// entering calls (a callee is a region of its own), and of those, for a loop
+// header, only the ones that lead back to it (the loop). s holds n + 1
+// entries of scratch in each array. Returns the region's size.
+typedef struct { uint8_t *mark; uint32_t *list, *pos, *cnt, *pred; } TierScratch;
+static int tier_succ(const Insn *in, size_t i, uint32_t s[2]) {
+    switch (in->op) {
+        case OP_JMP: s[0] = in->a.t; return 1;
+        case OP_JZ: case OP_DUPJZ: case OP_JE: case OP_JNE: case OP_JL: case OP_JLE: case OP_JG: case OP_JGE:
+            s[0] = in->a.t; s[1] = (uint32_t)i + 1; return 2;
+        case OP_RET: case OP_TCALL: case OP_HALT: return 0;   // a TCALL target is a region of its own
+        default: s[0] = (uint32_t)i + 1; return 1;
+    }
+}
+static size_t tier_region(const SisaProgram *P, const TierRoot *r, uint8_t *region, TierScratch *S) {
+    const Insn *prog = P->prog;
+    size_t n = P->prog_len, m = 0, k = 1;
+    uint32_t s[2];
+    S->list[m++] = r->ip; S->mark[r->ip] = 1;
+    for (size_t j = 0; j < m; ++j) {                   // forward, breadth first
+        uint32_t i = S->list[j];
+        for (int e = tier_succ(&prog[i], i, s); e-- > 0; )
+            if (s[e] < n && !S->mark[s[e]]) { S->mark[s[e]] = 1; S->list[m++] = s[e]; }
+    }
+    int want = 1;
+    if (r->kind == TIER_LOOP) {
+        // predecessors within the reachable set, then back from the header
+        for (size_t j = 0; j < m; ++j) { S->pos[S->list[j]] = (uint32_t)j; S->cnt[j] = 0; }
+        S->cnt[m] = 0;
+        for (size_t j = 0; j < m; ++j)
+            for (int e = tier_succ(&prog[S->list[j]], S->list[j], s); e-- > 0; )
+                if (s[e] < n && S->mark[s[e]]) S->cnt[S->pos[s[e]] + 1]++;
+        for (size_t j = 0; j < m; ++j) S->cnt[j + 1] += S->cnt[j];
+        for (size_t j = 0; j < m; ++j)
+            for (int e = tier_succ(&prog[S->list[j]], S->list[j], s); e-- > 0; )
+                if (s[e] < n && S->mark[s[e]]) S->pred[S->cnt[S->pos[s[e]]]++] = (uint32_t)j;
+        // cnt[j] is now the end of j's predecessors, cnt[j-1] their start
+        uint32_t *q = S->cnt + m + 1;                  // unused tail of cnt: the work list
+        size_t nq = 0;
+        q[nq++] = 0; S->mark[r->ip] = 2;
+        while (nq) {
+            uint32_t j = q[--nq];
+            for (uint32_t e = j ? S->cnt[j - 1] : 0; e < S->cnt[j]; ++e) {
+                uint32_t i = S->list[S->pred[e]];
+                if (S->mark[i] == 1) { S->mark[i] = 2; q[nq++] = S->pred[e]; ++k; }
+            }
+        }
+        if (k > 1) want = 2;                           // else no loop back: keep all of it
+    }
+    for (size_t j = 0; j < m; ++j) {
+        uint32_t i = S->list[j];
+        if (S->mark[i] >= want) region[i] = 1;
+        S->mark[i] = 0;
+    }
+    return want == 2 ? k : m;
+}
+
+// Build the job's regions and compile them. Runs on its own thread, so an
+// allocation failure is caught here rather than in the run's context.
+static void tier_compile(TierJob *J) {
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    size_t n = J->p->prog_len;
+    uint8_t *region = calloc(n + 1, 1);
+    TierScratch S;
+    S.mark = calloc(n + 1, 1);
+    S.list = malloc((n + 1) * sizeof(uint32_t)); S.pos = malloc((n + 1) * sizeof(uint32_t));
+    S.cnt = malloc(2 * (n + 2) * sizeof(uint32_t)); S.pred = malloc(2 * (n + 1) * sizeof(uint32_t));
+    J->ok = 0;
+    if (region && S.mark && S.list && S.pos && S.cnt && S.pred) {
+        SisaErr e, *saved = sisa_err_ctx;
+        e.code = SISA_OK;
+        sisa_err_ctx = &e;
+        if (setjmp(e.jb) == 0) {
+            for (size_t r = 0; r < J->nroots; ++r) J->roots[r].insns = tier_region(J->p, &J->roots[r], region, &S);
+            J->insns = 0;
+            for (size_t i = 0; i < n; ++i) J->insns += region[i];
+            J->ok = jit_build(J->p, region, J->poly, &J->code);
+        }
+        sisa_err_ctx = saved;
+    }
+    free(region); free(S.mark); free(S.list); free(S.pos); free(S.cnt); free(S.pred);
+    timespec_get(&t1, TIME_UTC);
+    J->sec = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+#ifndef SISA_NO_THREADS
+    atomic_store(&J->done, 1);
+#endif
+}
+#ifndef SISA_NO_THREADS
+#ifdef _WIN32
+static DWORD WINAPI tier_thread(LPVOID arg) { tier_compile(arg); return 0; }
+#else
+static void *tier_thread(void *arg) { tier_compile(arg); return NULL; }
+#endif
+#endif
+
+static void tier_job_free(TierJob *J) {
+    free(J->roots); free(J->poly); free(J);
+}
+
+static void tier_request(Tier *T);
+// Install the job's code once it is done (wait: block until it is); another
+// compile starts if the roots changed meanwhile, unless waiting
+static void tier_poll(Tier *T, int wait) {
+    TierJob *J = T->job;
+    if (!J) return;
+#ifndef SISA_NO_THREADS
+    if (J->threaded) {
+        if (!wait && !atomic_load(&J->done)) return;
+#ifdef _WIN32
+        WaitForSingleObject(J->thread, INFINITE); CloseHandle(J->thread);
+#else
+        pthread_join(J->thread, NULL);
+#endif
+    }
+#endif
+    T->job = NULL;
+    T->compiles++;
+    T->compile_sec += J->sec;
+    if (J->ok) {
+        if (T->code.mem) { jit_unmap(T->code.mem, T->code.size); jit_code_free(&T->code); }
+        T->code = J->code;
+        T->code_insns = J->insns;
+        for (size_t r = 0; r < J->nroots; ++r) T->roots[r].insns = J->roots[r].insns;
+        for (size_t i = 0; i <= T->p->prog_len; ++i) if (T->code.entry[i] != JIT_NO_ENTRY) T->hot[i] = 1;
+    } else T->failed = 1;
+    tier_job_free(J);
+    if (T->again && !wait && !T->failed) tier_request(T);
+}
+
+// Compile the current roots, in the background if allowed
+static void tier_request(Tier *T) {
+    if (T->job) { T->again = 1; return; }
+    size_t n = T->p->prog_len;
+    TierJob *J = calloc(1, sizeof(TierJob));
+    if (J) {
+        J->roots = malloc(T->nroots * sizeof(TierRoot));
+        J->poly = malloc(n + 1);
+    }
+    if (!J || !J->roots || !J->poly) { if (J) tier_job_free(J); T->failed = 1; return; }
+    J->p = T->p;
+    memcpy(J->roots, T->roots, T->nroots * sizeof(TierRoot));
+    J->nroots = T->nroots;
+    memcpy(J->poly, T->poly, n + 1);
+    T->job = J;
+    T->again = 0;
+#ifndef SISA_NO_THREADS
+    if (T->background) {
+#ifdef _WIN32
+        J->threaded = (J->thread = CreateThread(NULL, 0, tier_thread, J, 0, NULL)) != NULL;
+#else
+        J->threaded = pthread_create(&J->thread, NULL, tier_thread, J) == 0;
+#endif
+        if (J->threaded) return;
+    }
+#endif
+    tier_compile(J);
+    tier_poll(T, 1);
+}
+
+// Run the installed code from insn t; 0 if it reached HALT. Otherwise T->ip
+// is where the interpreter goes on.
+static int tier_enter(SisaVM *vm, Tier *T, uint32_t t) {
+    JitCtx ctx;
+    ctx.top = &vm->stack[vm->sp];
+    ctx.mem = vm->memory;
+    ctx.limit = &vm->stack[vm->stack_max];
+    ctx.depth = jit_depth(vm);
+    ctx.mem_mask = vm->mem_mask;
+    ctx.callstack = vm->callstack + vm->csp;
+    ctx.entry = (const char *)T->code.mem + T->code.entry[t];
+    ctx.code = &T->code;
+    jit_vm = vm;
+    T->entries++;
+    int32_t depth = ctx.depth;
+    int status = ((JitFn)T->code.mem)(&ctx);
+    vm->sp = (int)(ctx.top - vm->stack);
+    vm->csp += depth - ctx.depth;
+    if (status == JIT_OK) return 0;
+    if (status == JIT_GUARD) {
+        T->guards++;
+        T->poly[ctx.resume] = 1;
+        tier_request(T);
+    } else if (status == JIT_EXIT) {
+        T->exits++;
+    } else {                                   // whole-program statuses; not from region code
+        if (status == JIT_BLOCK_OOB) block_fail(jit_block_op);
+        if (status == JIT_NATIVE_FAIL) native_fail(jit_native, jit_native_rc);
+        runtime_err(jit_status_msg[status]);
+    }
+    T->ip = ctx.resume;
+    return 1;
+}
+
+// The tier loop stopped at T->ip, whose count ran out; 0 if the program halted
+static int tier_event(SisaVM *vm, Tier *T) {
+    uint32_t t = T->ip;
+    T->events++;
+    tier_poll(T, 0);
+    if (!T->seen[t] && !T->failed) {
+        if (T->nroots == T->roots_cap) {
+            size_t cap = T->roots_cap ? 2 * T->roots_cap : 16;
+            TierRoot *r = realloc(T->roots, cap * sizeof(TierRoot));
+            if (!r) nomem();
+            T->roots = r; T->roots_cap = cap;
+        }
+        T->roots[T->nroots++] = (TierRoot){ t, T->event, 0, 0 };
+        T->seen[t] = 1;
+        tier_request(T);
+    }
+    if (T->code.mem && T->code.entry[t] != JIT_NO_ENTRY) {
+        T->hot[t] = 1;
+        for (size_t r = 0; r < T->nroots; ++r) if (T->roots[r].ip == t) { T->roots[r].entries++; break; }
+        return tier_enter(vm, T, t);
+    }
+    T->hot[t] = T->failed ? INT32_MAX : TIER_POLL;
+    return 1;
+}
+
+static void tier_free(Tier *T) {
+    if (!T) return;
+    tier_poll(T, 1);
+    if (T->code.mem) { jit_unmap(T->code.mem, T->code.size); jit_code_free(&T->code); }
+    free(T->hot); free(T->poly); free(T->seen); free(T->roots);
+    memset(T, 0, sizeof(*T));
+}
+
+// Counters for a run of vm->p; what was compiled for it before stays
+static Tier *tier_prepare(SisaVM *vm) {
+    Tier *T = vm->tier;
+    if (!T && !(T = vm->tier = calloc(1, sizeof(Tier)))) nomem();
+    size_t n = vm->p->prog_len;
+    if (T->p != vm->p) {
+        tier_free(T);
+        T->hot = malloc((n + 1) * sizeof(int32_t));
+        T->poly = calloc(n + 1, 1);
+        T->seen = calloc(n + 1, 1);
+        if (!T->hot || !T->poly || !T->seen) nomem();
+        T->p = vm->p;
+    }
+    T->threshold = vm->tier_threshold ? vm->tier_threshold : TIER_THRESHOLD;
+    T->background = !vm->tier_sync;
+    for (size_t i = 0; i <= n; ++i)
+        T->hot[i] = T->code.mem && T->code.entry[i] != JIT_NO_ENTRY ? 1 : (int32_t)T->threshold;
+    for (size_t r = 0; r < T->nroots; ++r) T->roots[r].entries = 0;
+    T->ip = vm->ip;
+    T->ran = 1;
+    T->events = T->entries = T->exits = T->guards = 0;
+    if (T->again && !T->failed) tier_request(T);
+    return T;
+}
+
+static void run_tier(SisaVM *vm) {
+    Tier *T = tier_prepare(vm);
+    for (;;) {
+        T->event = 0;
+        run_loop_tier(vm);
+        if (!T->event || !tier_event(vm, T)) return;
+    }
+}
+
+#else
+#define VM_HAVE_JIT 0
+#endif
+
+static void run_vm(SisaVM *vm, unsigned flags) {
+    int verified = vm->p->verified;
+#if VM_HAVE_JIT
+    // a capture run interprets; JIT code and the register IR only start at insn 0
+    if (flags & SISA_RUN_SNAPSHOT) flags &= ~(unsigned)(SISA_RUN_JIT | SISA_RUN_REG | SISA_RUN_TIER);
+    if (vm->ip || vm->resumed) flags &= ~(unsigned)(SISA_RUN_JIT | SISA_RUN_REG);
+    // and only the interpreter keeps a budget or counts
+    if (vm->fueled || (flags & SISA_RUN_STATS)) flags &= ~(unsigned)(SISA_RUN_JIT | SISA_RUN_REG | SISA_RUN_TIER);
+    if ((flags & SISA_RUN_JIT) && !(flags & (SISA_RUN_TRACE | SISA_RUN_PROFILE | RUN_COUNT | SISA_RUN_NO_VERIFY)) && verified
+        && (vm->jit_prog == vm->p || (jit_release(vm), jit_compile(vm)))) {
+        run_jit(vm);
+        return;
+    }
+    if ((flags & SISA_RUN_TIER) && !(flags & (SISA_RUN_TRACE | RUN_COUNT | SISA_RUN_NO_VERIFY)) && verified) {
+        run_tier(vm);
+        return;
+    }
+#endif
+    if (flags & SISA_RUN_TRACE) run_loop_trace(vm);
+    else if (flags & (SISA_RUN_PROFILE | RUN_COUNT)) { prof_start(vm, !(flags & RUN_COUNT)); run_loop_prof(vm); }
+    else if (flags & SISA_RUN_STATS) {
+        stats_start(vm, flags);
+        if (verified && !(flags & SISA_RUN_NO_VERIFY)) run_loop_stats(vm); else run_loop_stats_checked(vm);
+    }
+    else if (verified && !(flags & SISA_RUN_NO_VERIFY) && (flags & SISA_RUN_REG) && vm->p->reg && !vm->fueled
+             && !vm->ip && !vm->resumed) run_loop_reg(vm);
+    else if (verified && !(flags & SISA_RUN_NO_VERIFY)) { if (vm->fueled) run_loop_fuel(vm); else run_loop_fast(vm); }
+    else if (vm->fueled) run_loop_fuel_checked(vm);
+    else run_loop_checked(vm);
+}
+
+// Map a whole file read-only (shared with other processes mapping it)
+static const unsigned char *map_file(const char *path, size_t *size) {
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (f == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER sz;
+    HANDLE m = NULL;
+    void *p = NULL;
+    if (GetFileSizeEx(f, &sz) && sz.QuadPart > 0) m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m) { p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0); CloseHandle(m); }
+    CloseHandle(f);
+    if (p) *size = (size_t)sz.QuadPart;
+    return p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *p = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) p = NULL;
+    }
+    close(fd);
+    if (p) *size = (size_t)st.st_size;
+    return p;
+#endif
+}
+static void unmap_file(const unsigned char *p, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(p);
+#else
+    munmap((void *)p, size);
+#endif
+}
+
+// Data memory beyond MEM_SIZE cells is an anonymous private mapping: pages
+// read as the shared zero page until first written, so a big heap costs
+// address space only until it is used.
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+static int32_t *heap_map(size_t bytes) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+#endif
+}
+static void heap_unmap(int32_t *p, size_t bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, bytes);
+#endif
+}
+#ifndef _WIN32
+// New zero pages over [p, p+bytes), whatever was mapped there
+static int heap_fresh(int32_t *p, size_t bytes) {
+    return mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != MAP_FAILED;
+}
+#endif
+// Give every page of the heap back; it reads as zero again
+static int heap_zero(int32_t *p, size_t bytes) {
+#ifdef _WIN32
+    return VirtualFree(p, bytes, MEM_DECOMMIT) && VirtualAlloc(p, bytes, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#elif defined(__linux__)
+    return madvise(p, bytes, MADV_DONTNEED) == 0;  // private anonymous: refaults as zero
+#else
+    return heap_fresh(p, bytes);
+#endif
+}
+
+static size_t mem_round(size_t cells) {
+    size_t n = MEM_SIZE;
+    while (n < cells) n *= 2;
+    return n;
+}
+
+static int vm_fail(SisaVM *vm, int code, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(vm->err.msg, sizeof(vm->err.msg), fmt, ap);
+    va_end(ap);
+    return vm->err.code = code;
+}
+
+// Data segment: a file mapped copy-on-write (MAP_PRIVATE) over part of the
+// heap, so LOAD/LOADB read it in place and STOREs only touch the VM's copy.
+// Where it cannot be mapped (Windows, odd file systems) it is read in.
+static int data_place(SisaVM *vm) {
+    int32_t *at = vm->memory + vm->data_base;
+#ifndef _WIN32
+    if (!vm->data_copy) {
+        if (!vm->data_bytes || mmap(at, (size_t)vm->data_bytes, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_FIXED, fileno(vm->data_file), 0) != MAP_FAILED) return 1;
+        vm->data_copy = 1;
+    }
+#endif
+    rewind(vm->data_file);
+    return fread(at, 1, (size_t)vm->data_bytes, vm->data_file) == vm->data_bytes;
+}
+// The two cells below the segment hold its length: cells, then bytes (-1 if over INT32_MAX)
+static void data_header(SisaVM *vm) {
+    vm->memory[vm->data_base - 2] = (int32_t)vm->data_cells;
+    vm->memory[vm->data_base - 1] = vm->data_bytes > INT32_MAX ? -1 : (int32_t)vm->data_bytes;
+}
+static void data_release(SisaVM *vm) {
+    if (vm->data_file) fclose(vm->data_file);
+    vm->data_file = NULL;
+    vm->data_base = vm->data_cells = 0;
+    vm->data_bytes = 0;
+    vm->data_copy = 0;
+}
+
+// Zero [from, to) of data memory, everything else being zero already. A
+// mapped heap is remapped instead when that is cheaper, which clears
+// [0, from) as well. The data segment, if touched, is put back. Pages mapped
+// from a snapshot file are always replaced: they would refault as the file.
+static void mem_clear(SisaVM *vm, size_t from, size_t to) {
+    size_t bytes = (to - from) * sizeof(int32_t), all = ((size_t)vm->mem_mask + 1) * sizeof(int32_t);
+    int over_data = vm->data_file && to > vm->data_base;
+    vm->snap_id = 0;
+#ifndef _WIN32
+    if (vm->snap_mapped) {
+        if (!heap_fresh(vm->memory, all)) memset(vm->memory, 0, all);
+        vm->snap_mapped = 0;
+        return;  // no data segment: sisa_restore dropped it
+    }
+#endif
+    if (vm->mem_mapped && (bytes >= MEM_REMAP_MIN || over_data)
+        && heap_zero(vm->memory, all)) {
+#ifdef __linux__
+        over_data = vm->data_copy;  // MADV_DONTNEED refaults a private file mapping from the file
+#endif
+    } else memset(vm->memory + from, 0, bytes);
+    if (over_data) (void)data_place(vm);
+    if (vm->data_file) data_header(vm);
+}
+
+// Embedding API (sisa.h)
+
+// Run one load step with its own error context, so it may fail from anywhere
+typedef void (*ProgStep)(SisaProgram *P, const void *arg, unsigned opts);
+static int program_step(SisaProgram *P, ProgStep step, const void *arg, unsigned opts, char *err, size_t errlen) {
+    SisaErr e;
+    SisaErr *saved = sisa_err_ctx;
+    e.code = SISA_OK;
+    e.msg[0] = 0;
+    sisa_err_ctx = &e;
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    if (setjmp(e.jb) == 0) step(P, arg, opts);
+    timespec_get(&t1, TIME_UTC);
+    P->load_sec += (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    sisa_err_ctx = saved;
+    if (e.code && err && errlen) snprintf(err, errlen, "%s", e.msg);
+    return e.code;
+}
+
+static void step_source(SisaProgram *P, const void *src, unsigned opts) {
+    (void)opts;
+    assemble_from_string(P, src);
+}
+
+// A binary image stays mapped for the life of the program; source is
+// streamed through the assembler ("-": from stdin)
+static void step_file(SisaProgram *P, const void *path, unsigned opts) {
+    (void)opts;
+    size_t size = 0;
+    const unsigned char *map = map_file(path, &size);
+    if (map && is_image(map, size)) {
+        P->map = map;
+        P->map_size = size;
+        load_image(P, map, size);
+        return;
+    }
+    if (map) unmap_file(map, size);
+    if (strcmp(path, "-") == 0) { assemble_from_stream(P, stdin); return; }
+    P->asm_in = fopen(path, "rb");
+    if (!P->asm_in) sisa_fail(SISA_ERR_IO, "Failed to open '%s'", (const char *)path);
+    assemble_from_stream(P, P->asm_in);
+    fclose(P->asm_in);
+    P->asm_in = NULL;
+}
+
+static void step_prepare(SisaProgram *P, const void *arg, unsigned opts) {
+    (void)arg;
+    decode_program(P);
+    verify_program(P, opts);
+    if (!(opts & SISA_LOAD_NO_OPT)) optimize_program(P, (opts & SISA_LOAD_DUMP_OPT) != 0);
+    P->code_hash = fnv1a(P->code, P->code_len, 2166136261u);
+    for (int i = 0; i < P->const_count; ++i) {
+        unsigned char k[12];
+        for (int j = 0; j < 8; ++j) k[j] = (unsigned char)(P->consts[i].bits >> (8*j));
+        for (int j = 0; j < 4; ++j) k[8+j] = (unsigned char)(P->consts[i].tag >> (8*j));
+        P->code_hash = fnv1a(k, sizeof k, P->code_hash);
+    }
+    for (int i = 0; i < P->native_count; ++i) {
+        const Native *N = &P->natives[i];
+        P->code_hash = fnv1a((const unsigned char *)N->name, strlen(N->name) + 1, P->code_hash);
+        P->code_hash = fnv1a((const unsigned char *)N->sig, strlen(N->sig) + 1, P->code_hash);
+    }
+    // constant store addresses bound what a batch run must clear afterwards
+    P->mem_written = 0;
+    for (size_t i = 0; i < P->prog_len; ++i) {
+        const Insn *in = &P->prog[i];
+        if (in->op == OP_STORE || in->op == OP_STOREF || in->op == OP_MEMCPY || in->op == OP_MEMSET
+            || in->op == OP_VADD || in->op == OP_VMUL || in->op == OP_VADDF || in->op == OP_VMULF
+            || (in->op == OP_CALLN && !P->natives[in->a.i].pure))
+            P->mem_written = UINT32_MAX;
+        else if (in->op == OP_STOREI && (uint32_t)in->a.i >= P->mem_written) P->mem_written = (uint32_t)in->a.i + 1;
+    }
+}
+
+static void step_save(SisaProgram *P, const void *path, unsigned opts) {
+    (void)opts;
+    if (!save_image(P, path)) sisa_fail(SISA_ERR_IO, "Failed to write '%s'", (const char *)path);
+}
+
+static int program_new(SisaProgram **out, char *err, size_t errlen) {
+    *out = calloc(1, sizeof(SisaProgram));
+    if (*out) return SISA_OK;
+    if (err && errlen) snprintf(err, errlen, "Runtime error: malloc failed");
+    return SISA_ERR_NOMEM;
+}
+
+static int program_finish(SisaProgram **out, int rc) {
+    if (rc) { sisa_program_free(*out); *out = NULL; }
+    return rc;
+}
+
+int sisa_program_from_source(const char *src, unsigned opts, SisaProgram **out, char *err, size_t errlen) {
+    return sisa_program_from_source_host(src, opts, NULL, out, err, errlen);
+}
+
+int sisa_program_from_file(const char *path, unsigned opts, SisaProgram **out, char *err, size_t errlen) {
+    return sisa_program_from_file_host(path, opts, NULL, out, err, errlen);
+}
+
+int sisa_program_from_source_host(const char *src, unsigned opts, const SisaHost *h, SisaProgram **out,
+                                  char *err, size_t errlen) {
+    int rc = program_new(out, err, errlen);
+    if (!rc) (*out)->host = h;
+    if (!rc) rc = program_step(*out, step_source, src, opts, err, errlen);
+    if (!rc) rc = program_step(*out, step_prepare, NULL, opts, err, errlen);
+    if (!rc) (*out)->host = NULL;
+    return program_finish(out, rc);
+}
+
+int sisa_program_from_file_host(const char *path, unsigned opts, const SisaHost *h, SisaProgram **out,
+                                char *err, size_t errlen) {
+    int rc = program_new(out, err, errlen);
+    if (!rc) (*out)->host = h;
+    if (!rc) rc = program_step(*out, step_file, path, opts, err, errlen);
+    if (!rc) rc = program_step(*out, step_prepare, NULL, opts, err, errlen);
+    if (!rc) (*out)->host = NULL;
+    return program_finish(out, rc);
+}
+
+SisaHost *sisa_host_create(void) { return calloc(1, sizeof(SisaHost)); }
+
+int sisa_host_add(SisaHost *h, const char *name, const char *sig, SisaNativeFn fn, void *user) {
+    size_t len = strlen(name);
+    Native N;
+    memset(&N, 0, sizeof N);
+    if (!len || len > NATIVE_NAME_MAX || !fn || !native_sig(&N, sig)) return SISA_ERR_ASM;
+    for (int i = 0; i < h->count; ++i) if (strcmp(h->fn[i].name, name) == 0) return SISA_ERR_ASM;
+    if (h->count == h->cap) {
+        int cap = h->cap ? h->cap * 2 : 16;
+        Native *q = realloc(h->fn, (size_t)cap * sizeof(Native));
+        if (!q) return SISA_ERR_NOMEM;
+        h->fn = q;
+        h->cap = cap;
+    }
+    memcpy(N.name, name, len + 1);
+    N.fn = fn;
+    N.user = user;
+    h->fn[h->count++] = N;
+    return SISA_OK;
+}
+
+void sisa_host_free(SisaHost *h) {
+    if (!h) return;
+    free(h->fn);
+    free(h);
+}
+
+int sisa_program_save(const SisaProgram *p, const char *path, char *err, size_t errlen) {
+    return program_step((SisaProgram *)p, step_save, path, 0, err, errlen);
+}
+
+void sisa_program_free(SisaProgram *p) {
+    if (!p) return;
+    free(p->code_owned);
+    free(p->prog);
+    free(p->reg);
+    free(p->reg_off);
+    free(p->frame);
+    free(p->labels);
+    free(p->label_names);
+    free(p->label_hash);
+    free(p->consts);
+    free(p->const_hash);
+    free(p->natives);
+    free(p->asm_b.buf);
+    free(p->asm_shift);
+    free(p->asm_numeric);
+    free(p->asm_src);
+    if (p->asm_in) fclose(p->asm_in);
+    if (p->map) unmap_file(p->map, p->map_size);
+    free(p);
+}
+
+SisaVM *sisa_create(void) {
+    SisaVM *vm = calloc(1, sizeof(SisaVM));
+    if (!vm) return NULL;
+    vm->memory = vm->mem_inline;
+    vm->mem_mask = MEM_SIZE - 1;
+    if (sisa_set_stack(vm, STACK_MAX)) { free(vm); return NULL; }
+    return vm;
+}
+
+// The stacks are one reservation, the value stack (after its guard slot) and
+// then the call stack, so they can grow to millions of slots without moving:
+// every loop keeps pointers into them, and the pages a run never reaches are
+// never touched.
+int sisa_set_stack(SisaVM *vm, size_t slots) {
+    if (slots < STACK_SIZE) slots = STACK_SIZE;
+    if (slots > STACK_LIMIT || slots > (SIZE_MAX - sizeof(Value)) / (sizeof(Value) + sizeof(uint32_t)))
+        return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: cannot reserve %zu stack slots", slots);
+    size_t bytes = (1 + slots) * sizeof(Value) + slots * sizeof(uint32_t);
+    void *m = heap_map(bytes);
+    if (!m) return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: cannot reserve %zu stack slots", slots);
+    if (vm->stack_map) heap_unmap(vm->stack_map, vm->stack_bytes);
+    vm->stack_map = m;
+    vm->stack_bytes = bytes;
+    vm->stack = (Value *)m + 1;
+    vm->callstack = (uint32_t *)(vm->stack + slots);
+    vm->stack_max = (int)slots;
+    vm->sp = vm->csp = 0;
+    vm->ip = 0;
+    vm->at_snapshot = 0;
+    vm->yielded = 0;
+    return SISA_OK;
+}
+
+// Switch to a zeroed memory m of n cells
+static void mem_replace(SisaVM *vm, int32_t *m, size_t n) {
+    if (vm->mem_mapped) heap_unmap(vm->memory, ((size_t)vm->mem_mask + 1) * sizeof(int32_t));
+    else memset(vm->mem_inline, 0, sizeof(vm->mem_inline));
+    data_release(vm);
+    vm->memory = m;
+    vm->mem_mask = (uint32_t)(n - 1);
+    vm->mem_mapped = m != vm->mem_inline;
+    vm->snap_id = 0;
+    vm->snap_mapped = 0;
+}
+
+int sisa_set_memory(SisaVM *vm, size_t cells) {
+    size_t n = mem_round(cells);
+    int32_t *m = vm->mem_inline;
+    if (cells > MEM_MAX || (n > MEM_SIZE && !(m = heap_map(n * sizeof(int32_t)))))
+        return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: cannot reserve %zu cells of memory", cells);
+    mem_replace(vm, m, n);
+    return SISA_OK;
+}
+
+int sisa_map_data(SisaVM *vm, const char *path, size_t *base) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return vm_fail(vm, SISA_ERR_IO, "Failed to open '%s'", path);
+    uint64_t bytes;
+    int ok;
+#ifdef _WIN32
+    struct _stat64 st;
+    ok = _fstat64(_fileno(f), &st) == 0;
+    bytes = (uint64_t)st.st_size;
+#else
+    struct stat st;
+    ok = fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode);
+    bytes = (uint64_t)st.st_size;
+#endif
+    if (!ok) { fclose(f); return vm_fail(vm, SISA_ERR_IO, "Data error: '%s' is not a regular file", path); }
+    // after the memory the VM has, the segment page-aligned so it can be mapped
+    size_t at = (size_t)vm->mem_mask + 1;
+#ifndef _WIN32
+    long page = sysconf(_SC_PAGESIZE);
+    while (page > 0 && at * sizeof(int32_t) % (size_t)page) at *= 2;
+#endif
+    uint64_t cells = (bytes + 3) / 4;
+    if (cells > MEM_MAX - at) {
+        fclose(f);
+        return vm_fail(vm, SISA_ERR_NOMEM, "Data error: '%s' does not fit in memory (%zu cells at most)", path, (size_t)(MEM_MAX - at));
+    }
+    size_t n = mem_round(at + (size_t)cells);
+    int32_t *m = heap_map(n * sizeof(int32_t));
+    if (!m) { fclose(f); return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: cannot reserve %zu cells of memory", n); }
+    mem_replace(vm, m, n);
+    vm->data_file = f;
+    vm->data_base = at;
+    vm->data_cells = (size_t)cells;
+    vm->data_bytes = bytes;
+#ifdef _WIN32
+    vm->data_copy = 1;
+#endif
+    if (!data_place(vm)) {
+        data_release(vm);
+        memset(m, 0, n * sizeof(int32_t));
+        return vm_fail(vm, SISA_ERR_IO, "Failed to read '%s'", path);
+    }
+    data_header(vm);
+    if (base) *base = at;
+    return SISA_OK;
+}
+
+int sisa_load(SisaVM *vm, const SisaProgram *p) {
+    vm->p = p;
+    vm->sp = 0;
+    vm->csp = 0;
+    vm->ip = 0;
+    vm->at_snapshot = 0;
+    vm->yielded = 0;
+    memset(vm->stack - 1, 0, sizeof(Value));      // the guard slot; a run writes each slot before reading it
+    mem_clear(vm, 0, (size_t)vm->mem_mask + 1);
+    vm->err.code = SISA_OK;
+    vm->err.msg[0] = 0;
+    if (vm->out_mode == OUT_MEMORY) vm->out.len = 0;
+    if (vm->prof) vm->prof->p = NULL;
+    if (vm->stats) vm->stats->p = NULL;
+#if VM_HAVE_JIT
+    if (vm->tier) vm->tier->ran = 0;
+#endif
+    return SISA_OK;
+}
+
+int sisa_run(SisaVM *vm, unsigned flags) {
+    SisaErr *saved = sisa_err_ctx;
+    vm->err.code = SISA_OK;
+    vm->err.msg[0] = 0;
+    vm->out_binary = (flags & SISA_RUN_BINARY_OUT) != 0;
+    vm->out_sync = (flags & SISA_RUN_TRACE) != 0;   // keep PRINTs in line with the trace
+    vm->snap_stop = (flags & SISA_RUN_SNAPSHOT) != 0;
+    vm->at_snapshot = 0;
+    sisa_err_ctx = &vm->err;
+    if (vm->fueled && vm->fuel <= 0) vm->yielded = 1;  // nothing to go on with
+    else {
+        vm->resumed = vm->yielded;
+        vm->yielded = 0;
+        if (setjmp(vm->err.jb) == 0) run_vm(vm, flags);
+        vm->resumed = 0;
+    }
+    if (vm->yielded) {
+        vm->err.code = SISA_YIELD;
+        snprintf(vm->err.msg, sizeof(vm->err.msg), "Run stopped: out of fuel");
+    }
+    else if (!vm->at_snapshot) vm->ip = 0;   // the next run starts over
+    if (vm->prof) prof_stop(vm->prof);
+    if (vm->stats) stats_stop(vm);
+#if VM_HAVE_JIT
+    if (vm->tier) tier_poll(vm->tier, 1);  // no compile outlives the run
+#endif
+    out_flush(vm);
+    sisa_err_ctx = saved;
+    return vm->err.code;
+}
+
+const char *sisa_error(const SisaVM *vm) { return vm->err.msg; }
+
+void sisa_output_sink(SisaVM *vm, SisaSinkFn fn, void *user) {
+    vm->out_mode = fn ? OUT_SINK : OUT_STDOUT;
+    vm->sink = fn;
+    vm->sink_user = user;
+    vm->out.len = 0;
+}
+
+void sisa_set_tier(SisaVM *vm, unsigned threshold, int background) {
+    vm->tier_threshold = threshold > INT32_MAX ? INT32_MAX : threshold;
+    vm->tier_sync = !background;
+}
+
+void sisa_set_fuel(SisaVM *vm, uint64_t n) {
+    vm->fuel = n > INT64_MAX ? INT64_MAX : (int64_t)n;
+    vm->fueled = n != 0;
+}
+
+int64_t sisa_fuel(const SisaVM *vm) { return vm->fueled ? vm->fuel : INT64_MAX; }
+
+void sisa_output_memory(SisaVM *vm) {
+    vm->out_mode = OUT_MEMORY;
+    vm->out.len = 0;
+}
+
+const char *sisa_output(const SisaVM *vm, size_t *len) {
+    *len = vm->out_mode == OUT_MEMORY ? vm->out.len : 0;
+    return *len ? vm->out.buf : "";
+}
+
+// Profile report: one row per opcode, function or label
+typedef struct {
+    const char *name;
+    char buf[16];               // name of an unlabelled function
+    uint64_t calls, insns, ticks, total_insns, total_ticks;
+} ProfRow;
+static int prof_row_cmp(const void *a, const void *b) {
+    const ProfRow *x = a, *y = b;
+    if (x->insns != y->insns) return x->insns < y->insns ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+// ticks net of the profiler's share: floor per instruction
+static uint64_t prof_net(uint64_t ticks, uint64_t n, uint64_t floor) { return ticks > n * floor ? ticks - n * floor : 0; }
+static double prof_pct(uint64_t a, uint64_t b) { return b ? 100.0 * (double)a / (double)b : 0.0; }
+static void prof_table(FILE *f, const char *what, ProfRow *r, size_t n, uint64_t insns, uint64_t ticks) {
+    qsort(r, n, sizeof(ProfRow), prof_row_cmp);
+    fprintf(f, "\n%-20s %14s %6s %16s %6s %9s\n", what, "insns", "%", PROF_UNIT, "%", "per insn");
+    for (size_t i = 0; i < n; ++i)
+        if (r[i].insns)
+            fprintf(f, "%-20s %14llu %6.2f %16llu %6.2f %9.1f\n", r[i].name,
+                    (unsigned long long)r[i].insns, prof_pct(r[i].insns, insns),
+                    (unsigned long long)r[i].ticks, prof_pct(r[i].ticks, ticks),
+                    (double)r[i].ticks / (double)r[i].insns);
+}
+
+#if VM_HAVE_JIT
+// sisa_profile_write for a tiered run
+static int tier_write(SisaVM *vm, FILE *f) {
+    const Tier *T = vm->tier;
+    const SisaProgram *p = T->p;
+    if (!f) return SISA_OK;
+    fprintf(f, "tier: threshold %u arrivals, then a look every %d until the code is in; compiled %s\n",
+            T->threshold, TIER_POLL, T->background ? "in the background" : "on the running thread");
+    fprintf(f, "tier: %u compiles in %.3f ms, %zu of %zu insns native (%zu bytes)%s\n", T->compiles,
+            T->compile_sec * 1e3, T->code.mem ? T->code_insns : 0, p->prog_len, T->code.mem ? T->code.size : 0,
+            T->failed ? "; a compile failed, the rest ran interpreted" : "");
+    fprintf(f, "tier: %llu events, %llu native entries, %llu exits to the interpreter, %llu type guard failures\n",
+            (unsigned long long)T->events, (unsigned long long)T->entries,
+            (unsigned long long)T->exits, (unsigned long long)T->guards);
+    fprintf(f, "\n%-20s %-10s %8s %10s\n", "region", "kind", "insns", "entries");
+    for (size_t r = 0; r < T->nroots; ++r) {
+        const TierRoot *R = &T->roots[r];
+        char buf[16];
+        const char *name = NULL;
+        for (int l = 0; l < p->label_count && !name; ++l)
+            if (p->labels[l].offset == p->prog[R->ip].off) name = label_name(p, l);
+        if (!name) { snprintf(buf, sizeof(buf), "ip_%04u", p->prog[R->ip].off); name = buf; }
+        fprintf(f, "%-20s %-10s %8zu %10llu\n", name, R->kind == TIER_LOOP ? "loop" : "function",
+                R->insns, (unsigned long long)R->entries);
+    }
+    return ferror(f) ? vm_fail(vm, SISA_ERR_IO, "Failed to write the profile") : SISA_OK;
+}
+#endif
+
+int sisa_profile_write(SisaVM *vm, FILE *summary, FILE *stacks) {
+    const Profile *P = vm->prof;
+#if VM_HAVE_JIT
+    if ((!P || !P->p) && vm->tier && vm->tier->ran) return tier_write(vm, summary);
+#endif
+    if (!P || !P->p) return vm_fail(vm, SISA_ERR_RUNTIME, "No profile: nothing was run with SISA_RUN_PROFILE");
+    const SisaProgram *p = P->p;
+    size_t n = P->n, nrows = n > 256 ? n : 256;
+    if ((size_t)p->label_count + 1 > nrows) nrows = (size_t)p->label_count + 1;
+    // named[i]: the label at instruction i, region[i]: the last one at or before it
+    int32_t *named = malloc(n * sizeof(int32_t)), *region = malloc(n * sizeof(int32_t));
+    int32_t *fn_row = malloc((n + 1) * sizeof(int32_t)), *seen = malloc((n + 1) * sizeof(int32_t));  // by fn + 1
+    int32_t *path = malloc((size_t)P->node_count * sizeof(int32_t));
+    ProfRow *row = calloc(nrows, sizeof(ProfRow));
+    int rc = SISA_OK;
+    if (!named || !region || !fn_row || !seen || !path || !row) { rc = vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: malloc failed"); goto out; }
+    for (size_t i = 0; i < n; ++i) named[i] = -1;
+    for (size_t i = 0; i <= n; ++i) fn_row[i] = seen[i] = -1;
+    for (int l = p->label_count - 1; l >= 0; --l) {  // the first of several labels wins
+        size_t lo = 0, hi = n - 1;                   // first instruction at or after it
+        while (lo < hi) { size_t m = (lo + hi) / 2; if (p->prog[m].off < p->labels[l].offset) lo = m + 1; else hi = m; }
+        named[lo] = l;
+    }
+    for (size_t i = 0, l = (size_t)-1; i < n; ++i) { if (named[i] >= 0) l = (size_t)named[i]; region[i] = (int32_t)l; }
+
+    uint64_t insns = 0, ticks = 0, fl = P->floor == UINT64_MAX ? 0 : P->floor;
+    for (size_t i = 0; i < n; ++i) { insns += P->hits[i]; ticks += prof_net(P->ticks[i], P->hits[i], fl); }
+    size_t k;
+    if (summary) {
+        fprintf(summary, "profile: %llu instructions, %llu %s (%.1f per instruction, after taking off a floor of %llu)\n",
+                (unsigned long long)insns, (unsigned long long)ticks, PROF_UNIT,
+                insns ? (double)ticks / (double)insns : 0.0, (unsigned long long)fl);
+        for (k = 0; k < 256; ++k) row[k] = (ProfRow){ .name = op_name((unsigned char)k) };
+        for (size_t i = 0; i < n; ++i) { row[p->prog[i].op].insns += P->hits[i]; row[p->prog[i].op].ticks += prof_net(P->ticks[i], P->hits[i], fl); }
+        prof_table(summary, "opcode", row, 256, insns, ticks);
+
+        // functions: self counts per node, totals once per path through the node
+        k = 0;
+        for (int j = 0; j < P->node_count; ++j) {
+            const ProfNode *N = &P->node[j];
+            size_t f = (size_t)(N->fn + 1);
+            if (fn_row[f] < 0) {
+                ProfRow *R = &row[fn_row[f] = (int32_t)k++];
+                memset(R, 0, sizeof(*R));
+                if (N->fn < 0) R->name = "<main>";
+                else if (named[N->fn] >= 0) R->name = label_name(p, named[N->fn]);
+                else { snprintf(R->buf, sizeof(R->buf), "ip_%04u", p->prog[N->fn].off); R->name = R->buf; }
+            }
+            ProfRow *R = &row[fn_row[f]];
+            R->calls += N->calls; R->insns += N->insns; R->ticks += prof_net(N->ticks, N->insns, fl);
+            for (int a = j; a >= 0; a = P->node[a].parent) {
+                size_t g = (size_t)(P->node[a].fn + 1);
+                if (seen[g] == j) continue;  // recursion: count the node once
+                seen[g] = j;
+                if (fn_row[g] >= 0) { row[fn_row[g]].total_insns += N->insns; row[fn_row[g]].total_ticks += prof_net(N->ticks, N->insns, fl); }
+            }
+        }
+        qsort(row, k, sizeof(ProfRow), prof_row_cmp);
+        fprintf(summary, "\n%-20s %10s %14s %6s %14s %6s %16s %16s\n", "function", "calls", "self insns", "%",
+                "total insns", "%", "self " PROF_UNIT, "total " PROF_UNIT);
+        for (size_t i = 0; i < k; ++i)
+            fprintf(summary, "%-20s %10llu %14llu %6.2f %14llu %6.2f %16llu %16llu\n", row[i].name,
+                    (unsigned long long)row[i].calls, (unsigned long long)row[i].insns, prof_pct(row[i].insns, insns),
+                    (unsigned long long)row[i].total_insns, prof_pct(row[i].total_insns, insns),
+                    (unsigned long long)row[i].ticks, (unsigned long long)row[i].total_ticks);
+
+        memset(row, 0, ((size_t)p->label_count + 1) * sizeof(ProfRow));
+        for (int l = 0; l < p->label_count; ++l) row[l].name = label_name(p, l);
+        row[p->label_count].name = "<start>";  // code before the first label
+        for (size_t i = 0; i < n; ++i) {
+            ProfRow *R = &row[region[i] < 0 ? p->label_count : region[i]];
+            R->insns += P->hits[i]; R->ticks += prof_net(P->ticks[i], P->hits[i], fl);
+        }
+        prof_table(summary, "label", row, (size_t)p->label_count + 1, insns, ticks);
+        if (ferror(summary)) rc = vm_fail(vm, SISA_ERR_IO, "Failed to write the profile");
+    }
+    if (stacks) {
+        for (int j = 0; j < P->node_count; ++j) {
+            if (!P->node[j].insns) continue;
+            int d = 0;
+            for (int a = j; a >= 0; a = P->node[a].parent) path[d++] = P->node[a].fn;
+            while (d--) {
+                int32_t fn = path[d];
+                if (fn < 0) fputs("<main>", stacks);
+                else if (named[fn] >= 0) fputs(label_name(p, named[fn]), stacks);
+                else fprintf(stacks, "ip_%04u", p->prog[fn].off);
+                fputc(d ? ';' : ' ', stacks);
+            }
+            fprintf(stacks, "%llu\n", (unsigned long long)P->node[j].insns);
+        }
+        if (ferror(stacks)) rc = vm_fail(vm, SISA_ERR_IO, "Failed to write the profile");
+    }
+out:
+    free(named); free(region); free(fn_row); free(seen); free(path); free(row);
+    return rc;
+}
+
+const SisaStats *sisa_stats(const SisaVM *vm) { return vm->stats && vm->stats->p ? &vm->stats->s : NULL; }
+
+int sisa_stats_write(SisaVM *vm, FILE *f, int format) {
+    const SisaStats *S = sisa_stats(vm);
+    if (!S) return vm_fail(vm, SISA_ERR_RUNTIME, "No stats: nothing was run with SISA_RUN_STATS");
+    if (format == SISA_STATS_PROM) {
+        fprintf(f, "# HELP sisa_instructions_total Instructions run, by opcode class.\n"
+                   "# TYPE sisa_instructions_total counter\n");
+        for (int c = 0; c < SISA_CLASSES; ++c)
+            fprintf(f, "sisa_instructions_total{class=\"%s\"} %llu\n", class_name[c], (unsigned long long)S->insns_by_class[c]);
+        fprintf(f, "# HELP sisa_stack_peak_slots Deepest value and call stacks.\n"
+                   "# TYPE sisa_stack_peak_slots gauge\n"
+                   "sisa_stack_peak_slots{stack=\"value\"} %u\n"
+                   "sisa_stack_peak_slots{stack=\"call\"} %u\n"
+                   "# HELP sisa_memory_cells Cells of the memory pages not all zero after the run.\n"
+                   "# TYPE sisa_memory_cells gauge\n"
+                   "sisa_memory_cells %llu\n"
+                   "# HELP sisa_print_bytes_total PRINT output.\n"
+                   "# TYPE sisa_print_bytes_total counter\n"
+                   "sisa_print_bytes_total %llu\n"
+                   "# HELP sisa_load_seconds Time spent assembling (or reading), verifying and optimizing the program.\n"
+                   "# TYPE sisa_load_seconds gauge\n"
+                   "sisa_load_seconds %.9f\n"
+                   "# HELP sisa_run_seconds Time spent running it.\n"
+                   "# TYPE sisa_run_seconds gauge\n"
+                   "sisa_run_seconds %.9f\n",
+                S->peak_sp, S->peak_csp, (unsigned long long)S->mem_cells, (unsigned long long)S->print_bytes,
+                S->load_s, S->run_s);
+        if (S->counters)
+            fprintf(f, "# HELP sisa_cpu_cycles_total CPU cycles in user space during the run.\n"
+                       "# TYPE sisa_cpu_cycles_total counter\n"
+                       "sisa_cpu_cycles_total %llu\n"
+                       "# HELP sisa_branch_misses_total Mispredicted branches during the run.\n"
+                       "# TYPE sisa_branch_misses_total counter\n"
+                       "sisa_branch_misses_total %llu\n"
+                       "# HELP sisa_cache_misses_total Last-level cache misses during the run.\n"
+                       "# TYPE sisa_cache_misses_total counter\n"
+                       "sisa_cache_misses_total %llu\n",
+                    (unsigned long long)S->cycles, (unsigned long long)S->branch_misses, (unsigned long long)S->cache_misses);
+    } else {
+        fprintf(f, "{\"insns\": %llu, \"insns_by_class\": {", (unsigned long long)S->insns);
+        for (int c = 0; c < SISA_CLASSES; ++c)
+            fprintf(f, "%s\"%s\": %llu", c ? ", " : "", class_name[c], (unsigned long long)S->insns_by_class[c]);
+        fprintf(f, "}, \"peak_sp\": %u, \"peak_csp\": %u, \"mem_cells\": %llu, \"print_bytes\": %llu, "
+                   "\"load_s\": %.6f, \"run_s\": %.6f, ",
+                S->peak_sp, S->peak_csp, (unsigned long long)S->mem_cells, (unsigned long long)S->print_bytes,
+                S->load_s, S->run_s);
+        if (S->counters) fprintf(f, "\"cycles\": %llu, \"branch_misses\": %llu, \"cache_misses\": %llu}\n",
+                                 (unsigned long long)S->cycles, (unsigned long long)S->branch_misses,
+                                 (unsigned long long)S->cache_misses);
+        else fprintf(f, "\"cycles\": null, \"branch_misses\": null, \"cache_misses\": null}\n");
+    }
+    return ferror(f) ? vm_fail(vm, SISA_ERR_IO, "Failed to write the stats") : SISA_OK;
+}
+
+void sisa_destroy(SisaVM *vm) {
+    if (!vm) return;
+#if VM_HAVE_JIT
+    jit_release(vm);
+    tier_free(vm->tier);
+    free(vm->tier);
+#endif
+    if (vm->mem_mapped) heap_unmap(vm->memory, ((size_t)vm->mem_mask + 1) * sizeof(int32_t));
+    if (vm->stack_map) heap_unmap(vm->stack_map, vm->stack_bytes);
+    data_release(vm);
+    if (vm->prof) {
+        free(vm->prof->hits); free(vm->prof->ticks);
+        free(vm->prof->node); free(vm->prof->child);
+        free(vm->prof);
+    }
+    if (vm->stats) {
+        free(vm->stats->line);
+        free(vm->stats);
+    }
+    free(vm->out.buf);
+    free(vm);
+}
+
+// the prog[] insn covering byte offset off (a superinstruction covers its pair)
+static size_t prog_at(const SisaProgram *P, uint32_t off) {
+    size_t lo = 0, hi = P->prog_len;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (P->prog[mid].off <= off) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Snapshots (sisa_snapshot_*)
+// The state of a VM stopped at a SNAPSHOT: stacks, where to go on, and data
+// memory without its all-zero pages. In memory and on disk it is one image,
+// little-endian:
+//    0 "SISASNAP"
+//    8 u32 version
+//   12 u32 code_len    of the program it comes from
+//   16 u32 code_hash   FNV-1a over that program's bytecode
+//   20 u32 byte offset of the SNAPSHOT the run stopped at
+//   24 u32 sp, 28 u32 csp
+//   32 u32 memory cells, 36 u32 page runs, 40 u32 pages
+//   44 u32 checksum    FNV-1a over bytes 0-43 and 48 up to the first page
+//   48 sp x { u8 tag (1 int, 2 double); 8 bytes: int32 and 0, or the double }
+//   .. csp x u32 byte offset of the CALL of each return address, oldest first
+//   .. runs x { u32 first page; u32 pages }, ascending
+//   .. the pages of the runs, SNAP_PAGE bytes each, from a SNAP_PAGE boundary
+// Code positions are byte offsets, so a snapshot does not depend on the
+// peephole pass. A file snapshot stays mapped and sisa_restore maps its
+// pages into a heap copy-on-write; otherwise they are copied. The checksum
+// leaves the pages out: any contents are valid memory.
+#define SNAP_VERSION 1
+#define SNAP_HEADER  48
+#define SNAP_PAGE    4096   // bytes: pages are mapped where the OS page size divides it
+#define SNAP_CELLS   (SNAP_PAGE / sizeof(int32_t))
+
+struct SisaSnapshot {
+    unsigned char *img;
+    size_t size;
+    int mapped;                 // img is a read-only mapping of the file
+    int fd;                     // that file, for copy-on-write restores; -1 if none
+    uint64_t id;                // for SisaVM.snap_id
+    uint32_t code_len, code_hash, at, sp, csp, cells, nruns, npages;   // from the header
+    size_t pages_at;            // image offset of the first page
+};
+
+#ifndef SISA_NO_THREADS
+static atomic_uint_fast64_t snap_serial;
+#else
+static uint64_t snap_serial;
+#endif
+
+static void wr_u32_le(unsigned char *p, uint32_t x) {
+    for (int i = 0; i < 4; ++i) p[i] = (unsigned char)(x >> (8*i));
+}
+static int page_zero(const int32_t *p) {
+    int32_t any = 0;
+    for (size_t i = 0; i < SNAP_CELLS; ++i) any |= p[i];
+    return any == 0;
+}
+static size_t snap_meta_end(uint32_t sp, uint32_t csp, uint32_t nruns) {
+    return SNAP_HEADER + (size_t)sp * 9 + (size_t)csp * 4 + (size_t)nruns * 8;
+}
+static uint32_t snap_checksum(const unsigned char *img, size_t meta_end) {
+    return fnv1a(img + SNAP_HEADER, meta_end - SNAP_HEADER, fnv1a(img, 44, 2166136261u));
+}
+
+// Check S's image and fill in its header fields; NULL or what is wrong
+static const char *snap_parse(SisaSnapshot *S) {
+    const unsigned char *h = S->img;
+    if (S->size < SNAP_HEADER || memcmp(h, "SISASNAP", 8) != 0) return "not a snapshot";
+    if (rd_u32_le(h + 8) != SNAP_VERSION) return "unknown version";
+    S->code_len = rd_u32_le(h + 12); S->code_hash = rd_u32_le(h + 16); S->at = rd_u32_le(h + 20);
+    S->sp = rd_u32_le(h + 24); S->csp = rd_u32_le(h + 28); S->cells = rd_u32_le(h + 32);
+    S->nruns = rd_u32_le(h + 36); S->npages = rd_u32_le(h + 40);
+    if (S->cells < MEM_SIZE || S->cells > MEM_MAX || (S->cells & (S->cells - 1))) return "bad memory size";
+    size_t meta = snap_meta_end(S->sp, S->csp, S->nruns);
+    S->pages_at = (meta + SNAP_PAGE - 1) / SNAP_PAGE * SNAP_PAGE;
+    if (S->sp > S->size || S->csp > S->size || S->nruns > S->size || S->npages > S->size / SNAP_PAGE
+        || S->pages_at + (size_t)S->npages * SNAP_PAGE != S->size)
+        return "section sizes do not match the file";
+    if (snap_checksum(h, meta) != rd_u32_le(h + 44)) return "checksum mismatch";
+    const unsigned char *run = h + meta - (size_t)S->nruns * 8;
+    uint64_t next = 0, pages = 0;
+    for (uint32_t r = 0; r < S->nruns; ++r, run += 8) {
+        uint64_t first = rd_u32_le(run), n = rd_u32_le(run + 4);
+        if (first < next || n == 0 || first + n > S->cells / SNAP_CELLS) return "bad page runs";
+        next = first + n;
+        pages += n;
+    }
+    if (pages != S->npages) return "bad page runs";
+    for (uint32_t k = 0; k < S->sp; ++k) {
+        unsigned tag = h[SNAP_HEADER + 9 * (size_t)k];
+        if (tag != TY_INT && tag != TY_FLOAT) return "bad stack value";
+    }
+    return NULL;
+}
+
+static void snap_free(SisaSnapshot *S) {
+    if (!S) return;
+    if (S->mapped) unmap_file(S->img, S->size);
+    else free(S->img);
+#ifndef _WIN32
+    if (S->fd >= 0) close(S->fd);
+#endif
+    free(S);
+}
+
+int sisa_snapshot_take(SisaVM *vm, SisaSnapshot **out) {
+    *out = NULL;
+    if (!vm->p || !vm->at_snapshot)
+        return vm_fail(vm, SISA_ERR_RUNTIME, "Snapshot error: the last run did not stop at a SNAPSHOT");
+    const SisaProgram *P = vm->p;
+    size_t npage = ((size_t)vm->mem_mask + 1) / SNAP_CELLS;
+    uint32_t nruns = 0, npages = 0;
+    for (size_t g = 0, prev = 0; g < npage; ++g) {
+        size_t used = !page_zero(vm->memory + g * SNAP_CELLS);
+        nruns += used && !prev;
+        npages += used;
+        prev = used;
+    }
+    size_t meta = snap_meta_end((uint32_t)vm->sp, (uint32_t)vm->csp, nruns);
+    size_t pages_at = (meta + SNAP_PAGE - 1) / SNAP_PAGE * SNAP_PAGE;
+    SisaSnapshot *S = calloc(1, sizeof(SisaSnapshot));
+    if (S) { S->fd = -1; S->size = pages_at + (size_t)npages * SNAP_PAGE; S->img = calloc(1, S->size); }
+    if (!S || !S->img) { snap_free(S); return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: malloc failed"); }
+
+    unsigned char *h = S->img;
+    memcpy(h, "SISASNAP", 8);
+    wr_u32_le(h + 8, SNAP_VERSION);
+    wr_u32_le(h + 12, (uint32_t)P->code_len); wr_u32_le(h + 16, P->code_hash);
+    wr_u32_le(h + 20, P->prog[vm->ip - 1].off);
+    wr_u32_le(h + 24, (uint32_t)vm->sp); wr_u32_le(h + 28, (uint32_t)vm->csp);
+    wr_u32_le(h + 32, vm->mem_mask + 1); wr_u32_le(h + 36, nruns); wr_u32_le(h + 40, npages);
+    unsigned char *q = h + SNAP_HEADER;
+    for (int k = 0; k < vm->sp; ++k, q += 9) {
+        Value v = vm->stack[k];
+        if (VAL_IS_INT(v)) { q[0] = TY_INT; wr_u32_le(q + 1, (uint32_t)VAL_I(v)); }
+        else { double f = VAL_F(v); q[0] = TY_FLOAT; memcpy(q + 1, &f, 8); }
+    }
+    for (int j = 0; j < vm->csp; ++j, q += 4) wr_u32_le(q, P->prog[vm->callstack[j] - 1].off);
+    unsigned char *page = h + pages_at;
+    for (size_t g = 0, prev = 0; g < npage; ++g) {
+        const int32_t *m = vm->memory + g * SNAP_CELLS;
+        size_t used = !page_zero(m);
+        if (used && !prev) { wr_u32_le(q, (uint32_t)g); wr_u32_le(q + 4, 0); q += 8; }
+        prev = used;
+        if (!used) continue;
+        wr_u32_le(q - 4, rd_u32_le(q - 4) + 1);
+        memcpy(page, m, SNAP_PAGE);
+        page += SNAP_PAGE;
+    }
+    wr_u32_le(h + 44, snap_checksum(h, meta));
+    snap_parse(S);
+    S->id = ++snap_serial;
+    *out = S;
+    return SISA_OK;
+}
+
+int sisa_snapshot_save(const SisaSnapshot *s, const char *path, char *err, size_t errlen) {
+    FILE *f = fopen(path, "wb");
+    int ok = f && fwrite(s->img, 1, s->size, f) == s->size;
+    if (f && fclose(f) != 0) ok = 0;
+    if (ok) return SISA_OK;
+    if (err && errlen) snprintf(err, errlen, "Failed to write '%s'", path);
+    return SISA_ERR_IO;
+}
+
+// The file stays mapped read-only (and open, for copy-on-write restores)
+int sisa_snapshot_from_file(const char *path, SisaSnapshot **out, char *err, size_t errlen) {
+    SisaSnapshot *S = *out = calloc(1, sizeof(SisaSnapshot));
+    if (!S) { if (err && errlen) snprintf(err, errlen, "Runtime error: malloc failed"); return SISA_ERR_NOMEM; }
+    S->fd = -1;
+#ifdef _WIN32
+    S->img = (unsigned char *)map_file(path, &S->size);
+#else
+    struct stat st;
+    if ((S->fd = open(path, O_RDONLY)) >= 0 && fstat(S->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, S->fd, 0);
+        if (m != MAP_FAILED) { S->img = m; S->size = (size_t)st.st_size; }
+    }
+#endif
+    S->mapped = S->img != NULL;
+    const char *why = S->img ? snap_parse(S) : NULL;
+    if (S->img && !why) { S->id = ++snap_serial; return SISA_OK; }
+    if (err && errlen) {
+        if (why) snprintf(err, errlen, "Snapshot error: '%s': %s", path, why);
+        else snprintf(err, errlen, "Failed to open '%s'", path);
+    }
+    snap_free(S);
+    *out = NULL;
+    return why ? SISA_ERR_IMAGE : SISA_ERR_IO;
+}
+
+void sisa_snapshot_free(SisaSnapshot *s) { snap_free(s); }
+
+// Where S's positions are in p: the insn after its SNAPSHOT, or 0 if S does
+// not fit p or stacks of stack_max slots. Verified code runs unchecked, so
+// there the restored stack must have the depth the verifier proved, frame by
+// frame from main's, and each frame the headroom its CALL tested for.
+static uint32_t snap_resume(const SisaProgram *p, const SisaSnapshot *S, int stack_max, const char **why) {
+    *why = "taken from another program";
+    if (S->code_len != p->code_len || S->code_hash != p->code_hash) return 0;
+    *why = "stacks deeper than this VM's";
+    if (S->sp > (uint32_t)stack_max || S->csp > (uint32_t)stack_max) return 0;
+    *why = "positions do not match the program";
+    size_t ip = prog_at(p, S->at);
+    if (p->prog[ip].off != S->at || p->prog[ip].op != OP_SNAPSHOT) return 0;
+    const unsigned char *cs = S->img + SNAP_HEADER + (size_t)S->sp * 9;
+    int64_t base = 0;
+    uint32_t fn = 0;
+    for (uint32_t j = 0; j < S->csp; ++j) {
+        size_t c = prog_at(p, rd_u32_le(cs + 4 * (size_t)j));
+        if (p->prog[c].off != rd_u32_le(cs + 4 * (size_t)j) || p->prog[c].op != OP_CALL) return 0;
+        if (p->verified) {
+            if (p->frame[c].fn != fn) return 0;
+            base += p->frame[c].depth;
+            fn = p->prog[c].a.t;
+            if (base + p->prog[c].aux > stack_max) { *why = "stacks deeper than this VM's"; return 0; }
+        }
+    }
+    *why = "stack depth does not match the verified code";
+    if (p->verified && (p->frame[ip].fn != fn || base + p->frame[ip].depth != (int64_t)S->sp)) return 0;
+    return (uint32_t)ip + 1;
+}
+
+#ifndef _WIN32
+static int snap_can_map(const SisaVM *vm, const SisaSnapshot *S) {
+    long page = sysconf(_SC_PAGESIZE);
+    return S->fd >= 0 && vm->mem_mapped && page > 0 && SNAP_PAGE % page == 0;
+}
+#endif
+
+// Put S's stacks and memory into vm and point it at the insn after the
+// SNAPSHOT. Memory that still is S's from the last restore is only reset
+// below p->mem_written, which a run cannot store above.
+static int snap_apply(SisaVM *vm, const SisaProgram *p, const SisaSnapshot *S) {
+    const char *why;
+    uint32_t ip = snap_resume(p, S, vm->stack_max, &why);
+    if (!ip) return vm_fail(vm, SISA_ERR_IMAGE, "Snapshot error: %s", why);
+    const unsigned char *run = S->img + snap_meta_end(S->sp, S->csp, S->nruns) - (size_t)S->nruns * 8;
+    size_t limit = S->cells / SNAP_CELLS;   // pages to put back
+    if (vm->snap_id == S->id && (size_t)vm->mem_mask + 1 == S->cells && p->mem_written < S->cells) {
+        limit = (p->mem_written + SNAP_CELLS - 1) / SNAP_CELLS;
+        memset(vm->memory, 0, limit * SNAP_PAGE);
+    } else if ((size_t)vm->mem_mask + 1 != S->cells || vm->data_file) {
+        if (sisa_set_memory(vm, S->cells)) return vm->err.code;
+    } else {
+        mem_clear(vm, 0, S->cells);
+    }
+#ifndef _WIN32
+    int map = snap_can_map(vm, S) && limit == S->cells / SNAP_CELLS;
+#endif
+    size_t src = S->pages_at;
+    for (uint32_t r = 0; r < S->nruns; ++r, run += 8) {
+        size_t first = rd_u32_le(run), n = rd_u32_le(run + 4);
+        if (first >= limit) break;
+        if (n > limit - first) n = limit - first;
+        int32_t *dst = vm->memory + first * SNAP_CELLS;
+        size_t bytes = n * SNAP_PAGE;
+#ifndef _WIN32
+        if (map && mmap(dst, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, S->fd, (off_t)src) != MAP_FAILED) {
+            vm->snap_mapped = 1;
+            src += bytes;
+            continue;
+        }
+        if (map && !heap_fresh(dst, bytes)) return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: cannot map snapshot memory");
+#endif
+        memcpy(dst, S->img + src, bytes);
+        src += bytes;
+    }
+    vm->snap_id = S->id;
+
+    const unsigned char *q = S->img + SNAP_HEADER;
+    for (uint32_t k = 0; k < S->sp; ++k, q += 9) {
+        if (q[0] == TY_INT) vm->stack[k] = mk_int((int32_t)rd_u32_le(q + 1));
+        else vm->stack[k] = mk_float(val_from_double(rd_double_le(q + 1)));
+    }
+    for (uint32_t j = 0; j < S->csp; ++j, q += 4) vm->callstack[j] = (uint32_t)prog_at(p, rd_u32_le(q)) + 1;
+    vm->sp = (int)S->sp;
+    vm->csp = (int)S->csp;
+    vm->ip = ip;
+    vm->at_snapshot = 0;
+    vm->yielded = 0;
+    return SISA_OK;
+}
+
+int sisa_restore(SisaVM *vm, const SisaProgram *p, const SisaSnapshot *s) {
+    vm->err.code = SISA_OK;
+    vm->err.msg[0] = 0;
+    if (snap_apply(vm, p, s)) return vm->err.code;
+    vm->p = p;
+    if (vm->out_mode == OUT_MEMORY) vm->out.len = 0;
+    if (vm->prof) vm->prof->p = NULL;
+    if (vm->stats) vm->stats->p = NULL;
+#if VM_HAVE_JIT
+    if (vm->tier) vm->tier->ran = 0;
+#endif
+    return SISA_OK;
+}
+
+// Batch runs (sisa_run_batch)
+// Runs are done in blocks of BATCH_BLOCK so that captured output stays
+// bounded. Each worker starts a block with an equal slice of its run indices
+// in its own deque. It pops from the bottom end and, once that is empty,
+// steals from the top end of the others (Chase-Lev, minus the push side:
+// nothing is added). Results go to the callback in run order once the
+// block is done.
+#define BATCH_BLOCK 65536
+
+typedef struct {
+    int rc;
+    int worker;
+    size_t off, len, err_len;   // output, then error message, in the worker VM's buffer
+} BatchResult;
+
+typedef struct BatchCtx BatchCtx;
+typedef struct {
+    BatchCtx *B;
+    int id;
+    uint32_t rng;
+    SisaVM *vm;                 // output kept in memory
+} BatchWorker;
+
+#ifndef SISA_NO_THREADS
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;   // runs [top, bottom) of the block are left
+    _Atomic int64_t bottom;
+} Deque;
+#endif
+
+struct BatchCtx {
+    const SisaProgram *p;
+    const int32_t *inputs;
+    size_t stride;
+    unsigned flags;
+    uint64_t fuel;              // per run; 0: none
+    const SisaSnapshot *snap;   // runs start from it, else from insn 0
+    size_t base;                // first run of the block
+    BatchResult *res;           // one per run of the block
+    BatchWorker *w;
+    int nw;
+#ifndef SISA_NO_THREADS
+    Deque *dq;
+#endif
+};
+
+static void batch_one(BatchWorker *W, size_t i) {
+    BatchCtx *B = W->B;
+    SisaVM *vm = W->vm;
+    size_t run = B->base + i;
+    BatchResult *R = &B->res[i];
+    R->worker = W->id;
+    R->off = vm->out.len;
+    if (B->snap) {
+        R->rc = snap_apply(vm, B->p, B->snap);
+    } else {
+        // the last run dirtied at most [0, mem_written); the inputs overwrite [0, stride)
+        size_t cells = (size_t)vm->mem_mask + 1;
+        size_t dirty = B->p->mem_written < cells ? B->p->mem_written : cells;
+        if (dirty > B->stride) mem_clear(vm, B->stride, dirty);
+        vm->sp = 0;
+        vm->csp = 0;
+        vm->ip = 0;                 // after a run that ran out of fuel
+        vm->yielded = 0;
+        R->rc = SISA_OK;
+    }
+    if (!R->rc) {
+        memcpy(vm->memory, B->inputs + run * B->stride, B->stride * sizeof(int32_t));
+        if (B->fuel) sisa_set_fuel(vm, B->fuel);
+        R->rc = sisa_run(vm, B->flags);
+    }
+    R->len = vm->out.len - R->off;
+    R->err_len = 0;
+    if (R->rc) {
+        size_t n = strlen(vm->err.msg);
+        if (out_reserve(&vm->out, n)) {
+            memcpy(vm->out.buf + vm->out.len, vm->err.msg, n);
+            vm->out.len += n;
+            R->err_len = n;
+        }
+    }
+}
+
+#ifndef SISA_NO_THREADS
+static int64_t dq_pop(Deque *d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) {                                // empty
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return -1;
+    }
+    if (t == b) {                               // last one: race the thieves for it
+        int64_t want = t;
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &want, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) b = -1;
+        atomic_store_explicit(&d->bottom, t + 1, memory_order_relaxed);
+    }
+    return b;
+}
+
+// -1: empty, -2: lost a race with another thief or the owner
+static int64_t dq_steal(Deque *d) {
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return -1;
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) return -2;
+    return t;
+}
+
+// Nothing is ever pushed, so a sweep that finds every deque empty ends the block
+static int64_t batch_steal(BatchWorker *W) {
+    BatchCtx *B = W->B;
+    for (;;) {
+        int raced = 0;
+        W->rng ^= W->rng << 13; W->rng ^= W->rng >> 17; W->rng ^= W->rng << 5;
+        int start = (int)(W->rng % (uint32_t)B->nw);
+        for (int k = 0; k < B->nw; ++k) {
+            int v = (start + k) % B->nw;
+            if (v == W->id) continue;
+            int64_t i = dq_steal(&B->dq[v]);
+            if (i >= 0) return i;
+            if (i == -2) raced = 1;
+        }
+        if (!raced) return -1;
+    }
+}
+
+static void batch_worker(BatchWorker *W) {
+    Deque *own = &W->B->dq[W->id];
+    for (;;) {
+        int64_t i = dq_pop(own);
+        if (i < 0 && (i = batch_steal(W)) < 0) return;
+        batch_one(W, (size_t)i);
+    }
+}
+
+#ifdef _WIN32
+typedef HANDLE BatchThread;
+static DWORD WINAPI batch_thread(LPVOID arg) { batch_worker(arg); return 0; }
+static int thread_start(BatchThread *t, BatchWorker *W) { return (*t = CreateThread(NULL, 0, batch_thread, W, 0, NULL)) != NULL; }
+static void thread_join(BatchThread t) { WaitForSingleObject(t, INFINITE); CloseHandle(t); }
+static int cpu_count(void) { SYSTEM_INFO si; GetSystemInfo(&si); return (int)si.dwNumberOfProcessors; }
+#else
+typedef pthread_t BatchThread;
+static void *batch_thread(void *arg) { batch_worker(arg); return NULL; }
+static int thread_start(BatchThread *t, BatchWorker *W) { return pthread_create(t, NULL, batch_thread, W) == 0; }
+static void thread_join(BatchThread t) { pthread_join(t, NULL); }
+static int cpu_count(void) { long n = sysconf(_SC_NPROCESSORS_ONLN); return n > 0 ? (int)n : 1; }
+#endif
+#endif
+
+int sisa_run_batch(const SisaProgram *p, const int32_t *inputs, size_t stride, size_t nruns,
+                   const SisaBatchOpts *o, SisaBatchFn fn, void *user, char *err, size_t errlen) {
+    int threads = o->threads;
+#ifdef SISA_NO_THREADS
+    threads = 1;
+#else
+    if (threads <= 0) threads = cpu_count();
+#endif
+    size_t block = nruns < BATCH_BLOCK ? nruns : BATCH_BLOCK;
+    if ((size_t)threads > block) threads = block ? (int)block : 1;
+    BatchCtx B = {0};
+    B.p = p; B.inputs = inputs; B.stride = stride; B.snap = o->snapshot; B.fuel = o->fuel;
+    B.flags = o->flags & ~(SISA_RUN_TRACE | SISA_RUN_PROFILE | SISA_RUN_SNAPSHOT | SISA_RUN_STATS | SISA_RUN_PERF);  // nothing would collect them
+    B.nw = threads;
+    B.res = malloc((block ? block : 1) * sizeof(BatchResult));
+    B.w = calloc((size_t)threads, sizeof(BatchWorker));
+#ifndef SISA_NO_THREADS
+    B.dq = calloc((size_t)threads, sizeof(Deque));
+    BatchThread *th = malloc((size_t)threads * sizeof(BatchThread));
+    int *started = malloc((size_t)threads * sizeof(int));
+    int ok = B.dq && th && started;
+#else
+    int ok = 1;
+#endif
+    ok = ok && B.res && B.w;
+    int rc = ok ? SISA_OK : SISA_ERR_NOMEM;
+    if (!ok && err) snprintf(err, errlen, "Runtime error: malloc failed");
+    for (int k = 0; !rc && k < threads; ++k) {
+        BatchWorker *W = &B.w[k];
+        W->B = &B; W->id = k; W->rng = 2463534242u + 977u * (uint32_t)k;
+        if (!(W->vm = sisa_create())) {
+            rc = SISA_ERR_NOMEM;
+            if (err) snprintf(err, errlen, "Runtime error: malloc failed");
+            break;
+        }
+        if (o->stack_slots) rc = sisa_set_stack(W->vm, o->stack_slots);
+        if (!rc && o->snapshot) rc = sisa_restore(W->vm, p, o->snapshot);  // sizes the memory
+        else if (!rc && !(rc = sisa_set_memory(W->vm, o->mem_cells)) && o->data_path)
+            rc = sisa_map_data(W->vm, o->data_path, NULL);
+        // the inputs go below the memory, or below the data segment's length cells
+        size_t room = o->data_path && !o->snapshot ? W->vm->data_base - 2 : (size_t)W->vm->mem_mask + 1;
+        if (!rc && stride > room) rc = vm_fail(W->vm, SISA_ERR_RUNTIME, "Batch input error: %zu values per run, room for %zu", stride, room);
+        if (rc) { if (err) snprintf(err, errlen, "%s", W->vm->err.msg); break; }
+        sisa_output_memory(W->vm);
+        if (!o->snapshot) sisa_load(W->vm, p);
+    }
+    ok = !rc;
+
+    for (B.base = 0; ok && B.base < nruns; B.base += block) {
+        size_t n = nruns - B.base < block ? nruns - B.base : block;
+        for (int k = 0; k < threads; ++k) B.w[k].vm->out.len = 0;
+#ifdef SISA_NO_THREADS
+        for (size_t i = 0; i < n; ++i) batch_one(&B.w[0], i);
+#else
+        for (int k = 0; k < threads; ++k) {
+            atomic_store(&B.dq[k].top, (int64_t)(n * (size_t)k / (size_t)threads));
+            atomic_store(&B.dq[k].bottom, (int64_t)(n * (size_t)(k + 1) / (size_t)threads));
+        }
+        // a worker whose thread fails to start is simply stolen from
+        for (int k = 1; k < threads; ++k) started[k] = thread_start(&th[k], &B.w[k]);
+        batch_worker(&B.w[0]);
+        for (int k = 1; k < threads; ++k) if (started[k]) thread_join(th[k]);
+#endif
+        for (size_t i = 0; i < n; ++i) {
+            const BatchResult *R = &B.res[i];
+            const char *o = B.w[R->worker].vm->out.buf + R->off;
+            char msg[sizeof(((SisaErr *)0)->msg)] = "";
+            if (R->rc) { memcpy(msg, o + R->len, R->err_len); msg[R->err_len] = 0; }
+            fn(user, B.base + i, R->rc, R->len ? o : "", R->len, msg);
+        }
+    }
+
+    for (int k = 0; B.w && k < threads; ++k) sisa_destroy(B.w[k].vm);
+    free(B.w);
+    free(B.res);
+#ifndef SISA_NO_THREADS
+    free(B.dq);
+    free(th);
+    free(started);
+#endif
+    return rc;
+}
+
+// Green threads (sisa_sched_*)
+// Workers take VMs from one run queue, run each for a slice of fuel and put
+// it back at the end if it has more to do, so that many long runs share a
+// few threads round robin.
+#ifdef SISA_NO_THREADS
+typedef int Mutex;
+typedef int CondVar;
+static void mutex_init(Mutex *m) { (void)m; }
+static void mutex_free(Mutex *m) { (void)m; }
+static void mutex_lock(Mutex *m) { (void)m; }
+static void mutex_unlock(Mutex *m) { (void)m; }
+static void cond_init(CondVar *c) { (void)c; }
+static void cond_free(CondVar *c) { (void)c; }
+static void cond_wait(CondVar *c, Mutex *m) { (void)c; (void)m; }
+static void cond_signal(CondVar *c) { (void)c; }
+static void cond_broadcast(CondVar *c) { (void)c; }
+#elif defined(_WIN32)
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE CondVar;
+static void mutex_init(Mutex *m) { InitializeSRWLock(m); }
+static void mutex_free(Mutex *m) { (void)m; }
+static void mutex_lock(Mutex *m) { AcquireSRWLockExclusive(m); }
+static void mutex_unlock(Mutex *m) { ReleaseSRWLockExclusive(m); }
+static void cond_init(CondVar *c) { InitializeConditionVariable(c); }
+static void cond_free(CondVar *c) { (void)c; }
+static void cond_wait(CondVar *c, Mutex *m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void cond_signal(CondVar *c) { WakeConditionVariable(c); }
+static void cond_broadcast(CondVar *c) { WakeAllConditionVariable(c); }
+#else
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+static void mutex_init(Mutex *m) { pthread_mutex_init(m, NULL); }
+static void mutex_free(Mutex *m) { pthread_mutex_destroy(m); }
+static void mutex_lock(Mutex *m) { pthread_mutex_lock(m); }
+static void mutex_unlock(Mutex *m) { pthread_mutex_unlock(m); }
+static void cond_init(CondVar *c) { pthread_cond_init(c, NULL); }
+static void cond_free(CondVar *c) { pthread_cond_destroy(c); }
+static void cond_wait(CondVar *c, Mutex *m) { pthread_cond_wait(c, m); }
+static void cond_signal(CondVar *c) { pthread_cond_signal(c); }
+static void cond_broadcast(CondVar *c) { pthread_cond_broadcast(c); }
+#endif
+
+typedef struct SchedTask {
+    struct SchedTask *next;
+    SisaVM *vm;
+    unsigned flags;
+    int64_t left;               // of the budget; INT64_MAX: none
+    SisaDoneFn done;
+    void *user;
+} SchedTask;
+
+struct SisaSched {
+    Mutex lock;                 // what follows
+    CondVar work, idle;
+    SchedTask *head, *tail;     // the run queue
+    size_t pending;             // added and not done yet
+    int closing;
+    uint64_t slice;
+    int threads;                // 0: sisa_sched_wait runs the queue
+#ifndef SISA_NO_THREADS
+#ifdef _WIN32
+    HANDLE *th;
+#else
+    pthread_t *th;
+#endif
+#endif
+};
+
+// Run T for a slice; 0 once it is done (and freed)
+static int sched_slice(SisaSched *S, SchedTask *T) {
+    int64_t give = T->left;
+    if (S->slice && (uint64_t)give > S->slice) give = (int64_t)S->slice;
+    sisa_set_fuel(T->vm, give == INT64_MAX ? 0 : (uint64_t)give);
+    int rc = sisa_run(T->vm, T->flags);
+    if (give != INT64_MAX && T->left != INT64_MAX) T->left -= give - sisa_fuel(T->vm);
+    if (rc == SISA_YIELD && T->left > 0) return 1;
+    sisa_set_fuel(T->vm, 0);
+    T->done(T->user, T->vm, rc);
+    free(T);
+    return 0;
+}
+
+static void sched_push(SisaSched *S, SchedTask *T) {
+    T->next = NULL;
+    if (S->tail) S->tail->next = T; else S->head = T;
+    S->tail = T;
+}
+
+static SchedTask *sched_pop(SisaSched *S) {
+    SchedTask *T = S->head;
+    if (T && !(S->head = T->next)) S->tail = NULL;
+    return T;
+}
+
+// Under S->lock: take tasks until the queue is empty (and closing, for a worker)
+static void sched_run(SisaSched *S, int worker) {
+    for (;;) {
+        SchedTask *T;
+        while (!(T = sched_pop(S)) && worker && !S->closing) cond_wait(&S->work, &S->lock);
+        if (!T) return;
+        mutex_unlock(&S->lock);
+        int again = sched_slice(S, T);
+        mutex_lock(&S->lock);
+        if (again) sched_push(S, T);
+        else if (--S->pending == 0) cond_broadcast(&S->idle);
+    }
+}
+
+#ifndef SISA_NO_THREADS
+static void sched_worker(SisaSched *S) {
+    mutex_lock(&S->lock);
+    sched_run(S, 1);
+    mutex_unlock(&S->lock);
+}
+#ifdef _WIN32
+static DWORD WINAPI sched_thread(LPVOID arg) { sched_worker(arg); return 0; }
+#else
+static void *sched_thread(void *arg) { sched_worker(arg); return NULL; }
+#endif
+#endif
+
+SisaSched *sisa_sched_create(int threads, uint64_t slice) {
+    SisaSched *S = calloc(1, sizeof(SisaSched));
+    if (!S) return NULL;
+    mutex_init(&S->lock);
+    cond_init(&S->work);
+    cond_init(&S->idle);
+    S->slice = slice > INT64_MAX ? INT64_MAX : slice;
+#ifndef SISA_NO_THREADS
+    if (threads <= 0) threads = cpu_count();
+    if (!(S->th = malloc((size_t)threads * sizeof(*S->th)))) threads = 0;
+    // those that fail to start are done without
+#ifdef _WIN32
+    while (S->threads < threads && (S->th[S->threads] = CreateThread(NULL, 0, sched_thread, S, 0, NULL)) != NULL) S->threads++;
+#else
+    while (S->threads < threads && pthread_create(&S->th[S->threads], NULL, sched_thread, S) == 0) S->threads++;
+#endif
+#else
+    (void)threads;
+#endif
+    return S;
+}
+
+int sisa_sched_add(SisaSched *S, SisaVM *vm, unsigned flags, uint64_t budget, SisaDoneFn done, void *user) {
+    SchedTask *T = malloc(sizeof(SchedTask));
+    if (!T) return vm_fail(vm, SISA_ERR_NOMEM, "Runtime error: malloc failed");
+    T->vm = vm;
+    T->flags = flags & ~(unsigned)SISA_RUN_SNAPSHOT;   // a SNAPSHOT stop would look done
+    T->left = budget && budget < INT64_MAX ? (int64_t)budget : INT64_MAX;
+    T->done = done;
+    T->user = user;
+    mutex_lock(&S->lock);
+    sched_push(S, T);
+    S->pending++;
+    cond_signal(&S->work);
+    mutex_unlock(&S->lock);
+    return SISA_OK;
+}
+
+void sisa_sched_wait(SisaSched *S) {
+    mutex_lock(&S->lock);
+    if (!S->threads) sched_run(S, 0);
+    while (S->pending) cond_wait(&S->idle, &S->lock);
+    mutex_unlock(&S->lock);
+}
+
+void sisa_sched_free(SisaSched *S) {
+    if (!S) return;
+    sisa_sched_wait(S);
+    mutex_lock(&S->lock);
+    S->closing = 1;
+    cond_broadcast(&S->work);
+    mutex_unlock(&S->lock);
+#ifndef SISA_NO_THREADS
+#ifdef _WIN32
+    for (int k = 0; k < S->threads; ++k) { WaitForSingleObject(S->th[k], INFINITE); CloseHandle(S->th[k]); }
+#else
+    for (int k = 0; k < S->threads; ++k) pthread_join(S->th[k], NULL);
+#endif
+    free(S->th);
+#endif
+    cond_free(&S->work);
+    cond_free(&S->idle);
+    mutex_free(&S->lock);
+    free(S);
+}
+
+#ifndef SISA_NO_MAIN
+// Read file into string
+// The whole file, NUL-terminated ("-": stdin). Read in doubling chunks so
+// pipes work too.
+static char *read_file(const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f) return NULL;
+    size_t cap = 65536, len = 0;
+    char *buf = malloc(cap);
+    for (size_t got = 1; buf && got; ) {
+        if (len + 1 == cap) {
+            char *q = realloc(buf, cap *= 2);
+            if (!q) { free(buf); buf = NULL; break; }
+            buf = q;
+        }
+        got = fread(buf + len, 1, cap - 1 - len, f);
+        len += got;
+    }
+    if (buf && ferror(f)) { free(buf); buf = NULL; }
+    if (buf) buf[len] = 0;
+    if (f != stdin) fclose(f);
+    return buf;
+}
+// --vec: kernel sets by name
+static const char *const vec_isa_name[VEC_NISA] = { "scalar", "sse2", "avx2", "neon" };
+// whether the CPU can run kernel set isa
+static int vec_isa_ok(int isa) {
+    switch (isa) {
+        case VEC_SCALAR: return 1;
+#ifdef VEC_X86
+        case VEC_SSE2: return 1;
+        case VEC_AVX2: return vec_have_avx2();
+#elif defined(VEC_ARM)
+        case VEC_NEON: return 1;
+#endif
+        default: return 0;
+    }
+}
+// --bench-asm: assemble src repeatedly for about half a second of CPU time
+typedef struct { const char *src; size_t lines, bytes; int runs; double sec; } AsmBench;
+static void bench_assembler(SisaProgram *P, const void *arg, unsigned opts) {
+    AsmBench *b = (AsmBench *)arg;  // the results go back through arg
+    const char *src = b->src;
+    (void)opts;
+    size_t lines = 0, bytes = strlen(src);
+    for (const char *p = src; *p; ++p) lines += *p == '\n';
+    if (bytes && src[bytes-1] != '\n') lines++;
+    int runs = 0;
+    clock_t t0 = clock(), t;
+    do {
+        reset_labels(P);
+        assemble_from_string(P, src);
+        runs++;
+        t = clock();
+    } while (t - t0 < CLOCKS_PER_SEC / 2);
+    b->lines = lines;
+    b->bytes = bytes;
+    b->runs = runs;
+    b->sec = (double)(t - t0) / CLOCKS_PER_SEC;
+}
+// Assembler throughput on the source file at path (--bench-asm, --bench)
+static int measure_assembler(const char *path, AsmBench *b, char *err, size_t errlen) {
+    char *src = read_file(path);
+    if (!src) { snprintf(err, errlen, "Failed to open '%s'", path); return SISA_ERR_IO; }
+    SisaProgram *P;
+    int rc = program_new(&P, err, errlen);
+    if (rc) { free(src); return rc; }
+    P->asm_src = src;  // freed with P
+    b->src = src;
+    rc = program_step(P, bench_assembler, b, 0, err, errlen);
+    sisa_program_free(P);
+    return rc;
+}
+
+// --bench: one counting run for the number of instructions executed, one
+// untimed run (JIT compile, warm caches), then runs timed runs with the
+// output thrown away; the results go to stdout as one JSON line. The
+// register tier's dispatches follow from the same counts: a register insn
+// runs exactly when the stack insn it was made from does.
+static void bench_discard(void *user, const char *data, size_t len) { (void)user; (void)data; (void)len; }
+static int sec_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+static void json_str(const char *s) {
+    putchar('"');
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') putchar('\\');
+        if ((unsigned char)*s >= 0x20) putchar(*s);
+    }
+    putchar('"');
+}
+static int bench_program(const SisaProgram *P, const char *path, unsigned flags, int runs, const AsmBench *ab,
+                         size_t mem_cells, size_t stack_slots, const char *data_path, unsigned tier_threshold) {
+    SisaVM *vm = sisa_create();
+    double *sec = malloc((size_t)runs * sizeof(double));
+    if (!vm || !sec) { fprintf(stderr, "Runtime error: malloc failed\n"); sisa_destroy(vm); free(sec); return 1; }
+    int rc = stack_slots ? sisa_set_stack(vm, stack_slots) : SISA_OK;
+    if (!rc) rc = sisa_set_memory(vm, mem_cells);
+    if (!rc && data_path) rc = sisa_map_data(vm, data_path, NULL);
+    sisa_output_sink(vm, bench_discard, NULL);
+    sisa_set_tier(vm, tier_threshold, 1);
+    if (!rc) rc = sisa_load(vm, P) || sisa_run(vm, RUN_COUNT | (flags & SISA_RUN_BINARY_OUT));
+    uint64_t insns = 0;
+    for (size_t i = 0; !rc && i < vm->prof->n; ++i) insns += vm->prof->hits[i];
+    int jit = VM_HAVE_JIT && (flags & SISA_RUN_JIT) && !(flags & SISA_RUN_NO_VERIFY) && P->verified;
+    int tier = VM_HAVE_JIT && !jit && (flags & SISA_RUN_TIER) && !(flags & SISA_RUN_NO_VERIFY) && P->verified;
+    int reg = !jit && !tier && (flags & SISA_RUN_REG) && !(flags & SISA_RUN_NO_VERIFY) && P->reg;
+    uint64_t dispatches = rc || reg ? 0 : insns;
+    for (size_t j = 0; !rc && reg && j <= P->reg_len; ++j) dispatches += vm->prof->hits[prog_at(P, P->reg_off[j])];
+    for (int r = -1; !rc && r < runs; ++r) {
+        struct timespec t0, t1;
+        sisa_load(vm, P);
+        timespec_get(&t0, TIME_UTC);
+        rc = sisa_run(vm, flags);
+        timespec_get(&t1, TIME_UTC);
+        if (r >= 0) sec[r] = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    }
+    if (rc) {
+        fprintf(stderr, "%s\n", sisa_error(vm));
+    } else {
+        qsort(sec, (size_t)runs, sizeof(double), sec_cmp);
+        const char *engine = jit ? "jit" : tier ? "tier" : reg ? "reg" : P->verified && !(flags & SISA_RUN_NO_VERIFY) ? "fast" : "checked";
+        double best = sec[0] > 0 ? sec[0] : 1e-9;
+        printf("{\"program\": ");
+        json_str(path);
+        printf(", \"engine\": \"%s\", \"dispatch\": \"%s\", \"values\": \"%s\", \"vec\": \"%s\", "
+               "\"runs\": %d, \"insns\": %llu, \"best_s\": %.6f, \"median_s\": %.6f, "
+               "\"insns_per_s\": %.0f, \"ns_per_insn\": %.3f, ",
+               engine, VM_THREADED ? "threaded" : "switch", sizeof(Value) == 8 ? "nan-box" : "tagged",
+               vec_isa_name[vec_isa()], runs, (unsigned long long)insns, sec[0], sec[runs / 2],
+               (double)insns / best, best * 1e9 / (double)(insns ? insns : 1));
+        if (jit || tier) printf("\"dispatches\": null, ");
+        else printf("\"dispatches\": %llu, ", (unsigned long long)dispatches);
+        if (ab->lines) printf("\"asm_lines\": %zu, \"asm_lines_per_s\": %.0f}\n", ab->lines, (double)ab->lines * ab->runs / ab->sec);
+        else printf("\"asm_lines\": null, \"asm_lines_per_s\": null}\n");
+    }
+    sisa_destroy(vm);
+    free(sec);
+    return rc ? 1 : 0;
+}
+
+// One --batch or --serve input value at p, as strtol reads it: an int32, or a
+// uint32 for its bits (0xFFFFFFFF is -1). 0 if there is none or it is out of
+// that range.
+static int read_input(char *p, char **end, int32_t *out) {
+    errno = 0;
+    long long v = strtoll(p, end, 0);
+    if (*end == p || errno == ERANGE || v < INT32_MIN || v > (long long)UINT32_MAX) return 0;
+    *out = (int32_t)(uint32_t)v;
+    return 1;
+}
+
+// --batch input: one run per non-blank line, each a list of integers;
+// shorter lines are padded with zeros to the widest one
+static int32_t *read_batch_inputs(const char *path, size_t max, size_t *stride, size_t *nruns, char *err, size_t errlen) {
+    char *src = read_file(path);
+    if (!src) { snprintf(err, errlen, "Failed to open '%s'", path); return NULL; }
+    size_t w = 0, n = 0;
+    int lineno = 0;
+    for (char *p = src; *p; ) {
+        size_t k = 0;
+        ++lineno;
+        while (*p && *p != '\n') {
+            if (isspace((unsigned char)*p)) { ++p; continue; }
+            char *end;
+            int32_t v;
+            if (!read_input(p, &end, &v)) { snprintf(err, errlen, "Batch input error: bad number at %s:%d", path, lineno); free(src); return NULL; }
+            p = end;
+            ++k;
+        }
+        if (*p) ++p;
+        if (k > max) { snprintf(err, errlen, "Batch input error: more than %zu values at %s:%d", max, path, lineno); free(src); return NULL; }
+        if (k) { ++n; if (k > w) w = k; }
+    }
+    int32_t *in = calloc(n * w + 1, sizeof(int32_t));
+    if (!in) { snprintf(err, errlen, "Runtime error: malloc failed"); free(src); return NULL; }
+    size_t run = 0, k = 0;
+    for (char *p = src; *p; ) {
+        if (*p == '\n') { run += k != 0; k = 0; ++p; continue; }
+        if (isspace((unsigned char)*p)) { ++p; continue; }
+        read_input(p, &p, &in[run * w + k++]);  // checked above
+    }
+    free(src);
+    *stride = w;
+    *nruns = n;
+    return in;
+}
+
+// --mem: a cell count with an optional k, m or g (x1024) suffix
+static int parse_count(const char *s, unsigned long long max, unsigned long long *out) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s || *s == '-') return 0;
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; ++end; break;
+        case 'm': case 'M': shift = 20; ++end; break;
+        case 'g': case 'G': shift = 30; ++end; break;
+    }
+    if (*end || n > max >> shift) return 0;
+    *out = n << shift;
+    return 1;
+}
+
+static int parse_cells(const char *s, size_t *out) {
+    unsigned long long n;
+    if (!parse_count(s, MEM_MAX, &n)) return 0;
+    *out = (size_t)n;
+    return 1;
+}
+
+static void batch_emit(void *user, size_t run, int rc, const char *out, size_t len, const char *err) {
+    fwrite(out, 1, len, stdout);
+    if (rc) {
+        fflush(stdout);
+        fprintf(stderr, "run %zu: %s\n", run, err);
+        ++*(size_t *)user;
+    }
+}
+
+// Server mode (--serve)
+// One request per line: a program file (source or image), then integers
+// copied to memory[0..] as in --batch. Each answer is a line "seq rc len",
+// the len bytes the run printed and, if rc is not SISA_OK, its error message
+// on a line of its own; seq numbers a connection's requests from 0. Each run
+// gets a VM from a pool and goes to a scheduler (sisa_sched_*), so answers
+// come in the order they finish; with --slice a long run shares the workers
+// with the short ones instead of holding one up.
+// Prepared programs are cached by the FNV-1a of the file contents (an edited
+// file is simply a new program); past --cache of them, the least recently
+// used is dropped once no run is using it.
+#define SERVE_CACHE 64      // default programs kept
+#define SERVE_RUNS 64       // runs in flight, each on its own VM, before the readers block
+
+typedef struct CacheEntry {
+    struct CacheEntry *prev, *next;     // most recently used first
+    uint32_t hash;
+    size_t size;
+    unsigned char *bytes;               // the file, NUL-terminated; an image's code stays in it
+    SisaProgram *p;
+    int refs;                           // runs using it
+    int cached;                         // still in the list: dropped ones go at refs 0
+} CacheEntry;
+
+typedef struct Server Server;
+typedef struct {
+    Server *S;
+    FILE *in, *out;
+    Mutex out_lock;                     // one answer at a time
+    int refs;                           // the reader and its runs in flight; under S->lock
+} ServeConn;
+
+typedef struct ServeVM {
+    struct ServeVM *next;               // in the free list
+    SisaVM *vm;
+    CacheEntry *last;                   // the program vm has loaded, held so that it stays the same one
+    size_t last_n;                      // the inputs its last run had
+} ServeVM;
+
+typedef struct {
+    ServeConn *c;
+    size_t seq;
+    ServeVM *v;
+    CacheEntry *E;                      // a reference to drop once done; NULL: v->last holds it
+} ServeJob;
+
+struct Server {
+    unsigned flags, opts;
+    uint64_t fuel;                      // each run's budget; 0: none
+    SisaSched *sched;
+    size_t mem_cells, stack_slots;      // for new VMs
+    const char *data_path;
+    unsigned tier_threshold;
+    Mutex lock;                         // what follows
+    CondVar room;
+    ServeVM *free;
+    int vms;                            // made so far, up to SERVE_RUNS
+    ServeVM *all[SERVE_RUNS];
+    CacheEntry *mru, *lru;
+    int cached, cache_max;
+    size_t requests, hits, misses, dropped;
+};
+
+static void step_bytes(SisaProgram *P, const void *arg, unsigned opts) {
+    const CacheEntry *E = (const CacheEntry *)arg;
+    (void)opts;
+    if (is_image(E->bytes, E->size)) load_image(P, E->bytes, E->size);
+    else assemble_from_string(P, (const char *)E->bytes);
+}
+
+static void cache_free(CacheEntry *E) {
+    sisa_program_free(E->p);
+    free(E->bytes);
+    free(E);
+}
+
+static void cache_unlink(Server *S, CacheEntry *E) {
+    if (E->prev) E->prev->next = E->next; else S->mru = E->next;
+    if (E->next) E->next->prev = E->prev; else S->lru = E->prev;
+    E->prev = E->next = NULL;
+}
+
+static void cache_front(Server *S, CacheEntry *E) {
+    E->prev = NULL;
+    E->next = S->mru;
+    if (S->mru) S->mru->prev = E; else S->lru = E;
+    S->mru = E;
+}
+
+// Under S->lock
+static CacheEntry *cache_find(Server *S, uint32_t h, const unsigned char *bytes, size_t size) {
+    for (CacheEntry *E = S->mru; E; E = E->next)
+        if (E->hash == h && E->size == size && memcmp(E->bytes, bytes, size) == 0) return E;
+    return NULL;
+}
+
+// The prepared program for the file at path, with a reference for the caller.
+// A miss is prepared outside the lock; two readers missing on the same file
+// at once both prepare it and the second one keeps the first one's.
+static int cache_get(Server *S, const char *path, CacheEntry **out, char *err, size_t errlen) {
+    size_t size = 0;
+    const unsigned char *map = map_file(path, &size);
+    if (!map) { snprintf(err, errlen, "Failed to open '%s'", path); return SISA_ERR_IO; }
+    uint32_t h = fnv1a(map, size, 2166136261u);
+    mutex_lock(&S->lock);
+    CacheEntry *E = cache_find(S, h, map, size);
+    if (E) {
+        cache_unlink(S, E);
+        cache_front(S, E);
+        E->refs++;
+        S->hits++;
+    }
+    mutex_unlock(&S->lock);
+    if (E) { unmap_file(map, size); *out = E; return SISA_OK; }
+
+    int rc = SISA_ERR_NOMEM;
+    snprintf(err, errlen, "Runtime error: malloc failed");
+    if ((E = calloc(1, sizeof *E)) && (E->bytes = malloc(size + 1))) {
+        memcpy(E->bytes, map, size);
+        E->bytes[size] = 0;
+        E->size = size;
+        E->hash = h;
+        rc = program_new(&E->p, err, errlen);
+        if (!rc) rc = program_step(E->p, step_bytes, E, S->opts, err, errlen);
+        if (!rc) rc = program_step(E->p, step_prepare, NULL, S->opts, err, errlen);
+    }
+    unmap_file(map, size);
+    if (rc) { if (E) cache_free(E); return rc; }
+
+    CacheEntry *drop = NULL;
+    mutex_lock(&S->lock);
+    CacheEntry *had = cache_find(S, h, E->bytes, size);
+    if (had) {
+        had->refs++;
+        S->hits++;
+    } else {
+        E->refs = 1;
+        E->cached = 1;
+        cache_front(S, E);
+        S->misses++;
+        // a dropped entry still running goes when its last run ends
+        for (S->cached++; S->cached > S->cache_max; S->cached--) {
+            CacheEntry *L = S->lru;
+            cache_unlink(S, L);
+            L->cached = 0;
+            S->dropped++;
+            if (!L->refs) { L->next = drop; drop = L; }
+        }
+    }
+    mutex_unlock(&S->lock);
+    if (had) { cache_free(E); E = had; }
+    while (drop) { CacheEntry *n = drop->next; cache_free(drop); drop = n; }
+    *out = E;
+    return SISA_OK;
+}
+
+static void cache_put(Server *S, CacheEntry *E) {
+    mutex_lock(&S->lock);
+    int last = --E->refs == 0 && !E->cached;
+    mutex_unlock(&S->lock);
+    if (last) cache_free(E);
+}
+
+static SisaVM *serve_vm_new(Server *S, char *err, size_t errlen) {
+    SisaVM *vm = sisa_create();
+    if (!vm) { snprintf(err, errlen, "Runtime error: malloc failed"); return NULL; }
+    if ((S->stack_slots && sisa_set_stack(vm, S->stack_slots)) || sisa_set_memory(vm, S->mem_cells)
+        || (S->data_path && sisa_map_data(vm, S->data_path, NULL))) {
+        snprintf(err, errlen, "%s", sisa_error(vm));
+        sisa_destroy(vm);
+        return NULL;
+    }
+    sisa_output_memory(vm);
+    sisa_set_tier(vm, S->tier_threshold, 1);
+    return vm;
+}
+
+// A free VM, preferring one that has E loaded; NULL if one cannot be made
+static ServeVM *serve_vm_get(Server *S, const CacheEntry *E, char *err, size_t errlen) {
+    mutex_lock(&S->lock);
+    while (!S->free && S->vms == SERVE_RUNS) cond_wait(&S->room, &S->lock);
+    ServeVM **pv = &S->free, *v = NULL;
+    for (ServeVM **q = &S->free; *q; q = &(*q)->next)
+        if ((*q)->last == E) { pv = q; break; }
+    if ((v = *pv)) *pv = v->next;
+    else if ((v = calloc(1, sizeof *v))) S->all[S->vms++] = v;    // made outside the lock below
+    mutex_unlock(&S->lock);
+    if (!v) snprintf(err, errlen, "Runtime error: malloc failed");
+    else if (!v->vm && !(v->vm = serve_vm_new(S, err, errlen))) {
+        mutex_lock(&S->lock);
+        v->next = S->free;              // tried again by the next request
+        S->free = v;
+        mutex_unlock(&S->lock);
+        return NULL;
+    }
+    return v;
+}
+
+static void serve_vm_put(Server *S, ServeVM *v) {
+    mutex_lock(&S->lock);
+    v->next = S->free;
+    S->free = v;
+    cond_signal(&S->room);
+    mutex_unlock(&S->lock);
+}
+
+static ServeConn *conn_new(Server *S, FILE *in, FILE *out) {
+    ServeConn *c = calloc(1, sizeof *c);
+    if (!c) return NULL;
+    c->S = S;
+    c->in = in;
+    c->out = out;
+    c->refs = 1;
+    mutex_init(&c->out_lock);
+    return c;
+}
+
+static void conn_put(ServeConn *c) {
+    Server *S = c->S;
+    mutex_lock(&S->lock);
+    int last = --c->refs == 0;
+    mutex_unlock(&S->lock);
+    if (!last) return;
+    if (c->in != stdin) fclose(c->in);
+    if (c->out != stdout) fclose(c->out);
+    mutex_free(&c->out_lock);
+    free(c);
+}
+
+static void serve_answer(ServeConn *c, size_t seq, int rc, const char *out, size_t len, const char *msg) {
+    mutex_lock(&c->out_lock);
+    fprintf(c->out, "%zu %d %zu\n", seq, rc, len);
+    fwrite(out, 1, len, c->out);
+    if (rc) fprintf(c->out, "%s\n", msg);
+    fflush(c->out);                     // a client that has gone away is not an error here
+    mutex_unlock(&c->out_lock);
+}
+
+static void serve_done(void *user, SisaVM *vm, int rc) {
+    ServeJob *j = user;
+    Server *S = j->c->S;
+    size_t len = 0;
+    const char *out = sisa_output(vm, &len);
+    serve_answer(j->c, j->seq, rc, out, len, sisa_error(vm));
+    if (j->E) cache_put(S, j->E);
+    conn_put(j->c);
+    serve_vm_put(S, j->v);
+    free(j);
+}
+
+// Set a VM up for the program at path with n inputs and hand it to the scheduler
+static void serve_submit(Server *S, ServeConn *c, size_t seq, const char *path, const int32_t *in, size_t n) {
+    char err[256];
+    CacheEntry *E = NULL;
+    ServeJob *j = NULL;
+    ServeVM *v = NULL;
+    mutex_lock(&S->lock);
+    S->requests++;
+    mutex_unlock(&S->lock);
+    int rc = cache_get(S, path, &E, err, sizeof(err));
+    if (!rc && !(j = calloc(1, sizeof *j))) rc = SISA_ERR_NOMEM, snprintf(err, sizeof err, "Runtime error: malloc failed");
+    if (!rc && !(v = serve_vm_get(S, E, err, sizeof(err)))) rc = SISA_ERR_NOMEM;
+    if (rc) {
+        serve_answer(c, seq, rc, "", 0, err);
+        if (E) cache_put(S, E);
+        free(j);
+        return;
+    }
+    SisaVM *vm = v->vm;
+    // the inputs go below the memory, or below the data segment's length cells
+    size_t cells = (size_t)vm->mem_mask + 1, room = vm->data_file ? vm->data_base - 2 : cells;
+    if (v->last != E) {
+        if (v->last) cache_put(S, v->last);
+        v->last = E;
+        E = NULL;                       // its reference is the VM's now
+        sisa_load(vm, v->last->p);
+    } else {
+        // the same program again: as in --batch, only what its last run can have written
+        size_t dirty = E->p->mem_written < cells ? E->p->mem_written : cells;
+        if (v->last_n > dirty) dirty = v->last_n;
+        if (dirty > n) mem_clear(vm, n, dirty);
+        vm->sp = 0;
+        vm->csp = 0;
+        vm->ip = 0;                     // after a run stopped out of fuel
+        vm->yielded = 0;
+        vm->out.len = 0;
+    }
+    v->last_n = n;
+    j->c = c;
+    j->seq = seq;
+    j->v = v;
+    j->E = E;
+    mutex_lock(&S->lock);
+    c->refs++;
+    mutex_unlock(&S->lock);
+    if (n > room) {
+        serve_done(j, vm, vm_fail(vm, SISA_ERR_RUNTIME, "Server input error: %zu values, room for %zu", n, room));
+        return;
+    }
+    if (n) memcpy(vm->memory, in, n * sizeof(int32_t));
+    if (sisa_sched_add(S->sched, vm, S->flags, S->fuel, serve_done, j)) serve_done(j, vm, SISA_ERR_NOMEM);
+    else if (!S->sched->threads) sisa_sched_wait(S->sched);     // no workers: one run at a time
+}
+
+// One line of f into *buf, without its newline; 0 at the end of the input
+static int serve_line(FILE *f, char **buf, size_t *cap) {
+    size_t len = 0;
+    for (;;) {
+        if (*cap - len < 2) {
+            size_t n = *cap ? *cap * 2 : 256;
+            char *q = realloc(*buf, n);
+            if (!q) return 0;
+            *buf = q;
+            *cap = n;
+        }
+        if (!fgets(*buf + len, (int)(*cap - len > INT32_MAX ? INT32_MAX : *cap - len), f)) return len != 0;
+        len += strlen(*buf + len);
+        if (len && (*buf)[len-1] == '\n') { (*buf)[--len] = 0; return 1; }
+    }
+}
+
+// Read c's requests until it closes, then drop the reader's reference
+static void serve_reader(ServeConn *c) {
+    Server *S = c->S;
+    char *line = NULL;
+    size_t cap = 0, seq = 0;
+    while (serve_line(c->in, &line, &cap)) {
+        char *p = line;
+        while (isspace((unsigned char)*p)) ++p;
+        if (!*p || *p == '#') continue;
+        char *path = p;
+        while (*p && !isspace((unsigned char)*p)) ++p;
+        size_t plen = (size_t)(p - path), n = 0, vcap = 0;
+        int32_t *in = NULL;
+        char bad[32] = "";
+        for (;;) {
+            while (isspace((unsigned char)*p)) ++p;
+            if (!*p) break;
+            char *end;
+            int32_t v;
+            if (!read_input(p, &end, &v) || (*end && !isspace((unsigned char)*end))) { snprintf(bad, sizeof bad, "%.16s", p); break; }
+            if (n == vcap) {
+                int32_t *q = realloc(in, (vcap = vcap ? vcap * 2 : 16) * sizeof(int32_t));
+                if (!q) { snprintf(bad, sizeof bad, "(out of memory)"); break; }
+                in = q;
+            }
+            in[n++] = v;
+            p = end;
+        }
+        if (bad[0]) {
+            char msg[64];
+            snprintf(msg, sizeof msg, "Server input error: bad value '%s'", bad);
+            serve_answer(c, seq++, SISA_ERR_RUNTIME, "", 0, msg);
+        } else {
+            path[plen] = 0;             // the values have been read past it
+            serve_submit(S, c, seq++, path, in, n);
+        }
+        free(in);
+    }
+    free(line);
+    conn_put(c);
+}
+
+#if !defined(_WIN32) && !defined(SISA_NO_THREADS)
+static void *serve_reader_thread(void *arg) { serve_reader(arg); return NULL; }
+#endif
+// Accept clients on a Unix socket until the process is stopped; each has a
+// reader thread feeding the shared scheduler
+static int serve_socket(Server *S, const char *path) {
+#ifdef _WIN32
+    (void)S;
+    fprintf(stderr, "Server error: no Unix sockets here to listen on '%s'; use --serve -\n", path);
+    return 1;
+#else
+    struct sockaddr_un sa;
+    struct stat st;
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof sa.sun_path) { fprintf(stderr, "Server error: socket path '%s' is too long\n", path); return 1; }
+    memcpy(sa.sun_path, path, strlen(path) + 1);
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);  // left by a server that was killed
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof sa) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "Server error: cannot listen on '%s': %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        int cfd = accept(fd, NULL, NULL);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Server error: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        int wfd = dup(cfd);
+        FILE *in = fdopen(cfd, "r"), *out = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+        ServeConn *c = in && out ? conn_new(S, in, out) : NULL;
+        if (!c) {
+            if (in) fclose(in); else close(cfd);
+            if (out) fclose(out); else if (wfd >= 0) close(wfd);
+            continue;
+        }
+#ifndef SISA_NO_THREADS
+        pthread_t t;
+        if (pthread_create(&t, NULL, serve_reader_thread, c) == 0) { pthread_detach(t); continue; }
+#endif
+        serve_reader(c);                // one client at a time
+    }
+    close(fd);
+    return 1;
+#endif
+}
+
+static int serve(const char *where, unsigned flags, unsigned opts, int threads, uint64_t slice, uint64_t fuel,
+                 int cache_max, size_t mem_cells, size_t stack_slots, const char *data_path,
+                 unsigned tier_threshold, int verbose) {
+    Server S;
+    char err[256];
+    memset(&S, 0, sizeof S);
+    S.flags = flags;
+    S.opts = opts;
+    S.fuel = fuel;
+    S.cache_max = cache_max > 0 ? cache_max : SERVE_CACHE;
+    S.mem_cells = mem_cells;
+    S.stack_slots = stack_slots;
+    S.data_path = data_path;
+    S.tier_threshold = tier_threshold;
+    mutex_init(&S.lock);
+    cond_init(&S.room);
+    int rc = 0;
+    // the first VM up front, to report bad options before serving
+    ServeVM *v = serve_vm_get(&S, NULL, err, sizeof(err));
+    if (!v) { fprintf(stderr, "%s\n", err); rc = 1; }
+    else serve_vm_put(&S, v);
+    if (!rc && !(S.sched = sisa_sched_create(threads, slice))) { fprintf(stderr, "Runtime error: malloc failed\n"); rc = 1; }
+    if (!rc && strcmp(where, "-") != 0) rc = serve_socket(&S, where);
+    else if (!rc) {
+        ServeConn *c = conn_new(&S, stdin, stdout);
+        if (!c) { fprintf(stderr, "Runtime error: malloc failed\n"); rc = 1; }
+        else serve_reader(c);
+    }
+    sisa_sched_free(S.sched);
+    if (verbose) fprintf(stderr, "serve: %zu requests, %zu cache hits, %zu misses, %zu dropped\n",
+                         S.requests, S.hits, S.misses, S.dropped);
+    for (int k = 0; k < S.vms; ++k) {
+        if (S.all[k]->last) cache_put(&S, S.all[k]->last);
+        sisa_destroy(S.all[k]->vm);
+        free(S.all[k]);
+    }
+    while (S.mru) { CacheEntry *E = S.mru; S.mru = E->next; cache_free(E); }
+    cond_free(&S.room);
+    mutex_free(&S.lock);
+    return rc;
+}
+
+// Entrypoint: assemble (or load an image) & run file
+int main(int argc, char **argv) {
+    unsigned flags = 0;
+    int verbose = 0, opt = 1, dump_opt = 0, dump_reg = 0, bench_asm = 0, bench_runs = 0, threads = 0, tier_threshold = 0;
+    int cache_max = 0, stats_fmt = -1;
+    unsigned long long fuel = 0, slice = 0;
+    size_t mem_cells = 0, stack_slots = 0;
+    const char *path = NULL, *save_path = NULL, *batch_path = NULL, *data_path = NULL, *stacks_path = NULL;
+    const char *snap_path = NULL, *restore_path = NULL, *serve_at = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0 || strcmp(argv[i], "-t") == 0) flags |= SISA_RUN_TRACE;
+        else if (strcmp(argv[i], "--no-verify") == 0) flags |= SISA_RUN_NO_VERIFY;
+        else if (strcmp(argv[i], "--jit") == 0) flags |= SISA_RUN_JIT;
+        else if (strcmp(argv[i], "--reg") == 0) flags |= SISA_RUN_REG;
+        else if (strcmp(argv[i], "--tier") == 0) flags |= SISA_RUN_TIER;
+        else if (strcmp(argv[i], "--tier-threshold") == 0 && i + 1 < argc) {
+            flags |= SISA_RUN_TIER;
+            if ((tier_threshold = atoi(argv[++i])) <= 0) { fprintf(stderr, "Bad tier threshold '%s'\n", argv[i]); return 1; }
+        }
+        else if (strcmp(argv[i], "--binary-out") == 0) flags |= SISA_RUN_BINARY_OUT;
+        else if (strcmp(argv[i], "--profile") == 0) flags |= SISA_RUN_PROFILE;
+        else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc) { flags |= SISA_RUN_PROFILE; stacks_path = argv[++i]; }
+        else if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) verbose = 1;
+        else if (strcmp(argv[i], "--no-opt") == 0) opt = 0;
+        else if (strcmp(argv[i], "--dump-opt") == 0) dump_opt = 1;
+        else if (strcmp(argv[i], "--dump-reg") == 0) dump_reg = 1;
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) save_path = argv[++i];
+        else if (strcmp(argv[i], "--bench-asm") == 0) bench_asm = 1;
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            if ((bench_runs = atoi(argv[++i])) <= 0) { fprintf(stderr, "Bad run count '%s'\n", argv[i]); return 1; }
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batch_path = argv[++i];
+        else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) data_path = argv[++i];
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) snap_path = argv[++i];
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) restore_path = argv[++i];
+        else if (strcmp(argv[i], "--vec") == 0 && i + 1 < argc) {
+            const char *v = argv[++i];
+            for (vec_forced = VEC_NISA - 1; vec_forced >= 0 && strcmp(v, vec_isa_name[vec_forced]) != 0; --vec_forced) {}
+            if (vec_forced < 0 || !vec_isa_ok(vec_forced)) { fprintf(stderr, "Vector kernels '%s' not available here\n", v); return 1; }
+        }
+        else if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            if (!parse_cells(argv[++i], &mem_cells)) { fprintf(stderr, "Bad memory size '%s'\n", argv[i]); return 1; }
+        }
+        else if (strcmp(argv[i], "--stack") == 0 && i + 1 < argc) {
+            if (!parse_cells(argv[++i], &stack_slots) || !stack_slots || stack_slots > STACK_LIMIT) {
+                fprintf(stderr, "Bad stack size '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "-j") == 0) && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) serve_at = argv[++i];
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            if ((cache_max = atoi(argv[++i])) <= 0) { fprintf(stderr, "Bad cache size '%s'\n", argv[i]); return 1; }
+        }
+        else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            if (!parse_count(argv[++i], INT64_MAX, &fuel) || !fuel) { fprintf(stderr, "Bad fuel '%s'\n", argv[i]); return 1; }
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            const char *f = argv[++i];
+            if (strcmp(f, "json") == 0) stats_fmt = SISA_STATS_JSON;
+            else if (strcmp(f, "prom") == 0) stats_fmt = SISA_STATS_PROM;
+            else { fprintf(stderr, "Bad stats format '%s' (json or prom)\n", f); return 1; }
+            flags |= SISA_RUN_STATS;
+        }
+        else if (strcmp(argv[i], "--perf") == 0) flags |= SISA_RUN_STATS | SISA_RUN_PERF;
+        else if (strcmp(argv[i], "--slice") == 0 && i + 1 < argc) {
+            if (!parse_count(argv[++i], INT64_MAX, &slice) || !slice) { fprintf(stderr, "Bad slice '%s'\n", argv[i]); return 1; }
+        }
+        else if (argv[i][0] == '-' && argv[i][1]) { fprintf(stderr, "Unknown option '%s'\n", argv[i]); return 1; }
+        else path = argv[i];
+    }
+    if (!path && !serve_at) {
+        printf("Usage: %s [options] <program.asm | image.sbc | ->\n", argv[0]);
+        printf("       %s --serve <socket | -> [options]\n\n", argv[0]);
+        printf("  (-: read the source from stdin)\n");
+        printf("  -t, --trace     print a TRACE line (ip, opcode, stack) before every instruction\n");
+        printf("  --no-verify     run with run-time stack/type checks even if the program verifies\n");
+        printf("  --jit           compile verified programs to x86-64 machine code\n");
+        printf("  --reg           run verified programs on the register IR tier\n");
+        printf("  --tier          interpret verified programs, compiling hot loops and functions to\n");
+        printf("                  machine code in the background as they warm up\n");
+        printf("  --tier-threshold N  --tier, compiling after N arrivals at a loop header or function\n");
+        printf("                  (default %d)\n", TIER_THRESHOLD);
+        printf("  --binary-out    PRINT writes binary records (tag 1 + int32, tag 2 + double) to stdout\n");
+        printf("  --profile       count instructions and clock ticks per opcode, function and label;\n");
+        printf("                  the summary goes to stderr after the run (with --tier: the tier's\n");
+        printf("                  compiles, native entries and exits instead)\n");
+        printf("  --profile-stacks <file>  --profile, plus the counts per call path as collapsed stacks\n");
+        printf("                  for flame graph tools\n");
+        printf("  -v, --verbose   report load-time verification results on stderr\n");
+        printf("  --no-opt        run the program as assembled, without superinstructions\n");
+        printf("  --dump-opt      list the superinstructions the peephole pass made on stderr\n");
+        printf("  --dump-reg      list the register IR of a verified program on stderr\n");
+        printf("  --save <file>   write the assembled program as a binary image and exit\n");
+        printf("  --bench-asm     report assembler throughput (lines/s) on the program and exit\n");
+        printf("  --bench N       time N runs (output discarded) and print instructions/s, ns/instruction\n");
+        printf("                  and assembler lines/s as one JSON line\n");
+        printf("  --batch <file>  run once per line of integers (copied to memory[0..]), outputs in line order\n");
+        printf("  -j, --threads N worker threads for --batch and --serve (default: one per CPU)\n");
+        printf("  --serve <socket | ->  keep running programs for requests, one per line: a program file\n");
+        printf("                  and integers for memory[0..] as in --batch, read from a Unix socket's\n");
+        printf("                  clients or from stdin (-); answers \"seq rc length\", the output and the\n");
+        printf("                  error message if rc is not 0. Prepared programs stay cached\n");
+        printf("  --cache N       --serve: how many prepared programs to keep (default %d)\n", SERVE_CACHE);
+        printf("  --fuel N        stop a run (each run, with --batch and --serve) as a failure once it has\n");
+        printf("                  executed about N instructions, k/m/g suffixes allowed; the run is\n");
+        printf("                  interpreted (--jit, --reg and --tier do not apply)\n");
+        printf("  --slice N       --serve: switch to the next waiting run every N instructions, so long\n");
+        printf("                  runs share the workers with short ones (interpreted, as with --fuel)\n");
+        printf("  --stats <json | prom>  after the run, write its telemetry to stderr as a JSON line or\n");
+        printf("                  Prometheus text: instructions by opcode class, peak stack depths, memory\n");
+        printf("                  cells in use, PRINT bytes, load and run time (interpreted, as with --fuel)\n");
+        printf("  --perf          --stats, plus the CPU's cycles, branch misses and cache misses during the\n");
+        printf("                  run (Linux perf_event_open; left out where it is not allowed)\n");
+        printf("  --mem <cells>   data memory size, k/m/g suffixes allowed (default 4096; larger sizes are\n");
+        printf("                  reserved lazily, so only pages the program touches cost memory)\n");
+        printf("  --stack <slots> value and call stack depth, k/m suffixes allowed (default %u; reserved\n", (unsigned)STACK_MAX);
+        printf("                  lazily like --mem, so deep recursion is bounded by memory)\n");
+        printf("  --data <file>   map file (copy-on-write) into memory after the --mem cells; its length\n");
+        printf("                  in cells and in bytes is in the two cells before it\n");
+        printf("  --snapshot <file>  run up to the first SNAPSHOT instruction, save the VM's state there\n");
+        printf("                  (stacks, position, memory) to file and exit\n");
+        printf("  --restore <file>  start from a --snapshot of the same program instead of the first\n");
+        printf("                  instruction, with its memory (for --batch: every run)\n");
+        printf("  --vec <isa>     vector op kernels: scalar, sse2, avx2 or neon (default: the best\n");
+        printf("                  this CPU has)\n\n");
+        printf("Integer sample: sample_int.asm\n");
+        printf("Float sample:   sample_float.asm\n");
+        return 0;
+    }
+
+    if (restore_path && (mem_cells || data_path || bench_runs)) {
+        fprintf(stderr, "--restore takes the memory from the snapshot; it does not combine with --mem, --data or --bench\n");
+        return 1;
+    }
+    if (snap_path && (batch_path || bench_runs)) { fprintf(stderr, "--snapshot does not combine with --batch or --bench\n"); return 1; }
+    if (slice && !serve_at) { fprintf(stderr, "--slice is for --serve\n"); return 1; }
+    if ((flags & SISA_RUN_STATS) && (serve_at || batch_path || bench_runs || (flags & (SISA_RUN_TRACE | SISA_RUN_PROFILE)))) {
+        fprintf(stderr, "--stats and --perf report a single run; they do not combine with --serve, --batch, --bench,\n"
+                        "--trace or --profile\n");
+        return 1;
+    }
+    if (stats_fmt < 0) stats_fmt = SISA_STATS_JSON;
+    if (fuel && bench_runs) { fprintf(stderr, "--fuel does not combine with --bench\n"); return 1; }
+    if (serve_at) {
+        if (path || batch_path || bench_runs || bench_asm || save_path || snap_path || restore_path
+            || (flags & (SISA_RUN_TRACE | SISA_RUN_PROFILE | SISA_RUN_BINARY_OUT))) {
+            fprintf(stderr, "--serve takes its programs from the requests; it does not combine with a program, --batch,\n"
+                            "--bench, --bench-asm, --save, --snapshot, --restore, --trace, --profile or --binary-out\n");
+            return 1;
+        }
+        unsigned sopts = (verbose ? SISA_LOAD_VERBOSE : 0) | (dump_opt ? SISA_LOAD_DUMP_OPT : 0)
+                       | (dump_reg ? SISA_LOAD_DUMP_REG : 0) | (opt ? 0 : SISA_LOAD_NO_OPT);
+        return serve(serve_at, flags, sopts, threads, slice, fuel, cache_max, mem_cells, stack_slots, data_path,
+                     (unsigned)tier_threshold, verbose) ? 1 : 0;
+    }
+
+    // the same steps as sisa_program_from_file, with the CLI's reports in between
+    char err[256];
+    SisaProgram *P;
+    int rc = program_new(&P, err, sizeof(err));
+    if (!rc && bench_asm) {
+        AsmBench ab;
+        sisa_program_free(P);
+        if (measure_assembler(path, &ab, err, sizeof(err))) { fprintf(stderr, "%s\n", err); return 1; }
+        printf("asm: %zu lines x %d runs in %.3f s: %.0f lines/s, %.1f MB/s\n", ab.lines, ab.runs, ab.sec,
+               (double)ab.lines * ab.runs / ab.sec, (double)ab.bytes * ab.runs / ab.sec / 1e6);
+        return 0;
+    }
+    if (!rc) rc = program_step(P, step_file, path, 0, err, sizeof(err));
+    if (rc) { fprintf(stderr, "%s\n", err); return 1; }
+    // binary output and benchmark results own stdout
+    fprintf(flags & SISA_RUN_BINARY_OUT || bench_runs ? stderr : stdout, "%s %zu bytes.\n", P->map ? "Loaded" : "Assembled", P->code_len);
+    if (save_path) {
+        if (sisa_program_save(P, save_path, err, sizeof(err))) { fprintf(stderr, "%s\n", err); return 1; }
+        printf("Saved %s (%d labels).\n", save_path, P->label_count);
+        sisa_program_free(P);
+        return 0;
+    }
+
+    // a trace follows the program as written
+    unsigned opts = (verbose ? SISA_LOAD_VERBOSE : 0) | (dump_opt ? SISA_LOAD_DUMP_OPT : 0) | (dump_reg ? SISA_LOAD_DUMP_REG : 0)
+                  | (opt && !(flags & SISA_RUN_TRACE) ? 0 : SISA_LOAD_NO_OPT);
+    rc = program_step(P, step_prepare, NULL, opts, err, sizeof(err));
+    if (rc) { fprintf(stderr, "%s\n", err); return 1; }
+    if (verbose) fprintf(stderr, "vector kernels: %s\n", vec_isa_name[vec_isa()]);
+    SisaSnapshot *snap = NULL;
+    if (restore_path && sisa_snapshot_from_file(restore_path, &snap, err, sizeof(err))) { fprintf(stderr, "%s\n", err); return 1; }
+#ifdef _WIN32
+    if (flags & SISA_RUN_BINARY_OUT) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (bench_runs) {
+        AsmBench ab = { 0 };
+        // stdin has been read up by now
+        if (!P->map && strcmp(path, "-") != 0 && measure_assembler(path, &ab, err, sizeof(err))) { fprintf(stderr, "%s\n", err); return 1; }
+        rc = bench_program(P, path, flags & ~(SISA_RUN_TRACE | SISA_RUN_PROFILE), bench_runs, &ab, mem_cells, stack_slots, data_path, (unsigned)tier_threshold);
+        sisa_program_free(P);
+        return rc;
+    }
+    if (batch_path) {
+        size_t stride, nruns, failed = 0;
+        int32_t *inputs = read_batch_inputs(batch_path, snap ? snap->cells : mem_round(mem_cells), &stride, &nruns, err, sizeof(err));
+        if (!inputs) { fprintf(stderr, "%s\n", err); return 1; }
+        struct timespec t0, t1;
+        timespec_get(&t0, TIME_UTC);
+        SisaBatchOpts bo = { mem_cells, data_path, flags, threads, snap, stack_slots, fuel };
+        rc = sisa_run_batch(P, inputs, stride, nruns, &bo, batch_emit, &failed, err, sizeof(err));
+        timespec_get(&t1, TIME_UTC);
+        fflush(stdout);
+        if (rc) fprintf(stderr, "%s\n", err);
+        double sec = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if (verbose) fprintf(stderr, "batch: %zu runs (%zu failed) in %.3f s, %.0f runs/s\n",
+                             nruns, failed, sec, sec > 0 ? nruns / sec : 0.0);
+        free(inputs);
+        sisa_snapshot_free(snap);
+        sisa_program_free(P);
+        return rc || failed ? 1 : 0;
+    }
+    SisaVM *vm = sisa_create();
+    if (!vm) { fprintf(stderr, "Runtime error: malloc failed\n"); return 1; }
+    size_t data_base;
+    if ((stack_slots && sisa_set_stack(vm, stack_slots)) || (!snap && sisa_set_memory(vm, mem_cells))
+        || (data_path && sisa_map_data(vm, data_path, &data_base))) {
+        fprintf(stderr, "%s\n", sisa_error(vm));
+        return 1;
+    }
+    if (data_path && verbose)
+        fprintf(stderr, "data: '%s' at cell %zu (byte %zu), %llu bytes\n", data_path, data_base,
+                data_base * sizeof(int32_t), (unsigned long long)vm->data_bytes);
+    sisa_set_tier(vm, (unsigned)tier_threshold, 1);
+    sisa_load(vm, P);
+    if (snap && sisa_restore(vm, P, snap)) { fprintf(stderr, "%s\n", sisa_error(vm)); return 1; }
+    sisa_set_fuel(vm, fuel);
+    rc = sisa_run(vm, flags | (snap_path ? SISA_RUN_SNAPSHOT : 0));
+    if (rc) fprintf(stderr, "%s\n", sisa_error(vm));
+    if (!rc && snap_path) {
+        SisaSnapshot *out;
+        fflush(stdout);
+        if ((rc = sisa_snapshot_take(vm, &out))) fprintf(stderr, "%s\n", sisa_error(vm));
+        else if ((rc = sisa_snapshot_save(out, snap_path, err, sizeof(err)))) fprintf(stderr, "%s\n", err);
+        else printf("Saved %s (%u of %u memory pages).\n", snap_path, out->npages, out->cells / (uint32_t)SNAP_CELLS);
+        sisa_snapshot_free(out);
+    }
+    if (flags & SISA_RUN_STATS) {              // and its stats
+        fflush(stdout);
+        if (sisa_stats_write(vm, stderr, stats_fmt)) { fprintf(stderr, "%s\n", sisa_error(vm)); rc = 1; }
+    }
+    if ((flags & SISA_RUN_PROFILE) && !(flags & SISA_RUN_TRACE)) {  // a failed run still has its profile
+        FILE *st = stacks_path ? fopen(stacks_path, "w") : NULL;
+        fflush(stdout);
+        if (stacks_path && !st) { fprintf(stderr, "Failed to open '%s'\n", stacks_path); rc = 1; }
+        else if (sisa_profile_write(vm, stderr, st)) { fprintf(stderr, "%s\n", sisa_error(vm)); rc = 1; }
+        if (st && fclose(st)) { fprintf(stderr, "Failed to write '%s'\n", stacks_path); rc = 1; }
+    }
+    sisa_destroy(vm);
+    sisa_snapshot_free(snap);
+    sisa_program_free(P);
+    return rc ? 1 : 0;
+}
+#endif
@@ -0,0 +1,486 @@
+// vm_loop.h - interpreter loop template
+// Included by vm.c once per loop variant (no include guard on purpose).
+// Before including, define:
+//   VM_LOOP_NAME   name of the generated function
+//   VM_LOOP_TRACE  1 to emit the per-instruction TRACE line, 0 for the fast path
+//   VM_LOOP_PROF   1 to call the profiler hook before every instruction
+//   VM_LOOP_CHECKED 1 for run-time stack depth and type checks, 0 for code
+//                  that passed verify_program()
+//   VM_LOOP_TIER   1 to count arrivals at backward-branch and call targets
+//                  and stop at the target whose count runs out (see run_tier)
+//   VM_LOOP_FUEL   1 to charge vm->fuel at taken jumps, calls and returns and
+//                  stop, to be resumed, once it is used up (see sisa_set_fuel)
+//   VM_LOOP_STATS  1 (with VM_LOOP_FUEL) to record the straight lines fuel pays
+//                  for and the deepest stacks in vm->stats (SISA_RUN_STATS)
+// VM_THREADED (set by vm.c) selects computed-goto dispatch or the switch loop.
+//
+// The generated function runs vm->p's pre-decoded prog[] array on vm's
+// stacks and memory, from insn vm->ip (0 unless a snapshot was restored or
+// the last run ran out of fuel):
+// operands are already decoded and jump targets are instruction indices
+// checked by decode_program(), and prog[prog_len] is a HALT sentinel, so
+// handlers do no bounds or truncation checks of their own.
+
+#if VM_LOOP_TRACE
+#define VM_TRACE_HOOK() trace_insn(vm, pc)
+#elif VM_LOOP_PROF
+#define VM_TRACE_HOOK() prof_insn(vm->prof, prog, pc)
+#elif VM_LOOP_STATS
+#define VM_TRACE_HOOK() do { \
+        if ((uint32_t)VM_DEPTH() > st->s.peak_sp) st->s.peak_sp = (uint32_t)VM_DEPTH(); \
+        st->at = pc;                   /* for a run that faults in the line */ \
+    } while (0)
+#else
+#define VM_TRACE_HOOK() ((void)0)
+#endif
+
+// Stack access. Handlers address the value k slots below the top, drop
+// values and overwrite the top; each mode maps that onto its own storage.
+#if VM_LOOP_CHECKED
+// vm->sp / stack[], every access depth- and tag-checked
+#define VM_VAL(k)          val_at_checked(vm, k)
+#define VM_INT(k, name)    int_at_checked(vm, k, name)
+#define VM_FLT(k, name)    float_at_checked(vm, k, name)
+#define VM_DROP(n)         (vm->sp -= (n))
+#define VM_SET_INT(x)      (stack[vm->sp-1] = mk_int(x))
+#define VM_SET_FLT(x)      (stack[vm->sp-1] = mk_float(x))
+#define VM_PUSH_INT(x)     push_int(vm, x)
+#define VM_PUSH_FLT(x)     push_float(vm, x)
+#define VM_DUP()           push_from_value(vm, peek_val(vm))
+#define VM_DEPTH()         vm->sp
+#define VM_SYNC()          (vm->csp = csp)
+#define VM_CHECK(c, msg)   do { if (!(c)) runtime_err(msg); } while (0)
+// a superinstruction that stands for a PUSH first checks the PUSH had room
+#define VM_ROOM()          VM_CHECK(vm->sp < stack_max, "stack overflow")
+#else
+// verified code: the top of stack lives in the local tos and s points at its
+// home slot (stale until spilled), so a binary op is one load and no store.
+// An empty stack parks s on the guard slot stack[-1].
+#define VM_VAL(k)          ((k) == 0 ? tos : s[-(k)])
+#define VM_INT(k, name)    ((k) == 0 ? VAL_I(tos) : VAL_I(s[-(k)]))
+#define VM_FLT(k, name)    ((k) == 0 ? VAL_F(tos) : VAL_F(s[-(k)]))
+#define VM_DROP(n)         (s -= (n), tos = *s)
+#define VM_SET_INT(x)      (tos = mk_int(x))
+#define VM_SET_FLT(x)      (tos = mk_float(x))
+#define VM_PUSH_INT(x)     (*s++ = tos, tos = mk_int(x))
+#define VM_PUSH_FLT(x)     (*s++ = tos, tos = mk_float(x))
+#define VM_DUP()           (*s++ = tos)
+#define VM_DEPTH()         ((int)(s - stack) + 1)
+#define VM_SYNC()          (*s = tos, vm->sp = VM_DEPTH(), vm->csp = csp)
+#define VM_CHECK(c, msg)   ((void)0)
+#define VM_ROOM()          ((void)0)
+#endif
+
+#if VM_LOOP_TIER
+// tier counters: stop at target t, synced, for run_tier to look at; kind is
+// TIER_LOOP or TIER_CALL
+#define VM_HOT(t, kind)    do { if (--hot[t] == 0) { VM_SYNC(); vm->tier->ip = (t); vm->tier->event = (kind); return; } } while (0)
+#define VM_HOT_BACK(t)     do { if ((t) <= (uint32_t)(pc - prog)) VM_HOT(t, TIER_LOOP); } while (0)
+#else
+#define VM_HOT(t, kind)    ((void)0)
+#define VM_HOT_BACK(t)     ((void)0)
+#endif
+
+#if VM_LOOP_FUEL
+// fuel: a transfer pays for the straight line of insns since the last one
+// (from seg), so the count is exact though only taken branches pay, and a
+// run that faults has paid up to its last transfer. Once it is used up the
+// run stops, synced, at the target.
+#define VM_FUEL(t) do { \
+        VM_LINE(); vm->fuel = fuel -= pc - seg + 1; VM_SEG(seg = prog + (t)); \
+        if (fuel <= 0) { VM_SYNC(); vm->ip = (t); vm->yielded = 1; return; } \
+    } while (0)
+#define VM_FUEL_END()      (VM_LINE(), vm->fuel = fuel - (pc - seg + 1))
+#else
+#define VM_FUEL(t)         ((void)0)
+#define VM_FUEL_END()      ((void)0)
+#endif
+
+#if VM_LOOP_STATS
+// the line [seg, pc] ran once more: +1 at its start and -1 after its end, so
+// that stats_stop's running sum over them is each insn's count. The call
+// stack only grows at a transfer.
+#define VM_LINE()          (++line[seg - prog], --line[pc - prog + 1], \
+                            st->s.peak_csp = (uint32_t)csp > st->s.peak_csp ? (uint32_t)csp : st->s.peak_csp)
+#define VM_SEG(x)          (st->seg = (x))
+#else
+#define VM_LINE()          ((void)0)
+#define VM_SEG(x)          (x)
+#endif
+
+#if VM_THREADED
+// One indirect jump per handler: each gets its own branch-predictor entry.
+#define VM_CASE(o) L_##o
+#define VM_DEFAULT L_BAD
+#define VM_DISPATCH() do { VM_TRACE_HOOK(); goto *dispatch[pc->op]; } while (0)
+#define VM_NEXT() do { pc++; VM_DISPATCH(); } while (0)
+#define VM_JUMP(t) do { VM_FUEL(t); pc = prog + (t); VM_DISPATCH(); } while (0)
+#else
+// plain blocks, not do/while(0): continue must reach the dispatch loop
+#define VM_CASE(o) case o
+#define VM_DEFAULT default
+#define VM_NEXT() { pc++; continue; }
+#define VM_JUMP(t) { VM_FUEL(t); pc = prog + (t); continue; }
+#endif
+
+static void VM_LOOP_NAME(SisaVM *vm) {
+#if VM_THREADED
+    static const void *const dispatch[256] = {
+        [OP_NOP] = &&L_OP_NOP,     [OP_PUSH] = &&L_OP_PUSH,   [OP_PUSHF] = &&L_OP_PUSHF,
+        [OP_ADD] = &&L_OP_ADD,     [OP_SUB] = &&L_OP_SUB,     [OP_MUL] = &&L_OP_MUL,
+        [OP_DIV] = &&L_OP_DIV,     [OP_MOD] = &&L_OP_MOD,     [OP_INC] = &&L_OP_INC,
+        [OP_DEC] = &&L_OP_DEC,     [OP_NEG] = &&L_OP_NEG,     [OP_ADDF] = &&L_OP_ADDF,
+        [OP_MULF] = &&L_OP_MULF,   [OP_DUP] = &&L_OP_DUP,     [OP_PRINT] = &&L_OP_PRINT,
+        [OP_POP] = &&L_OP_POP,     [OP_LOAD] = &&L_OP_LOAD,   [OP_STORE] = &&L_OP_STORE,
+        [OP_JMP] = &&L_OP_JMP,     [OP_JZ] = &&L_OP_JZ,       [OP_CALL] = &&L_OP_CALL,
+        [OP_RET] = &&L_OP_RET,     [OP_LOADB] = &&L_OP_LOADB, [OP_HALT] = &&L_OP_HALT,
+        [OP_LOADF] = &&L_OP_LOADF, [OP_STOREF] = &&L_OP_STOREF, [OP_MEMCPY] = &&L_OP_MEMCPY,
+        [OP_MEMSET] = &&L_OP_MEMSET, [OP_MEMCMP] = &&L_OP_MEMCMP,
+        [OP_VADD] = &&L_OP_VADD,   [OP_VMUL] = &&L_OP_VMUL,   [OP_VDOT] = &&L_OP_VDOT,
+        [OP_VSUM] = &&L_OP_VSUM,   [OP_VADDF] = &&L_OP_VADDF, [OP_VMULF] = &&L_OP_VMULF,
+        [OP_VDOTF] = &&L_OP_VDOTF, [OP_VSUMF] = &&L_OP_VSUMF, [OP_SNAPSHOT] = &&L_OP_SNAPSHOT,
+        [OP_ADDI] = &&L_OP_ADDI,   [OP_SUBI] = &&L_OP_SUBI,   [OP_LOADI] = &&L_OP_LOADI,
+        [OP_SUBF] = &&L_OP_SUBF,   [OP_DIVF] = &&L_OP_DIVF,   [OP_NEGF] = &&L_OP_NEGF,
+        [OP_FMAF] = &&L_OP_FMAF,   [OP_ITOF] = &&L_OP_ITOF,   [OP_FTOI] = &&L_OP_FTOI,
+        [OP_CMP] = &&L_OP_CMP,     [OP_JE] = &&L_OP_JE,       [OP_JNE] = &&L_OP_JNE,
+        [OP_JL] = &&L_OP_JL,       [OP_JLE] = &&L_OP_JLE,     [OP_JG] = &&L_OP_JG,
+        [OP_JGE] = &&L_OP_JGE,     [OP_CALLN] = &&L_OP_CALLN,
+        [OP_STOREI] = &&L_OP_STOREI, [OP_DUPJZ] = &&L_OP_DUPJZ, [OP_TCALL] = &&L_OP_TCALL,
+        // the rest: decode turns PUSH8 / PUSH16 / PUSHK into PUSH; no overlaps, so
+        // -Wextra reports a slot given twice
+        [OP_PUSH8 ... OP_PUSHK] = &&L_BAD,
+        [OP_CALLN + 1 ... OP_ADDI - 1] = &&L_BAD, [OP_TCALL + 1 ... OP_HALT - 1] = &&L_BAD,
+    };
+#endif
+    const Insn *const prog = vm->p->prog;
+    Value *const stack = vm->stack;
+    uint32_t *const callstack = vm->callstack;
+    int32_t *const memory_arr = vm->memory;
+    const uint32_t mem_mask = vm->mem_mask;  // LOAD/STORE: one unsigned compare
+    const Native *const natives = vm->p->natives;
+    const int stack_max = vm->stack_max;
+    int csp = vm->csp;
+#if VM_LOOP_TIER
+    int32_t *const hot = vm->tier->hot;
+    const Insn *pc = prog + vm->tier->ip;
+#else
+    const Insn *pc = prog + vm->ip;
+#endif
+#if VM_LOOP_FUEL
+    int64_t fuel = vm->fueled ? vm->fuel : INT64_MAX;
+    const Insn *seg = pc;
+#endif
+#if VM_LOOP_STATS
+    RunStats *const st = vm->stats;
+    uint64_t *const line = st->line;
+    st->seg = seg;
+#endif
+#if !VM_LOOP_CHECKED
+    Value *s = stack + vm->sp - 1;
+    Value tos = *s;
+#endif
+#if VM_THREADED
+    VM_DISPATCH();
+#else
+    for (;;) {
+        VM_TRACE_HOOK();
+        switch(pc->op) {
+#endif
+            VM_CASE(OP_NOP): VM_NEXT();
+            VM_CASE(OP_PUSH): VM_PUSH_INT(pc->a.i); VM_NEXT();
+            VM_CASE(OP_PUSHF): VM_PUSH_FLT(pc->a.f); VM_NEXT();
+            // binary int ops: a is the top, b the value below it; b op a
+            // replaces both (checks run a first, then b)
+            VM_CASE(OP_ADD): {
+                int32_t a = VM_INT(0, "ADD"), b = VM_INT(1, "ADD");
+                VM_DROP(1); VM_SET_INT(int_add(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_SUB): {
+                int32_t a = VM_INT(0, "SUB"), b = VM_INT(1, "SUB");
+                VM_DROP(1); VM_SET_INT(int_sub(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_MUL): {
+                int32_t a = VM_INT(0, "MUL"), b = VM_INT(1, "MUL");
+                VM_DROP(1); VM_SET_INT(int_mul(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_DIV): {
+                int32_t a = VM_INT(0, "DIV"), b = VM_INT(1, "DIV");
+                if (a == 0) runtime_err("division by zero");
+                VM_DROP(1); VM_SET_INT(int_div(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_MOD): {
+                int32_t a = VM_INT(0, "MOD"), b = VM_INT(1, "MOD");
+                if (a == 0) runtime_err("modulo by zero");
+                VM_DROP(1); VM_SET_INT(int_mod(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_INC): {
+                Value v = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(v), "INC expects integer");
+                VM_SET_INT(int_add(VAL_I(v), 1));
+                VM_NEXT();
+            }
+            VM_CASE(OP_DEC): {
+                Value v = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(v), "DEC expects integer");
+                VM_SET_INT(int_sub(VAL_I(v), 1));
+                VM_NEXT();
+            }
+            VM_CASE(OP_NEG): {
+                Value v = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(v), "NEG expects integer");
+                VM_SET_INT(int_sub(0, VAL_I(v)));
+                VM_NEXT();
+            }
+            VM_CASE(OP_ADDF): {
+                double a = VM_FLT(0, "ADDF"), b = VM_FLT(1, "ADDF");
+                VM_DROP(1); VM_SET_FLT(flt_result(b + a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_MULF): {
+                double a = VM_FLT(0, "MULF"), b = VM_FLT(1, "MULF");
+                VM_DROP(1); VM_SET_FLT(flt_result(b * a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_SUBF): {
+                double a = VM_FLT(0, "SUBF"), b = VM_FLT(1, "SUBF");
+                VM_DROP(1); VM_SET_FLT(flt_result(b - a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_DIVF): {
+                double a = VM_FLT(0, "DIVF"), b = VM_FLT(1, "DIVF");
+                VM_DROP(1); VM_SET_FLT(flt_result(b / a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_NEGF): { double a = VM_FLT(0, "NEGF"); VM_SET_FLT(-a); VM_NEXT(); }
+            VM_CASE(OP_FMAF): {
+                double c = VM_FLT(0, "FMAF"), b = VM_FLT(1, "FMAF"), a = VM_FLT(2, "FMAF");
+                VM_DROP(2); VM_SET_FLT(flt_result(vm_fma(a, b, c)));
+                VM_NEXT();
+            }
+            VM_CASE(OP_ITOF): { int32_t a = VM_INT(0, "ITOF"); VM_SET_FLT((double)a); VM_NEXT(); }
+            VM_CASE(OP_FTOI): {
+                double a = VM_FLT(0, "FTOI");
+                if (!ftoi_ok(a)) runtime_err("FTOI out of range");
+                VM_SET_INT((int32_t)a);
+                VM_NEXT();
+            }
+            VM_CASE(OP_CMP): {
+                Value a = VM_VAL(0), b = VM_VAL(1);
+                VM_DROP(1); VM_SET_INT(val_cmp(b, a));
+                VM_NEXT();
+            }
+            VM_CASE(OP_DUP): VM_DUP(); VM_NEXT();
+            VM_CASE(OP_PRINT): {
+                Value v = VM_VAL(0);
+                VM_DROP(1);
+                vm_print(vm, v);
+                VM_NEXT();
+            }
+            VM_CASE(OP_POP): { (void)VM_VAL(0); VM_DROP(1); VM_NEXT(); }
+            VM_CASE(OP_LOAD): {
+                // pop addr (int) and push memory[addr] as int
+                Value a = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(a), "LOAD expects integer address");
+                int32_t addr = VAL_I(a);
+                if ((uint32_t)addr > mem_mask) runtime_err("LOAD address out of bounds");
+                VM_SET_INT(memory_arr[addr]);
+                VM_NEXT();
+            }
+            VM_CASE(OP_LOADB): {
+                // pop byte addr (int) and push that byte of memory
+                Value a = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(a), "LOADB expects integer address");
+                int32_t addr = VAL_I(a);
+                if (addr < 0 || (uint32_t)addr >> 2 > mem_mask) runtime_err("LOADB address out of bounds");
+                VM_SET_INT(((const uint8_t *)memory_arr)[addr]);
+                VM_NEXT();
+            }
+            VM_CASE(OP_STORE): {
+                // pop addr (int), pop value (int required) and store memory[addr]=value
+                Value addrv = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(addrv), "STORE expects integer address");
+                int32_t addr = VAL_I(addrv);
+                if ((uint32_t)addr > mem_mask) runtime_err("STORE address out of bounds");
+                Value val = VM_VAL(1);
+                VM_CHECK(VAL_IS_INT(val), "STORE currently supports integers only");
+                memory_arr[addr] = VAL_I(val);
+                VM_DROP(2);
+                VM_NEXT();
+            }
+            VM_CASE(OP_LOADF): {
+                // pop addr (int) and push the double in memory[addr..addr+1]
+                Value a = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(a), "LOADF expects integer address");
+                int32_t addr = VAL_I(a);
+                if ((uint32_t)addr >= mem_mask) runtime_err("LOADF address out of bounds");
+                double f;
+                memcpy(&f, memory_arr + addr, sizeof(f));
+                VM_SET_FLT(val_from_double(f));
+                VM_NEXT();
+            }
+            VM_CASE(OP_STOREF): {
+                // pop addr (int), pop value (float required) into memory[addr..addr+1]
+                Value addrv = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(addrv), "STOREF expects integer address");
+                int32_t addr = VAL_I(addrv);
+                if ((uint32_t)addr >= mem_mask) runtime_err("STOREF address out of bounds");
+                double f = VM_FLT(1, "STOREF");
+                memcpy(memory_arr + addr, &f, sizeof(f));
+                VM_DROP(2);
+                VM_NEXT();
+            }
+            // block ops: one out-of-line call on the synced stack (see block_op)
+            VM_CASE(OP_MEMCPY): VM_CASE(OP_MEMSET): VM_CASE(OP_MEMCMP):
+            VM_CASE(OP_VADD): VM_CASE(OP_VMUL): VM_CASE(OP_VADDF): VM_CASE(OP_VMULF):
+            VM_CASE(OP_VDOT): VM_CASE(OP_VSUM): VM_CASE(OP_VDOTF): VM_CASE(OP_VSUMF): {
+                int k = block_arity(pc->op);
+#if VM_LOOP_CHECKED
+                for (int j = 0; j < k; ++j) (void)VM_INT(j, op_name(pc->op));
+#endif
+                VM_SYNC();
+                if (!block_op(memory_arr, mem_mask, pc->op, stack + vm->sp)) block_fail(pc->op);
+                VM_DROP(k - block_results(pc->op));
+                VM_NEXT();
+            }
+            // host function: called on the synced stack with its arguments in
+            // place, types and room already proven for verified code
+            VM_CASE(OP_CALLN): {
+                const Native *N = &natives[pc->a.i];
+#if VM_LOOP_CHECKED
+                native_check(vm, N);
+#endif
+                VM_SYNC();
+                int rc = N->fn(N->user, (SisaValue *)(stack + vm->sp - N->nargs), memory_arr, (size_t)mem_mask + 1);
+                if (rc) native_fail(N, rc);
+                VM_DROP(N->nargs - N->nres);
+                VM_NEXT();
+            }
+            VM_CASE(OP_JMP): VM_HOT_BACK(pc->a.t); VM_JUMP(pc->a.t);
+            VM_CASE(OP_JZ): {
+                Value v = VM_VAL(0);
+                VM_DROP(1);
+                int is_zero = 0;
+                if (VAL_IS_INT(v)) is_zero = (VAL_I(v) == 0);
+                else is_zero = (VAL_F(v) == 0.0);
+                if (is_zero) { VM_HOT_BACK(pc->a.t); VM_JUMP(pc->a.t); }
+                VM_NEXT();
+            }
+            // compare-and-jump: b op a, as ints or else as doubles (see val_jcc)
+#define VM_JCC(o, rel) \
+            VM_CASE(o): { \
+                Value a = VM_VAL(0), b = VM_VAL(1); \
+                VM_DROP(2); \
+                if (VAL_IS_INT(a) && VAL_IS_INT(b) ? VAL_I(b) rel VAL_I(a) : val_num(b) rel val_num(a)) { \
+                    VM_HOT_BACK(pc->a.t); VM_JUMP(pc->a.t); \
+                } \
+                VM_NEXT(); \
+            }
+            VM_JCC(OP_JE, ==)
+            VM_JCC(OP_JNE, !=)
+            VM_JCC(OP_JL, <)
+            VM_JCC(OP_JLE, <=)
+            VM_JCC(OP_JG, >)
+            VM_JCC(OP_JGE, >=)
+#undef VM_JCC
+            VM_CASE(OP_CALL): {
+                if (csp >= stack_max) runtime_err("call stack overflow");
+#if !VM_LOOP_CHECKED
+                // verified callee: one headroom test instead of one per push
+                if (VM_DEPTH() + pc->aux > stack_max) runtime_err("stack overflow");
+#endif
+                callstack[csp++] = (uint32_t)(pc - prog) + 1;
+                VM_HOT(pc->a.t, TIER_CALL);
+                VM_JUMP(pc->a.t);
+            }
+            VM_CASE(OP_RET): {
+                if (csp <= 0) runtime_err("call stack underflow");
+                uint32_t t = callstack[--csp];
+                VM_JUMP(t);
+            }
+            // superinstructions (see optimize_program); checks and messages
+            // are those of the pair they replace
+            VM_CASE(OP_ADDI): {
+                VM_ROOM();
+                int32_t b = VM_INT(0, "ADD");
+                VM_SET_INT(int_add(b, pc->a.i));
+                VM_NEXT();
+            }
+            VM_CASE(OP_SUBI): {
+                VM_ROOM();
+                int32_t b = VM_INT(0, "SUB");
+                VM_SET_INT(int_sub(b, pc->a.i));
+                VM_NEXT();
+            }
+            VM_CASE(OP_LOADI): VM_ROOM(); VM_PUSH_INT(memory_arr[pc->a.i]); VM_NEXT();
+            VM_CASE(OP_STOREI): {
+                VM_ROOM();
+                Value val = VM_VAL(0);
+                VM_CHECK(VAL_IS_INT(val), "STORE currently supports integers only");
+                memory_arr[pc->a.i] = VAL_I(val);
+                VM_DROP(1);
+                VM_NEXT();
+            }
+            VM_CASE(OP_DUPJZ): {
+                VM_CHECK(VM_DEPTH() > 0, "stack underflow (peek)");
+                VM_ROOM();
+                Value v = VM_VAL(0);
+                if (VAL_IS_INT(v) ? VAL_I(v) == 0 : VAL_F(v) == 0.0) { VM_HOT_BACK(pc->a.t); VM_JUMP(pc->a.t); }
+                VM_NEXT();
+            }
+            // CALL; RET (see call_pass): the callee returns to our caller, so
+            // nothing goes on the call stack
+            VM_CASE(OP_TCALL):
+#if !VM_LOOP_CHECKED
+                if (VM_DEPTH() + pc->aux > stack_max) runtime_err("stack overflow");
+#endif
+                VM_HOT(pc->a.t, TIER_CALL);
+                VM_JUMP(pc->a.t);
+            VM_CASE(OP_SNAPSHOT):
+                if (vm->snap_stop) { VM_FUEL_END(); VM_SYNC(); vm->ip = (uint32_t)(pc - prog) + 1; vm->at_snapshot = 1; return; }
+                VM_NEXT();
+            VM_CASE(OP_HALT): VM_FUEL_END(); VM_SYNC(); return;
+            VM_DEFAULT:
+                sisa_fail(SISA_ERR_BYTECODE, "Unknown opcode %02X at %u", pc->op, pc->off);
+#if !VM_THREADED
+        }
+    }
+#endif
+}
+
+#undef VM_TRACE_HOOK
+#undef VM_VAL
+#undef VM_INT
+#undef VM_FLT
+#undef VM_DROP
+#undef VM_SET_INT
+#undef VM_SET_FLT
+#undef VM_PUSH_INT
+#undef VM_PUSH_FLT
+#undef VM_DUP
+#undef VM_DEPTH
+#undef VM_SYNC
+#undef VM_CHECK
+#undef VM_ROOM
+#undef VM_HOT
+#undef VM_HOT_BACK
+#undef VM_FUEL
+#undef VM_FUEL_END
+#undef VM_LINE
+#undef VM_SEG
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP
+#undef VM_LOOP_NAME
+#undef VM_LOOP_TRACE
+#undef VM_LOOP_PROF
+#undef VM_LOOP_CHECKED
+#undef VM_LOOP_TIER
+#undef VM_LOOP_FUEL
+#undef VM_LOOP_STATS
@@ -0,0 +1,29 @@
+#!/bin/sh
+# batch.sh - --batch runs one program per input line; values must fit 32 bits
+# (an int32, or a uint32 for its bits), anything else fails the batch
+# Usage: tests/batch.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL batch ($1): $2" >&2; status=1; }
+
+printf '1 2\n0xFFFFFFFF -2147483648\n2147483647 0\n' > "$tmp/ok"
+printf '3\n2147483647\n2147483647\n' > "$tmp/want"
+for flags in "" "--no-verify" "-j 2"; do
+    "$tmp/vm" --batch "$tmp/ok" $flags "$here/serve_add.asm" 2> "$tmp/err" | sed '/^Assembled /d' > "$tmp/got"
+    cmp -s "$tmp/got" "$tmp/want" || { fail "$flags" "got '$(cat "$tmp/got" | tr '\n' ' ')'"; cat "$tmp/err" >&2; }
+done
+for v in 99999999999999 4294967296 -2147483649 0x100000000 x; do
+    printf '1 2\n1 %s\n' "$v" > "$tmp/bad"
+    "$tmp/vm" --batch "$tmp/bad" "$here/serve_add.asm" > "$tmp/got" 2> "$tmp/err"
+    rc=$?
+    want="Batch input error: bad number at $tmp/bad:2"
+    [ $rc -ne 0 ] && grep -qxF "$want" "$tmp/err" || fail "$v" "exit status $rc, stderr '$(cat "$tmp/err")'"
+done
+[ $status -eq 0 ] && echo "batch tests passed" >&2
+exit $status
@@ -0,0 +1,9 @@
+; calln_arity.asm - a CALLN with too few arguments for the native is
+; rejected by the verifier and faults before the call
+; expect:
+; error: Runtime error: stack underflow
+; verify: rejected
+PUSH 4
+CALLN hash
+PRINT
+HALT
@@ -0,0 +1,34 @@
+; calln_builtin.asm - the built-in natives read the memory the program just
+; stored and leave their results in place of their arguments
+; expect: 9 12 42 47 -345 -1730920959 9
+; verify: ok
+PUSH 9       ; below the arguments, untouched
+PUSH 757084721
+PUSH 10
+STORE        ; bytes 40..43: "12 -"
+PUSH 3486771
+PUSH 11
+STORE        ; bytes 44..47: "345\0"
+PUSHF 81.0
+CALLN sqrt
+FTOI
+PRINT        ; 9
+PUSH 40
+CALLN atoi   ; 12 and the address after it
+PUSH 1
+STORE
+PRINT        ; 12
+PUSH 1
+LOAD
+PRINT        ; 42
+PUSH 1
+LOAD
+CALLN atoi   ; skips the blank
+PRINT        ; 47
+PRINT        ; -345
+PUSH 40
+PUSH 7
+CALLN hash   ; FNV-1a of "12 -345"
+PRINT
+PRINT        ; 9
+HALT
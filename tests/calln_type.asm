@@ -0,0 +1,11 @@
+; calln_type.asm - a CALLN whose argument does not fit the native's signature
+; is rejected by the verifier and faults before the call
+; expect: 2
+; error: sqrt expects float on stack
+; verify: rejected
+PUSH 2
+PRINT
+PUSH 4
+CALLN sqrt
+PRINT
+HALT
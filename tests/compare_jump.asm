@@ -0,0 +1,344 @@
+; compare_jump.asm - JE..JGE and CMP on ints, mixed operands, -0.0 and NaN,
+; each taking or falling through as the comparison says; operands come from
+; literals and from memory so no engine can fold them all
+; expect: 1 0 0 1 1 0 1 0 1 1 0 1 0 0 0 0 0 1 1 -1 1 0 0 0 0 1 1 2000 0 500 499 1499
+PUSHF nan
+PUSH 0
+STOREF       ; memory[0..1] = NaN
+PUSHF -0.0
+PUSH 2
+STOREF       ; memory[2..3] = -0.0
+PUSHF 0.0
+PUSH 4
+STOREF       ; memory[4..5] = 0.0
+c0:               ; ints: 2 < 3
+    PUSH 2
+    PUSH 3
+    JL t0
+    PUSH 0
+    PRINT
+    JMP c1
+t0:
+    PUSH 1
+    PRINT
+c1:
+    PUSH 2
+    PUSH 3
+    JG t1
+    PUSH 0
+    PRINT
+    JMP c2
+t1:
+    PUSH 1
+    PRINT
+c2:
+    PUSH 2
+    PUSH 3
+    JE t2
+    PUSH 0
+    PRINT
+    JMP c3
+t2:
+    PUSH 1
+    PRINT
+c3:
+    PUSH 2
+    PUSH 3
+    JNE t3
+    PUSH 0
+    PRINT
+    JMP c4
+t3:
+    PUSH 1
+    PRINT
+c4:
+    PUSH 3
+    PUSH 3
+    JLE t4
+    PUSH 0
+    PRINT
+    JMP c5
+t4:
+    PUSH 1
+    PRINT
+c5:
+    PUSH 2
+    PUSH 3
+    JGE t5
+    PUSH 0
+    PRINT
+    JMP c6
+t5:
+    PUSH 1
+    PRINT
+c6:               ; -0.0 == 0.0
+    PUSHF -0.0
+    PUSHF 0.0
+    JE t6
+    PUSH 0
+    PRINT
+    JMP c7
+t6:
+    PUSH 1
+    PRINT
+c7:
+    PUSHF -0.0
+    PUSHF 0.0
+    JL t7
+    PUSH 0
+    PRINT
+    JMP c8
+t7:
+    PUSH 1
+    PRINT
+c8:               ; mixed: as doubles
+    PUSHF -0.0
+    PUSH 0
+    JGE t8
+    PUSH 0
+    PRINT
+    JMP c9
+t8:
+    PUSH 1
+    PRINT
+c9:
+    PUSH 2
+    PUSHF 2.5
+    JL t9
+    PUSH 0
+    PRINT
+    JMP c10
+t9:
+    PUSH 1
+    PRINT
+c10:               ; NaN: unordered, only JNE jumps
+    PUSHF nan
+    PUSHF 1.0
+    JE t10
+    PUSH 0
+    PRINT
+    JMP c11
+t10:
+    PUSH 1
+    PRINT
+c11:
+    PUSHF nan
+    PUSHF 1.0
+    JNE t11
+    PUSH 0
+    PRINT
+    JMP c12
+t11:
+    PUSH 1
+    PRINT
+c12:
+    PUSHF nan
+    PUSHF 1.0
+    JL t12
+    PUSH 0
+    PRINT
+    JMP c13
+t12:
+    PUSH 1
+    PRINT
+c13:
+    PUSHF nan
+    PUSHF 1.0
+    JLE t13
+    PUSH 0
+    PRINT
+    JMP c14
+t13:
+    PUSH 1
+    PRINT
+c14:
+    PUSHF 1.0
+    PUSHF nan
+    JG t14
+    PUSH 0
+    PRINT
+    JMP c15
+t14:
+    PUSH 1
+    PRINT
+c15:
+    PUSHF -nan
+    PUSHF -nan
+    JGE t15
+    PUSH 0
+    PRINT
+    JMP c16
+t15:
+    PUSH 1
+    PRINT
+c16:               ; NaN from memory
+    PUSH 0
+    LOADF
+    PUSH 0
+    LOADF
+    JE t16
+    PUSH 0
+    PRINT
+    JMP c17
+t16:
+    PUSH 1
+    PRINT
+c17:
+    PUSH 0
+    LOADF
+    PUSH 2
+    LOADF
+    JNE t17
+    PUSH 0
+    PRINT
+    JMP c18
+t17:
+    PUSH 1
+    PRINT
+c18:               ; -0.0 from memory >= 0.0
+    PUSH 2
+    LOADF
+    PUSH 4
+    LOADF
+    JGE t18
+    PUSH 0
+    PRINT
+    JMP c19
+t18:
+    PUSH 1
+    PRINT
+c19:
+PUSH 2
+PUSH 3
+CMP
+PRINT        ; -1
+PUSHF 3.5
+PUSH 3
+CMP
+PRINT        ; 1
+PUSHF -0.0
+PUSHF 0.0
+CMP
+PRINT        ; 0
+PUSH 0
+LOADF
+PUSHF 1.0
+CMP
+PRINT        ; 0: unordered
+PUSHF 1.0
+PUSH 0
+LOADF
+CMP
+PRINT        ; 0
+PUSH 2
+LOADF
+PUSH 4
+LOADF
+CMP
+PRINT        ; 0
+PUSHF 1e300
+PUSHF -inf
+CMP
+PRINT        ; 1
+
+; the same compares in a loop long enough for --tier to compile it: for
+; i < 2000 with x = ITOF(i), count x == -0.0, x != NaN, x >= NaN, x < 500.0
+; and i > 1500, and sum CMP(x, 250.0)
+PUSH 0
+PUSH 10
+STORE        ; memory[10] = i; memory[11..16] = the counts
+loop:
+    PUSH 10
+    LOAD
+    ITOF
+    PUSH 2
+    LOADF
+    JE k1
+    JMP n1
+k1: PUSH 11
+    LOAD
+    INC
+    PUSH 11
+    STORE
+n1: PUSH 10
+    LOAD
+    ITOF
+    PUSH 0
+    LOADF
+    JNE k2
+    JMP n2
+k2: PUSH 12
+    LOAD
+    INC
+    PUSH 12
+    STORE
+n2: PUSH 10
+    LOAD
+    ITOF
+    PUSH 0
+    LOADF
+    JGE k3
+    JMP n3
+k3: PUSH 13
+    LOAD
+    INC
+    PUSH 13
+    STORE
+n3: PUSH 10
+    LOAD
+    ITOF
+    PUSHF 500.0
+    JL k4
+    JMP n4
+k4: PUSH 14
+    LOAD
+    INC
+    PUSH 14
+    STORE
+n4: PUSH 10
+    LOAD
+    PUSH 1500
+    JG k5
+    JMP n5
+k5: PUSH 15
+    LOAD
+    INC
+    PUSH 15
+    STORE
+n5: PUSH 10
+    LOAD
+    ITOF
+    PUSHF 250.0
+    CMP
+    PUSH 16
+    LOAD
+    ADD
+    PUSH 16
+    STORE
+    PUSH 10
+    LOAD
+    INC
+    DUP
+    PUSH 10
+    STORE
+    PUSH 2000
+    JL loop
+PUSH 11
+LOAD
+PRINT        ; 1: only 0.0
+PUSH 12
+LOAD
+PRINT        ; 2000
+PUSH 13
+LOAD
+PRINT        ; 0
+PUSH 14
+LOAD
+PRINT        ; 500
+PUSH 15
+LOAD
+PRINT        ; 499
+PUSH 16
+LOAD
+PRINT        ; -250 + 0 + 1749 = 1499
+HALT
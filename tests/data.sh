@@ -0,0 +1,51 @@
+#!/bin/sh
+# data.sh - --data maps a file after the default 4096 cells: its lengths are
+# at memory[4094..4095], LOADB reads its bytes up to the last one, zeros
+# after it to the end of memory and faults past that; STOREs into it never
+# reach the file; Examples/line_count.asm counts its lines
+# Usage: tests/data.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL data ($1): $2" >&2; status=1; }
+
+printf 'ab\ncd\n\377' > "$tmp/in"     # 7 bytes, 2 cells
+cp "$tmp/in" "$tmp/orig"
+# prints cells, bytes, then the bytes at 16384 + 0, 5, 6 (the last), 7, 8
+# and 32767 (the last of the 8192 cells the memory is rounded up to), the
+# first byte again after a STORE over it, then faults at byte 32768
+{
+    echo "PUSH 4094"; echo "LOAD"; echo "PRINT"
+    echo "PUSH 4095"; echo "LOAD"; echo "PRINT"
+    for a in 16384 16389 16390 16391 16392 32767; do
+        echo "PUSH $a"; echo "LOADB"; echo "PRINT"
+    done
+    echo "PUSH 120"; echo "PUSH 4096"; echo "STORE"
+    echo "PUSH 16384"; echo "LOADB"; echo "PRINT"
+    echo "PUSH 32768"; echo "LOADB"; echo "PRINT"; echo "HALT"
+} > "$tmp/bytes.asm"
+printf '2\n7\n97\n10\n255\n0\n0\n0\n120\n' > "$tmp/want"
+for flags in "" "--no-verify" "--jit" "--reg" "--tier"; do
+    "$tmp/vm" $flags --data "$tmp/in" "$tmp/bytes.asm" 2> "$tmp/err" < /dev/null | sed '/^Assembled /d' > "$tmp/got"
+    cmp -s "$tmp/got" "$tmp/want" || fail "$flags" "got '$(tr '\n' ' ' < "$tmp/got")'"
+    grep -qxF "Runtime error: LOADB address out of bounds" "$tmp/err" || fail "$flags" "stderr '$(cat "$tmp/err")'"
+    cmp -s "$tmp/in" "$tmp/orig" || fail "$flags" "the STORE reached the file"
+done
+
+# a file over several pages, its last line without a newline
+i=0
+: > "$tmp/lines"
+while [ $i -lt 3000 ]; do echo "line $i of the data file" >> "$tmp/lines"; i=$((i + 1)); done
+printf 'no newline' >> "$tmp/lines"
+for f in "$tmp/in" "$tmp/lines"; do
+    want=$(tr -cd '\n' < "$f" | wc -c | tr -d ' ')
+    got=$("$tmp/vm" --data "$f" "$here/../Examples/line_count.asm" < /dev/null | tail -n 1)
+    [ "$got" = "$want" ] || fail "line_count $(basename "$f")" "got '$got', want '$want'"
+done
+[ $status -eq 0 ] && echo "data tests passed" >&2
+exit $status
@@ -0,0 +1,128 @@
+; float_ops.asm - SUBF, DIVF, NEGF, FMAF, ITOF and FTOI, straight and in a
+; loop long enough for --tier to compile it
+; expect: 1.5 -0.25 -0 inf -inf 268435457 268435456 -2 2147483647 -2147483648 7 -3 2000 1000 999
+PUSHF 4.0
+PUSHF 2.5
+SUBF
+PRINT        ; 1.5
+PUSHF 1.0
+PUSHF -4.0
+DIVF
+PRINT        ; -0.25
+PUSHF 0.0
+NEGF
+PRINT        ; -0
+PUSHF 1.0
+PUSHF 0.0
+DIVF
+PRINT        ; inf
+PUSHF 1.0
+PUSHF -0.0
+DIVF
+PRINT        ; -inf
+PUSHF 134217729.0
+PUSHF 134217729.0
+PUSHF -18014398509481984.0
+FMAF         ; (2^27 + 1)^2 - 2^54 = 2^28 + 1, rounded once
+FTOI
+PRINT        ; 268435457
+PUSHF 134217729.0
+PUSHF 134217729.0
+MULF
+PUSHF -18014398509481984.0
+ADDF         ; the product rounded first loses the 1
+FTOI
+PRINT        ; 268435456
+PUSHF -2.9
+FTOI
+PRINT        ; -2: truncated
+PUSHF 2147483647.9
+FTOI
+PRINT
+PUSHF -2147483648.0
+FTOI
+PRINT
+PUSH 7
+ITOF
+DUP
+PUSHF 0.5
+ADDF
+FTOI
+PRINT        ; 7
+PUSHF 10.0
+SUBF
+FTOI
+PRINT        ; -3
+
+; for i < 2000, with h = ITOF(i) / 2: s += h - (-h * 0.5 + 2 - 2) * -2 + 1,
+; which is 1 each time, and t += i - 2 * FTOI(h), which is 1 for odd i
+PUSH 0
+PUSH 0
+STORE        ; memory[0] = i
+PUSHF 0.0
+PUSH 2
+STOREF       ; memory[2..3] = s
+PUSH 0
+PUSH 4
+STORE        ; memory[4] = t
+loop:
+    PUSH 0
+    LOAD
+    ITOF
+    PUSHF 2.0
+    DIVF         ; h
+    DUP
+    NEGF
+    PUSHF 1.0
+    PUSHF 0.5
+    SUBF         ; 0.5
+    PUSHF 2.0
+    FMAF         ; -h * 0.5 + 2
+    PUSHF 2.0
+    SUBF
+    PUSHF -2.0
+    MULF         ; h
+    SUBF         ; 0.0
+    PUSHF 1.0
+    ADDF
+    PUSH 2
+    LOADF
+    ADDF
+    PUSH 2
+    STOREF       ; s += 1
+    PUSH 0
+    LOAD
+    ITOF
+    PUSHF 2.0
+    DIVF
+    FTOI
+    DUP
+    ADD
+    PUSH 0
+    LOAD
+    SUB
+    PUSH 4
+    LOAD
+    SUB
+    NEG
+    PUSH 4
+    STORE        ; t += i - 2 * FTOI(h)
+    PUSH 0
+    LOAD
+    INC
+    DUP
+    PUSH 0
+    STORE
+    PUSH 2000
+    JL loop
+PUSH 2
+LOADF
+FTOI
+PRINT        ; 2000
+PUSH 4
+LOAD
+PRINT        ; 1000
+PUSHF 999.75
+FTOI
+PRINT        ; 999
+HALT
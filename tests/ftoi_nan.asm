@@ -0,0 +1,11 @@
+; ftoi_nan.asm - FTOI faults on a NaN read from memory
+; expect:
+; error: Runtime error: FTOI out of range
+PUSHF -nan
+PUSH 0
+STOREF
+PUSH 0
+LOADF
+FTOI
+PRINT
+HALT
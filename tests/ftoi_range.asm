@@ -0,0 +1,10 @@
+; ftoi_range.asm - FTOI faults on a value past int32 instead of wrapping
+; expect: 2147483647
+; error: Runtime error: FTOI out of range
+PUSHF 2147483647.5
+FTOI
+PRINT
+PUSHF 2147483648.0
+FTOI
+PRINT
+HALT
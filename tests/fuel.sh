@@ -0,0 +1,56 @@
+#!/bin/sh
+# fuel.sh - --fuel stops a runaway loop with an error at an exact count on
+# every engine, charging a superinstruction as one instruction (so --no-opt
+# gets fewer iterations from the same fuel), and --slice lets a short --serve
+# request finish while a runaway one shares its worker
+# Usage: tests/fuel.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL fuel ($1): $2" >&2; status=1; }
+
+# PUSH 0, then 6 instructions a round (DUP; PUSH 0; STORE is one STOREI), 7
+# with --no-opt: 100 fuel runs out at the JMP of round 17, or of round 15
+cat > "$tmp/runaway.asm" <<ASM
+PUSH 0
+loop:
+    INC
+    DUP
+    PRINT
+    DUP
+    PUSH 0
+    STORE
+    JMP loop
+ASM
+for flags in "17" "17 --jit" "17 --reg" "17 --tier" "17 --no-verify" "15 --no-opt"; do
+    want=${flags%% *}
+    set -- $flags
+    shift
+    "$tmp/vm" "$@" --fuel 100 "$tmp/runaway.asm" > "$tmp/out" 2> "$tmp/err"
+    rc=$?
+    got=$(tail -n 1 "$tmp/out")
+    [ $rc -eq 1 ] && grep -qxF "Run stopped: out of fuel" "$tmp/err" \
+        || fail "$*" "exit status $rc, stderr '$(cat "$tmp/err")'"
+    [ "$got" = "$want" ] || fail "$*" "stopped after round $got, want $want"
+done
+"$tmp/vm" --fuel 1k "$here/int_wrap.asm" > /dev/null 2> "$tmp/err" || fail "1k" "a short run failed: $(cat "$tmp/err")"
+
+# with -j 1 and --slice the second request answers before the first has
+# used up its fuel
+printf 'loop:\n    JMP loop\n' > "$tmp/spin.asm"
+printf '%s\n%s 1 2\n' "$tmp/spin.asm" "$here/serve_add.asm" > "$tmp/req"
+printf '1 0 2\n3\n0 7 0\nRun stopped: out of fuel\n' > "$tmp/want"
+"$tmp/vm" --serve - -j 1 --slice 1k --fuel 50m < "$tmp/req" > "$tmp/got" 2> "$tmp/err"
+rc=$?
+if [ $rc -ne 0 ] || ! cmp -s "$tmp/got" "$tmp/want"; then
+    fail "--slice" "exit status $rc"
+    diff "$tmp/want" "$tmp/got" >&2
+    cat "$tmp/err" >&2
+fi
+[ $status -eq 0 ] && echo "fuel tests passed" >&2
+exit $status
@@ -0,0 +1,150 @@
+// host.c - host functions through the embedding API: signatures are checked
+// when added, a CALLN that does not fit its native's signature is refused
+// before the native runs, and a native sees the live stack and memory on
+// every engine. Built by host.sh against vm.c with -DSISA_NO_MAIN.
+#include "../source_code/sisa.h"
+
+static int status;
+
+static void fail(const char *what, const char *detail) {
+    fprintf(stderr, "FAIL host (%s): %s\n", what, detail);
+    status = 1;
+}
+
+// i>i: double memory[addr] and leave -1 there
+static int nat_cell(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    int32_t at = sisa_int(&a[0]);
+    ++*(int *)user;
+    if (at < 0 || (size_t)at >= cells || (cells & (cells - 1))) return 1;
+    sisa_set_int(&a[0], mem[at] * 2);
+    mem[at] = -1;
+    return 0;
+}
+// if>fi: swap an int and a float
+static int nat_pair(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)mem; (void)cells;
+    ++*(int *)user;
+    int32_t i = sisa_int(&a[0]);
+    double f = sisa_float(&a[1]);
+    sisa_set_float(&a[0], f);
+    sisa_set_int(&a[1], i);
+    return 0;
+}
+// v>i: 1 for an int, 2 for a float
+static int nat_kind(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)mem; (void)cells;
+    ++*(int *)user;
+    sisa_set_int(&a[0], sisa_is_int(&a[0]) ? 1 : 2);
+    return 0;
+}
+// >: always fails
+static int nat_fail(void *user, SisaValue *a, int32_t *mem, size_t cells) {
+    (void)a; (void)mem; (void)cells;
+    ++*(int *)user;
+    return 7;
+}
+
+static const char *live_src =
+    "PUSH 21\nPUSH 5\nSTORE\n"          // memory[5] = 21
+    "PUSH 7\n"                          // below the arguments, untouched
+    "PUSH 5\nCALLN cell\nPRINT\n"       // 42
+    "PUSH 5\nLOAD\nPRINT\n"             // -1
+    "PUSH 3\nPUSHF 0.5\nCALLN pair\nPRINT\nPRINT\n"   // 3, 0.5
+    "PUSHF 1.5\nCALLN kind\nPUSH 4\nCALLN kind\nPRINT\nPRINT\n"   // 1, 2
+    "PUSH 0\n"                          // 2000 calls, enough for --tier
+    "loop:\nPUSH 1\nSTORE\nPUSH 1\nCALLN cell\nPUSH 2\nDIV\nINC\n"
+    "DUP\nPUSH 2000\nJL loop\nPRINT\n"  // 2000
+    "PRINT\nHALT\n";                    // 7
+static const char *live_want = "42\n-1\n3\n0.5\n1\n2\n2000\n7\n";
+
+// Run src on h with flags; the run's rc, its output in out
+static int run(const SisaHost *h, const char *src, unsigned flags, const char **out, char *err, size_t errlen) {
+    SisaProgram *p;
+    int rc = sisa_program_from_source_host(src, 0, h, &p, err, errlen);
+    if (rc) return rc;
+    SisaVM *vm = sisa_create();
+    sisa_output_memory(vm);
+    sisa_load(vm, p);
+    rc = sisa_run(vm, flags);
+    size_t len;
+    static char buf[256];
+    snprintf(buf, sizeof buf, "%s", sisa_output(vm, &len));
+    *out = buf;
+    snprintf(err, errlen, "%s", sisa_error(vm));
+    sisa_destroy(vm);
+    sisa_program_free(p);
+    return rc;
+}
+
+int main(void) {
+    int calls = 0;
+    char err[256];
+    const char *out;
+    SisaHost *h = sisa_host_create();
+    if (sisa_host_add(h, "cell", "i>i", nat_cell, &calls) || sisa_host_add(h, "pair", "if>fi", nat_pair, &calls)
+        || sisa_host_add(h, "kind", "v>i", nat_kind, &calls) || sisa_host_add(h, "fail", ">", nat_fail, &calls))
+        fail("add", "a good signature refused");
+    static const char *bad[][2] = {
+        { "cell", "i>i" }, { "", "i>i" }, { "x", "i>v" }, { "x", "q>i" }, { "x", "ii" },
+        { "x", "iiiiiiiii>" }, { "a_name_of_thirty_two_characters_", "i>i" },
+    };
+    for (size_t i = 0; i < sizeof bad / sizeof bad[0]; ++i)
+        if (sisa_host_add(h, bad[i][0], bad[i][1], nat_fail, &calls) != SISA_ERR_ASM) fail("add", bad[i][1]);
+
+    static const unsigned flags[] = { 0, SISA_RUN_NO_VERIFY, SISA_RUN_JIT, SISA_RUN_REG, SISA_RUN_TIER };
+    for (size_t i = 0; i < sizeof flags / sizeof flags[0]; ++i) {
+        calls = 0;
+        char what[32];
+        snprintf(what, sizeof what, "live, flags %#x", flags[i]);
+        if (run(h, live_src, flags[i], &out, err, sizeof err)) fail(what, err);
+        else if (strcmp(out, live_want) != 0) fail(what, out);
+        else if (calls != 2004) fail(what, "the natives ran the wrong number of times");
+    }
+
+    // unknown names fail the assembly; calls that do not fit fail the run
+    // before the native is called, whether verified or not
+    if (run(h, "PUSH 1\nCALLN nope\nHALT\n", 0, &out, err, sizeof err) != SISA_ERR_ASM
+        || strcmp(err, "Unknown native 'nope' at line 2") != 0)
+        fail("unknown", err);
+    if (run(NULL, "PUSH 1\nCALLN cell\nHALT\n", 0, &out, err, sizeof err) != SISA_ERR_ASM)
+        fail("unknown without the host", err);
+    static const char *misfit[][2] = {
+        { "CALLN cell\nHALT\n", "Runtime error: stack underflow" },
+        { "PUSHF 1.0\nCALLN cell\nHALT\n", "cell expects integer on stack" },
+        { "PUSHF 1.0\nCALLN pair\nHALT\n", "Runtime error: stack underflow" },
+        { "PUSHF 0.5\nPUSH 3\nCALLN pair\nHALT\n", "pair expects float on stack" },
+        { "PUSH 3\nPUSH 4\nCALLN pair\nHALT\n", "pair expects float on stack" },
+        { "CALLN kind\nHALT\n", "Runtime error: stack underflow" },
+    };
+    for (size_t i = 0; i < sizeof misfit / sizeof misfit[0]; ++i)
+        for (size_t j = 0; j < 2; ++j) {
+            calls = 0;
+            int rc = run(h, misfit[i][0], j ? SISA_RUN_NO_VERIFY : 0, &out, err, sizeof err);
+            if (rc != SISA_ERR_RUNTIME || strcmp(err, misfit[i][1]) != 0) fail(misfit[i][0], err);
+            else if (calls) fail(misfit[i][0], "the native was called");
+        }
+    if (run(h, "CALLN fail\nPUSH 1\nPRINT\nHALT\n", 0, &out, err, sizeof err) != SISA_ERR_RUNTIME
+        || strcmp(err, "Runtime error: native fail failed (7)") != 0 || *out)
+        fail("fail", err);
+
+    // an image names its natives: a host without one, or with another
+    // signature, refuses it
+    SisaProgram *p;
+    const char *img = "host_test.sbc";
+    if (sisa_program_from_source_host("PUSH 5\nCALLN cell\nPRINT\nHALT\n", 0, h, &p, err, sizeof err)
+        || sisa_program_save(p, img, err, sizeof err))
+        fail("save", err);
+    else {
+        sisa_program_free(p);
+        SisaHost *other = sisa_host_create();
+        sisa_host_add(other, "cell", "f>f", nat_cell, &calls);
+        if (sisa_program_from_file_host(img, 0, NULL, &p, err, sizeof err) == SISA_OK) fail("image", "loaded without cell");
+        if (sisa_program_from_file_host(img, 0, other, &p, err, sizeof err) == SISA_OK) fail("image", "loaded with cell f>f");
+        if (sisa_program_from_file_host(img, 0, h, &p, err, sizeof err)) fail("image", err);
+        else sisa_program_free(p);
+        sisa_host_free(other);
+    }
+    remove(img);
+    sisa_host_free(h);
+    return status;
+}
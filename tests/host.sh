@@ -0,0 +1,16 @@
+#!/bin/sh
+# host.sh - build host.c against the library and run it, tagged and NaN-boxed
+# Usage: tests/host.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+for flags in "" "-DSISA_NAN_BOX"; do
+    $cc -O2 -std=c11 ${CFLAGS:-} $flags -DSISA_NO_MAIN "$here/host.c" "$here/../source_code/vm.c" \
+        -o "$tmp/host" -lpthread -lm || exit 1
+    (cd "$tmp" && ./host) || { echo "FAIL host ($flags)" >&2; status=1; }
+done
+[ $status -eq 0 ] && echo "host tests passed" >&2
+exit $status
@@ -0,0 +1,57 @@
+#!/bin/sh
+# image.sh - every program in tests/ saved with --save and run from the image
+# prints what it prints from source, and exits the same way; an image cut
+# short anywhere, or with any byte of its header changed, is refused
+# Usage: tests/image.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL image $(basename "$1"): $2" >&2; status=1; }
+
+# run vm on a program, output without the Assembled / Loaded line, then rc
+out() {
+    "$tmp/vm" "$@" > "$tmp/o" 2> "$tmp/err" < /dev/null
+    rc=$?
+    sed '/^Assembled /d; /^Loaded /d' "$tmp/o"
+    echo "rc $rc"
+}
+for f in "$here"/*.asm; do
+    "$tmp/vm" --save "$tmp/img.sbc" "$f" > /dev/null 2> "$tmp/err" < /dev/null || { fail "$f" "--save: $(cat "$tmp/err")"; continue; }
+    for flags in "" "--jit" "--reg"; do
+        out $flags "$f" > "$tmp/want"
+        out $flags "$tmp/img.sbc" > "$tmp/got"
+        cmp -s "$tmp/want" "$tmp/got" || { fail "$f" "image run ($flags) differs"; diff "$tmp/want" "$tmp/got" >&2; }
+    done
+done
+
+# refused: exit status 1 (not a crash) with a message
+refused() {  # image, what
+    "$tmp/vm" "$1" > /dev/null 2> "$tmp/err" < /dev/null
+    rc=$?
+    [ $rc -eq 1 ] && [ -s "$tmp/err" ] || fail "$2" "exit status $rc, stderr '$(cat "$tmp/err")'"
+}
+for f in float_ops.asm calln_builtin.asm compare_jump.asm; do
+    "$tmp/vm" --save "$tmp/img.sbc" "$here/$f" > /dev/null 2>&1 || { fail "$f" "--save failed"; continue; }
+    size=$(wc -c < "$tmp/img.sbc")
+    n=4   # shorter than the magic it is not an image at all
+    while [ $n -lt "$size" ]; do
+        head -c $n "$tmp/img.sbc" > "$tmp/cut.sbc"
+        refused "$tmp/cut.sbc" "$f cut to $n bytes"
+        n=$((n + 1))
+    done
+    i=0
+    while [ $i -lt 36 ]; do
+        cp "$tmp/img.sbc" "$tmp/bad.sbc"
+        b=$(od -An -tu1 -j $i -N1 "$tmp/img.sbc" | tr -d ' ')
+        printf "\\$(printf %o $((b ^ 255)))" | dd of="$tmp/bad.sbc" bs=1 seek=$i conv=notrunc 2> /dev/null
+        refused "$tmp/bad.sbc" "$f header byte $i flipped"
+        i=$((i + 1))
+    done
+done
+[ $status -eq 0 ] && echo "image tests passed" >&2
+exit $status
@@ -0,0 +1,62 @@
+; int_min_div.asm - INT_MIN / -1 wraps to INT_MIN and INT_MIN % -1 is 0 on
+; every engine, for constant operands, a constant on either side, and both
+; in memory in a loop hot enough for --tier
+; expect: -2147483648 0 -2147483648 0 -2147483648 0
+PUSH -2147483648
+PUSH -1
+DIV
+PRINT
+PUSH -2147483648
+PUSH -1
+MOD
+PRINT
+PUSH -2147483648
+PUSH 0
+STORE        ; memory[0] = INT_MIN
+PUSH -1
+PUSH 1
+STORE        ; memory[1] = -1
+PUSH 0
+LOAD
+PUSH -1
+DIV
+PRINT
+PUSH -2147483648
+PUSH 1
+LOAD
+MOD
+PRINT
+PUSH 100000
+PUSH 2
+STORE        ; memory[2] = iterations left
+loop:
+    PUSH 0
+    LOAD
+    PUSH 1
+    LOAD
+    DIV
+    PUSH 3
+    STORE
+    PUSH 0
+    LOAD
+    PUSH 1
+    LOAD
+    MOD
+    PUSH 4
+    STORE
+    PUSH 2
+    LOAD
+    DEC
+    DUP
+    PUSH 2
+    STORE
+    JZ done
+    JMP loop
+done:
+PUSH 3
+LOAD
+PRINT
+PUSH 4
+LOAD
+PRINT
+HALT
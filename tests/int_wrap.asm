@@ -0,0 +1,53 @@
+; int_wrap.asm - int arithmetic wraps modulo 2^32 on every engine, for
+; constants and for values loaded from memory
+; expect: -2147483648 2147483647 0 -2147483648 -2147483648 2147483647 -2147483648 2147483647 0 -2147483648
+PUSH 2147483647
+PUSH 1
+ADD
+PRINT
+PUSH -2147483648
+PUSH 1
+SUB
+PRINT
+PUSH 65536
+PUSH 65536
+MUL
+PRINT
+PUSH -2147483648
+NEG
+PRINT
+PUSH 2147483647
+INC
+PRINT
+PUSH -2147483648
+DEC
+PRINT
+PUSH 2147483647
+PUSH 0
+STORE        ; memory[0] = INT_MAX
+PUSH 65536
+PUSH 1
+STORE        ; memory[1] = 65536
+PUSH 0
+LOAD
+PUSH 1
+ADD
+PRINT
+PUSH 0
+LOAD
+PUSH -1
+SUB
+PUSH 1
+SUB
+PRINT
+PUSH 1
+LOAD
+PUSH 1
+LOAD
+MUL
+PRINT
+PUSH 0
+LOAD
+INC
+PRINT
+HALT
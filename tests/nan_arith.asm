@@ -0,0 +1,119 @@
+; nan_arith.asm - ADDF, SUBF, MULF and DIVF give the positive NaN for any NaN
+; operands, whatever their signs and order, on every engine and build (0/0
+; as well, which is -nan in x86 hardware); NEGF still flips the sign
+; expect: nan nan nan nan nan nan nan nan nan nan nan -nan 4000
+PUSHF 0.0
+PUSHF 0.0
+DIVF
+PRINT        ; 0/0
+PUSHF -nan
+PUSH 0
+STOREF       ; memory[0..1] = -nan
+PUSHF nan
+PUSH 2
+STOREF       ; memory[2..3] = nan
+PUSH 0
+LOADF
+PUSH 2
+LOADF
+ADDF
+PRINT
+PUSH 2
+LOADF
+PUSH 0
+LOADF
+ADDF
+PRINT
+PUSH 0
+LOADF
+PUSH 2
+LOADF
+SUBF
+PRINT
+PUSH 2
+LOADF
+PUSH 0
+LOADF
+SUBF
+PRINT
+PUSH 0
+LOADF
+PUSH 2
+LOADF
+MULF
+PRINT
+PUSH 2
+LOADF
+PUSH 0
+LOADF
+MULF
+PRINT
+PUSH 0
+LOADF
+PUSH 2
+LOADF
+DIVF
+PRINT
+PUSH 2
+LOADF
+PUSH 0
+LOADF
+DIVF
+PRINT
+PUSHF -nan
+PUSHF 1.0
+ADDF
+PRINT
+PUSHF -nan
+PUSHF 1.0
+MULF
+PRINT
+PUSHF 0.0
+PUSHF 0.0
+DIVF
+NEGF
+PRINT        ; -nan
+; a loop long enough for --tier: count the rounds whose four results,
+; mixed-sign NaNs each, all print as nan (compare the bits via STOREF / LOAD)
+PUSH 0
+PUSH 4
+STORE        ; memory[4] = i, memory[5] = count
+loop:
+    PUSH 0
+    LOADF
+    PUSH 2
+    LOADF
+    ADDF
+    PUSH 2
+    LOADF
+    PUSH 0
+    LOADF
+    MULF
+    SUBF
+    PUSH 0
+    LOADF
+    DIVF
+    PUSH 6
+    STOREF
+    PUSH 7
+    LOAD
+    PUSH 2146959360
+    JNE skip     ; the high word of the positive NaN, 0x7FF80000
+    PUSH 5
+    LOAD
+    INC
+    PUSH 5
+    STORE
+skip:
+    PUSH 4
+    LOAD
+    INC
+    DUP
+    PUSH 4
+    STORE
+    PUSH 4000
+    JL loop
+PUSH 5
+LOAD
+PRINT
+HALT
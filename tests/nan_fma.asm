@@ -0,0 +1,96 @@
+; nan_fma.asm - FMAF gives the positive NaN for any NaN operands, whatever
+; their signs and places, on every engine and build, like ADDF and the rest
+; (nan_arith.asm); hardware FMA passes on the sign of the first NaN it reads
+; expect: nan nan nan nan nan nan nan 4000
+PUSHF 0.0
+PUSHF 0.0
+DIVF
+PUSHF 0.0
+PUSHF 0.0
+DIVF
+NEGF
+PUSHF 1.0
+FMAF
+PRINT        ; 0/0 * -(0/0) + 1
+PUSHF -nan
+PUSH 0
+STOREF       ; memory[0..1] = -nan
+PUSHF nan
+PUSH 2
+STOREF       ; memory[2..3] = nan
+PUSH 0
+LOADF
+PUSH 2
+LOADF
+PUSHF 1.0
+FMAF
+PRINT        ; -nan * nan + 1
+PUSH 2
+LOADF
+PUSH 0
+LOADF
+PUSHF 1.0
+FMAF
+PRINT        ; nan * -nan + 1
+PUSH 2
+LOADF
+PUSHF 1.0
+PUSH 0
+LOADF
+FMAF
+PRINT        ; nan * 1 + -nan
+PUSH 0
+LOADF
+PUSHF 1.0
+PUSH 2
+LOADF
+FMAF
+PRINT        ; -nan * 1 + nan
+PUSHF 1.0
+PUSH 0
+LOADF
+PUSHF 2.0
+FMAF
+PRINT        ; 1 * -nan + 2
+PUSHF -nan
+PUSHF 2.0
+PUSHF 1.0
+FMAF
+PRINT        ; -nan * 2 + 1, all constants
+; a loop long enough for --tier: count the rounds whose result, from
+; mixed-sign NaNs, prints as nan (compare the bits via STOREF / LOAD)
+PUSH 0
+PUSH 4
+STORE        ; memory[4] = i, memory[5] = count
+loop:
+    PUSH 0
+    LOADF
+    PUSH 2
+    LOADF
+    PUSH 0
+    LOADF
+    FMAF
+    PUSH 6
+    STOREF
+    PUSH 7
+    LOAD
+    PUSH 2146959360
+    JNE skip     ; the high word of the positive NaN, 0x7FF80000
+    PUSH 5
+    LOAD
+    INC
+    PUSH 5
+    STORE
+skip:
+    PUSH 4
+    LOAD
+    INC
+    DUP
+    PUSH 4
+    STORE
+    PUSH 4000
+    JL loop
+PUSH 5
+LOAD
+PRINT
+HALT
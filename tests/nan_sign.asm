@@ -0,0 +1,31 @@
+; nan_sign.asm - a negative NaN keeps its sign through a literal, STOREF /
+; LOADF, VSUMF and a snapshot, in the tagged and the NaN-boxed build alike;
+; memory holding an int's NaN-boxed bits loads as a float
+; expect: -nan -nan -nan -nan -nan
+; snapshot: -nan
+PUSHF -nan
+PRINT
+PUSHF -nan
+PUSH 0
+STOREF       ; memory[0..1] = -nan
+PUSH 0
+LOADF
+PRINT
+PUSH 0
+PUSH 1
+VSUMF        ; the one double at memory[0]
+PRINT
+PUSH 5
+PUSH 2
+STORE
+PUSH -458752
+PUSH 3
+STORE        ; memory[2..3]: the bits of a NaN-boxed int 5
+PUSH 2
+LOADF        ; still a float, -nan
+PRINT
+PUSH 0
+LOADF
+SNAPSHOT     ; a --restore run goes on from here with -nan on the stack
+PRINT
+HALT
@@ -0,0 +1,20 @@
+; numeric_targets.asm - a numeric jump target is a byte offset counted with
+; PUSH as 5 bytes and PUSHF as 9, whatever size the assembler gives them
+; expect: 1 2.5 2 1 0 100000 0
+PUSH 1          ; 0
+JMP 15          ; 5
+PUSH 2          ; 10
+PRINT           ; 15
+PUSHF 2.5       ; 16
+PRINT           ; 25
+PUSH 3          ; 26
+DEC             ; 31
+DUP             ; 32
+PRINT           ; 33
+DUP             ; 34
+JZ 45           ; 35
+JMP 31          ; 40
+PUSH 100000     ; 45
+PRINT           ; 50
+PRINT           ; 51
+HALT            ; 52
@@ -0,0 +1,55 @@
+#!/bin/sh
+# profile.sh - --profile counts every instruction of Examples/factorial.asm
+# exactly, per opcode, function and label, and --profile-stacks writes
+# well-formed collapsed stacks adding up to the same total; the clock
+# columns vary from run to run and are not checked
+# Usage: tests/profile.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL profile ($1): $2" >&2; status=1; }
+
+for build in "" "-DSISA_DISPATCH_SWITCH"; do
+    [ -n "$build" ] && { $cc -O2 -std=c11 ${CFLAGS:-} $build "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1; }
+    "$tmp/vm" --profile --profile-stacks "$tmp/stacks" "$here/../Examples/factorial.asm" > "$tmp/out" 2> "$tmp/prof" < /dev/null \
+        || fail "$build" "exit status $?: $(cat "$tmp/prof")"
+    [ "$(tail -n 1 "$tmp/out")" = "120" ] || fail "$build" "output '$(cat "$tmp/out")'"
+    grep -q '^profile: 38 instructions, ' "$tmp/prof" || fail "$build" "total: $(head -n 1 "$tmp/prof")"
+    # the name and count columns of each table, in the order printed
+    awk '/^opcode / { t = "op" } /^function / { t = "fn" } /^label / { t = "lb" }
+         /^$/ { t = "" }
+         t == "op" && !/^opcode / { print "op", $1, $2 }
+         t == "fn" && !/^function / { print "fn", $1, $2, $3, $5 }
+         t == "lb" && !/^label / { print "lb", $1, $2 }' "$tmp/prof" > "$tmp/got"
+    cat > "$tmp/want" <<TAB
+op CALL 6
+op DUPJZ 6
+op RET 6
+op DUP 5
+op MUL 5
+op SUBI 5
+op PUSH 2
+op HALT 1
+op POP 1
+op PRINT 1
+fn factorial 6 34 34
+fn <main> 1 4 38
+lb factorial 31
+lb <start> 4
+lb base 3
+TAB
+    cmp -s "$tmp/got" "$tmp/want" || { fail "$build" "tables differ"; diff "$tmp/want" "$tmp/got" >&2; }
+    bad=$(grep -cvE '^<main>(;[A-Za-z_][A-Za-z0-9_]*)* [0-9]+$' "$tmp/stacks")
+    [ "$bad" -eq 0 ] || fail "$build" "$bad malformed stack lines"
+    total=$(awk '{ n += $NF } END { print n }' "$tmp/stacks")
+    [ "$total" = 38 ] || fail "$build" "stacks add up to $total"
+    deep=$(grep -c '^<main>;factorial;factorial;factorial;factorial;factorial;factorial 4$' "$tmp/stacks")
+    [ "$deep" -eq 1 ] || fail "$build" "no line for the deepest call"
+done
+[ $status -eq 0 ] && echo "profile tests passed" >&2
+exit $status
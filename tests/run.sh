@@ -0,0 +1,86 @@
+#!/bin/sh
+# run.sh - build each engine and run the regression programs on it
+# Usage: tests/run.sh   (CC and CFLAGS are honoured)
+# Each program states what it must do in comments at its top:
+#   ; expect: a b c     its last output lines, one word each ("; expect:"
+#                       alone: no output)
+#   ; error: message    the run fails with this line on stderr (else it
+#                       must succeed)
+#   ; verify: ok        the verifier accepts it (or "rejected")
+#   ; snapshot: a b     its last output lines when run again from the
+#                       --snapshot of a first run (--restore)
+# Every engine has to agree; a mismatch is reported on stderr and fails the
+# run. serve.sh checks --serve the same way.
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+
+build() {  # name, extra flags
+    $cc -O2 -std=c11 ${CFLAGS:-} $2 "$here/../source_code/vm.c" -o "$tmp/$1" -lpthread -lm || exit 1
+}
+build threaded ""
+build switch "-DSISA_DISPATCH_SWITCH"
+build nanbox "-DSISA_NAN_BOX"
+
+fail() {  # file, vm, flags, what
+    echo "FAIL $(basename "$1") ($(basename "$2") $3): $4" >&2
+    status=1
+}
+
+suite() {  # vm, flags
+    for f in "$here"/*.asm; do
+        want=$(sed -n 's/^; expect: *//p' "$f")
+        err=$(sed -n 's/^; error: //p' "$f")
+        n=$(echo "$want" | wc -w)
+        "$1" $2 "$f" > "$tmp/out" 2> "$tmp/err" < /dev/null
+        rc=$?
+        got=$(tail -n "$n" "$tmp/out" | tr '\n' ' ' | sed 's/ $//')
+        [ "$n" -gt 0 ] || got=$(sed '/^Assembled /d' "$tmp/out")
+        [ "$got" = "$want" ] || fail "$f" "$1" "$2" "got '$got', want '$want'"
+        if [ -n "$err" ]; then
+            [ $rc -ne 0 ] && grep -qxF "$err" "$tmp/err" || fail "$f" "$1" "$2" "want error '$err', got '$(cat "$tmp/err")'"
+        elif [ $rc -ne 0 ]; then
+            fail "$f" "$1" "$2" "exit status $rc: $(cat "$tmp/err")"
+        fi
+    done
+}
+for f in "$here"/*.asm; do
+    v=$(sed -n 's/^; verify: //p' "$f")
+    [ -z "$v" ] && continue
+    got=$("$tmp/threaded" -v "$f" 2>&1 < /dev/null | sed -n 's/^verify: \([a-z]*\).*/\1/p')
+    [ "$got" = "$v" ] || fail "$f" threaded -v "verifier said '$got', want '$v'"
+done
+snap() {  # vm
+    for f in "$here"/*.asm; do
+        want=$(sed -n 's/^; snapshot: *//p' "$f")
+        [ -z "$want" ] && continue
+        n=$(echo "$want" | wc -w)
+        "$1" --snapshot "$tmp/snap" "$f" > /dev/null 2>&1 < /dev/null \
+            && "$1" --restore "$tmp/snap" "$f" > "$tmp/out" 2> "$tmp/err" < /dev/null \
+            || { fail "$f" "$1" --restore "$(cat "$tmp/err")"; continue; }
+        got=$(tail -n "$n" "$tmp/out" | tr '\n' ' ' | sed 's/ $//')
+        [ "$got" = "$want" ] || fail "$f" "$1" --restore "got '$got', want '$want'"
+    done
+}
+suite "$tmp/threaded" ""
+suite "$tmp/threaded" "--no-verify"
+suite "$tmp/threaded" "--jit"
+suite "$tmp/threaded" "--reg"
+suite "$tmp/threaded" "--tier"
+suite "$tmp/threaded" "--tier --tier-threshold 1"
+suite "$tmp/switch" ""
+suite "$tmp/nanbox" ""
+suite "$tmp/nanbox" "--jit"
+suite "$tmp/nanbox" "--reg"
+suite "$tmp/nanbox" "--tier --tier-threshold 1"
+for k in scalar sse2 avx2 neon; do  # each vector kernel set the CPU has
+    echo HALT | "$tmp/threaded" --vec $k - > /dev/null 2>&1 && suite "$tmp/threaded" "--vec $k"
+done
+snap "$tmp/threaded"
+snap "$tmp/switch"
+snap "$tmp/nanbox"
+[ $status -eq 0 ] && echo "all tests passed" >&2
+exit $status
@@ -0,0 +1,63 @@
+#!/bin/sh
+# serve.sh - one --serve process answering a sequence of requests on each
+# engine: a request that faults (or wraps, as INT_MIN / -1 does) gets its
+# answer and the requests after it still get theirs; so does one with an
+# input value beyond 32 bits, which is answered before it is queued
+# Usage: tests/serve.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+printf 'PUSH 1\nPUSH 0\nDIV\nHALT\n' > "$tmp/div0.asm"
+cat > "$tmp/req" <<REQ
+$here/serve_add.asm 1 2
+$here/int_min_div.asm
+$tmp/div0.asm
+$here/serve_add.asm 3 4
+REQ
+cat > "$tmp/want" <<ANS
+0 0 2
+3
+1 0 42
+-2147483648
+0
+-2147483648
+0
+-2147483648
+0
+2 6 0
+Runtime error: division by zero
+3 0 2
+7
+ANS
+cat > "$tmp/req2" <<REQ
+$here/serve_add.asm 99999999999999
+$here/serve_add.asm 1 -2147483649
+$here/serve_add.asm 0xFFFFFFFF -2147483648
+REQ
+cat > "$tmp/want2" <<ANS
+0 6 0
+Server input error: bad value '99999999999999'
+1 6 0
+Server input error: bad value '-2147483649'
+2 0 11
+2147483647
+ANS
+for flags in "" "--no-verify" "--jit" "--reg" "--tier" "--fuel 1g"; do
+    for r in "" 2; do
+        "$tmp/vm" --serve - -j 1 $flags < "$tmp/req$r" > "$tmp/got" 2> "$tmp/err"
+        rc=$?
+        if [ $rc -ne 0 ] || ! cmp -s "$tmp/got" "$tmp/want$r"; then
+            echo "FAIL serve$r ($flags): exit status $rc" >&2
+            diff "$tmp/want$r" "$tmp/got" >&2
+            cat "$tmp/err" >&2
+            status=1
+        fi
+    done
+done
+[ $status -eq 0 ] && echo "serve tests passed" >&2
+exit $status
@@ -0,0 +1,9 @@
+; serve_add.asm - prints memory[0] + memory[1] (serve.sh passes them in)
+; expect: 0
+PUSH 0
+LOAD
+PUSH 1
+LOAD
+ADD
+PRINT
+HALT
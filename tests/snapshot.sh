@@ -0,0 +1,64 @@
+#!/bin/sh
+# snapshot.sh - a snapshot restores only into the program it came from, and
+# --batch --restore starts every run from the snapshot's memory
+# Usage: tests/snapshot.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL snapshot ($1): $2" >&2; status=1; }
+
+# another program, another program of the same length, and an unverified run
+# of the right one
+rec="$here/snapshot_recursive.asm"
+"$tmp/vm" --snapshot "$tmp/rec.snap" "$rec" > /dev/null 2>&1 || fail "take" "--snapshot failed"
+sed 's/^PUSH 6$/PUSH 5/' "$rec" > "$tmp/same_len.asm"
+for prog in "$here/serve_add.asm" "$tmp/same_len.asm"; do
+    "$tmp/vm" --restore "$tmp/rec.snap" "$prog" > "$tmp/got" 2> "$tmp/err"
+    rc=$?
+    [ $rc -ne 0 ] && grep -qxF "Snapshot error: taken from another program" "$tmp/err" \
+        || fail "$(basename "$prog")" "exit status $rc, stderr '$(cat "$tmp/err")'"
+    grep -qv "^Assembled " "$tmp/got" && fail "$(basename "$prog")" "ran: '$(cat "$tmp/got" | tr '\n' ' ')'"
+done
+"$tmp/vm" --restore "$tmp/rec.snap" --no-verify "$rec" 2> /dev/null | sed '/^Assembled /d' > "$tmp/got"
+printf '720\n7\n6\n' | cmp -s - "$tmp/got" || fail "--no-verify" "got '$(cat "$tmp/got" | tr '\n' ' ')'"
+
+# memory[5] is 100 at the snapshot and 7 when a run ends: each batch run
+# prints memory[0] + memory[1] + 100
+cat > "$tmp/seeded.asm" <<'ASM'
+PUSH 100
+PUSH 5
+STORE
+SNAPSHOT
+PUSH 0
+LOAD
+PUSH 1
+LOAD
+ADD
+PUSH 5
+LOAD
+ADD
+PRINT
+PUSH 7
+PUSH 5
+STORE
+HALT
+ASM
+"$tmp/vm" --snapshot "$tmp/seeded.snap" "$tmp/seeded.asm" > /dev/null 2>&1 || fail "take" "--snapshot failed"
+printf '1 2\n3 4\n-100 0\n' > "$tmp/seeds"
+printf '103\n107\n0\n' > "$tmp/want"
+for flags in "" "--no-verify" "-j 2" "--tier"; do
+    "$tmp/vm" --batch "$tmp/seeds" --restore "$tmp/seeded.snap" $flags "$tmp/seeded.asm" 2> "$tmp/err" \
+        | sed '/^Assembled /d' > "$tmp/got"
+    cmp -s "$tmp/got" "$tmp/want" || { fail "--batch $flags" "got '$(cat "$tmp/got" | tr '\n' ' ')'"; cat "$tmp/err" >&2; }
+done
+"$tmp/vm" --batch "$tmp/seeds" --restore "$tmp/rec.snap" "$tmp/seeded.asm" > "$tmp/got" 2> "$tmp/err"
+rc=$?
+[ $rc -ne 0 ] && grep -qxF "Snapshot error: taken from another program" "$tmp/err" && ! grep -q '^[0-9]' "$tmp/got" \
+    || fail "--batch, another program" "exit status $rc, stderr '$(cat "$tmp/err")'"
+[ $status -eq 0 ] && echo "snapshot tests passed" >&2
+exit $status
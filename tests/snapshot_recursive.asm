@@ -0,0 +1,46 @@
+; snapshot_recursive.asm - a SNAPSHOT three calls deep in a recursion: a
+; --restore run goes on with the call stack, the frames' values, a float
+; under them and memory as they were
+; verify: ok
+; expect: 1 720 7 6
+; snapshot: 720 7 6
+PUSH 1
+PRINT
+PUSHF 0.5    ; under the frames until the end
+PUSH 6
+CALL fact
+PRINT        ; 720
+PUSH 0
+LOAD
+PRINT        ; 7 calls
+PUSHF 12.0
+MULF
+FTOI
+PRINT        ; 6
+HALT
+
+fact:            ; n -> n!, memory[0] += 1
+    PUSH 0
+    LOAD
+    INC
+    PUSH 0
+    STORE
+    DUP
+    JZ base
+    DUP
+    PUSH 3
+    SUB
+    JZ snap
+go:
+    DUP
+    DEC
+    CALL fact
+    MUL
+    RET
+snap:
+    SNAPSHOT     ; in fact(3), under fact(6), fact(5) and fact(4)
+    JMP go
+base:
+    POP
+    PUSH 1
+    RET
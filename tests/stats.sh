@@ -0,0 +1,77 @@
+#!/bin/sh
+# stats.sh - --stats json and --stats prom report the counts of
+# Examples/factorial.asm, and for every program in tests/ the same number of
+# instructions as --profile, split into classes that add up to it
+# Usage: tests/stats.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL stats ($1): $2" >&2; status=1; }
+
+# the report is the last line of stderr (json) or its sisa_ lines (prom),
+# printed as "name value" lines with the same names for both
+json() {
+    tail -n 1 "$1" | sed 's/"insns_by_class": {\([^}]*\)}/\1/' | tr -d '{}"' | tr ',' '\n' \
+        | sed 's/^ *//; s/: / /' | grep -v '^\(load_s\|run_s\|cycles\|branch_misses\|cache_misses\) '
+}
+prom() {
+    awk '/^sisa_instructions_total/ { split($1, k, "\""); print k[2], $2; n += $2 }
+         /^sisa_stack_peak_slots/ { split($1, k, "\""); print (k[2] == "value" ? "peak_sp" : "peak_csp"), $2 }
+         /^sisa_memory_cells / { print "mem_cells", $2 }
+         /^sisa_print_bytes_total / { print "print_bytes", $2 }
+         END { print "insns", n }' "$1" | sort
+}
+# the classes' sum, for a "name value" report
+classes() {
+    awk '$1 ~ /^(stack|int|float|memory|block|control|host|print)$/ { n += $2 } END { print n + 0 }' "$1"
+}
+
+fact="$here/../Examples/factorial.asm"
+"$tmp/vm" --stats json "$fact" > /dev/null 2> "$tmp/err"
+json "$tmp/err" | sort > "$tmp/json"
+sort > "$tmp/want" <<'WANT'
+insns 38
+stack 8
+int 10
+float 0
+memory 0
+block 0
+control 19
+host 0
+print 1
+peak_sp 6
+peak_csp 6
+mem_cells 0
+print_bytes 4
+WANT
+cmp -s "$tmp/json" "$tmp/want" || fail "factorial json" "got '$(tr '\n' ' ' < "$tmp/json")'"
+"$tmp/vm" --stats prom "$fact" > /dev/null 2> "$tmp/err"
+prom "$tmp/err" > "$tmp/prom"
+cmp -s "$tmp/prom" "$tmp/want" || fail "factorial prom" "got '$(tr '\n' ' ' < "$tmp/prom")'"
+grep -q '^sisa_load_seconds [0-9.e+-]*$' "$tmp/err" && grep -q '^sisa_run_seconds [0-9.e+-]*$' "$tmp/err" \
+    || fail "factorial prom" "no load and run times"
+
+# --no-opt leaves tail_call_deep.asm's 3M calls as calls: on a short stack
+# it overflows soon, and both reports count up to the fault
+for f in "$here"/*.asm; do
+    name=$(basename "$f")
+    for flags in "" "--no-opt --stack 4096"; do
+        "$tmp/vm" --profile $flags "$f" > /dev/null 2> "$tmp/err"
+        want=$(sed -n 's/^profile: \([0-9]*\) instructions.*/\1/p' "$tmp/err")
+        "$tmp/vm" --stats json $flags "$f" > /dev/null 2> "$tmp/err"
+        json "$tmp/err" > "$tmp/json"
+        "$tmp/vm" --stats prom $flags "$f" > /dev/null 2> "$tmp/err"
+        prom "$tmp/err" > "$tmp/prom"
+        got=$(sed -n 's/^insns //p' "$tmp/json")
+        [ -n "$want" ] && [ "$got" = "$want" ] || fail "$name $flags" "--stats json $got, --profile $want"
+        [ "$(classes "$tmp/json")" = "$got" ] || fail "$name $flags" "classes add up to $(classes "$tmp/json"), not $got"
+        sort "$tmp/json" | cmp -s - "$tmp/prom" || fail "$name $flags" "json and prom differ"
+    done
+done
+[ $status -eq 0 ] && echo "stats tests passed" >&2
+exit $status
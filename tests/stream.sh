@@ -0,0 +1,37 @@
+#!/bin/sh
+# stream.sh - the streaming assembler gives the same program for a source
+# stretched over many 64 KB read chunks, with CRLF line endings, lines
+# longer than a chunk, no newline after its last line, read from a file or
+# from stdin, as for the plain LF source it was made from
+# Usage: tests/stream.sh   (CC and CFLAGS are honoured)
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cc=${CC:-cc}
+status=0
+$cc -O2 -std=c11 ${CFLAGS:-} "$here/../source_code/vm.c" -o "$tmp/vm" -lpthread -lm || exit 1
+
+fail() { echo "FAIL stream $(basename "$1") ($2): $3" >&2; status=1; }
+
+# before each line 40 comment lines of 200 bytes, after every tenth a
+# comment of 70000; CRLF between lines and none at the end
+stretch() {
+    awk 'BEGIN { pad = "; "; while (length(pad) < 198) pad = pad "pad "; long = ""; while (length(long) < 70000) long = long "long comment "; }
+         NR > 1 { printf "\r\n" }
+         { for (i = 0; i < 40; ++i) printf "%s\r\n", pad
+           printf "%s", $0
+           if (NR % 10 == 0) printf " ; %s", long }' "$1"
+}
+for f in "$here/../Examples/factorial.asm" "$here/compare_jump.asm" "$here/float_ops.asm" "$here/vector_tail.asm"; do
+    stretch "$f" > "$tmp/big.asm"
+    [ "$(wc -c < "$tmp/big.asm")" -gt 131072 ] || fail "$f" "" "the stretched source is too small"
+    "$tmp/vm" "$f" < /dev/null > "$tmp/want" 2>&1
+    for how in file stdin; do
+        if [ $how = file ]; then "$tmp/vm" "$tmp/big.asm" < /dev/null > "$tmp/got" 2>&1
+        else "$tmp/vm" - < "$tmp/big.asm" > "$tmp/got" 2>&1; fi
+        cmp -s "$tmp/want" "$tmp/got" || { fail "$f" $how "output differs"; diff "$tmp/want" "$tmp/got" >&2; }
+    done
+done
+[ $status -eq 0 ] && echo "stream tests passed" >&2
+exit $status
@@ -0,0 +1,24 @@
+; tail_call_deep.asm - a 3M-deep tail recursion, three times the call stack:
+; CALL; RET runs without a call stack entry on every engine, --reg included
+; verify: ok
+; expect: 3000000 0
+PUSH 3000000
+CALL count
+PUSH 0
+LOAD
+PRINT
+PRINT
+HALT
+count:          ; n -> 0, memory[0] += n
+    DUP
+    JZ done
+    DEC
+    PUSH 0
+    LOAD
+    INC
+    PUSH 0
+    STORE
+    CALL count
+    RET
+done:
+    RET
@@ -0,0 +1,111 @@
+; tier_guard.asm - a hot function compiled for the ints it was called with
+; gets floats: under --tier its speculated-int DUP fails its guard, the
+; interpreter takes over there and the function is compiled again generic
+; expect: 1999 1 0 0 1 99999 1999
+PUSH 0
+PUSH 1
+STORE        ; memory[1] = count
+PUSH 0
+loop:            ; ints: nonzero(i - 1000), i < 2000
+    DUP
+    PUSH 1000
+    SUB
+    CALL nonzero
+    PUSH 1
+    LOAD
+    ADD
+    PUSH 1
+    STORE
+    INC
+    DUP
+    PUSH 2000
+    JL loop
+POP
+PUSH 1
+LOAD
+PRINT        ; 1999
+PUSHF 2.5
+CALL nonzero
+PRINT        ; 1
+PUSHF 0.0
+CALL nonzero
+PRINT        ; 0
+PUSHF -0.0
+CALL nonzero
+PRINT        ; 0
+PUSHF nan
+CALL nonzero
+PRINT        ; 1
+PUSH 0
+PUSH 1
+STORE
+PUSH 0
+floop:           ; floats: nonzero(i * 0.5 - 500), i < 100000
+    DUP
+    ITOF
+    PUSHF 0.5
+    MULF
+    PUSHF 500.0
+    SUBF
+    CALL nonzero
+    PUSH 1
+    LOAD
+    ADD
+    PUSH 1
+    STORE
+    INC
+    DUP
+    PUSH 100000
+    JL floop
+PUSH 1
+LOAD
+PRINT        ; 99999: only i = 1000 gives 0.0
+PUSH 0
+PUSH 1
+STORE
+PUSH 0
+mloop:           ; both: ints for even i, floats for odd i, i < 2000
+    DUP
+    DUP
+    PUSH 2
+    MOD
+    JZ even
+    ITOF
+    CALL nonzero
+    JMP counted
+even:
+    CALL nonzero
+counted:
+    PUSH 1
+    LOAD
+    ADD
+    PUSH 1
+    STORE
+    INC
+    DUP
+    PUSH 2000
+    JL mloop
+PUSH 1
+LOAD
+PRINT        ; 1999: only i = 0 gives 0
+HALT
+
+; 1 if x (int or float) is not zero, else 0
+nonzero:
+    DUP          ; no static type: speculated int under --tier
+    JZ zero
+    POP
+    CALL one
+    RET
+zero:
+    POP
+    PUSH 0
+    RET
+one:
+    PUSH 0
+    JZ yes
+    PUSH 0
+    RET
+yes:
+    PUSH 1
+    RET
@@ -0,0 +1,162 @@
+; vector_tail.asm - vector ops over 11 ints and 7 doubles, so every kernel
+; set has a tail shorter than its width; the cell after each result stays 0
+; expect: 105 500 1100 385 385 1100 0 55.125 10.5 33.25 55.125 0
+; ints a[i] = i - 5 at cell i, b[i] = i * i at cell 100 + i, i < 11
+PUSH 0
+PUSH 500
+STORE
+init:
+    PUSH 500
+    LOAD
+    PUSH 5
+    SUB
+    PUSH 500
+    LOAD
+    STORE               ; a[i] = i - 5
+    PUSH 500
+    LOAD
+    DUP
+    MUL
+    PUSH 500
+    LOAD
+    PUSH 100
+    ADD
+    STORE               ; b[i] = i * i
+    PUSH 500
+    LOAD
+    INC
+    DUP
+    PUSH 500
+    STORE
+    PUSH 11
+    SUB
+    JZ init_f
+    JMP init
+; doubles x[j] = j * 0.5 at cell 1000 + 2j, y[j] = x[j] * x[j] at cell
+; 1100 + 2j, j < 7
+init_f:
+PUSHF 0.0
+PUSH 502
+STOREF
+PUSH 0
+PUSH 500
+STORE
+initf:
+    PUSH 502
+    LOADF
+    PUSH 500
+    LOAD
+    DUP
+    ADD
+    PUSH 1000
+    ADD
+    STOREF              ; x[j]
+    PUSH 502
+    LOADF
+    DUP
+    MULF
+    PUSH 500
+    LOAD
+    DUP
+    ADD
+    PUSH 1100
+    ADD
+    STOREF              ; y[j]
+    PUSH 502
+    LOADF
+    PUSHF 0.5
+    ADDF
+    PUSH 502
+    STOREF
+    PUSH 500
+    LOAD
+    INC
+    DUP
+    PUSH 500
+    STORE
+    PUSH 7
+    SUB
+    JZ run
+    JMP initf
+
+run:
+PUSH 200
+PUSH 0
+PUSH 100
+PUSH 11
+VADD                    ; c[i] = i - 5 + i * i at cell 200 + i
+PUSH 300
+PUSH 0
+PUSH 100
+PUSH 11
+VMUL                    ; d[i] = (i - 5) * i * i at cell 300 + i
+PUSH 210
+LOAD
+PRINT                   ; 105
+PUSH 310
+LOAD
+PRINT                   ; 500
+PUSH 0
+PUSH 100
+PUSH 11
+VDOT
+PRINT                   ; 1100
+PUSH 100
+PUSH 11
+VSUM
+PRINT                   ; 385
+PUSH 200
+PUSH 11
+VSUM
+PRINT                   ; 385
+PUSH 300
+PUSH 11
+VSUM
+PRINT                   ; 1100
+PUSH 211
+LOAD
+PUSH 311
+LOAD
+ADD
+PRINT                   ; 0: nothing written past the tail
+
+PUSH 1200
+PUSH 1000
+PUSH 1100
+PUSH 7
+VADDF                   ; x + x * x at cell 1200 + 2j
+PUSH 1300
+PUSH 1000
+PUSH 1100
+PUSH 7
+VMULF                   ; x * x * x at cell 1300 + 2j
+PUSH 1000
+PUSH 1100
+PUSH 7
+VDOTF
+PRINT                   ; 55.125
+PUSH 1000
+PUSH 7
+VSUMF
+PRINT                   ; 10.5
+PUSH 1200
+PUSH 7
+VSUMF
+PRINT                   ; 33.25
+PUSH 1300
+PUSH 7
+VSUMF
+PRINT                   ; 55.125
+PUSH 1214
+LOAD
+PUSH 1314
+LOAD
+ADD
+PUSH 1215
+LOAD
+ADD
+PUSH 1315
+LOAD
+ADD
+PRINT                   ; 0
+HALT
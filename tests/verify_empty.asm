@@ -0,0 +1,3 @@
+; verify_empty.asm - no code at all
+; verify: ok
+; expect:
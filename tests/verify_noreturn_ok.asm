@@ -0,0 +1,18 @@
+; verify_noreturn_ok.asm - a callee that ends in HALT, and calls to it that
+; give it what it takes: still verified
+; verify: ok
+; expect: 9
+PUSH 1
+CALL f
+PRINT
+HALT
+f:
+    DUP
+    JZ b
+    DEC
+    CALL f
+    RET
+b:
+    PUSH 9
+    PRINT
+    HALT
@@ -0,0 +1,11 @@
+; verify_noreturn_recursive.asm - f recurses forever, popping one value
+; each time, so it needs more arguments than any caller has
+; verify: rejected
+; error: Runtime error: stack underflow
+; expect:
+PUSH 1
+CALL f
+HALT
+f:
+    POP
+    CALL f
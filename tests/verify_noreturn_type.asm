@@ -0,0 +1,12 @@
+; verify_noreturn_type.asm - the argument types of a callee that never
+; returns are checked too: f uses a float as a LOAD address
+; verify: rejected
+; error: Runtime error: LOAD expects integer address
+; expect:
+PUSHF 1e300
+CALL f
+HALT
+f:
+    LOAD
+    PRINT
+    HALT
@@ -0,0 +1,13 @@
+; verify_noreturn_underflow.asm - a callee that never returns still takes
+; its arguments: f pops three values the caller never pushed
+; verify: rejected
+; error: Runtime error: stack underflow
+; expect:
+CALL f
+HALT
+f:
+    POP
+    POP
+    POP
+    PRINT
+    HALT
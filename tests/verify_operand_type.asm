@@ -0,0 +1,9 @@
+; verify_operand_type.asm - ADD of a float and an int
+; verify: rejected
+; error: ADD expects integer on stack
+; expect:
+PUSHF 1.5
+PUSH 2
+ADD
+PRINT
+HALT
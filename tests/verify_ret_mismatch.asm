@@ -0,0 +1,15 @@
+; verify_ret_mismatch.asm - f returns two values on one path, one on the other
+; verify: rejected
+; expect: 3
+PUSH 0
+CALL f
+PRINT
+HALT
+f:
+    JZ a
+    PUSH 1
+    PUSH 2
+    RET
+a:
+    PUSH 3
+    RET
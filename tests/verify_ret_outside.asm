@@ -0,0 +1,6 @@
+; verify_ret_outside.asm - RET with no CALL
+; verify: rejected
+; error: Runtime error: call stack underflow
+; expect:
+PUSH 1
+RET
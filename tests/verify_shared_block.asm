@@ -0,0 +1,13 @@
+; verify_shared_block.asm - f and g both jump into s
+; verify: rejected
+; expect:
+PUSH 0
+CALL f
+CALL g
+HALT
+f:
+    JMP s
+g:
+    JMP s
+s:
+    RET
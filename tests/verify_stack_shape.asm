@@ -0,0 +1,9 @@
+; verify_stack_shape.asm - the two paths into a reach it with different depths
+; verify: rejected
+; expect: 5
+PUSH 1
+JZ a
+PUSH 5
+a:
+PRINT
+HALT